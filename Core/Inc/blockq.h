@@ -0,0 +1,59 @@
+/*
+ * blockq.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Audio block event queue: MIDI messages, and changes to parameters
+ * of the renderer (e.g. from OSC, with more than MIDI's resolution),
+ * waiting to take effect at an exact sample. Rendering of each audio
+ * block is split at the events falling inside it, so every event lands
+ * on its own sample rather than at the start of the next block.
+ *
+ * Times are in timestamp_now() microseconds, but this has no hardware
+ * dependencies. Not thread safe: push and render from the same context.
+ */
+
+#ifndef INC_BLOCKQ_H_
+#define INC_BLOCKQ_H_
+
+#include <stdint.h>
+#include "midi.h"
+
+#define BLOCKQ_SIZE 32
+
+#define BLOCKQ_MIDI 0 // The param of a MIDI message's event
+
+typedef struct {
+  uint32_t time;  // When it should be heard
+  uint8_t param;  // BLOCKQ_MIDI, or which of the renderer's parameters
+  union {
+    midi_message msg;
+    float value;  // Of the parameter
+  };
+} blockq_event;
+
+typedef struct {
+  blockq_event events[BLOCKQ_SIZE]; // Sorted by time
+  uint32_t count;
+
+  // Statistics
+  uint32_t late;    // Events whose time had passed; applied at the block start
+  uint32_t dropped; // Events which did not fit
+  uint32_t max_count; // High water mark
+} blockq;
+
+// Renders frames [first_frame, first_frame + frames) of the block
+typedef void (*blockq_render_fn)(void *ctx, uint32_t first_frame, uint32_t frames);
+// Applies an event at the given frame of the block
+typedef void (*blockq_apply_fn)(void *ctx, const blockq_event *e, uint32_t frame);
+
+void blockq_init(blockq *q);
+int blockq_push(blockq *q, uint32_t time, const midi_message *mm);
+int blockq_push_param(blockq *q, uint32_t time, uint8_t param, float value);
+void blockq_render(blockq *q, uint32_t block_time, uint32_t block_frames, uint32_t sample_rate,
+                   blockq_render_fn render, blockq_apply_fn apply, void *ctx);
+
+#endif /* INC_BLOCKQ_H_ */
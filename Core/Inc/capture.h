@@ -0,0 +1,90 @@
+/*
+ * capture.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Compact binary capture of received MIDI, for streaming over the
+ * console instead of the text monitor. Decode it on the host with
+ * Tools/midicap.py.
+ *
+ * The stream starts with the 5 bytes "MCAP" CAPTURE_VERSION, followed
+ * by records:
+ *
+ *   header: ppplllll - port (0-6) and number of MIDI bytes (1-31)
+ *   delta:  microseconds since the previous record of the same port
+ *           (or since the capture started), as a big-endian variable
+ *           length quantity (as in a Standard MIDI File)
+ *   bytes:  the MIDI bytes, with running status per port
+ *
+ * A header with 0 bytes is a repeat, and all there is of it: the same
+ * bytes as the port's previous record, the same delta after it. Runs
+ * of real-time messages (e.g., back to back timing clocks) are mostly
+ * repeats. Only records of up to CAPTURE_REPEAT_MAX bytes are repeated.
+ *
+ * Port 7 headers are meta records, with the type in the low 5 bits
+ * and no delta:
+ *   CAPTURE_META_DROPS, a variable length count of records lost as
+ *     the buffer was full; running status restarts on every port
+ *   CAPTURE_META_END, the capture stopped
+ *
+ * A note with running status takes 5 bytes, so the 46 kB/s of a
+ * 460800 baud console carries about 9000 a second: five ports
+ * of back-to-back notes at 31250 baud. A repeat takes 1 byte, so
+ * every port can send back-to-back timing clocks. The limit is single
+ * bytes which are not repeats, e.g. real-time messages of changing
+ * kinds or at uneven times: 4 bytes each, or three ports flat out.
+ * Beyond what the console carries, records are dropped & counted.
+ *
+ * No hardware dependencies. One producer & one consumer, which may
+ * be in different contexts.
+ */
+
+#ifndef INC_CAPTURE_H_
+#define INC_CAPTURE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midi.h"
+
+#define CAPTURE_SIZE      4096 // Bytes; a power of 2
+#define CAPTURE_PORTS     7
+#define CAPTURE_VERSION   2
+#define CAPTURE_MAX_BYTES 31   // MIDI bytes in one record
+#define CAPTURE_REPEAT_MAX MIDI_MAX_ENCODED // Longest record repeated
+
+#define CAPTURE_META       0xE0
+#define CAPTURE_META_DROPS 0x00
+#define CAPTURE_META_END   0x01
+
+typedef struct {
+  uint8_t buff[CAPTURE_SIZE];
+  volatile uint32_t head; // Written by the producer
+  volatile uint32_t tail; // Written by the consumer
+
+  volatile uint8_t active;
+  uint32_t last_time[CAPTURE_PORTS];
+  midi_encoder encoders[CAPTURE_PORTS];
+  uint32_t pending_drops; // Not yet reported in the stream
+
+  // Each port's previous record, as a repeat would repeat it
+  uint8_t last_bytes[CAPTURE_PORTS][CAPTURE_REPEAT_MAX];
+  uint8_t last_len[CAPTURE_PORTS]; // 0 if there is none to repeat
+  uint32_t last_delta[CAPTURE_PORTS];
+
+  // Statistics
+  uint32_t records;
+  uint32_t repeats;  // Of the records
+  uint32_t drops;
+  uint32_t max_used;
+} capture_log;
+
+void capture_init(capture_log *c);
+void capture_start(capture_log *c, uint32_t now);
+void capture_stop(capture_log *c);
+void capture_message(capture_log *c, const midi_message *mm, const uint8_t *sysex);
+size_t capture_read(capture_log *c, uint8_t *out, size_t max);
+
+#endif /* INC_CAPTURE_H_ */
@@ -0,0 +1,68 @@
+/*
+ * deferred.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Deferred (PendSV) processing tier.
+ *
+ * Work runs in three tiers:
+ * 1. Interrupt handlers: move bytes, note the time, request work. Minimal.
+ * 2. PendSV: time critical "soft" work requested by the interrupt
+ *    handlers (MIDI parsing, voice updates, audio rendering). Preempts
+ *    the main loop, so its latency is bounded by the interrupt handlers
+ *    alone, but is preempted by every interrupt handler.
+ * 3. Main loop (thread mode): console & everything else, by sched.h.
+ */
+
+#ifndef INC_DEFERRED_H_
+#define INC_DEFERRED_H_
+
+#include <stdint.h>
+
+// NVIC preemption priorities for each tier (NVIC_PRIORITYGROUP_3:
+// 3 bits, 0-7, lower preempts higher). SysTick is TICK_INT_PRIORITY (0).
+#define PRIO_ISR_MIDI_UART    1
+#define PRIO_ISR_AUDIO_DMA    2
+#define PRIO_ISR_CONSOLE_UART 3
+#define PRIO_ISR_USB          3
+#define PRIO_ISR_ETH          4
+#define PRIO_ISR_DISPLAY      5
+#define PRIO_ISR_FLASH        6
+#define PRIO_DEFERRED         7  // PendSV: below every interrupt handler
+
+// Deferred jobs; keep in sync with deferred_names[] in deferred.c.
+// They run in bit order when several are pending.
+#define DEFER_MIDI_RX ((uint32_t)0x01) // MIDI byte(s) received
+#define DEFER_AUDIO   ((uint32_t)0x02) // Half of the I2S DMA buffer needs filling
+#define DEFER_MIDI_TX ((uint32_t)0x04) // A MIDI output needs more to send
+#define DEFER_NET     ((uint32_t)0x08) // Ethernet frames received or sent, or timers due
+#define DEFER_NUM     4
+
+typedef void (*deferred_fn)(void);
+
+/*
+ * Preemption latency is the time from a job being requested until
+ * it starts running in PendSV, in DWT cycles.
+ */
+typedef struct {
+  uint32_t count;
+  uint32_t last_latency;
+  uint32_t max_latency;
+  uint32_t max_run;
+} deferred_stats;
+
+extern deferred_stats deferred_job_stats[DEFER_NUM];
+extern const char *const deferred_names[DEFER_NUM];
+
+void deferred_init(void);
+void deferred_register(uint32_t job, deferred_fn fn);
+void deferred_post(uint32_t jobs);
+void deferred_run(void);
+void deferred_mask(void);
+void deferred_unmask(void);
+void deferred_reset_stats(void);
+
+#endif /* INC_DEFERRED_H_ */
@@ -0,0 +1,55 @@
+/*
+ * display.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * An SSD1306 OLED (ssd1306.h) on I2C1, the Nucleo's Arduino D15 (SCL,
+ * PB8) & D14 (SDA, PB9), at 400 kHz. Neither is in the CubeMX
+ * configuration, so they are set up here.
+ *
+ * Sending never waits: display_flush() starts the first dirty page by
+ * DMA (DMA1 stream 6 channel 1) and returns, and each transfer's
+ * completion interrupt (PRIO_ISR_DISPLAY) starts the next until no
+ * page is dirty. A page is 135 bytes, about 3 ms on the bus; all eight
+ * take about 25 ms. Pages redrawn the same are not sent at all.
+ *
+ * A display that does not answer (none attached) is tried again every
+ * DISPLAY_RETRY_MS, when it is set up afresh and redrawn.
+ *
+ * Draw into oled from the main loop only.
+ *
+ * References:
+ * - RM0410 Rev 5 section 33: Inter-integrated circuit (I2C) interface;
+ *   Table 27: DMA1 request mapping
+ * - DS11532 Rev 8 Table 12: alternate functions
+ * - UM1974 Rev 10 Table 18: ST Zio connectors (D14 & D15)
+ */
+
+#ifndef INC_DISPLAY_H_
+#define INC_DISPLAY_H_
+
+#include <stdint.h>
+#include "ssd1306.h"
+
+#define DISPLAY_PERIOD_MS 50   // Between redraws
+#define DISPLAY_RETRY_MS  1000 // Between tries of a display that did not answer
+
+typedef struct {
+  uint8_t present;    // Answered the last transfer
+  uint32_t transfers; // Completed
+  uint32_t bytes;
+  uint32_t errors;    // Not acknowledged & bus errors
+  uint32_t busy_max_us; // Longest from display_flush() to all sent
+} display_stats;
+
+extern ssd1306 oled;
+extern display_stats oled_stats;
+
+void display_init(void);
+void display_flush(void);
+void display_reset_stats(void);
+
+#endif /* INC_DISPLAY_H_ */
@@ -0,0 +1,81 @@
+/*
+ * dlog.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Deferred binary log.
+ *
+ * DLOG() records only the address of its format string, a timestamp
+ * and up to DLOG_MAX_ARGS raw word-sized arguments into a ring; it costs
+ * tens of cycles, and may be called from any interrupt priority.
+ * dlog_process() does the printf formatting later, from a background
+ * task.
+ *
+ * The format strings stay in flash, in .rodata.dlog sections, so the
+ * address of one identifies it: a host tool can decode raw entries by
+ * looking the address up in the ELF.
+ *
+ * Arguments are cast to & stored as uintptr_t (uint32_t here), so
+ * only integer conversions (%lu, %ld, %lx, %c) may be used, plus %s
+ * of strings that live forever (e.g., literals, port names); a
+ * pointer stays whole in a 64-bit host build too.
+ */
+
+#ifndef INC_DLOG_H_
+#define INC_DLOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DLOG_SIZE     32 // Entries; a power of 2
+#define DLOG_MAX_ARGS 4
+
+typedef struct {
+  const char *fmt;
+  uint32_t timestamp; // timestamp_now() when logged
+  uint32_t nargs;
+  uintptr_t args[DLOG_MAX_ARGS];
+} dlog_entry;
+
+typedef struct {
+  dlog_entry entries[DLOG_SIZE];
+  volatile uint32_t head; // Written by loggers
+  volatile uint32_t tail; // Written by dlog_process()
+  uint32_t drops;         // Ring was full
+} dlog_ring;
+
+extern dlog_ring dlog;
+
+// Counts 0 to DLOG_MAX_ARGS variadic arguments
+#define DLOG_NARGS(...) DLOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, N, ...) N
+
+// Each argument as the uintptr_t dlog_write() reads
+#define DLOG_ARGS(n, ...)  DLOG_ARGS_(n, __VA_ARGS__)
+#define DLOG_ARGS_(n, ...) DLOG_ARGS##n(__VA_ARGS__)
+#define DLOG_ARGS0()
+#define DLOG_ARGS1(a)          , (uintptr_t)(a)
+#define DLOG_ARGS2(a, b)       , (uintptr_t)(a), (uintptr_t)(b)
+#define DLOG_ARGS3(a, b, c)    , (uintptr_t)(a), (uintptr_t)(b), (uintptr_t)(c)
+#define DLOG_ARGS4(a, b, c, d) , (uintptr_t)(a), (uintptr_t)(b), (uintptr_t)(c), (uintptr_t)(d)
+
+/** Logs fmt with up to 4 integer (or permanent string) arguments. */
+#define DLOG(fmt, ...) ({ \
+    static const char dlog_fmt_[] __attribute__((section(".rodata.dlog"))) = fmt; \
+    dlog_write(dlog_fmt_, DLOG_NARGS(__VA_ARGS__) DLOG_ARGS(DLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)); \
+  })
+
+typedef void (*dlog_output_fn)(const char *text, size_t len);
+
+void dlog_init(void);
+void dlog_write(const char *fmt, uint32_t nargs, ...);
+uint32_t dlog_process(dlog_output_fn out, uint32_t max_entries);
+
+static inline uint32_t dlog_pending(void) {
+  return dlog.head - dlog.tail;
+}
+
+#endif /* INC_DLOG_H_ */
@@ -0,0 +1,73 @@
+/*
+ * ethif.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * The Ethernet MAC (RJ45 on the Nucleo, a LAN8742A PHY over RMII) as a
+ * net_if (net.h) with one RTP-MIDI session (rtpmidi.h) on it, a MIDI
+ * port of its own, MIDI_SOURCE_NET. Directly on the HAL ETH driver
+ * that CubeMX sets up.
+ *
+ * The address is fixed, ETHIF_IP: there is no DHCP, and no Bonjour to
+ * announce the session, so add it by hand on the other end (Audio MIDI
+ * Setup's Network window on a Mac: a new directory entry, port 5004).
+ * The MAC address is made from the MCU's unique ID (main.c).
+ *
+ * The PHY is polled from the main loop, ethif_poll(): the MAC is started
+ * at the speed & duplex the PHY negotiated when the link comes up, and
+ * stopped when it goes down. Everything else happens in PendSV, in
+ * ethif_service(), which the ETH interrupt (PRIO_ISR_ETH) requests with
+ * DEFER_NET: received frames are handed to net_input() in the DMA's
+ * buffer, then released; frames sent are released as the DMA finishes
+ * with them. The buffers are counted by reference (pktbuf.h), so a
+ * handler may keep a frame, net_hold(), without copying it.
+ *
+ * References:
+ * - RM0410 Rev 5 section 43: Ethernet (ETH): media access control
+ *   (MAC) with DMA controller
+ * - Microchip LAN8742A datasheet, section 4.2: PHY registers
+ * - UM1974 Rev 10 section 6.12: Ethernet (on the Nucleo-144)
+ */
+
+#ifndef INC_ETHIF_H_
+#define INC_ETHIF_H_
+
+#include <stdint.h>
+#include "net.h"
+#include "rtpmidi.h"
+#include "pktbuf.h"
+
+#define ETHIF_IP      NET_IP(192, 168, 1, 200)
+#define ETHIF_NETMASK NET_IP(255, 255, 255, 0)
+#define ETHIF_GATEWAY NET_IP(192, 168, 1, 1)
+#define ETHIF_NAME    "Nucleo MIDI" // Of our RTP-MIDI session
+#define ETHIF_POLL_MS 100 // Between ethif_poll()s
+
+typedef struct {
+  uint8_t link_up;
+  uint8_t speed_100; // Of the link, if up
+  uint8_t full_duplex;
+  uint32_t link_changes;
+  uint32_t rx_frames;
+  uint32_t rx_dropped;    // Too long for one buffer
+  uint32_t rx_unbuffered; // Descriptors left without a buffer, the pool being empty
+  uint32_t rx_starved;    // Times the DMA found no descriptor to receive into
+  uint32_t tx_frames;
+  uint32_t tx_starved;    // Frames not sent, the DMA having no descriptor free
+  uint32_t dma_errors;
+} ethif_stats;
+
+extern net_if eth_net;
+extern rtpmidi eth_session;
+extern ethif_stats eth_stats;
+extern pktbuf_pool eth_pool; // The frames' buffers, both ways
+
+void ethif_init(uint8_t port, rtpmidi_message_fn deliver, void *ctx);
+void ethif_poll(void);
+void ethif_service(uint32_t now);
+void ethif_reset_stats(void);
+
+#endif /* INC_ETHIF_H_ */
@@ -0,0 +1,47 @@
+/*
+ * events.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Event flags posted by interrupt handlers (and the deferred tier)
+ * and consumed by the main loop. When no events are pending the main loop sleeps
+ * in WFI until the next interrupt.
+ */
+
+#ifndef INC_EVENTS_H_
+#define INC_EVENTS_H_
+
+#include <stdint.h>
+
+// Event bits; keep in sync with event_names[] in events.c
+#define EV_SERIAL_RX ((uint32_t)0x01) // Console byte(s) received
+#define EV_MIDI_MSG  ((uint32_t)0x02) // MIDI message(s) parsed (see deferred.h)
+#define EV_TICK      ((uint32_t)0x04) // SysTick (1 ms)
+#define EV_NUM       3
+
+/*
+ * Time from the first post of an event until the main loop took it,
+ * in DWT cycles.
+ */
+typedef struct {
+  uint32_t count;
+  uint32_t last;
+  uint32_t max;
+  uint64_t total;
+} event_latency;
+
+extern event_latency event_latencies[EV_NUM];
+extern const char *const event_names[EV_NUM];
+
+void events_init(void);
+void event_post(uint32_t events);
+uint32_t events_take(void);
+uint32_t events_wait(void);
+void events_idle_update(void);
+uint32_t events_idle_permille(void);
+void events_reset_stats(void);
+
+#endif /* INC_EVENTS_H_ */
@@ -0,0 +1,137 @@
+/*
+ * kvstore.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Log-structured key/value store in NOR flash: small values under
+ * small numeric keys, kept across resets.
+ *
+ * The flash is two areas, each erased whole. One is active: a header
+ * (magic, generation & its CRC) and then records, appended & never
+ * rewritten. A record is a word of magic, length & key, the value
+ * padded to words with 0xFF, and a CRC-32 of the two. A key's latest
+ * record is its value; one of no length erases it. When the active
+ * area is full, compaction copies the latest record of each key to the
+ * other, erased area and then writes that area's header with the next
+ * generation, making it active; the old area is erased after. So each
+ * area takes its turn, and every erase is of a whole area's worth of
+ * records, which spreads the wear evenly.
+ *
+ * Records & headers are programmed a word at a time, their first word
+ * last: until it is, nothing reads as there. Power lost at any point
+ * leaves the latest value of every key either as it was or as it was
+ * being set. kvstore_mount() finds records by their magic & CRC, so it
+ * steps over half written ones; writing goes on past the last word
+ * that is not blank. Of two valid areas, the later generation wins.
+ *
+ * kvstore_mount() reads the flash to build the index: the offset of
+ * each key's latest record, so finding a value takes one lookup.
+ * kvstore_set() only queues the value in RAM, where kvstore_get() sees
+ * it at once. The writing is done by kvstore_poll(), which starts at
+ * most one flash operation, a word's programming or an area's erase,
+ * and never waits for one: call it from the main loop. Erases, which
+ * may stall whatever runs from the same flash bank for a second or
+ * more, are started only when its caller allows.
+ *
+ * No hardware dependencies: the flash is reached through a
+ * kvstore_flash. Call everything from one context.
+ */
+
+#ifndef INC_KVSTORE_H_
+#define INC_KVSTORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define KVSTORE_AREAS     2
+#define KVSTORE_MAX_KEYS  32 // Keys are 0 to this - 1
+#define KVSTORE_MAX_VALUE 64 // Bytes
+#define KVSTORE_PENDING   8  // Values set & not yet written
+
+// Header, value & CRC: the most a record takes
+#define KVSTORE_RECORD_MAX (4 + KVSTORE_MAX_VALUE + 4)
+// An area must hold the area header & a record of every key, with
+// room for one more after compaction
+#define KVSTORE_AREA_MIN (12 + (KVSTORE_MAX_KEYS + 1) * KVSTORE_RECORD_MAX)
+
+// Flash operation status, from kvstore_flash.status()
+#define KVSTORE_FLASH_DONE   0
+#define KVSTORE_FLASH_BUSY   1
+#define KVSTORE_FLASH_FAILED 2
+
+/** The flash the store is kept in: KVSTORE_AREAS areas of area_size
+ * bytes one after the other, mapped for reading at base. program() &
+ * erase() start an operation, returning 0 if they cannot; offsets are
+ * from base. status() tells how the last one is going.
+ */
+typedef struct {
+  const uint8_t *base; // Word aligned
+  uint32_t area_size;  // A multiple of 4, at least KVSTORE_AREA_MIN
+  void *ctx;
+  int (*program)(void *ctx, uint32_t offset, uint32_t word);
+  int (*erase)(void *ctx, int area);
+  int (*status)(void *ctx);
+} kvstore_flash;
+
+typedef struct {
+  uint32_t offset; // Of the key's latest record in the active area; 0 if none
+  int8_t pending;  // Slot of the value set since, if any; else -1
+} kvstore_entry;
+
+typedef struct {
+  uint8_t state;   // KVSTORE_SLOT_
+  uint8_t len;
+  uint16_t key;
+  uint8_t value[KVSTORE_MAX_VALUE];
+} kvstore_slot;
+
+#define KVSTORE_SLOT_FREE    0
+#define KVSTORE_SLOT_QUEUED  1
+#define KVSTORE_SLOT_WRITING 2
+
+// Words of the longest thing programmed: a record
+#define KVSTORE_IMAGE_WORDS (KVSTORE_RECORD_MAX / 4)
+
+typedef struct {
+  const kvstore_flash *flash;
+  kvstore_entry index[KVSTORE_MAX_KEYS];
+  kvstore_slot pending[KVSTORE_PENDING];
+
+  uint8_t phase;        // What the writing is doing
+  uint8_t op;           // The flash operation under way, if any
+  int8_t active;        // Area of the records; -1 before there is one
+  uint8_t dirty;        // Bit per area to erase before it is written
+  uint8_t erasing;      // The area, while op is an erase
+  uint32_t generation;  // Of the active area
+  uint32_t write_pos;   // Offset in the active area to append at
+
+  // The record or header being programmed, a word a poll
+  uint32_t image[KVSTORE_IMAGE_WORDS];
+  uint32_t image_at;    // Offset from the flash's base
+  uint8_t image_words;  // 0 when there is none
+  uint8_t image_done;   // Words programmed
+  int8_t image_slot;    // Of the value, for a record being written
+
+  // Compaction: the next key to copy & where to, and where those copied went
+  uint16_t copy_key;
+  uint32_t copy_pos;
+  uint32_t moved[KVSTORE_MAX_KEYS];
+
+  // Statistics
+  uint32_t records;     // Written, not counting compaction's copies
+  uint32_t compactions;
+  uint32_t erases;
+  uint32_t errors;      // Flash operations that failed or read back wrong
+  uint32_t torn_words;  // Not blank & not part of a record, found by kvstore_mount()
+} kvstore;
+
+int kvstore_mount(kvstore *s, const kvstore_flash *flash);
+size_t kvstore_get(const kvstore *s, uint16_t key, void *value, size_t size);
+int kvstore_set(kvstore *s, uint16_t key, const void *value, size_t len);
+void kvstore_poll(kvstore *s, int may_erase);
+int kvstore_idle(const kvstore *s);
+
+#endif /* INC_KVSTORE_H_ */
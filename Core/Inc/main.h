@@ -47,6 +47,10 @@ extern "C" {
 /* Exported macro ------------------------------------------------------------*/
 /* USER CODE BEGIN EM */
 
+// Variables placed in the DTCM (see STM32F767ZITX_FLASH.ld)
+#define FAST_BSS __attribute((section(".fast_bss")))
+#define FAST_DATA __attribute((section(".fast_data")))
+
 /* USER CODE END EM */
 
 /* Exported functions prototypes ---------------------------------------------*/
@@ -2,7 +2,7 @@
  * midi.h
  *
  *  Created on: Sep 8, 2024
- *  Updated on: 2024-09-08
+ *  Updated on: 2026-10-19
  *      Author: Douglas P. Fields, Jr.
  *   Copyright: 2024, Douglas P. Fields, Jr.
  *     License: Apache 2.0
@@ -12,6 +12,9 @@
 #ifndef INC_MIDI_H_
 #define INC_MIDI_H_
 
+#include <stdint.h>
+#include <stddef.h>
+
 // MIDI Messages
 // TODO: Use a C23 enum if this is supported by our compiler
 // These generally are the same as the status byte used
@@ -32,10 +35,19 @@
 #define MIDI_NOTE_OFF ((uint8_t)0x80)
 #define MIDI_NOTE_ON  ((uint8_t)0x90)
 // System messages
+#define MIDI_SYSEX            ((uint8_t)0xF0)
+#define MIDI_TIME_CODE_QF     ((uint8_t)0xF1)
+#define MIDI_SONG_POSITION    ((uint8_t)0xF2)
+#define MIDI_SONG_SELECT      ((uint8_t)0xF3)
+#define MIDI_TUNE_REQUEST     ((uint8_t)0xF6)
+#define MIDI_EOX              ((uint8_t)0xF7)
 // Real time mesages
-#define MIDI_RT_TIMING_CLOCK ((uint8_t)0xF8)
-// ...
-#define MIDI_RT_SYSTEM_RESET ((uint8_t)0xFF)
+#define MIDI_RT_TIMING_CLOCK  ((uint8_t)0xF8)
+#define MIDI_RT_START         ((uint8_t)0xFA)
+#define MIDI_RT_CONTINUE      ((uint8_t)0xFB)
+#define MIDI_RT_STOP          ((uint8_t)0xFC)
+#define MIDI_RT_ACTIVE_SENSE  ((uint8_t)0xFE)
+#define MIDI_RT_SYSTEM_RESET  ((uint8_t)0xFF)
 
 /*
  * We return this structure when we have received a fully
@@ -62,8 +74,27 @@ typedef struct {
     uint8_t msb; // Most significant 7 of 14 bits
     uint8_t cc_value; // Control value for CC
   };
+  // Which port it was received on (see midiport.h); set by the receiver
+  uint8_t port;
+  // When the last byte of the message was received, in timestamp_now()
+  // microseconds; set by the receiver, not by midi_stream_receive()
+  uint32_t timestamp;
 } midi_message;
 
+/*
+ * Broad kinds of MIDI messages, e.g., for routing.
+ */
+typedef enum {
+  MIDI_CLASS_NOTE = 0,   // Note on/off & poly aftertouch
+  MIDI_CLASS_CONTROL,    // Control change & channel mode
+  MIDI_CLASS_PROGRAM,    // Program change
+  MIDI_CLASS_PRESSURE,   // Channel aftertouch
+  MIDI_CLASS_PITCH_BEND,
+  MIDI_CLASS_SYSTEM,     // System common & exclusive
+  MIDI_CLASS_REALTIME,
+  MIDI_NUM_CLASSES
+} midi_class;
+
 #define MIDI_14bits(mmptr) (((mmptr)->lsb & 0x7F) | (((mmptr)->msb & 0x7F) << 7))
 
 /*
@@ -74,10 +105,13 @@ typedef struct {
  * accumulates bytes for messages before returning
  * a fully parsed message.
  *
- * Currently we ignore SysEx instead of storing
- * any SysEx stuff.
+ * Only the first MIDI_SYSEX_MAX data bytes of a
+ * SysEx are kept, enough for short messages such as
+ * MIDI Time Code full frames.
  */
 
+#define MIDI_SYSEX_MAX 32
+
 typedef struct {
   // Last status byte received - applicable only to voice/mode messages
   // So if the first nibble has to start with 8-E
@@ -90,6 +124,13 @@ typedef struct {
   // will never be a valid data byte
   uint8_t data1;
 
+  // The data bytes (without F0/F7) of the last SysEx. When complete,
+  // midi_stream_receive() returns a MIDI_SYSEX message with
+  // data1 = sysex_len and data2 = sysex_overflow.
+  uint8_t sysex[MIDI_SYSEX_MAX];
+  uint8_t sysex_len;
+  uint8_t sysex_overflow; // More data bytes were received than kept
+
   // TODO: Track Omni/Poly/Mono for all 16 tracks
   // TODO: Track MSB & LSB for each CC and their last value
   // TODO: Track the state of every key
@@ -97,10 +138,24 @@ typedef struct {
   //       Track them when the sustain/sostenuto is on (MIDI 1.0 Spec 4.2.1 page A-5)
 } midi_stream;
 
+/*
+ * Output state of a MIDI stream: the running status sent.
+ */
+typedef struct {
+  // Last channel status byte sent, or MIDI_NONE
+  uint8_t last_status;
+} midi_encoder;
+
+// Longest message midi_encode() produces
+#define MIDI_MAX_ENCODED 3
+
 extern const uint32_t midi_note_freqX100[];
 
 void midi_stream_init(midi_stream *ms);
 int midi_stream_receive(midi_stream *ms, uint8_t b, midi_message *msg);
 int midi_snprintf(char *str, size_t size, midi_message *mm);
+midi_class midi_message_class(const midi_message *mm);
+void midi_encoder_init(midi_encoder *me);
+int midi_encode(midi_encoder *me, const midi_message *mm, uint8_t *out);
 
 #endif /* INC_MIDI_H_ */
@@ -0,0 +1,69 @@
+/*
+ * midimerge.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * MIDI merge: combines the messages of several sources onto one output.
+ *
+ * Each source has its own queue of complete messages. Messages are
+ * taken from the sources in round-robin order and encoded whole, with
+ * running status derived from what actually went out, so one source's
+ * message is never split by another's.
+ *
+ * Real-time messages are not queued here: send them straight away,
+ * even between the bytes of another message (MIDI 1.0 Specification
+ * 4.2, page 30).
+ *
+ * No hardware dependencies. Not thread safe: push and pull from
+ * the same context.
+ */
+
+#ifndef INC_MIDIMERGE_H_
+#define INC_MIDIMERGE_H_
+
+#include <stdint.h>
+#include "midi.h"
+
+#define MIDIMERGE_MAX_SOURCES 8
+#define MIDIMERGE_QUEUE_SIZE  8 // Power of 2
+
+typedef struct {
+  midi_message msg;
+  uint32_t queued; // When it was pushed
+} midimerge_entry;
+
+typedef struct {
+  midimerge_entry queue[MIDIMERGE_QUEUE_SIZE];
+  uint32_t head;
+  uint32_t tail;
+
+  // Statistics
+  uint32_t sent;
+  uint32_t drops;       // Messages dropped as the queue was full, or unsendable (e.g., SysEx)
+  uint32_t max_depth;
+  uint32_t max_latency; // Longest time queued
+  uint64_t total_latency;
+} midimerge_source;
+
+typedef struct {
+  midimerge_source sources[MIDIMERGE_MAX_SOURCES];
+  uint8_t num_sources;
+  uint8_t next;     // Source to try first next time
+  uint32_t waiting; // Messages queued from all sources
+  midi_encoder encoder;
+} midimerge;
+
+void midimerge_init(midimerge *m, uint8_t num_sources);
+int midimerge_push(midimerge *m, uint8_t source, const midi_message *mm, uint32_t now);
+int midimerge_pull(midimerge *m, uint8_t *out, uint32_t now);
+void midimerge_reset_stats(midimerge *m);
+
+/** Messages currently queued from one source. */
+static inline uint32_t midimerge_depth(const midimerge *m, uint8_t source) {
+  return m->sources[source].head - m->sources[source].tail;
+}
+
+#endif /* INC_MIDIMERGE_H_ */
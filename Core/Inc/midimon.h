@@ -0,0 +1,61 @@
+/*
+ * midimon.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * MIDI traffic monitor for a 128x64 display (ssd1306.h): how busy the
+ * inputs are, the last message, and a meter of each channel's note
+ * activity, drawn a page at a time:
+ *
+ *   page 0    "  312 msg/s   4 held"
+ *   page 1    "din2 90 3C 64"   (the last message, in hex)
+ *   pages 2-6 a bar for each channel, jumping to the velocity of each
+ *             note on & falling back over MIDIMON_FALL_MS
+ *   page 7    the channels, 0-F, inverted while notes are held on them
+ *
+ * midimon_message() counts every message routed, from PendSV;
+ * midimon_render() draws from the main loop. Each value the first
+ * writes is written by it alone, in one store, so the second reads
+ * them without locking (the last message packed into one word).
+ *
+ * No hardware dependencies.
+ */
+
+#ifndef INC_MIDIMON_H_
+#define INC_MIDIMON_H_
+
+#include <stdint.h>
+#include "midi.h"
+#include "ssd1306.h"
+
+#define MIDIMON_CHANNELS 16
+#define MIDIMON_FALL_MS  500  // For a bar to fall from full to nothing
+#define MIDIMON_RATE_MS  1000 // Between updates of the message rate
+
+typedef const char *(*midimon_port_name_fn)(uint8_t port);
+
+typedef struct {
+  // Written by midimon_message()
+  volatile uint32_t messages;
+  volatile uint32_t note_ons[MIDIMON_CHANNELS];
+  volatile uint8_t velocity[MIDIMON_CHANNELS]; // Of the last note on
+  volatile uint8_t held[MIDIMON_CHANNELS];     // Notes on & not yet off
+  volatile uint32_t last;    // Port, status & data bytes; 0 before any
+
+  // Kept by midimon_render()
+  midimon_port_name_fn port_name;
+  uint32_t seen_note_ons[MIDIMON_CHANNELS];
+  uint16_t level[MIDIMON_CHANNELS]; // Of each bar, 0-127 << 8
+  uint32_t rate;             // Messages a second, as last counted
+  uint32_t rate_messages;    // The count when the rate was last updated
+  uint32_t rate_ms;          // Since then
+} midimon;
+
+void midimon_init(midimon *m, midimon_port_name_fn port_name);
+void midimon_message(midimon *m, const midi_message *mm);
+void midimon_render(midimon *m, ssd1306 *d, uint32_t elapsed_ms);
+
+#endif /* INC_MIDIMON_H_ */
@@ -0,0 +1,113 @@
+/*
+ * midiport.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * MIDI DIN ports on the U(S)ARTs, each with its own receive & transmit
+ * buffers, parser and running status encoder.
+ *
+ * Port  U(S)ART  TX    RX    Nucleo
+ * 0     USART6   PG14  PG9   CN10 D1/D0 (set up by CubeMX)
+ * 1     USART2   PD5   PD6   CN9
+ * 2     UART4    PD1   PD0   CN9
+ * 3     UART5    PC12  PD2   CN8
+ * 4     UART7    PE8   PE7   CN10
+ *
+ * Received bytes are timestamped and queued by the interrupt handlers,
+ * which then request DEFER_MIDI_RX. Parse them in that deferred job with
+ * midiport_receive().
+ *
+ * Messages sent to a port are merged by source (midimerge.h). Only a
+ * few bytes at a time are moved on to the transmit buffer, so sources
+ * stay fair; the transmit interrupt requests DEFER_MIDI_TX for more.
+ * Real-time messages go out ahead of everything else.
+ *
+ * SysEx is not sent on the DIN ports: the merge queues hold messages
+ * without their data, and the transmit buffer only two messages, so a
+ * SysEx routed to a port is counted as a drop of its source. Routes to
+ * USB & the network do carry it.
+ */
+
+#ifndef INC_MIDIPORT_H_
+#define INC_MIDIPORT_H_
+
+#include "main.h"
+#include "ringbuffer.h"
+#include "midi.h"
+#include "midiroute.h"
+#include "midimerge.h"
+
+#define MIDI_NUM_PORTS     5
+#define MIDI_PORT_IN_SIZE  32 // Power of 2
+#define MIDI_PORT_OUT_SIZE 8  // Power of 2; enough for two messages
+#define MIDI_PORT_RT_SIZE  8  // Power of 2
+#define MIDI_BAUD_RATE     31250
+
+#if MIDI_NUM_PORTS > MIDIROUTE_MAX_PORTS
+#error "More MIDI ports than the routing matrix handles"
+#endif
+
+// Sources merged onto each output: the input ports, USB MIDI
+// (usbdev.h), RTP-MIDI (ethif.h), then the Standard MIDI File player.
+// USB MIDI & RTP-MIDI are also routed as ports MIDI_SOURCE_USB &
+// MIDI_SOURCE_NET, in & out.
+#define MIDI_SOURCE_USB    MIDI_NUM_PORTS
+#define MIDI_SOURCE_NET    (MIDI_NUM_PORTS + 1)
+#define MIDI_SOURCE_PLAYER (MIDI_NUM_PORTS + 2)
+#define MIDI_NUM_SOURCES   (MIDI_NUM_PORTS + 3)
+
+#if MIDI_SOURCE_USB >= MIDIROUTE_MAX_PORTS
+#error "No room in the routing matrix for USB MIDI"
+#endif
+
+#if MIDI_SOURCE_NET >= MIDIROUTE_MAX_PORTS
+#error "No room in the routing matrix for RTP-MIDI"
+#endif
+
+#if MIDI_NUM_SOURCES > MIDIMERGE_MAX_SOURCES
+#error "More MIDI sources than a merge handles"
+#endif
+
+typedef struct {
+  const char *name;
+  USART_TypeDef *usart;
+
+  // Received bytes, and when each arrived (same index)
+  char in_buff[MIDI_PORT_IN_SIZE];
+  ring_buffer_t in_rb;
+  uint32_t in_times[MIDI_PORT_IN_SIZE];
+  midi_stream parser;
+
+  // Messages waiting to be sent, by source (MIDI_NUM_SOURCES)
+  midimerge merge;
+  char out_buff[MIDI_PORT_OUT_SIZE];
+  ring_buffer_t out_rb;
+  // Real-time bytes, sent before anything in out_rb
+  char rt_buff[MIDI_PORT_RT_SIZE];
+  ring_buffer_t rt_rb;
+
+  // Statistics
+  uint32_t rx_bytes;
+  uint32_t rx_messages;
+  uint32_t rt_drops; // Real-time messages not sent as rt_rb was full
+  uint32_t overruns; // Bytes lost in the USART (ORE)
+  uint32_t in_drops; // Bytes received but dropped as in_rb was full
+  uint32_t in_max;   // High water marks of in_rb & out_rb, bytes
+  uint32_t out_max;
+} midi_port;
+
+extern midi_port midi_ports[MIDI_NUM_PORTS];
+
+void midiport_init(void);
+void midiport_isr(uint8_t port);
+void midiport_check_tx(void);
+int midiport_receive(uint8_t port, midi_message *mm);
+int midiport_send(uint8_t port, const midi_message *mm);
+void midiport_pump(uint8_t port);
+void midiport_pump_all(void);
+void midiport_reset_stats(void);
+
+#endif /* INC_MIDIPORT_H_ */
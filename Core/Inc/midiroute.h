@@ -0,0 +1,52 @@
+/*
+ * midiroute.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * MIDI routing matrix: which outputs each received message goes to,
+ * by input port, message class and channel. One table lookup per
+ * message.
+ *
+ * System & real-time messages have no channel; they use the
+ * channel 0 entry.
+ */
+
+#ifndef INC_MIDIROUTE_H_
+#define INC_MIDIROUTE_H_
+
+#include <stdint.h>
+#include "midi.h"
+
+// Output masks: bit n is output port n, plus our own synth
+#define MIDIROUTE_MAX_PORTS 7
+#define MIDIROUTE_SYNTH     ((uint8_t)0x80)
+
+#define MIDIROUTE_ALL_CLASSES  ((uint32_t)((1 << MIDI_NUM_CLASSES) - 1))
+#define MIDIROUTE_ALL_CHANNELS ((uint16_t)0xFFFF)
+
+typedef struct {
+  uint8_t out[MIDIROUTE_MAX_PORTS][MIDI_NUM_CLASSES][16];
+} midi_route_table;
+
+void midiroute_clear(midi_route_table *rt);
+void midiroute_connect(midi_route_table *rt, uint8_t in_port, uint32_t class_mask,
+                       uint16_t channel_mask, uint8_t out_mask);
+void midiroute_disconnect(midi_route_table *rt, uint8_t in_port, uint32_t class_mask,
+                          uint16_t channel_mask, uint8_t out_mask);
+
+/** The outputs for a message received on in_port. */
+static inline uint8_t midiroute_lookup(const midi_route_table *rt, uint8_t in_port,
+                                       const midi_message *mm) {
+  midi_class c = midi_message_class(mm);
+  uint8_t channel = c >= MIDI_CLASS_SYSTEM ? 0 : (mm->channel & 0x0F);
+
+  if (in_port >= MIDIROUTE_MAX_PORTS) {
+    return 0;
+  }
+  return rt->out[in_port][c][channel];
+}
+
+#endif /* INC_MIDIROUTE_H_ */
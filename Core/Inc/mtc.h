@@ -0,0 +1,64 @@
+/*
+ * mtc.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * MIDI Time Code (MTC) follower.
+ *
+ * Assembles SMPTE time from the 8 quarter frame messages (in either
+ * direction), takes full frame SysEx messages as locates, and
+ * interpolates the position between quarter frames using their
+ * receive timestamps, so the audio can lock to an external transport.
+ *
+ * The assembled time is that of piece 0 of the sequence.
+ *
+ * Times are in timestamp_now() microseconds; no hardware dependencies.
+ */
+
+#ifndef INC_MTC_H_
+#define INC_MTC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midi.h"
+
+// Frame rates, as encoded in the hours
+#define MTC_RATE_24    0
+#define MTC_RATE_25    1
+#define MTC_RATE_29_97 2 // 30 drop frame
+#define MTC_RATE_30    3
+
+// Not running if no quarter frame for this long
+#define MTC_TIMEOUT_US 100000
+
+typedef struct {
+  // Quarter frame assembly
+  uint8_t pieces[8];
+  uint8_t received;   // Bit mask of pieces received in sequence
+  int8_t last_piece;  // -1 if none
+  int8_t direction;   // 1 forward, -1 reverse, 0 unknown/stopped
+
+  // Position
+  uint8_t valid;      // We have a time
+  uint8_t rate;       // MTC_RATE_
+  uint32_t quarter_frames; // Position in quarter frames since 00:00:00:00
+  uint32_t last_time; // When the position was last updated
+
+  // Statistics
+  uint32_t quarter_frame_count;
+  uint32_t full_frame_count;
+  uint32_t direction_changes;
+  uint32_t sequence_breaks;
+} mtc_state;
+
+void mtc_init(mtc_state *mtc);
+void mtc_receive(mtc_state *mtc, const midi_message *mm);
+void mtc_receive_sysex(mtc_state *mtc, const uint8_t *data, size_t len, uint32_t timestamp);
+int mtc_running(const mtc_state *mtc, uint32_t now);
+uint64_t mtc_position_us(const mtc_state *mtc, uint32_t now);
+int mtc_snprintf(char *str, size_t size, const mtc_state *mtc, uint32_t now);
+
+#endif /* INC_MTC_H_ */
@@ -0,0 +1,134 @@
+/*
+ * net.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * A minimal IPv4 stack for one Ethernet interface: ARP, ICMP echo and
+ * UDP, enough for RTP-MIDI (rtpmidi.h) on a local network. No TCP, no
+ * fragments, no DHCP: the address is given to net_init().
+ *
+ * Received frames are parsed where they lie, in the driver's buffer:
+ * a UDP handler is given a pointer to its payload there, valid until
+ * it returns, unless it keeps the buffer with net_hold() and gives it
+ * back with net_release() when done. Frames to send are built in a
+ * buffer the driver lends, net_udp_begin(), and given back to it by
+ * net_udp_send(). Pings are answered in the buffer they came in, if
+ * the driver can hold it.
+ *
+ * The addresses of hosts are learnt from their ARP packets and from
+ * the IP packets they send us, so replies never wait for ARP. Sending
+ * to a host not yet known sends an ARP request instead; try again
+ * later.
+ *
+ * No hardware dependencies: the driver is a pair of functions, for
+ * the Ethernet MAC (ethif.h) on the target or a loopback on the host.
+ * Not reentrant: use each net_if from one context.
+ *
+ * References:
+ * - RFC 826: An Ethernet Address Resolution Protocol
+ * - RFC 791: Internet Protocol; RFC 792: ICMP; RFC 768: UDP
+ * - RFC 1071: Computing the Internet Checksum
+ */
+
+#ifndef INC_NET_H_
+#define INC_NET_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NET_ETH_HEADER  14
+#define NET_IP_HEADER   20 // Without options, as we send them
+#define NET_UDP_HEADER  8
+#define NET_UDP_OFFSET  (NET_ETH_HEADER + NET_IP_HEADER + NET_UDP_HEADER)
+#define NET_MAX_FRAME   1514 // Without the FCS
+#define NET_MAX_UDP     (NET_MAX_FRAME - NET_UDP_OFFSET)
+#define NET_ARP_ENTRIES 4
+#define NET_MAX_PORTS   4 // UDP ports bound
+
+// An IPv4 address a.b.c.d, as held here: in host byte order
+#define NET_IP(a, b, c, d) \
+  (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+#define NET_IP_BROADCAST 0xFFFFFFFFU
+
+typedef struct {
+  uint32_t ip;
+  uint16_t port;
+} net_endpoint;
+
+/*
+ * Called with each UDP datagram to a bound port: data is its payload,
+ * in the receive buffer; now is as given to net_input().
+ */
+typedef void (*net_udp_fn)(void *ctx, const net_endpoint *from, const uint8_t *data, size_t len,
+                           uint32_t now);
+
+typedef struct {
+  // A NET_MAX_FRAME byte buffer to build a frame in, or NULL if none
+  // is free now
+  uint8_t *(*tx_alloc)(void *ctx);
+  // Sends a frame built in a buffer from tx_alloc, or held, and frees
+  // the buffer (or gives back that hold) once sent
+  void (*tx_send)(void *ctx, uint8_t *frame, size_t len);
+  // Keeps the buffer of the frame being received, which p points
+  // into, after net_input() returns, until rx_release; optional.
+  // Returns 0 if it cannot.
+  int (*rx_hold)(void *ctx, const uint8_t *p);
+  void (*rx_release)(void *ctx, const uint8_t *p);
+  void *ctx;
+  // The MAC checks received checksums and fills in those sent, left 0
+  uint8_t checksum_offload;
+} net_driver;
+
+typedef struct {
+  uint32_t ip; // 0 if unused
+  uint8_t mac[6];
+  uint32_t used; // Least recently used is replaced
+} net_arp_entry;
+
+typedef struct {
+  uint16_t port; // 0 if unused
+  net_udp_fn fn;
+  void *ctx;
+} net_binding;
+
+typedef struct {
+  uint8_t mac[6];
+  uint32_t ip;
+  uint32_t netmask;
+  uint32_t gateway;
+  net_driver driver;
+
+  net_arp_entry arp[NET_ARP_ENTRIES];
+  uint32_t arp_clock;
+  net_binding ports[NET_MAX_PORTS];
+  uint16_t ip_id;
+  uint8_t *tx_frame; // From net_udp_begin(), until net_udp_send()
+
+  // Statistics
+  uint32_t rx_frames;
+  uint32_t rx_errors;  // Malformed, or bad checksums
+  uint32_t rx_ignored; // Not for us, or not something we speak
+  uint32_t rx_no_port; // UDP to a port nobody has bound
+  uint32_t rx_udp;
+  uint32_t rx_echoes;  // Pings answered
+  uint32_t tx_frames;
+  uint32_t tx_no_buffer;
+  uint32_t tx_no_arp;  // Sent an ARP request instead
+} net_if;
+
+void net_init(net_if *n, const uint8_t *mac, uint32_t ip, uint32_t netmask, uint32_t gateway,
+              const net_driver *driver);
+int net_udp_bind(net_if *n, uint16_t port, net_udp_fn fn, void *ctx);
+void net_input(net_if *n, uint8_t *frame, size_t len, uint32_t now);
+int net_hold(net_if *n, const uint8_t *data);
+void net_release(net_if *n, const uint8_t *data);
+uint8_t *net_udp_begin(net_if *n);
+int net_udp_send(net_if *n, const net_endpoint *to, uint16_t from_port, size_t len);
+void net_reset_stats(net_if *n);
+
+uint16_t net_checksum(uint32_t sum, const uint8_t *data, size_t len);
+
+#endif /* INC_NET_H_ */
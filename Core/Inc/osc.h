@@ -0,0 +1,108 @@
+/*
+ * osc.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Open Sound Control 1.0 server: parses the packets received (over
+ * UDP, net.h), messages & bundles, and hands each message whose
+ * address we know to an osc_method_fn, with its arguments and when it
+ * is to take effect.
+ *
+ * Addresses are looked up in a trie made ahead of time from the list
+ * in oscaddr.h (Tools/osctrie.py writes oscaddr.c): one step a
+ * character, over a handful of children at most, and no string
+ * compares. Patterns (*, ?, [ & {) are not expanded: they match only
+ * an address spelt the same, which none is.
+ *
+ * Time: messages on their own, and in bundles timed "immediately",
+ * take effect latency_us after they arrive (as MIDI does, so they are
+ * as steady). Bundles' timetags (NTP format, seconds since 1900 and a
+ * 32 bit fraction) are mapped to our microseconds once the sender has
+ * told us its time, osc_set_clock(); until then they are taken as
+ * immediately. Times passed are as soon as possible, times more than
+ * OSC_MAX_AHEAD_US ahead are refused: the synth's queue is short.
+ *
+ * No hardware dependencies; use from one context.
+ *
+ * References:
+ * - The Open Sound Control 1.0 Specification (opensoundcontrol.org)
+ * - RFC 5905 section 6: NTP timestamp format
+ */
+
+#ifndef INC_OSC_H_
+#define INC_OSC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define OSC_PORT         8000    // UDP
+#define OSC_MAX_DEPTH    4       // Of bundles within bundles
+#define OSC_MAX_AHEAD_US 2000000 // Later timetags are refused
+#define OSC_IMMEDIATELY  1ULL    // The timetag
+
+/*
+ * A node of an address trie, whose children are contiguous & sorted by
+ * their character. Node 0 is the root, the empty address.
+ */
+typedef struct {
+  char c;           // Of the address, leading here from the parent
+  uint8_t children;
+  uint16_t first;   // Index of the first child
+  int16_t method;   // Of the address ending here, or -1
+} osc_trie_node;
+
+/*
+ * The arguments of a message, checked against their type tags before
+ * the message is handed over; read them in order with osc_arg_*().
+ */
+typedef struct {
+  const char *types; // Type tags left
+  const uint8_t *data;
+} osc_args;
+
+/*
+ * Called with each message whose address is in the trie, by its
+ * method, when (timestamp_now() microseconds) it should take effect,
+ * and now, when it arrived. Returns 0 if the arguments are wrong.
+ */
+typedef int (*osc_method_fn)(void *ctx, int method, osc_args *args, uint32_t when, uint32_t now);
+
+typedef struct {
+  const osc_trie_node *trie;
+  uint32_t latency_us; // Of messages to take effect immediately
+  osc_method_fn fn;
+  void *ctx;
+
+  // Clock: the sender's time at clock_local, in microseconds since 1900
+  uint8_t synced;
+  uint64_t clock_us;
+  uint32_t clock_local;
+
+  // Statistics
+  uint32_t rx_packets;
+  uint32_t rx_messages;
+  uint32_t rx_bundles;
+  uint32_t rx_errors;    // Malformed
+  uint32_t rx_unmatched; // Messages to addresses not in the trie
+  uint32_t rx_bad_args;  // ... and with arguments the method did not take
+  uint32_t rx_unsynced;  // Timetags taken as immediately, before a clock
+  uint32_t rx_late;      // Timetags already passed
+  uint32_t rx_too_far;   // ... or too far ahead, so refused
+  uint32_t syncs;
+} osc_server;
+
+int osc_trie_lookup(const osc_trie_node *trie, const char *address);
+void osc_init(osc_server *s, const osc_trie_node *trie, uint32_t latency_us, osc_method_fn fn,
+              void *ctx);
+void osc_input(osc_server *s, const uint8_t *data, size_t len, uint32_t now);
+void osc_set_clock(osc_server *s, uint64_t timetag, uint32_t now);
+void osc_poll(osc_server *s, uint32_t now);
+void osc_reset_stats(osc_server *s);
+int osc_arg_float(osc_args *a, float *v);
+int osc_arg_timetag(osc_args *a, uint64_t *timetag);
+int osc_args_left(const osc_args *a);
+
+#endif /* INC_OSC_H_ */
@@ -0,0 +1,47 @@
+/*
+ * oscaddr.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * The OSC addresses we answer (osc.h), each a method. After changing
+ * the list, remake the trie:
+ *   Tools/osctrie.py Core/Inc/oscaddr.h > Core/Src/oscaddr.c
+ * (make -C Host osc-check fails if it was not).
+ *
+ * Arguments may be any numbers (int or float, 32 or 64 bit):
+ *   /clock t         Our time is the timetag (send it now & then;
+ *                    until it is, timetags are taken as immediately)
+ *   /synth/freq f    Frequency, Hz
+ *   /synth/level f   Level, 0-1; 0 is silent
+ *   /synth/note f [f] MIDI note number (fractions are between notes),
+ *                    and level if given
+ *   /synth/off       Silence
+ */
+
+#ifndef INC_OSCADDR_H_
+#define INC_OSCADDR_H_
+
+#include "osc.h"
+
+// Method, address
+#define OSC_ADDRESSES(X) \
+  X(OSC_CLOCK,       "/clock") \
+  X(OSC_SYNTH_FREQ,  "/synth/freq") \
+  X(OSC_SYNTH_LEVEL, "/synth/level") \
+  X(OSC_SYNTH_NOTE,  "/synth/note") \
+  X(OSC_SYNTH_OFF,   "/synth/off")
+
+#define OSC_METHOD(method, address) method,
+typedef enum {
+  OSC_ADDRESSES(OSC_METHOD)
+  OSC_NUM_METHODS
+} osc_method;
+#undef OSC_METHOD
+
+extern const osc_trie_node osc_trie[];
+extern const char *const osc_addresses[OSC_NUM_METHODS];
+
+#endif /* INC_OSCADDR_H_ */
@@ -0,0 +1,51 @@
+/*
+ * pktbuf.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * A pool of fixed size packet buffers, counted by reference, so frames
+ * are received into, handed around and sent from the same buffer
+ * without being copied.
+ *
+ * pktbuf_alloc() hands out a buffer with one reference. Whoever else
+ * keeps it takes another with pktbuf_ref(), and everyone gives theirs
+ * back with pktbuf_release(); the last makes it free again. Both take
+ * a pointer anywhere into the buffer, such as a payload within a frame.
+ *
+ * The buffers are the caller's, so they can go where its DMA wants
+ * them (ethif.c puts them in SRAM2). No hardware dependencies. Not
+ * thread safe: use each pool from one context.
+ */
+
+#ifndef INC_PKTBUF_H_
+#define INC_PKTBUF_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PKTBUF_MAX 16 // Buffers in a pool
+
+typedef struct {
+  uint8_t *base;
+  size_t size;    // Of each buffer
+  uint8_t count;
+  uint8_t refs[PKTBUF_MAX]; // 0 if free
+  uint8_t free;   // How many are
+  uint8_t next;   // Where to start looking for a free one
+
+  // Statistics
+  uint32_t allocs;
+  uint32_t exhausted; // Allocations failed, none being free
+  uint8_t min_free;   // Low water mark of free
+} pktbuf_pool;
+
+void pktbuf_init(pktbuf_pool *pool, uint8_t *base, size_t size, uint8_t count);
+uint8_t *pktbuf_alloc(pktbuf_pool *pool);
+int pktbuf_ref(pktbuf_pool *pool, const uint8_t *p);
+void pktbuf_release(pktbuf_pool *pool, const uint8_t *p);
+void pktbuf_reset_stats(pktbuf_pool *pool);
+
+#endif /* INC_PKTBUF_H_ */
@@ -0,0 +1,46 @@
+/*
+ * presets.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Settings kept across resets in the internal flash: a key/value store
+ * (kvstore.h) in the last 512 KB, which the linker script keeps clear
+ * of code. Its two areas are sectors 10 & 11 in the default single bank
+ * layout, or 20 & 21 and 22 & 23 with the nDBANK option bit cleared.
+ * Words are programmed by interrupt (FLASH_IRQn, PRIO_ISR_FLASH), one
+ * a presets_poll().
+ *
+ * The flash stalls any read of it while it programs or erases. A word
+ * takes tens of microseconds, which the audio & MIDI ride out. An erase
+ * takes a second or more: in dual bank mode the presets are in bank 2
+ * and the code in bank 1, so it goes on in the background; in single
+ * bank mode it would stall everything, so the erases are done by
+ * presets_init() before the audio starts, and a store that fills up
+ * again before the next reset waits for it.
+ *
+ * Call from the main loop only.
+ *
+ * References:
+ * - RM0410 Rev 5 section 3: Embedded flash memory (the single & dual
+ *   bank organizations, erasing & programming, read while write)
+ */
+
+#ifndef INC_PRESETS_H_
+#define INC_PRESETS_H_
+
+#include <stdint.h>
+#include "kvstore.h"
+
+#define PRESETS_ADDRESS   0x08180000UL // Keep in step with STM32F767ZITX_FLASH.ld
+#define PRESETS_AREA_SIZE (256 * 1024)
+
+extern kvstore presets;
+
+void presets_init(void);
+void presets_poll(void);
+int presets_dual_bank(void);
+
+#endif /* INC_PRESETS_H_ */
@@ -0,0 +1,85 @@
+/*
+ * prof.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Cycle-accurate profiling of named sections of the main loop
+ * using the Cortex-M7 DWT cycle counter (CYCCNT).
+ *
+ * Wrap a section with PROF_BEGIN(id) / PROF_END(id) in the same
+ * scope. Each section keeps count, min, max, total and a histogram
+ * with power-of-two buckets. Set PROF_ENABLED to 0 to compile
+ * every probe out to nothing.
+ */
+
+#ifndef INC_PROF_H_
+#define INC_PROF_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef PROF_ENABLED
+#define PROF_ENABLED 1
+#endif
+
+// Add new sections before PROF_NUM_SECTIONS and give them a name
+// in prof_section_names[] in prof.c
+typedef enum {
+  PROF_CHECK_IO = 0,
+  PROF_MIDI_SYNTH,
+  PROF_FILL_I2S,
+  PROF_USER_INPUT,
+  PROF_NUM_SECTIONS
+} prof_section;
+
+// Bucket n counts samples of [2^n, 2^(n+1)) cycles; bucket 0 also gets 0 cycles
+#define PROF_NUM_BUCKETS 32
+
+typedef struct {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t total; // For the mean; CYCCNT wraps every ~80s at 54 MHz but this won't
+  uint32_t buckets[PROF_NUM_BUCKETS];
+} prof_stats;
+
+extern prof_stats prof_sections[PROF_NUM_SECTIONS];
+extern const char *const prof_section_names[PROF_NUM_SECTIONS];
+
+void prof_init(void);
+void prof_reset(void);
+int prof_snprintf(char *str, size_t size, prof_section s);
+int prof_snprintf_histogram(char *str, size_t size, prof_section s);
+
+#if PROF_ENABLED
+
+#include "stm32f7xx.h" // DWT & __CLZ
+
+/** Current cycle count. */
+#define PROF_NOW() (DWT->CYCCNT)
+
+/** Adds one sample of the specified number of cycles to a section. */
+static inline void prof_record(prof_section s, uint32_t cycles) {
+  prof_stats *ps = &prof_sections[s];
+
+  ps->count++;
+  ps->total += cycles;
+  if (cycles < ps->min) ps->min = cycles;
+  if (cycles > ps->max) ps->max = cycles;
+  ps->buckets[cycles == 0 ? 0 : 31 - __CLZ(cycles)]++;
+}
+
+#define PROF_BEGIN(s) uint32_t prof_start_##s = PROF_NOW()
+#define PROF_END(s)   prof_record((s), PROF_NOW() - prof_start_##s)
+
+#else // PROF_ENABLED
+
+#define PROF_BEGIN(s)
+#define PROF_END(s)
+
+#endif // PROF_ENABLED
+
+#endif /* INC_PROF_H_ */
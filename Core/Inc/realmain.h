@@ -8,6 +8,9 @@
 #ifndef INC_REALMAIN_H_
 #define INC_REALMAIN_H_
 
+#include "main.h"
+
 void realmain();
+void uart_isr(UART_HandleTypeDef *huart);
 
 #endif /* INC_REALMAIN_H_ */
@@ -0,0 +1,191 @@
+/*
+ * rtpmidi.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * RTP-MIDI (RFC 6295) with Apple's session protocol, AppleMIDI, over
+ * UDP (net.h): what macOS' Network MIDI, rtpMIDI on Windows and
+ * rtpmidid on Linux speak. One session, with one peer, at a time.
+ *
+ * Sessions use two UDP ports, control and control + 1 (data). The
+ * initiator invites us on each in turn (IN, answered OK, or NO if we
+ * are busy), then synchronizes clocks with us on the data port (CK);
+ * either side ends it with BY. We can also initiate, rtpmidi_invite().
+ * A session is dropped after RTPMIDI_TIMEOUT_US with nothing heard.
+ *
+ * Clock: the session clock counts 100 us ticks (10 kHz). CK's three
+ * timestamps give the peer's clock less ours, which maps the time of
+ * each received command to ours: that is its midi_message timestamp,
+ * if it is not in the future or too far past; otherwise it is when it
+ * arrived.
+ *
+ * Sending: rtpmidi_send() adds messages to a packet, sent by
+ * rtpmidi_flush() (or when full), with a delta time before each but
+ * the first. Each packet carries a recovery journal: the state of
+ * the channels changed since the checkpoint, the last packet the peer
+ * has said it received (RS), in chapters P (program), C (controllers
+ * 0-119), W (pitch wheel) & N (notes). All notes off & all sound off
+ * are journaled as the notes they turn off. SysEx is not journaled,
+ * nor sent if longer than MIDI_SYSEX_MAX.
+ *
+ * Receiving: packets are parsed in place, and each message handed to
+ * the rtpmidi_message_fn as it is parsed. When packets were lost the
+ * journal of the next is compared with the state received, and the
+ * messages that bring it up to date are handed over first. A SysEx
+ * being received in segments is abandoned. Late packets are dropped.
+ * RS is sent every RTPMIDI_FEEDBACK_US while packets are arriving.
+ *
+ * No hardware dependencies; use each session from the same context
+ * as its net_if.
+ *
+ * References:
+ * - RFC 6295: RTP Payload Format for MIDI
+ * - RFC 4696: An Implementation Guide for RTP MIDI
+ * - RFC 3550: RTP: A Transport Protocol for Real-Time Applications
+ * - Apple, "MIDI Network Driver Protocol" (AppleMIDI)
+ */
+
+#ifndef INC_RTPMIDI_H_
+#define INC_RTPMIDI_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midi.h"
+#include "net.h"
+
+#define RTPMIDI_CONTROL_PORT 5004 // The data port is the next
+#define RTPMIDI_NAME_MAX     32   // Including the NUL
+#define RTPMIDI_TICK_US      100  // The session clock's
+#define RTPMIDI_MAX_COMMANDS 512  // Bytes of MIDI commands in a packet sent
+#define RTPMIDI_MAX_PENDING  128  // Channel messages in a packet sent
+#define RTPMIDI_TIMEOUT_US   60000000
+#define RTPMIDI_RETRY_US     1000000 // Between invitations
+#define RTPMIDI_INVITATIONS  12
+#define RTPMIDI_FEEDBACK_US  1000000
+#define RTPMIDI_MAX_AGE_US   1000000 // Older times are when received
+
+typedef enum {
+  RTPMIDI_IDLE = 0,
+  RTPMIDI_INVITING_CONTROL, // We invited the peer's control port
+  RTPMIDI_INVITING_DATA,    // ... and now its data port
+  RTPMIDI_ACCEPTED,         // We accepted on our control port
+  RTPMIDI_OPEN,
+} rtpmidi_state;
+
+/*
+ * Called with each message received, and its data if a SysEx (which
+ * is only valid until it returns).
+ */
+typedef void (*rtpmidi_message_fn)(void *ctx, const midi_message *mm, const uint8_t *sysex);
+
+/*
+ * A channel as we have sent it: each value, and the packet that last
+ * changed it (32 bit sequence numbers, the low 16 sent).
+ */
+typedef struct {
+  uint32_t last_seq; // Latest of all below
+  uint8_t program;
+  uint32_t program_seq;
+  uint16_t pitch;
+  uint32_t pitch_seq;
+  uint8_t control[120];
+  uint32_t control_seq[120];
+  uint8_t velocity[128]; // 0 if off
+  uint32_t on_seq[128];
+  uint32_t off_seq[128];
+} rtpmidi_tx_channel;
+
+/*
+ * A channel as we have received it; RTPMIDI_UNKNOWN until received.
+ */
+#define RTPMIDI_UNKNOWN 0xFF
+typedef struct {
+  uint8_t program;
+  uint8_t pitch_lsb;
+  uint8_t pitch_msb;
+  uint8_t control[120];
+  uint8_t velocity[128]; // 0 if off
+} rtpmidi_rx_channel;
+
+typedef struct {
+  // Configuration
+  net_if *net;
+  uint16_t control_port;
+  uint32_t ssrc;
+  char name[RTPMIDI_NAME_MAX];
+  uint8_t port; // Of the messages received
+  rtpmidi_message_fn deliver;
+  void *ctx;
+
+  // Session
+  rtpmidi_state state;
+  uint8_t initiator;
+  uint8_t tries;      // Invitations sent
+  uint32_t state_time;
+  uint32_t last_heard;
+  uint32_t token;
+  uint32_t peer_ssrc;
+  net_endpoint peer;  // Its control port
+  char peer_name[RTPMIDI_NAME_MAX];
+
+  // Clock: our microseconds, extended to 64 bits, and the peer's
+  // clock less ours, in ticks
+  uint64_t clock_us;
+  uint32_t clock_last;
+  int64_t offset;
+  uint8_t synced;
+  uint8_t syncs;       // Sent, as initiator
+  uint32_t next_sync;
+  uint32_t rtt_us;     // Round trip of the last CK, as initiator
+
+  // Receiving
+  uint8_t rx_started;
+  uint16_t rx_seq;     // Last received
+  uint16_t rx_reported; // Last sent in RS
+  uint32_t next_feedback;
+  midi_stream rx_stream;
+  rtpmidi_rx_channel rx_channels[16];
+
+  // Sending: the packet being filled, and the channels' journal
+  uint32_t tx_seq;     // Of the packet being filled
+  uint32_t checkpoint;
+  uint32_t tx_time;    // Of its first command, in ticks
+  uint32_t tx_last;    // ... and of its last, whence the next delta
+  uint8_t tx_commands[RTPMIDI_MAX_COMMANDS];
+  uint16_t tx_length;
+  midi_message tx_pending[RTPMIDI_MAX_PENDING]; // Its channel messages
+  uint16_t tx_count;   // Of messages of all kinds
+  uint16_t tx_channel_count;
+  rtpmidi_tx_channel tx_channels[16];
+
+  // Statistics
+  uint32_t sessions;
+  uint32_t rx_packets;
+  uint32_t rx_messages;
+  uint32_t rx_lost;        // Packets, by their sequence numbers
+  uint32_t rx_recovered;   // Messages from journals
+  uint32_t rx_unrecoverable; // Losses the journal did not cover
+  uint32_t rx_late;        // Packets out of order, dropped
+  uint32_t rx_errors;      // Malformed
+  uint32_t tx_packets;
+  uint32_t tx_messages;
+  uint32_t tx_drops;       // Messages not sent
+  uint32_t tx_unsent;      // Packets not sent, for want of a buffer
+  uint32_t journal_resets; // Journals too long, so started over
+} rtpmidi;
+
+void rtpmidi_init(rtpmidi *s, net_if *n, uint16_t control_port, const char *name, uint32_t ssrc,
+                  uint8_t port, rtpmidi_message_fn deliver, void *ctx, uint32_t now);
+int rtpmidi_bind(rtpmidi *s);
+int rtpmidi_invite(rtpmidi *s, const net_endpoint *peer, uint32_t now);
+void rtpmidi_end(rtpmidi *s);
+void rtpmidi_poll(rtpmidi *s, uint32_t now);
+int rtpmidi_send(rtpmidi *s, const midi_message *mm, const uint8_t *sysex, uint32_t now);
+void rtpmidi_flush(rtpmidi *s, uint32_t now);
+void rtpmidi_reset_stats(rtpmidi *s);
+const char *rtpmidi_state_name(rtpmidi_state state);
+
+#endif /* INC_RTPMIDI_H_ */
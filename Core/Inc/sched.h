@@ -0,0 +1,70 @@
+/*
+ * sched.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Cooperative run-to-completion task scheduler for the main loop.
+ *
+ * Tasks become ready when one of their events is posted, or
+ * every period if periodic. The ready task of the highest priority
+ * class runs next; within a class, the earliest deadline wins.
+ * A running task is never interrupted by another task, so a long
+ * low priority task still delays everything else: keep them short.
+ *
+ * All times are in units of the clock function given to sched_init()
+ * (DWT cycles on the target), so the scheduler has no hardware
+ * dependencies and can run against a simulated clock.
+ */
+
+#ifndef INC_SCHED_H_
+#define INC_SCHED_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Lower number is more important
+typedef enum {
+  SCHED_PRIO_UI = 0,
+  SCHED_PRIO_BACKGROUND,
+  SCHED_NUM_PRIOS
+} sched_priority;
+
+#define SCHED_MAX_TASKS 16
+
+typedef uint32_t (*sched_clock_fn)(void);
+
+typedef struct {
+  // Configuration; fill in before sched_add()
+  const char *name;
+  void (*run)(void);
+  sched_priority priority;
+  uint32_t events;   // Event bits which make this task ready
+  uint32_t period;   // Ready every this often; 0 if not periodic
+  uint32_t deadline; // Must finish this long after becoming ready; 0 = no deadline
+  uint32_t budget;   // Expected maximum run time; 0 = not checked
+
+  // State
+  uint8_t ready;
+  uint32_t ready_time;   // When it (first) became ready
+  uint32_t next_release; // For periodic tasks
+
+  // Statistics
+  uint32_t runs;
+  uint32_t deadline_misses;
+  uint32_t budget_overruns;
+  uint32_t max_run;      // Longest run time
+  uint32_t max_response; // Longest time from ready to finished
+} sched_task;
+
+void sched_init(sched_clock_fn clock);
+int sched_add(sched_task *t);
+void sched_post(uint32_t events);
+int sched_run_one(void);
+void sched_reset_stats(void);
+size_t sched_num_tasks(void);
+sched_task *sched_get_task(size_t i);
+
+#endif /* INC_SCHED_H_ */
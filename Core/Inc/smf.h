@@ -0,0 +1,116 @@
+/*
+ * smf.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Standard MIDI Files (format 0 & 1): a streaming reader & a recorder.
+ *
+ * The reader works on a file that is memory-mapped or in flash,
+ * without copying it: each track chunk is decoded an event at a time
+ * where it lies, and the tracks are merged in time order with a
+ * min-heap of their next event. The tempo map is followed as the
+ * events are read, so each one comes with its time in microseconds.
+ *
+ * Channel messages come back just as midi_stream_receive() produces
+ * them. SysEx & meta events point at their data in the file.
+ *
+ * The writer records timestamped messages into a format 0 file in
+ * a caller supplied buffer. SysEx, system common & real-time
+ * messages are not recorded. A gap longer than a delta time holds
+ * (2^28 - 1 ticks) is spanned with empty text events.
+ *
+ * No hardware dependencies.
+ *
+ * References:
+ * - Standard MIDI Files 1.0 (MIDI Manufacturers Association, 1996)
+ */
+
+#ifndef INC_SMF_H_
+#define INC_SMF_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midi.h"
+
+#define SMF_MAX_TRACKS 16
+
+// Errors returned by smf_open(), smf_next() & smf_writer_finish()
+#define SMF_ERR_HEADER    (-1) // Not a Standard MIDI File
+#define SMF_ERR_FORMAT    (-2) // Format 2, or no tracks
+#define SMF_ERR_TRACKS    (-3) // More than SMF_MAX_TRACKS
+#define SMF_ERR_TRUNCATED (-4) // A chunk or event runs past the end
+#define SMF_ERR_EVENT     (-5) // Data byte without a running status
+#define SMF_ERR_FULL      (-6) // Writer buffer is too small
+
+// Kinds of event from smf_next()
+#define SMF_EVENT_MIDI  0
+#define SMF_EVENT_SYSEX 1 // F0 or F7 (escape) event; data & len are what follows the length
+#define SMF_EVENT_META  2
+
+#define SMF_META_END_OF_TRACK 0x2F
+#define SMF_META_TEMPO        0x51
+
+#define SMF_DEFAULT_TEMPO 500000 // Microseconds per quarter note: 120 BPM
+
+typedef struct {
+  const uint8_t *start; // First delta time in the track chunk
+  const uint8_t *pos;   // The next event, after its delta time
+  const uint8_t *end;   // End of the track chunk
+  uint32_t tick;        // Of the next event
+  uint8_t status;       // Running status
+} smf_track;
+
+typedef struct {
+  uint8_t kind;  // SMF_EVENT_
+  uint8_t track;
+  uint32_t tick;
+  uint64_t time_us; // From the start of the file
+  midi_message msg; // For SMF_EVENT_MIDI (timestamp & port are not set)
+  uint8_t status;   // F0/F7 for SysEx, the meta type for meta events
+  const uint8_t *data;
+  uint32_t len;
+} smf_event;
+
+typedef struct {
+  const uint8_t *data;
+  size_t len;
+  uint16_t format;
+  uint16_t num_tracks;
+  uint16_t division; // Ticks per quarter note, or SMPTE when bit 15 is set
+
+  smf_track tracks[SMF_MAX_TRACKS];
+  // Min-heap of the tracks with events left, by (tick, track)
+  uint8_t heap[SMF_MAX_TRACKS];
+  uint8_t heap_len;
+
+  // Tempo map so far: tempo_us is the time of tempo_tick
+  uint32_t tempo;
+  uint32_t tempo_tick;
+  uint64_t tempo_us;
+
+  midi_stream parser;
+} smf_reader;
+
+typedef struct {
+  uint8_t *buff;
+  size_t size;
+  size_t len;
+  uint16_t division; // Ticks per quarter note at SMF_DEFAULT_TEMPO
+  uint32_t start;    // Timestamp of tick 0
+  uint32_t last_tick;
+  midi_encoder encoder;
+  uint8_t overflow;
+} smf_writer;
+
+int smf_open(smf_reader *r, const uint8_t *data, size_t len);
+void smf_rewind(smf_reader *r);
+int smf_next(smf_reader *r, smf_event *ev);
+
+void smf_writer_init(smf_writer *w, uint8_t *buff, size_t size, uint16_t division, uint32_t start);
+int smf_writer_add(smf_writer *w, const midi_message *mm);
+int smf_writer_finish(smf_writer *w);
+
+#endif /* INC_SMF_H_ */
@@ -0,0 +1,73 @@
+/*
+ * ssd1306.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * SSD1306 128x64 monochrome OLED over I2C: a framebuffer in RAM, laid
+ * out as the controller's display RAM is, 8 pages of 128 columns, each
+ * column of a page a byte of 8 pixels, LSB at the top.
+ *
+ * Drawing happens a page at a time: build the page's 128 bytes, then
+ * ssd1306_put_page(), which marks it dirty only if it changed. The
+ * transport sends the dirty pages one I2C transfer each, as
+ * ssd1306_next() makes them: the page's address & data behind the
+ * continuation control bytes, so there is nothing to wait for between
+ * them. After ssd1306_init() or ssd1306_reset() the first transfer is
+ * the controller's set up, and every page is dirty.
+ *
+ * No hardware dependencies. ssd1306_next() may interrupt the drawing
+ * (ssd1306_put_page()), but not the other way round: a page sent while
+ * being redrawn is marked dirty again once drawn, and so sent again.
+ *
+ * References:
+ * - Solomon Systech SSD1306 datasheet Rev 1.1: 8.1.5 (I2C, control
+ *   byte), 8.7 (GDDRAM), 9 (commands), and the application note's
+ *   software initialization flow
+ */
+
+#ifndef INC_SSD1306_H_
+#define INC_SSD1306_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SSD1306_ADDRESS 0x3C // 7 bit I2C address with SA0 low; 0x3D with it high
+#define SSD1306_WIDTH   128
+#define SSD1306_HEIGHT  64
+#define SSD1306_PAGES   (SSD1306_HEIGHT / 8)
+
+// Control bytes (8.1.5.2): Co set is a single byte, then another control
+// byte; Co clear is all the rest of the transfer
+#define SSD1306_CONTROL_COMMAND      0x00
+#define SSD1306_CONTROL_DATA         0x40
+#define SSD1306_CONTROL_COMMAND_BYTE 0x80
+
+// Three addressing commands & the data
+#define SSD1306_TRANSFER_MAX (3 * 2 + 1 + SSD1306_WIDTH)
+
+#define SSD1306_FONT_WIDTH 6 // Cells of 5x7 characters, a column apart
+#define SSD1306_TEXT_COLUMNS (SSD1306_WIDTH / SSD1306_FONT_WIDTH)
+
+typedef struct {
+  uint8_t fb[SSD1306_PAGES][SSD1306_WIDTH];
+  volatile uint8_t dirty;     // Pages of fb to send
+  volatile uint8_t set_up;    // Whether the controller has been set up
+  uint8_t tx[SSD1306_TRANSFER_MAX]; // The transfer being sent
+
+  // Statistics
+  uint32_t set_ups;
+  uint32_t pages_sent;
+  uint32_t pages_unchanged;   // Drawn the same, so not sent
+} ssd1306;
+
+void ssd1306_init(ssd1306 *d);
+void ssd1306_reset(ssd1306 *d);
+void ssd1306_put_page(ssd1306 *d, uint8_t page, const uint8_t *columns);
+size_t ssd1306_next(ssd1306 *d);
+void ssd1306_reset_stats(ssd1306 *d);
+int ssd1306_text(uint8_t *columns, int x, const char *s);
+
+#endif /* INC_SSD1306_H_ */
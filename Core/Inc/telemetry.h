@@ -0,0 +1,89 @@
+/*
+ * telemetry.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Compact binary telemetry packets: the counters the console shows,
+ * sent as one UDP datagram every TELEMETRY_PERIOD_MS (realmain.c), to
+ * be decoded & plotted by Tools/telemetry.py.
+ *
+ * All numbers are little endian. A packet is a header,
+ *   "MT", version (1 byte), 0 (1 byte), sequence number (4 bytes),
+ *   uptime in ms (4 bytes)
+ * then sections, each
+ *   id (1 byte), fields (1 byte), rows (1 byte)
+ * and its rows, each a NUL terminated name then fields 32 bit values.
+ * The meaning of each field is set by the section id (see below);
+ * a decoder shows those of a section it does not know by number.
+ *
+ * The writer has no hardware dependencies.
+ */
+
+#ifndef INC_TELEMETRY_H_
+#define INC_TELEMETRY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TELEMETRY_PORT      5005 // UDP, on the board & where it sends
+#define TELEMETRY_VERSION   1
+#define TELEMETRY_HEADER    12
+#define TELEMETRY_NAME_MAX  15 // Longer names are cut short
+#define TELEMETRY_PERIOD_MS 1000
+
+// Section ids & their fields; keep Tools/telemetry.py in step
+typedef enum {
+  // "system": idle per mille, loops per tick, core clock Hz, console
+  // UART overruns, UART error callbacks, USART3 interrupts, MIDI
+  // overruns, monitor drops, log drops
+  TELEMETRY_SYSTEM = 1,
+  // "audio": blocks, headroom last & min us (signed), late blocks,
+  // voices sounding, synth queue late & dropped, MIDI to sound
+  // latency last & max us
+  TELEMETRY_AUDIO = 2,
+  // By profiled section: count, min, max, mean cycles, then the 32
+  // power of two buckets of prof.h
+  TELEMETRY_PROFILE = 3,
+  // By PendSV job: runs, latency last & max cycles, max run cycles
+  TELEMETRY_DEFERRED = 4,
+  // By main loop task: runs, max run us, max response us, deadline
+  // misses, budget overruns
+  TELEMETRY_TASKS = 5,
+  // By event: count, latency last, mean & max us
+  TELEMETRY_EVENTS = 6,
+  // By MIDI port: rx bytes, rx messages, overruns, real-time drops,
+  // input ring high water, output ring high water
+  TELEMETRY_PORTS = 7,
+  // By ring or queue: high water mark, size
+  TELEMETRY_RINGS = 8,
+  // "usb0": rx messages, ignored, overruns, tx messages, transfers,
+  // drops
+  TELEMETRY_USB = 9,
+  // "net0": session state, link up, rx packets, rx messages, lost,
+  // recovered, tx packets, tx messages, tx drops, frames rx, frames
+  // tx, IP errors, pool exhausted, rx starved, tx starved
+  TELEMETRY_NET = 10,
+  // "osc": rx packets, messages, bundles, malformed, unmatched, bad
+  // arguments, timetags late, too far ahead
+  TELEMETRY_OSC = 11,
+} telemetry_section_id;
+
+typedef struct {
+  uint8_t *buf;
+  size_t size;
+  size_t len;
+  uint8_t *rows;  // Of the section being written
+  uint8_t fields; // Of its rows
+  uint8_t overflow;
+} telemetry_writer;
+
+void telemetry_begin(telemetry_writer *w, uint8_t *buf, size_t size, uint32_t seq,
+                     uint32_t uptime_ms);
+void telemetry_section(telemetry_writer *w, telemetry_section_id id, uint8_t fields);
+void telemetry_row(telemetry_writer *w, const char *name, const uint32_t *values);
+size_t telemetry_end(telemetry_writer *w);
+
+#endif /* INC_TELEMETRY_H_ */
@@ -0,0 +1,58 @@
+/*
+ * tempo.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * MIDI clock tempo tracker.
+ *
+ * Follows the Timing Clock (24 per quarter note) of a MIDI input with
+ * a second order phase-locked loop (alpha-beta filter) over the clock
+ * timestamps, giving a smoothed tempo, the jitter of the incoming clock,
+ * and the phase within the current clock for scheduling between clocks.
+ * Also follows Start, Stop, Continue & Song Position Pointer.
+ *
+ * Times are in timestamp_now() microseconds; no hardware dependencies.
+ */
+
+#ifndef INC_TEMPO_H_
+#define INC_TEMPO_H_
+
+#include <stdint.h>
+#include "midi.h"
+
+#define TEMPO_CLOCKS_PER_BEAT 24
+// MIDI beats (sixteenth notes) of Song Position Pointer
+#define TEMPO_CLOCKS_PER_SPP  6
+
+// Clock intervals outside these (about 400 to 10 BPM) are not tempo
+#define TEMPO_MIN_INTERVAL_US 6250
+#define TEMPO_MAX_INTERVAL_US 250000
+
+typedef struct {
+  uint8_t running;     // Between Start/Continue and Stop
+  uint8_t locked;      // Have a tempo
+  uint8_t start_pending; // Next clock is the first after Start/Continue
+  uint32_t position;   // Clocks since the start of the song
+
+  uint32_t last_clock; // When the last clock was received
+  uint32_t estimate;   // Filtered time of the last clock
+  uint32_t period_q8;  // Filtered clock period, microseconds * 256
+
+  // Statistics
+  uint32_t clocks;
+  uint32_t relocks;
+  uint32_t jitter_q4;  // Moving average of |phase error|, microseconds * 16
+  uint32_t jitter_max;
+} tempo_tracker;
+
+void tempo_init(tempo_tracker *tt);
+void tempo_receive(tempo_tracker *tt, const midi_message *mm);
+uint32_t tempo_bpm_x100(const tempo_tracker *tt);
+uint32_t tempo_phase(const tempo_tracker *tt, uint32_t now);
+uint32_t tempo_clock_time(const tempo_tracker *tt, uint32_t n);
+void tempo_reset_stats(tempo_tracker *tt);
+
+#endif /* INC_TEMPO_H_ */
@@ -0,0 +1,29 @@
+/*
+ * timestamp.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Free-running 32 bit microsecond timestamps from TIM2.
+ * Wraps after about 71.6 minutes; compare timestamps by
+ * unsigned subtraction only.
+ */
+
+#ifndef INC_TIMESTAMP_H_
+#define INC_TIMESTAMP_H_
+
+#include "main.h"
+
+#define TIMESTAMP_TIMER TIM2
+#define TIMESTAMP_HZ    1000000
+
+void timestamp_init(void);
+
+/** The current time in microseconds. Safe to call from anywhere. */
+static inline uint32_t timestamp_now(void) {
+  return TIMESTAMP_TIMER->CNT;
+}
+
+#endif /* INC_TIMESTAMP_H_ */
@@ -16,7 +16,8 @@ typedef struct {
   int last_is_left; // Did we last provide left or right channel? (we're mono for now)
 
   uint32_t sample_rate;
-  uint32_t desired_freq;
+  uint32_t desired_freq; // Hz, rounded
+  uint32_t freq_x100; // Hundredths of a Hz, as set
   int16_t desired_ampl; // Maximum positive signal value ; 0 or negative = silent
 
   // Calculated variables
@@ -28,6 +29,7 @@ typedef struct {
 
 void tonegen_init(tonegen_state *tgs, uint32_t sample_rate);
 void tonegen_set(tonegen_state *tgs, uint32_t desired_freq, int16_t desired_ampl);
+void tonegen_set_x100(tonegen_state *tgs, uint32_t freq_x100, int16_t desired_ampl);
 int16_t tonegen_next_sample(tonegen_state *tgs);
 
 
@@ -0,0 +1,65 @@
+/*
+ * usbdev.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Full speed USB device on USB_OTG_FS (CN13, the user USB connector),
+ * directly on the HAL PCD driver that CubeMX sets up: the descriptors,
+ * the standard control requests on endpoint 0, and the class
+ * endpoints.
+ *
+ * Interface 0-1: USB MIDI 1.0 (Audio Control & MIDIStreaming), one
+ *   embedded jack each way, on bulk endpoints 0x01 OUT & 0x81 IN.
+ *   Its packets are queued in usb_midi (usbmidi.h), a MIDI port of
+ *   its own, MIDI_SOURCE_USB.
+ * Interface 2-3: CDC ACM serial port, on bulk endpoints 0x02 OUT &
+ *   0x82 IN (and 0x83, which never has anything to say). While a
+ *   terminal has it open it sends the console output instead of
+ *   USART3, in transfers of up to 4 packets: one is topped up from
+ *   the ring buffer while the other goes. What it receives is console
+ *   input, like what USART3 receives. The line coding is kept for the
+ *   host but otherwise ignored.
+ *
+ * The PCD callbacks run in the OTG_FS interrupt (PRIO_ISR_USB). A
+ * received MIDI transfer requests DEFER_MIDI_RX, a sent one
+ * DEFER_MIDI_TX. When the receive queue has no room for another
+ * transfer the OUT endpoint is left NAKing until usbdev_midi_service()
+ * finds room, so the host waits rather than anything being lost; the
+ * serial port's does likewise until usbdev_cdc_service().
+ *
+ * References:
+ * - USB 2.0 Specification chapter 9: USB Device Framework
+ * - Universal Serial Bus Device Class Definition for MIDI Devices,
+ *   Release 1.0, Appendix B: Example MIDI Adapter
+ * - Universal Serial Bus Class Definitions for Communications Devices
+ *   1.2, and its PSTN Devices subclass 1.2, section 6.3
+ * - RM0410 Rev 5 section 42: USB on-the-go full-speed/high-speed
+ */
+
+#ifndef INC_USBDEV_H_
+#define INC_USBDEV_H_
+
+#include <stdint.h>
+#include "usbmidi.h"
+#include "ringbuffer.h"
+
+typedef struct {
+  uint32_t rx_bytes;
+  uint32_t tx_bytes;
+  uint32_t tx_transfers;
+} usbdev_cdc_stats;
+
+extern usbmidi usb_midi;
+extern usbdev_cdc_stats usb_cdc_stats;
+
+void usbdev_init(void);
+int usbdev_configured(void);
+void usbdev_midi_service(void);
+void usbdev_cdc_attach(ring_buffer_t *in_rb, ring_buffer_t *out_rb, uint32_t rx_event);
+int usbdev_cdc_open(void);
+void usbdev_cdc_service(int send);
+
+#endif /* INC_USBDEV_H_ */
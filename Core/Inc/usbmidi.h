@@ -0,0 +1,104 @@
+/*
+ * usbmidi.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * USB MIDI 1.0 event packets: the codec between midi_message and the
+ * 4-byte packets of the class's bulk endpoints, and the queues between
+ * those endpoints and the MIDI routing. The USB device itself is in
+ * usbdev.h.
+ *
+ * Each packet is a header, cable number (high nibble) & Code Index
+ * Number (low nibble, which says how many of the 3 MIDI bytes that
+ * follow are used), then the MIDI bytes with no running status.
+ * SysEx is split over packets of 3 bytes, the last holding 1-3 bytes
+ * including the F7.
+ *
+ * Messages to send are packed into 64 byte transfers (16 packets):
+ * one is filled while the other is in flight, so messages routed
+ * while a transfer is going out leave together in the next one.
+ * Received transfers are queued whole, with the time they arrived,
+ * and decoded later with usbmidi_receive().
+ *
+ * No hardware dependencies. Receiving: usbmidi_rx_put() from the USB
+ * interrupt, usbmidi_receive() from one other context. Sending:
+ * usbmidi_send() & usbmidi_tx_take() from one context,
+ * usbmidi_tx_done() from the USB interrupt.
+ *
+ * References:
+ * - Universal Serial Bus Device Class Definition for MIDI Devices,
+ *   Release 1.0, section 4: USB-MIDI Event Packets
+ */
+
+#ifndef INC_USBMIDI_H_
+#define INC_USBMIDI_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midi.h"
+
+#define USBMIDI_PACKET_SIZE      4
+#define USBMIDI_TRANSFER_SIZE    64 // Full speed bulk max packet size
+#define USBMIDI_TRANSFER_PACKETS (USBMIDI_TRANSFER_SIZE / USBMIDI_PACKET_SIZE)
+#define USBMIDI_RX_PACKETS       64 // Power of 2; at least USBMIDI_TRANSFER_PACKETS
+#define USBMIDI_CABLE            0  // We have one virtual MIDI cable
+
+// Packets to send a SysEx of len data bytes, with its F0 & F7
+#define USBMIDI_SYSEX_PACKETS(len) (((len) + 2 + 2) / 3)
+
+// Code Index Numbers (Table 4-1)
+#define USBMIDI_CIN_MISC          0x0 // Reserved
+#define USBMIDI_CIN_CABLE_EVENT   0x1 // Reserved
+#define USBMIDI_CIN_SYSCOMMON_2   0x2 // F1, F3
+#define USBMIDI_CIN_SYSCOMMON_3   0x3 // F2
+#define USBMIDI_CIN_SYSEX         0x4 // SysEx starts or continues
+#define USBMIDI_CIN_SYSEX_END_1   0x5 // SysEx ends with 1 byte, or F6
+#define USBMIDI_CIN_SYSEX_END_2   0x6
+#define USBMIDI_CIN_SYSEX_END_3   0x7
+// 0x8-0xE are the channel messages, the same as their status' high nibble
+#define USBMIDI_CIN_SINGLE_BYTE   0xF // Real-time, or any single byte
+
+typedef struct {
+  // Received packets, and when the transfer of each arrived (same index)
+  uint8_t rx_packets[USBMIDI_RX_PACKETS][USBMIDI_PACKET_SIZE];
+  uint32_t rx_times[USBMIDI_RX_PACKETS];
+  volatile uint32_t rx_head; // Written by usbmidi_rx_put()
+  volatile uint32_t rx_tail; // Written by usbmidi_receive()
+  // SysEx being received, byte by byte; its data is in rx_sysex.sysex
+  midi_stream rx_sysex;
+  uint8_t port; // Set on each message received
+
+  // Transfers being sent: tx_fill is being filled while the other
+  // is sent, if tx_busy
+  uint8_t tx_buff[2][USBMIDI_TRANSFER_SIZE];
+  uint8_t tx_len[2];
+  uint8_t tx_fill;
+  volatile uint8_t tx_busy;
+
+  // Statistics
+  uint32_t rx_messages;
+  uint32_t rx_ignored;   // Packets of other cables, reserved CINs or malformed
+  uint32_t rx_overruns;  // Packets lost as the queue was full
+  uint32_t tx_messages;
+  uint32_t tx_transfers;
+  uint32_t tx_drops;     // Messages not sent as the transfer was full
+} usbmidi;
+
+void usbmidi_init(usbmidi *u, uint8_t port);
+int usbmidi_encode(const midi_message *mm, uint8_t cable, uint8_t *packet);
+size_t usbmidi_encode_sysex(const uint8_t *data, size_t len, uint8_t cable, uint8_t *packets);
+int usbmidi_decode(usbmidi *u, const uint8_t *packet, midi_message *mm);
+
+uint32_t usbmidi_rx_room(const usbmidi *u);
+void usbmidi_rx_put(usbmidi *u, const uint8_t *data, size_t len, uint32_t now);
+int usbmidi_receive(usbmidi *u, midi_message *mm);
+
+int usbmidi_send(usbmidi *u, const midi_message *mm, const uint8_t *sysex);
+size_t usbmidi_tx_take(usbmidi *u, const uint8_t **data);
+void usbmidi_tx_done(usbmidi *u);
+void usbmidi_reset_stats(usbmidi *u);
+
+#endif /* INC_USBMIDI_H_ */
@@ -0,0 +1,115 @@
+/*
+ * blockq.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Audio block event queue. See blockq.h.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "blockq.h"
+
+void blockq_init(blockq *q) {
+  q->count = 0;
+  q->late = 0;
+  q->dropped = 0;
+  q->max_count = 0;
+}
+
+/** Makes room for an event at the given time, after those with the
+ * same time; returns NULL (and counts it dropped) if the queue is full.
+ */
+static blockq_event *insert(blockq *q, uint32_t time) {
+  uint32_t i;
+
+  if (q->count >= BLOCKQ_SIZE) {
+    q->dropped++;
+    return NULL;
+  }
+
+  // Usually the newest, so search from the end. Times wrap: compare differences.
+  for (i = q->count; i > 0 && (int32_t)(time - q->events[i - 1].time) < 0; i--) {
+  }
+  memmove(&q->events[i + 1], &q->events[i], (q->count - i) * sizeof(blockq_event));
+  q->events[i].time = time;
+  q->count++;
+  if (q->count > q->max_count) {
+    q->max_count = q->count;
+  }
+  return &q->events[i];
+}
+
+/** Queues a message to take effect at the given time.
+ * Events with the same time keep their order.
+ * Returns 0 (and drops it) if the queue is full.
+ */
+int blockq_push(blockq *q, uint32_t time, const midi_message *mm) {
+  blockq_event *e = insert(q, time);
+
+  if (e == NULL) {
+    return 0;
+  }
+  e->param = BLOCKQ_MIDI;
+  e->msg = *mm;
+  return 1;
+}
+
+/** Queues a change of one of the renderer's parameters (not
+ * BLOCKQ_MIDI) to take effect at the given time, as blockq_push().
+ */
+int blockq_push_param(blockq *q, uint32_t time, uint8_t param, float value) {
+  blockq_event *e = insert(q, time);
+
+  if (e == NULL) {
+    return 0;
+  }
+  e->param = param;
+  e->value = value;
+  return 1;
+}
+
+/** Renders one block of block_frames frames which will be heard
+ * starting at block_time, applying every queued event due before
+ * the end of the block at its own frame.
+ */
+void blockq_render(blockq *q, uint32_t block_time, uint32_t block_frames, uint32_t sample_rate,
+                   blockq_render_fn render, blockq_apply_fn apply, void *ctx) {
+  uint32_t frame = 0;
+  uint32_t done = 0;
+
+  while (done < q->count) {
+    const blockq_event *e = &q->events[done];
+    int32_t delta = (int32_t)(e->time - block_time);
+    uint32_t at;
+
+    if (delta < 0) {
+      q->late++;
+      at = 0;
+    } else {
+      at = (uint32_t)(((uint64_t)delta * sample_rate) / 1000000);
+      if (at >= block_frames) {
+        break;
+      }
+    }
+
+    if (at > frame) {
+      render(ctx, frame, at - frame);
+      frame = at;
+    }
+    apply(ctx, e, frame);
+    done++;
+  }
+
+  if (frame < block_frames) {
+    render(ctx, frame, block_frames - frame);
+  }
+
+  if (done > 0) {
+    q->count -= done;
+    memmove(&q->events[0], &q->events[done], q->count * sizeof(blockq_event));
+  }
+}
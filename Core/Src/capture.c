@@ -0,0 +1,216 @@
+/*
+ * capture.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Compact binary capture of received MIDI. See capture.h.
+ */
+
+#include "capture.h"
+
+static const uint8_t capture_magic[] = { 'M', 'C', 'A', 'P', CAPTURE_VERSION };
+
+static uint32_t room(const capture_log *c) {
+  return CAPTURE_SIZE - (c->head - c->tail);
+}
+
+/** Writes without publishing; the caller has checked there is room. */
+static void put(capture_log *c, uint32_t *head, const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++, (*head)++) {
+    c->buff[*head & (CAPTURE_SIZE - 1)] = data[i];
+  }
+}
+
+/** Encodes v as a big-endian variable length quantity; returns its length. */
+static size_t vlq(uint32_t v, uint8_t *out) {
+  uint8_t tmp[5];
+  size_t n = 0;
+
+  do {
+    tmp[n++] = v & 0x7F;
+    v >>= 7;
+  } while (v != 0);
+  for (size_t i = 0; i < n; i++) {
+    out[i] = tmp[n - 1 - i] | (i < n - 1 ? 0x80 : 0);
+  }
+  return n;
+}
+
+/** Running status restarts, and there is nothing to repeat, on every port. */
+static void restart_running_status(capture_log *c) {
+  for (int p = 0; p < CAPTURE_PORTS; p++) {
+    midi_encoder_init(&c->encoders[p]);
+    c->last_len[p] = 0;
+  }
+}
+
+/** Is this the port's previous record again, after the same delta? */
+static int is_repeat(const capture_log *c, uint8_t port, const uint8_t *bytes, size_t n,
+                     uint32_t delta) {
+  if (n != c->last_len[port] || delta != c->last_delta[port]) {
+    return 0;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (bytes[i] != c->last_bytes[port][i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void capture_init(capture_log *c) {
+  c->head = 0;
+  c->tail = 0;
+  c->active = 0;
+  c->pending_drops = 0;
+  c->records = 0;
+  c->repeats = 0;
+  c->drops = 0;
+  c->max_used = 0;
+  restart_running_status(c);
+}
+
+/** Starts a new capture, discarding anything unread, with every port's
+ * time starting at now. Must not run at the same time as
+ * capture_message() or capture_read().
+ */
+void capture_start(capture_log *c, uint32_t now) {
+  uint32_t head;
+
+  capture_init(c);
+  for (int p = 0; p < CAPTURE_PORTS; p++) {
+    c->last_time[p] = now;
+  }
+  head = c->head;
+  put(c, &head, capture_magic, sizeof(capture_magic));
+  c->head = head;
+  c->active = 1;
+}
+
+/** Ends the capture. Must not run at the same time as capture_message(). */
+void capture_stop(capture_log *c) {
+  uint8_t end = CAPTURE_META | CAPTURE_META_END;
+  uint32_t head = c->head;
+
+  if (!c->active) {
+    return;
+  }
+  c->active = 0;
+  if (room(c) >= 1) {
+    put(c, &head, &end, 1);
+    __sync_synchronize();
+    c->head = head;
+  }
+}
+
+/** Records a received message, with its port & timestamp. For a
+ * MIDI_SYSEX, sysex holds its data1 data bytes.
+ */
+void capture_message(capture_log *c, const midi_message *mm, const uint8_t *sysex) {
+  uint8_t bytes[MIDI_SYSEX_MAX + 2];
+  uint8_t hdr[1 + 5];
+  size_t n;
+  size_t need;
+  uint8_t port = mm->port;
+
+  if (!c->active || port >= CAPTURE_PORTS) {
+    return;
+  }
+
+  if (mm->type == MIDI_SYSEX) {
+    size_t len = mm->data1 < MIDI_SYSEX_MAX ? mm->data1 : MIDI_SYSEX_MAX;
+    bytes[0] = MIDI_SYSEX;
+    for (size_t i = 0; i < len; i++) {
+      bytes[1 + i] = sysex[i];
+    }
+    bytes[1 + len] = MIDI_EOX;
+    n = len + 2;
+    // SysEx cancels running status
+    midi_encoder_init(&c->encoders[port]);
+  } else {
+    n = midi_encode(&c->encoders[port], mm, bytes);
+    if (n == 0) {
+      return;
+    }
+  }
+
+  // Longer messages are split into several records; the decoder
+  // sees them as one stream of bytes per port
+  uint32_t delta = mm->timestamp - c->last_time[port];
+  size_t records = (n + CAPTURE_MAX_BYTES - 1) / CAPTURE_MAX_BYTES;
+  int repeat = is_repeat(c, port, bytes, n, delta);
+  // Each record has a header; all but the first have a delta of 0
+  need = repeat ? 1 : n + records + vlq(delta, hdr) + (records - 1);
+  if (c->pending_drops > 0) {
+    need += 1 + vlq(c->pending_drops, hdr);
+  }
+  if (need > room(c)) {
+    c->pending_drops++;
+    c->drops++;
+    // Whatever comes next must not depend on what was lost
+    restart_running_status(c);
+    return;
+  }
+
+  uint32_t head = c->head;
+  if (c->pending_drops > 0) {
+    hdr[0] = CAPTURE_META | CAPTURE_META_DROPS;
+    put(c, &head, hdr, 1);
+    put(c, &head, hdr, vlq(c->pending_drops, hdr));
+    c->pending_drops = 0;
+  }
+  if (repeat) {
+    hdr[0] = port << 5;
+    put(c, &head, hdr, 1);
+    c->repeats++;
+  } else {
+    for (size_t done = 0; done < n; ) {
+      size_t chunk = n - done < CAPTURE_MAX_BYTES ? n - done : CAPTURE_MAX_BYTES;
+      hdr[0] = (port << 5) | chunk;
+      size_t h = 1 + vlq(done == 0 ? delta : 0, hdr + 1);
+      put(c, &head, hdr, h);
+      put(c, &head, bytes + done, chunk);
+      done += chunk;
+    }
+    if (n <= CAPTURE_REPEAT_MAX) {
+      for (size_t i = 0; i < n; i++) {
+        c->last_bytes[port][i] = bytes[i];
+      }
+      c->last_len[port] = n;
+      c->last_delta[port] = delta;
+    } else {
+      c->last_len[port] = 0;
+    }
+  }
+  // Publish the records only once they are all written
+  __sync_synchronize();
+  c->head = head;
+
+  c->last_time[port] = mm->timestamp;
+  c->records++;
+  uint32_t used = head - c->tail;
+  if (used > c->max_used) {
+    c->max_used = used;
+  }
+}
+
+/** Takes up to max bytes of the stream; returns how many. */
+size_t capture_read(capture_log *c, uint8_t *out, size_t max) {
+  uint32_t tail = c->tail;
+  size_t n = c->head - tail;
+
+  if (n > max) {
+    n = max;
+  }
+  __sync_synchronize();
+  for (size_t i = 0; i < n; i++) {
+    out[i] = c->buff[(tail + i) & (CAPTURE_SIZE - 1)];
+  }
+  // Done with the bytes before the producer may reuse them
+  __sync_synchronize();
+  c->tail = tail + n;
+  return n;
+}
@@ -0,0 +1,123 @@
+/*
+ * deferred.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * PendSV deferred processing tier. See deferred.h.
+ *
+ * References:
+ * - Arm v7-M Architecture Reference Manual B1.5.4: PendSV is a
+ *   software-triggered exception at a configurable priority,
+ *   set pending via ICSR.PENDSVSET
+ */
+
+#include "main.h"
+#include "deferred.h"
+
+const char *const deferred_names[DEFER_NUM] = {
+    "midi_rx",
+    "audio",
+    "midi_tx",
+    "net",
+};
+
+FAST_BSS static volatile uint32_t pending;
+FAST_BSS static uint32_t request_time[DEFER_NUM];
+FAST_BSS static deferred_fn handlers[DEFER_NUM];
+FAST_BSS deferred_stats deferred_job_stats[DEFER_NUM];
+
+void deferred_init(void) {
+  pending = 0;
+  for (int i = 0; i < DEFER_NUM; i++) {
+    handlers[i] = NULL;
+  }
+  deferred_reset_stats();
+  HAL_NVIC_SetPriority(PendSV_IRQn, PRIO_DEFERRED, 0);
+}
+
+void deferred_reset_stats(void) {
+  for (int i = 0; i < DEFER_NUM; i++) {
+    deferred_job_stats[i].count = 0;
+    deferred_job_stats[i].last_latency = 0;
+    deferred_job_stats[i].max_latency = 0;
+    deferred_job_stats[i].max_run = 0;
+  }
+}
+
+/** Sets the function run for a job (a single DEFER_ bit). */
+void deferred_register(uint32_t job, deferred_fn fn) {
+  for (int i = 0; i < DEFER_NUM; i++) {
+    if (job == ((uint32_t)1 << i)) {
+      handlers[i] = fn;
+    }
+  }
+}
+
+/** Requests the jobs be run in PendSV. Safe to call from any
+ * interrupt priority, and from the main loop.
+ */
+void deferred_post(uint32_t jobs) {
+  uint32_t primask = __get_PRIMASK();
+  uint32_t now = DWT->CYCCNT;
+
+  __disable_irq();
+  uint32_t newly = jobs & ~pending;
+  pending |= jobs;
+  for (int i = 0; newly != 0; i++, newly >>= 1) {
+    if (newly & 1) {
+      request_time[i] = now;
+    }
+  }
+  __set_PRIMASK(primask);
+
+  SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+/** Keeps the deferred jobs from starting until deferred_unmask(),
+ * for the main loop to change what they use. BASEPRI holds the
+ * encoded priority, so it is encoded as HAL_NVIC_SetPriority() does.
+ */
+void deferred_mask(void) {
+  __set_BASEPRI(NVIC_EncodePriority(NVIC_GetPriorityGrouping(), PRIO_DEFERRED, 0)
+                << (8 - __NVIC_PRIO_BITS));
+}
+
+void deferred_unmask(void) {
+  __set_BASEPRI(0);
+}
+
+/** Runs all requested jobs. Called only by PendSV_Handler(). */
+void deferred_run(void) {
+  uint32_t jobs;
+
+  while (1) {
+    __disable_irq();
+    jobs = pending;
+    pending = 0;
+    __enable_irq();
+
+    if (jobs == 0) {
+      return;
+    }
+
+    for (int i = 0; jobs != 0; i++, jobs >>= 1) {
+      if (!(jobs & 1) || handlers[i] == NULL) {
+        continue;
+      }
+      deferred_stats *ds = &deferred_job_stats[i];
+      uint32_t start = DWT->CYCCNT;
+      uint32_t latency = start - request_time[i];
+
+      handlers[i]();
+
+      uint32_t run = DWT->CYCCNT - start;
+      ds->count++;
+      ds->last_latency = latency;
+      if (latency > ds->max_latency) ds->max_latency = latency;
+      if (run > ds->max_run) ds->max_run = run;
+    }
+  }
+}
@@ -0,0 +1,173 @@
+/*
+ * display.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * SSD1306 OLED on I2C1 by DMA. See display.h.
+ *
+ * Each transfer is one HAL_I2C_Master_Transmit_DMA() of what
+ * ssd1306_next() made, control bytes and all; there is no register
+ * address phase, which the HAL's memory writes may wait out. The HAL
+ * calls back from I2C1's interrupts once the stop condition has gone,
+ * and the next transfer is started from there, so the main loop only
+ * starts the first of each flush. It is never started while a
+ * transfer is under way, so the two never race for the bus.
+ */
+
+#include "main.h"
+#include "display.h"
+#include "deferred.h"
+#include "timestamp.h"
+
+// Not in the CubeMX configuration; stm32f7xx_it.c uses them too
+I2C_HandleTypeDef hi2c1;
+DMA_HandleTypeDef hdma_i2c1_tx;
+
+// Fast mode (400 kHz) from I2C1's 54 MHz clock (PCLK1, the reset
+// default of RCC_DCKCFGR2), with the analog filter on: as CubeMX
+// works it out
+#define TIMING_400KHZ 0x6000030D
+
+ssd1306 oled;
+display_stats oled_stats;
+
+static volatile uint8_t busy; // A transfer is under way, or about to be
+static uint16_t sending;      // Its length
+static uint32_t busy_since;   // timestamp_now() of the flush
+static uint32_t retry_tick;   // HAL_GetTick() to try an absent display again
+
+void display_init(void) {
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  __HAL_RCC_GPIOB_CLK_ENABLE();
+  __HAL_RCC_I2C1_CLK_ENABLE();
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  // The modules have their own pull-ups; ours help without one
+  GPIO_InitStruct.Pin = GPIO_PIN_8 | GPIO_PIN_9;
+  GPIO_InitStruct.Mode = GPIO_MODE_AF_OD;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  GPIO_InitStruct.Alternate = GPIO_AF4_I2C1;
+  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+  // I2C1_TX; stream 5 is taken by SPI3_TX (I2S)
+  hdma_i2c1_tx.Instance = DMA1_Stream6;
+  hdma_i2c1_tx.Init.Channel = DMA_CHANNEL_1;
+  hdma_i2c1_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  hdma_i2c1_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_i2c1_tx.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_i2c1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_i2c1_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma_i2c1_tx.Init.Mode = DMA_NORMAL;
+  hdma_i2c1_tx.Init.Priority = DMA_PRIORITY_LOW;
+  hdma_i2c1_tx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if (HAL_DMA_Init(&hdma_i2c1_tx) != HAL_OK) {
+    Error_Handler();
+  }
+  __HAL_LINKDMA(&hi2c1, hdmatx, hdma_i2c1_tx);
+
+  hi2c1.Instance = I2C1;
+  hi2c1.Init.Timing = TIMING_400KHZ;
+  hi2c1.Init.OwnAddress1 = 0;
+  hi2c1.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
+  hi2c1.Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
+  hi2c1.Init.OwnAddress2 = 0;
+  hi2c1.Init.OwnAddress2Masks = I2C_OA2_NOMASK;
+  hi2c1.Init.GeneralCallMode = I2C_GENERALCALL_DISABLE;
+  hi2c1.Init.NoStretchMode = I2C_NOSTRETCH_DISABLE;
+  if (HAL_I2C_Init(&hi2c1) != HAL_OK) {
+    Error_Handler();
+  }
+  if (HAL_I2CEx_ConfigAnalogFilter(&hi2c1, I2C_ANALOGFILTER_ENABLE) != HAL_OK) {
+    Error_Handler();
+  }
+
+  HAL_NVIC_SetPriority(DMA1_Stream6_IRQn, PRIO_ISR_DISPLAY, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+  HAL_NVIC_SetPriority(I2C1_EV_IRQn, PRIO_ISR_DISPLAY, 0);
+  HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
+  HAL_NVIC_SetPriority(I2C1_ER_IRQn, PRIO_ISR_DISPLAY, 0);
+  HAL_NVIC_EnableIRQ(I2C1_ER_IRQn);
+
+  ssd1306_init(&oled);
+  display_reset_stats();
+}
+
+/** Starts the next transfer, or finishes the flush if there is none.
+ * From the main loop while not busy, or the completion interrupt.
+ */
+static void send_next(void) {
+  size_t len = ssd1306_next(&oled);
+
+  if (len == 0) {
+    uint32_t took = timestamp_now() - busy_since;
+    if (took > oled_stats.busy_max_us) {
+      oled_stats.busy_max_us = took;
+    }
+    busy = 0;
+    return;
+  }
+  sending = (uint16_t)len;
+  busy = 1;
+  if (HAL_I2C_Master_Transmit_DMA(&hi2c1, SSD1306_ADDRESS << 1, oled.tx, sending) != HAL_OK) {
+    oled_stats.errors++;
+    oled_stats.present = 0;
+    busy = 0;
+  }
+}
+
+/** Starts sending the pages drawn since the last flush, unless the last
+ * flush is still going, in which case it sends them as it gets to them.
+ * Call from the main loop, after drawing.
+ */
+void display_flush(void) {
+  if (busy) {
+    return;
+  }
+  if (!oled_stats.present) {
+    if ((int32_t)(HAL_GetTick() - retry_tick) < 0) {
+      return;
+    }
+    retry_tick = HAL_GetTick() + DISPLAY_RETRY_MS;
+    // It may have been powered up since, or never have been set up
+    ssd1306_reset(&oled);
+  }
+  busy_since = timestamp_now();
+  send_next();
+}
+
+void display_reset_stats(void) {
+  oled_stats.transfers = 0;
+  oled_stats.bytes = 0;
+  oled_stats.errors = 0;
+  oled_stats.busy_max_us = 0;
+  ssd1306_reset_stats(&oled);
+}
+
+// HAL I2C callbacks /////////////////////////////////////////////////////////
+
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c) {
+  if (hi2c != &hi2c1) {
+    return;
+  }
+  oled_stats.transfers++;
+  oled_stats.bytes += sending;
+  oled_stats.present = 1;
+  send_next();
+}
+
+/** Not acknowledged (no display at the address), or a bus error: the
+ * HAL has stopped the transfer. It is tried again in a while.
+ */
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+  if (hi2c != &hi2c1) {
+    return;
+  }
+  oled_stats.errors++;
+  oled_stats.present = 0;
+  busy = 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * dlog.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Deferred binary log. See dlog.h.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include "main.h"
+#include "dlog.h"
+#include "timestamp.h"
+
+FAST_BSS dlog_ring dlog;
+
+void dlog_init(void) {
+  dlog.head = 0;
+  dlog.tail = 0;
+  dlog.drops = 0;
+}
+
+/** Use DLOG() rather than calling this directly. Safe at any
+ * interrupt priority; drops the entry if the ring is full.
+ */
+void dlog_write(const char *fmt, uint32_t nargs, ...) {
+  va_list ap;
+  uint32_t primask = __get_PRIMASK();
+
+  if (nargs > DLOG_MAX_ARGS) {
+    nargs = DLOG_MAX_ARGS;
+  }
+
+  // Claiming and filling the entry in one go keeps dlog_process() from
+  // ever seeing a half written one
+  va_start(ap, nargs);
+  __disable_irq();
+  uint32_t head = dlog.head;
+  if (head - dlog.tail >= DLOG_SIZE) {
+    dlog.drops++;
+  } else {
+    dlog_entry *e = &dlog.entries[head & (DLOG_SIZE - 1)];
+    e->fmt = fmt;
+    e->timestamp = timestamp_now();
+    e->nargs = nargs;
+    for (uint32_t i = 0; i < nargs; i++) {
+      e->args[i] = va_arg(ap, uintptr_t);
+    }
+    dlog.head = head + 1;
+  }
+  __set_PRIMASK(primask);
+  va_end(ap);
+}
+
+/** Formats and outputs up to max_entries logged entries, oldest first.
+ * Call from the main loop only. Returns how many were output.
+ */
+uint32_t dlog_process(dlog_output_fn out, uint32_t max_entries) {
+  char text[128];
+  uint32_t done = 0;
+
+  while (done < max_entries && dlog.tail != dlog.head) {
+    // Loggers never touch an entry until tail passes it
+    __DMB();
+    const dlog_entry *e = &dlog.entries[dlog.tail & (DLOG_SIZE - 1)];
+    // Unused arguments are harmless to snprintf
+    int l = snprintf(text, sizeof(text) - 1, e->fmt,
+                     e->args[0], e->args[1], e->args[2], e->args[3]);
+    __DMB();
+    dlog.tail++;
+
+    if (l > (int)sizeof(text) - 1) {
+      l = sizeof(text) - 1;
+    }
+    if (l > 0) {
+      out(text, l);
+    }
+    done++;
+  }
+  return done;
+}
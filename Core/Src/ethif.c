@@ -0,0 +1,268 @@
+/*
+ * ethif.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * The Ethernet MAC as a net_if, with an RTP-MIDI session. See ethif.h.
+ *
+ * The HAL driver's receive & transmit calls are made only from PendSV,
+ * and only while the MAC is started; the main loop starts & stops it,
+ * which PendSV cannot interrupt halfway as it only preempts the main
+ * loop. The ETH interrupt itself only requests DEFER_NET.
+ *
+ * Buffers: one pool (pktbuf.h) for both ways, in SRAM2, where the
+ * DMA does not contend with the CPU for SRAM1. Each receive descriptor
+ * owns one, which is handed to net_input() and then released, unless
+ * a handler held it; the descriptor gets a new one as the driver takes
+ * the frame, so a handler keeping a frame never stalls reception,
+ * while the pool lasts. Frames are built in a buffer from the pool and
+ * released when the DMA has sent them. Nothing is copied.
+ *
+ * The buffers are a multiple of a cache line long & aligned to one,
+ * ready for the D-cache, though it is off for now so the DMA and the
+ * CPU see the same memory.
+ */
+
+#include "main.h"
+#include "ethif.h"
+#include "pktbuf.h"
+#include "deferred.h"
+#include "timestamp.h"
+
+// From main.c
+extern ETH_HandleTypeDef heth;
+extern ETH_TxPacketConfig TxConfig;
+
+// LAN8742A, at address 0 on the Nucleo (UM1974 section 6.12)
+#define LAN8742_ADDRESS       0
+#define LAN8742_BSR           1      // Basic Status Register
+#define LAN8742_BSR_LINK      0x0004
+#define LAN8742_SCSR          31     // PHY Special Control/Status Register
+#define LAN8742_SCSR_SPEED    0x001C // Speed indication, as negotiated
+#define LAN8742_SCSR_100      0x0008
+#define LAN8742_SCSR_FULL     0x0010
+
+#define BUFFER_SIZE 1536 // heth.Init.RxBuffLen (1524), rounded up to a cache line
+// As many as fit in SRAM2 with the descriptors
+#define BUFFERS     10
+
+// Placed in SRAM2 by the linker script
+static uint8_t buffers[BUFFERS][BUFFER_SIZE] __attribute__((section(".eth_buffers"), aligned(32)));
+
+net_if eth_net;
+rtpmidi eth_session;
+ethif_stats eth_stats;
+pktbuf_pool eth_pool;
+
+static uint16_t rx_length; // Of the frame being received, 0 to drop it
+
+// The pool is used by PendSV only while the MAC is started, and by
+// the main loop only while it starts it
+static volatile uint8_t mac_started;
+static volatile uint8_t poll_due;
+
+// net_driver ////////////////////////////////////////////////////////////////
+
+static uint8_t *eth_tx_alloc(void *ctx) {
+  uint8_t *buff;
+
+  (void)ctx;
+  if (!mac_started) {
+    // No link: nothing to send on
+    return NULL;
+  }
+  buff = pktbuf_alloc(&eth_pool);
+  if (buff == NULL) {
+    // Take back those the DMA has sent since
+    HAL_ETH_ReleaseTxPacket(&heth);
+    buff = pktbuf_alloc(&eth_pool);
+  }
+  return buff;
+}
+
+static void eth_tx_send(void *ctx, uint8_t *frame, size_t len) {
+  ETH_BufferTypeDef buffer = { .buffer = frame, .len = len, .next = NULL };
+
+  (void)ctx;
+  TxConfig.Length = len;
+  TxConfig.TxBuffer = &buffer;
+  TxConfig.pData = frame;
+  if (HAL_ETH_Transmit_IT(&heth, &TxConfig) != HAL_OK) {
+    eth_stats.tx_starved++;
+    pktbuf_release(&eth_pool, frame);
+    return;
+  }
+  eth_stats.tx_frames++;
+}
+
+static int eth_rx_hold(void *ctx, const uint8_t *p) {
+  (void)ctx;
+  return pktbuf_ref(&eth_pool, p);
+}
+
+static void eth_rx_release(void *ctx, const uint8_t *p) {
+  (void)ctx;
+  pktbuf_release(&eth_pool, p);
+}
+
+// HAL ETH callbacks /////////////////////////////////////////////////////////
+
+/** A buffer for a receive descriptor, from HAL_ETH_Start_IT() or
+ * HAL_ETH_ReadData(); NULL leaves the descriptor for the next call.
+ */
+void HAL_ETH_RxAllocateCallback(uint8_t **buff) {
+  *buff = pktbuf_alloc(&eth_pool);
+  if (*buff == NULL) {
+    eth_stats.rx_unbuffered++;
+  }
+}
+
+/** Each buffer of a frame received, from HAL_ETH_ReadData(). Frames
+ * fit one buffer, so a second means one too long for us: its buffers
+ * after the first are freed here, that one by ethif_service().
+ */
+void HAL_ETH_RxLinkCallback(void **pStart, void **pEnd, uint8_t *buff, uint16_t Length) {
+  if (*pStart == NULL) {
+    *pStart = buff;
+    *pEnd = buff;
+    // Less the FCS
+    rx_length = Length > 4 ? Length - 4 : 0;
+  } else {
+    pktbuf_release(&eth_pool, buff);
+    rx_length = 0;
+  }
+}
+
+void HAL_ETH_TxFreeCallback(uint32_t *buff) {
+  pktbuf_release(&eth_pool, (uint8_t *)buff);
+}
+
+void HAL_ETH_RxCpltCallback(ETH_HandleTypeDef *h) {
+  (void)h;
+  deferred_post(DEFER_NET);
+}
+
+void HAL_ETH_TxCpltCallback(ETH_HandleTypeDef *h) {
+  (void)h;
+  deferred_post(DEFER_NET);
+}
+
+void HAL_ETH_ErrorCallback(ETH_HandleTypeDef *h) {
+  if (h->DMAErrorCode & ETH_DMASR_RBUS) {
+    // The DMA found no descriptor with a buffer: refill them
+    eth_stats.rx_starved++;
+    deferred_post(DEFER_NET);
+  } else {
+    eth_stats.dma_errors++;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/** Sets up the network interface & session and the ETH interrupt; the
+ * MAC starts once the link is up. Call after MX_ETH_Init().
+ */
+void ethif_init(uint8_t port, rtpmidi_message_fn deliver, void *ctx) {
+  net_driver driver = {
+      .tx_alloc = eth_tx_alloc,
+      .tx_send = eth_tx_send,
+      .rx_hold = eth_rx_hold,
+      .rx_release = eth_rx_release,
+      .ctx = NULL,
+      .checksum_offload = 1,
+  };
+
+  pktbuf_init(&eth_pool, buffers[0], BUFFER_SIZE, BUFFERS);
+  net_init(&eth_net, heth.Init.MACAddr, ETHIF_IP, ETHIF_NETMASK, ETHIF_GATEWAY, &driver);
+  rtpmidi_init(&eth_session, &eth_net, RTPMIDI_CONTROL_PORT, ETHIF_NAME,
+               HAL_GetUIDw0() ^ HAL_GetUIDw1() ^ HAL_GetUIDw2(), port, deliver, ctx,
+               timestamp_now());
+  rtpmidi_bind(&eth_session);
+
+  HAL_NVIC_SetPriority(ETH_IRQn, PRIO_ISR_ETH, 0);
+  HAL_NVIC_EnableIRQ(ETH_IRQn);
+}
+
+/** Follows the PHY's link, starting & stopping the MAC, and has the
+ * session's timers run. Call from the main loop every ETHIF_POLL_MS:
+ * each MDIO read takes some 30 us.
+ */
+void ethif_poll(void) {
+  ETH_MACConfigTypeDef config;
+  uint32_t bsr;
+  uint32_t scsr;
+
+  // Twice, as the link bit latches low
+  if (HAL_ETH_ReadPHYRegister(&heth, LAN8742_ADDRESS, LAN8742_BSR, &bsr) != HAL_OK ||
+      HAL_ETH_ReadPHYRegister(&heth, LAN8742_ADDRESS, LAN8742_BSR, &bsr) != HAL_OK) {
+    return;
+  }
+  if ((bsr & LAN8742_BSR_LINK) && !mac_started) {
+    if (HAL_ETH_ReadPHYRegister(&heth, LAN8742_ADDRESS, LAN8742_SCSR, &scsr) != HAL_OK) {
+      return;
+    }
+    eth_stats.speed_100 = (scsr & LAN8742_SCSR_100) != 0;
+    eth_stats.full_duplex = (scsr & LAN8742_SCSR_FULL) != 0;
+    HAL_ETH_GetMACConfig(&heth, &config);
+    config.Speed = eth_stats.speed_100 ? ETH_SPEED_100M : ETH_SPEED_10M;
+    config.DuplexMode = eth_stats.full_duplex ? ETH_FULLDUPLEX_MODE : ETH_HALFDUPLEX_MODE;
+    HAL_ETH_SetMACConfig(&heth, &config);
+    if (HAL_ETH_Start_IT(&heth) == HAL_OK) {
+      mac_started = 1;
+      eth_stats.link_up = 1;
+      eth_stats.link_changes++;
+    }
+  } else if (!(bsr & LAN8742_BSR_LINK) && mac_started) {
+    mac_started = 0;
+    HAL_ETH_Stop_IT(&heth);
+    eth_stats.link_up = 0;
+    eth_stats.link_changes++;
+  }
+
+  poll_due = 1;
+  deferred_post(DEFER_NET);
+}
+
+/** Hands each frame received to the network interface, releasing its
+ * buffer after (its descriptor already has another), takes back the
+ * buffers of those sent, and sends what the session has to.
+ * Runs in PendSV, as DEFER_NET.
+ */
+void ethif_service(uint32_t now) {
+  void *frame;
+
+  if (mac_started) {
+    HAL_ETH_ReleaseTxPacket(&heth);
+    while (HAL_ETH_ReadData(&heth, &frame) == HAL_OK) {
+      if (rx_length > 0) {
+        eth_stats.rx_frames++;
+        net_input(&eth_net, frame, rx_length, now);
+      } else {
+        eth_stats.rx_dropped++;
+      }
+      pktbuf_release(&eth_pool, frame);
+    }
+  }
+  if (poll_due) {
+    poll_due = 0;
+    rtpmidi_poll(&eth_session, now);
+  }
+  rtpmidi_flush(&eth_session, now);
+}
+
+void ethif_reset_stats(void) {
+  eth_stats.link_changes = 0;
+  eth_stats.rx_frames = 0;
+  eth_stats.rx_dropped = 0;
+  eth_stats.rx_unbuffered = 0;
+  eth_stats.rx_starved = 0;
+  eth_stats.tx_frames = 0;
+  eth_stats.tx_starved = 0;
+  eth_stats.dma_errors = 0;
+  pktbuf_reset_stats(&eth_pool);
+  net_reset_stats(&eth_net);
+  rtpmidi_reset_stats(&eth_session);
+}
@@ -0,0 +1,148 @@
+/*
+ * events.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Interrupt-to-main-loop event flags, with WFI idling, event latency
+ * and CPU idle time measurement. See events.h.
+ *
+ * Timing uses the DWT cycle counter, which prof_init() turns on.
+ *
+ * References:
+ * - Arm v7-M Architecture Reference Manual B1.5.19: WFI wakes on a
+ *   pending interrupt even while PRIMASK masks it, which is what
+ *   makes the check-then-sleep in events_wait() race free.
+ */
+
+#include "main.h"
+#include "events.h"
+
+const char *const event_names[EV_NUM] = {
+    "serial_rx",
+    "midi_msg",
+    "tick",
+};
+
+FAST_BSS static volatile uint32_t pending;
+// DWT cycle count when each event was first posted (while not pending)
+FAST_BSS static uint32_t post_time[EV_NUM];
+FAST_BSS event_latency event_latencies[EV_NUM];
+
+// Idle time accounting
+FAST_BSS static uint32_t idle_cycles;
+FAST_BSS static uint32_t window_start;
+FAST_BSS static uint32_t idle_permille;
+
+void events_init(void) {
+  pending = 0;
+  events_reset_stats();
+  // Keep the debugger connected while we sleep in WFI
+  HAL_DBGMCU_EnableDBGSleepMode();
+}
+
+void events_reset_stats(void) {
+  for (int i = 0; i < EV_NUM; i++) {
+    event_latencies[i].count = 0;
+    event_latencies[i].last = 0;
+    event_latencies[i].max = 0;
+    event_latencies[i].total = 0;
+  }
+  idle_cycles = 0;
+  idle_permille = 0;
+  window_start = DWT->CYCCNT;
+}
+
+/** Marks the events as pending. Safe to call from any interrupt priority. */
+void event_post(uint32_t events) {
+  uint32_t primask = __get_PRIMASK();
+  uint32_t now = DWT->CYCCNT;
+
+  __disable_irq();
+  uint32_t newly = events & ~pending;
+  pending |= events;
+  for (int i = 0; newly != 0; i++, newly >>= 1) {
+    if (newly & 1) {
+      post_time[i] = now;
+    }
+  }
+  __set_PRIMASK(primask);
+}
+
+/** Updates the latency statistics for events just taken. */
+static void record_latencies(uint32_t taken) {
+  uint32_t now = DWT->CYCCNT;
+  uint32_t t = taken;
+  for (int i = 0; t != 0; i++, t >>= 1) {
+    if (t & 1) {
+      event_latency *el = &event_latencies[i];
+      uint32_t latency = now - post_time[i];
+      el->count++;
+      el->last = latency;
+      el->total += latency;
+      if (latency > el->max) el->max = latency;
+    }
+  }
+}
+
+/** Returns (and clears) all pending events without waiting. */
+uint32_t events_take(void) {
+  uint32_t taken;
+
+  if (pending == 0) {
+    return 0;
+  }
+
+  __disable_irq();
+  taken = pending;
+  pending = 0;
+  __enable_irq();
+
+  record_latencies(taken);
+  return taken;
+}
+
+/** Returns (and clears) all pending events, sleeping until there
+ * is at least one.
+ */
+uint32_t events_wait(void) {
+  uint32_t taken;
+  uint32_t t0;
+
+  __disable_irq();
+  while (pending == 0) {
+    t0 = DWT->CYCCNT;
+    __WFI();
+    idle_cycles += DWT->CYCCNT - t0;
+    // Let the waking interrupt run, then check again
+    __enable_irq();
+    __disable_irq();
+  }
+  taken = pending;
+  pending = 0;
+  __enable_irq();
+
+  record_latencies(taken);
+  return taken;
+}
+
+/** Closes the current idle measurement window and starts a new one.
+ * Call periodically (e.g., every second).
+ */
+void events_idle_update(void) {
+  uint32_t now = DWT->CYCCNT;
+  uint32_t elapsed = now - window_start;
+
+  if (elapsed > 0) {
+    idle_permille = (uint32_t)((uint64_t)idle_cycles * 1000 / elapsed);
+  }
+  idle_cycles = 0;
+  window_start = now;
+}
+
+/** CPU time spent sleeping in the last window, in tenths of a percent. */
+uint32_t events_idle_permille(void) {
+  return idle_permille;
+}
@@ -0,0 +1,493 @@
+/*
+ * kvstore.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Log-structured key/value store in NOR flash. See kvstore.h.
+ */
+
+#include <string.h>
+#include "kvstore.h"
+
+#define BLANK        0xFFFFFFFFU
+#define AREA_MAGIC   0x4B565331U // "KVS1"
+#define RECORD_MAGIC 0xA5U       // Top byte of a record's first word
+#define HEADER_WORDS 3           // Magic, generation & its CRC
+
+// What the writing is doing
+#define PHASE_IDLE    0
+#define PHASE_FORMAT  1 // Writing the first area's header
+#define PHASE_RECORD  2 // Writing a value
+#define PHASE_COPY    3 // Compacting: copying records to the spare area
+#define PHASE_COMMIT  4 // Compacting: writing its header
+
+#define OP_NONE    0
+#define OP_PROGRAM 1
+#define OP_ERASE   2
+
+/** CRC-32 (IEEE 802.3, reflected), a nibble at a time. */
+static uint32_t crc32(uint32_t crc, const void *data, size_t len) {
+  static const uint32_t table[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+  };
+  const uint8_t *p = data;
+
+  crc = ~crc;
+  while (len-- > 0) {
+    crc ^= *p++;
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+static uint32_t area_base(const kvstore *s, int area) {
+  return (uint32_t)area * s->flash->area_size;
+}
+
+/** A word of the flash, at an offset from its base. */
+static uint32_t flash_word(const kvstore *s, uint32_t at) {
+  return *(const volatile uint32_t *)(s->flash->base + at);
+}
+
+/** The generation of an area with a valid header, else 0. */
+static uint32_t area_generation(const kvstore *s, int area) {
+  uint32_t at = area_base(s, area);
+  uint32_t generation = flash_word(s, at + 4);
+
+  if (flash_word(s, at) != AREA_MAGIC || flash_word(s, at + 8) != crc32(0, &generation, 4)) {
+    return 0;
+  }
+  return generation;
+}
+
+static int area_blank(const kvstore *s, int area) {
+  uint32_t at = area_base(s, area);
+
+  for (uint32_t i = 0; i < s->flash->area_size; i += 4) {
+    if (flash_word(s, at + i) != BLANK) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/** The words of a valid record at an offset from the flash's base,
+ * or 0 if there is none there.
+ */
+static uint32_t record_words(const kvstore *s, uint32_t at, uint32_t end) {
+  uint32_t head = flash_word(s, at);
+  uint32_t words = 2 + (((head >> 16) & 0xFF) + 3) / 4;
+  uint32_t crc = 0;
+
+  if ((head >> 24) != RECORD_MAGIC || words * 4 > end - at) {
+    return 0;
+  }
+  for (uint32_t i = 0; i < words - 1; i++) {
+    uint32_t w = flash_word(s, at + i * 4);
+    crc = crc32(crc, &w, 4);
+  }
+  return flash_word(s, at + (words - 1) * 4) == crc ? words : 0;
+}
+
+/** Indexes the records of the active area, the latest of each key
+ * last, and finds where to append: after the last word written.
+ */
+static void scan(kvstore *s) {
+  uint32_t at = area_base(s, s->active);
+  uint32_t end = at + s->flash->area_size;
+  uint32_t pos = at + HEADER_WORDS * 4;
+  uint32_t used = pos;
+
+  while (pos < end) {
+    uint32_t head = flash_word(s, pos);
+    uint32_t words;
+
+    if (head == BLANK) {
+      pos += 4;
+      continue;
+    }
+    words = record_words(s, pos, end);
+    if (words == 0) {
+      s->torn_words++;
+      pos += 4;
+    } else {
+      uint16_t key = head & 0xFFFF;
+      // Those of other sizes are stepped over, & lost when compacted
+      if (key < KVSTORE_MAX_KEYS && ((head >> 16) & 0xFF) <= KVSTORE_MAX_VALUE) {
+        s->index[key].offset = pos - at;
+      }
+      pos += words * 4;
+    }
+    used = pos;
+  }
+  s->write_pos = used - at;
+}
+
+/** Reads the store from the flash: finds the active area & indexes
+ * it, and which areas need erasing. Returns 0 if the flash will not do.
+ * The writing starts with kvstore_poll().
+ */
+int kvstore_mount(kvstore *s, const kvstore_flash *flash) {
+  uint32_t generation[KVSTORE_AREAS];
+
+  memset(s, 0, sizeof(*s));
+  s->flash = flash;
+  s->active = -1;
+  s->image_slot = -1;
+  for (int k = 0; k < KVSTORE_MAX_KEYS; k++) {
+    s->index[k].pending = -1;
+  }
+  if (flash->area_size < KVSTORE_AREA_MIN || flash->area_size % 4 != 0) {
+    return 0;
+  }
+
+  for (int a = 0; a < KVSTORE_AREAS; a++) {
+    generation[a] = area_generation(s, a);
+    if (generation[a] != 0 &&
+        (s->active < 0 || (int32_t)(generation[a] - generation[s->active]) > 0)) {
+      s->active = (int8_t)a;
+    }
+  }
+  for (int a = 0; a < KVSTORE_AREAS; a++) {
+    if (a != s->active && !area_blank(s, a)) {
+      s->dirty |= 1 << a;
+    }
+  }
+  if (s->active >= 0) {
+    s->generation = generation[s->active];
+    scan(s);
+  }
+  return 1;
+}
+
+/** Copies a key's value into value, as much as fits in size, and
+ * returns its length: 0 if it has none.
+ */
+size_t kvstore_get(const kvstore *s, uint16_t key, void *value, size_t size) {
+  const kvstore_entry *e;
+  const uint8_t *data;
+  size_t len;
+
+  if (key >= KVSTORE_MAX_KEYS) {
+    return 0;
+  }
+  e = &s->index[key];
+  if (e->pending >= 0) {
+    len = s->pending[e->pending].len;
+    data = s->pending[e->pending].value;
+  } else if (e->offset != 0) {
+    uint32_t at = area_base(s, s->active) + e->offset;
+    len = (flash_word(s, at) >> 16) & 0xFF;
+    data = s->flash->base + at + 4;
+  } else {
+    return 0;
+  }
+  if (len > 0 && size > 0) {
+    memcpy(value, data, len < size ? len : size);
+  }
+  return len;
+}
+
+/** Sets a key's value, or with a len of 0 erases it. The value is
+ * written later, by kvstore_poll(); setting it again before then
+ * replaces it, and setting what it already is does nothing. Returns 0
+ * if the key or length is out of range, or too many values are
+ * waiting to be written.
+ */
+int kvstore_set(kvstore *s, uint16_t key, const void *value, size_t len) {
+  uint8_t current[KVSTORE_MAX_VALUE];
+  kvstore_entry *e;
+  kvstore_slot *slot = NULL;
+
+  if (key >= KVSTORE_MAX_KEYS || len > KVSTORE_MAX_VALUE) {
+    return 0;
+  }
+  if (kvstore_get(s, key, current, sizeof(current)) == len &&
+      (len == 0 || memcmp(current, value, len) == 0)) {
+    return 1;
+  }
+
+  e = &s->index[key];
+  if (e->pending >= 0 && s->pending[e->pending].state == KVSTORE_SLOT_QUEUED) {
+    slot = &s->pending[e->pending];
+  } else {
+    // Any being written is older, & stays so
+    for (int i = 0; i < KVSTORE_PENDING; i++) {
+      if (s->pending[i].state == KVSTORE_SLOT_FREE) {
+        slot = &s->pending[i];
+        e->pending = (int8_t)i;
+        break;
+      }
+    }
+    if (slot == NULL) {
+      return 0;
+    }
+  }
+  slot->state = KVSTORE_SLOT_QUEUED;
+  slot->key = key;
+  slot->len = (uint8_t)len;
+  if (len > 0) {
+    memcpy(slot->value, value, len);
+  }
+  return 1;
+}
+
+/** Whether everything set has been written. An area may still wait
+ * to be erased (dirty).
+ */
+int kvstore_idle(const kvstore *s) {
+  if (s->op != OP_NONE || s->phase != PHASE_IDLE || s->active < 0) {
+    return 0;
+  }
+  for (int i = 0; i < KVSTORE_PENDING; i++) {
+    if (s->pending[i].state != KVSTORE_SLOT_FREE) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Writing ///////////////////////////////////////////////////////////////////
+
+/** Starts programming the next word of the image: all but the first in
+ * order, then the first, which makes it valid. Returns 0 if it could
+ * not be started.
+ */
+static int program_next(kvstore *s) {
+  uint8_t i = (uint8_t)((s->image_done + 1) % s->image_words);
+
+  if (!s->flash->program(s->flash->ctx, s->image_at + i * 4u, s->image[i])) {
+    return 0;
+  }
+  s->op = OP_PROGRAM;
+  return 1;
+}
+
+static void image_failed(kvstore *s);
+
+static void start_image(kvstore *s, uint32_t at, uint8_t words) {
+  s->image_at = at;
+  s->image_words = words;
+  s->image_done = 0;
+  if (!program_next(s)) {
+    image_failed(s);
+  }
+}
+
+/** Makes the header of an area of a generation into the image. */
+static void start_header(kvstore *s, int area, uint32_t generation) {
+  s->image[0] = AREA_MAGIC;
+  s->image[1] = generation;
+  s->image[2] = crc32(0, &generation, 4);
+  start_image(s, area_base(s, area), HEADER_WORDS);
+}
+
+/** Starts copying the next live record to the spare area, or when
+ * there are no more, its header.
+ */
+static void copy_next(kvstore *s) {
+  int spare = 1 - s->active;
+
+  for (; s->copy_key < KVSTORE_MAX_KEYS; s->copy_key++) {
+    uint32_t at = area_base(s, s->active) + s->index[s->copy_key].offset;
+    uint32_t words;
+
+    // Erased keys go no further
+    if (s->index[s->copy_key].offset == 0 || ((flash_word(s, at) >> 16) & 0xFF) == 0) {
+      continue;
+    }
+    words = 2 + (((flash_word(s, at) >> 16) & 0xFF) + 3) / 4;
+    for (uint32_t i = 0; i < words; i++) {
+      s->image[i] = flash_word(s, at + i * 4);
+    }
+    start_image(s, area_base(s, spare) + s->copy_pos, (uint8_t)words);
+    return;
+  }
+  s->phase = PHASE_COMMIT;
+  start_header(s, spare, s->generation + 1);
+}
+
+/** A record, area header or copy is all programmed & read back. */
+static void image_written(kvstore *s) {
+  uint32_t bytes = s->image_words * 4u;
+  int spare = 1 - s->active;
+
+  s->image_words = 0;
+  switch (s->phase) {
+  case PHASE_FORMAT:
+    s->active = (int8_t)(s->image_at / s->flash->area_size);
+    s->generation = s->image[1];
+    s->write_pos = HEADER_WORDS * 4;
+    s->phase = PHASE_IDLE;
+    break;
+  case PHASE_RECORD: {
+    kvstore_slot *slot = &s->pending[s->image_slot];
+    kvstore_entry *e = &s->index[slot->key];
+    e->offset = s->write_pos;
+    if (e->pending == s->image_slot) {
+      e->pending = -1;
+    }
+    slot->state = KVSTORE_SLOT_FREE;
+    s->image_slot = -1;
+    s->write_pos += bytes;
+    s->records++;
+    s->phase = PHASE_IDLE;
+    break;
+  }
+  case PHASE_COPY:
+    s->moved[s->copy_key++] = s->copy_pos;
+    s->copy_pos += bytes;
+    break;
+  case PHASE_COMMIT:
+    for (int k = 0; k < KVSTORE_MAX_KEYS; k++) {
+      s->index[k].offset = s->moved[k];
+    }
+    s->dirty |= 1 << s->active;
+    s->active = (int8_t)spare;
+    s->generation++;
+    s->write_pos = s->copy_pos;
+    s->compactions++;
+    s->phase = PHASE_IDLE;
+    break;
+  }
+}
+
+/** A word did not program, or would not start: what was being written
+ * is abandoned, its words left to be stepped over or erased.
+ */
+static void image_failed(kvstore *s) {
+  uint32_t bytes = s->image_words * 4u;
+
+  s->errors++;
+  s->image_words = 0;
+  switch (s->phase) {
+  case PHASE_RECORD: {
+    kvstore_slot *slot = &s->pending[s->image_slot];
+    // Tried again further on, unless set again since
+    slot->state = s->index[slot->key].pending == s->image_slot ? KVSTORE_SLOT_QUEUED
+                                                               : KVSTORE_SLOT_FREE;
+    s->image_slot = -1;
+    s->write_pos = s->image_at - area_base(s, s->active) + bytes;
+    break;
+  }
+  case PHASE_FORMAT:
+    s->dirty |= 1 << (s->image_at / s->flash->area_size);
+    break;
+  case PHASE_COPY:
+  case PHASE_COMMIT:
+    s->dirty |= 1 << (1 - s->active);
+    break;
+  }
+  s->phase = PHASE_IDLE;
+}
+
+/** Starts the next piece of work, when nothing is being written. */
+static void start_next(kvstore *s, int may_erase) {
+  kvstore_slot *slot = NULL;
+  uint8_t words;
+
+  if (s->dirty != 0 && may_erase) {
+    int area = s->dirty & 1 ? 0 : 1;
+    if (s->flash->erase(s->flash->ctx, area)) {
+      s->op = OP_ERASE;
+      s->erasing = (uint8_t)area;
+    } else {
+      s->errors++;
+    }
+    return;
+  }
+  if (s->active < 0) {
+    for (int a = 0; a < KVSTORE_AREAS; a++) {
+      if (!(s->dirty & (1 << a))) {
+        s->phase = PHASE_FORMAT;
+        start_header(s, a, 1);
+        return;
+      }
+    }
+    return;
+  }
+
+  for (int i = 0; i < KVSTORE_PENDING && slot == NULL; i++) {
+    if (s->pending[i].state == KVSTORE_SLOT_QUEUED) {
+      slot = &s->pending[i];
+      s->image_slot = (int8_t)i;
+    }
+  }
+  if (slot == NULL) {
+    return;
+  }
+  words = (uint8_t)(2 + (slot->len + 3) / 4);
+  if (s->write_pos + words * 4u > s->flash->area_size) {
+    // Full: compact into the other area, once it is erased
+    s->image_slot = -1;
+    if (!(s->dirty & (1 << (1 - s->active)))) {
+      s->phase = PHASE_COPY;
+      s->copy_key = 0;
+      s->copy_pos = HEADER_WORDS * 4;
+      memset(s->moved, 0, sizeof(s->moved));
+      copy_next(s);
+    }
+    return;
+  }
+
+  memset(s->image, 0xFF, words * 4u);
+  s->image[0] = ((uint32_t)RECORD_MAGIC << 24) | ((uint32_t)slot->len << 16) | slot->key;
+  if (slot->len > 0) {
+    memcpy(&s->image[1], slot->value, slot->len);
+  }
+  s->image[words - 1] = crc32(0, s->image, (words - 1) * 4u);
+  slot->state = KVSTORE_SLOT_WRITING;
+  s->phase = PHASE_RECORD;
+  start_image(s, area_base(s, s->active) + s->write_pos, words);
+}
+
+/** Does the next step of writing: sees to the flash operation under
+ * way, if any, and once it is done starts another. Erases are only
+ * started if may_erase. Call often; it does not wait.
+ */
+void kvstore_poll(kvstore *s, int may_erase) {
+  if (s->op != OP_NONE) {
+    int status = s->flash->status(s->flash->ctx);
+
+    if (status == KVSTORE_FLASH_BUSY) {
+      return;
+    }
+    if (s->op == OP_ERASE) {
+      s->op = OP_NONE;
+      // Taken as blank: a word that is not fails to program, & sends
+      // the area back to be erased again
+      if (status == KVSTORE_FLASH_DONE) {
+        s->dirty &= ~(1 << s->erasing);
+        s->erases++;
+      } else {
+        s->errors++;
+      }
+    } else {
+      uint8_t i = (uint8_t)((s->image_done + 1) % s->image_words);
+
+      s->op = OP_NONE;
+      if (status != KVSTORE_FLASH_DONE || flash_word(s, s->image_at + i * 4u) != s->image[i]) {
+        image_failed(s);
+      } else if (++s->image_done == s->image_words) {
+        image_written(s);
+      }
+    }
+  }
+
+  if (s->image_words != 0) {
+    if (!program_next(s)) {
+      image_failed(s);
+    }
+    return;
+  }
+  if (s->phase == PHASE_COPY) {
+    copy_next(s);
+  } else if (s->phase == PHASE_IDLE) {
+    start_next(s, may_erase);
+  }
+}
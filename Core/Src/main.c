@@ -245,7 +245,11 @@ static void MX_ETH_Init(void)
   heth.Init.RxBuffLen = 1524;
 
   /* USER CODE BEGIN MACADDRESS */
-
+  // Unique to each board: ST's OUI and the low bytes of the MCU's
+  // unique ID, as in ST's examples
+  MACAddr[3] = (uint8_t)(HAL_GetUIDw0() >> 16);
+  MACAddr[4] = (uint8_t)(HAL_GetUIDw0() >> 8);
+  MACAddr[5] = (uint8_t)HAL_GetUIDw0();
   /* USER CODE END MACADDRESS */
 
   if (HAL_ETH_Init(&heth) != HAL_OK)
@@ -2,19 +2,19 @@
  * midi.c
  *
  *  Created on: Sep 8, 2024
- *  Updated on: 2024-09-08
+ *  Updated on: 2026-10-19
  *      Author: Douglas P. Fields, Jr.
  *   Copyright: 2024, Douglas P. Fields, Jr.
  *     License: Apache 2.0
  *
  * Parses incoming MIDI messages into a persistent buffer, one
  * byte at a time. Handles running status.
+ * Encodes parsed messages back into bytes, with running status.
  *
  * For notes on MIDI: see MIDI.md
  */
 
 #include <stdint.h>
-#include <stdio.h>
 #include "midi.h"
 
 // These are the frequencies of MIDI notes from
@@ -157,6 +157,8 @@ const uint32_t midi_note_freqX100[] = {
 void midi_stream_init(midi_stream *ms) {
   ms->last_status = 0;
   ms->received_data1 = 0;
+  ms->sysex_len = 0;
+  ms->sysex_overflow = 0;
 }
 
 // FIXME: Fix all these magic numbers
@@ -193,8 +195,10 @@ int midi_stream_receive(midi_stream *ms, uint8_t b, midi_message *msg) {
         return 1;
       }
       switch (b & 0x7) { // So, 0xFn where n = 0 - 7
-      case 0x0: // Start of SysEx - we ignore all data bytes from here
+      case 0x0: // Start of SysEx - we keep the first MIDI_SYSEX_MAX data bytes
         ms->last_status = b;
+        ms->sysex_len = 0;
+        ms->sysex_overflow = 0;
         return 0;
       case 0x1: // MIDI Time Code Quarter Frame - (1 byte)
       case 0x2: // Song Position Pointer - (2 bytes)
@@ -211,7 +215,15 @@ int midi_stream_receive(midi_stream *ms, uint8_t b, midi_message *msg) {
         ms->last_status = MIDI_NONE; // End running status
         msg->type = b;
         return 1;
-      case 0x7: // SysEx EOX (end of eXclusive) - we are ignoring this for now
+      case 0x7: // SysEx EOX (end of eXclusive)
+        if (ms->last_status == MIDI_SYSEX) {
+          // The data bytes are in ms->sysex until the next SysEx starts
+          msg->type = MIDI_SYSEX;
+          msg->data1 = ms->sysex_len;
+          msg->data2 = ms->sysex_overflow;
+          ms->last_status = MIDI_NONE;
+          return 1;
+        }
         ms->last_status = MIDI_NONE;
         return 0;
       }
@@ -273,13 +285,13 @@ int midi_stream_receive(midi_stream *ms, uint8_t b, midi_message *msg) {
     return 0;
 
   case 0xC0: // Program Change (1 byte)
-    msg->type = ms->received_data1;
+    msg->type = ms->last_status;
     msg->channel = ms->last_status & 0x0F;
     msg->program = b;
     return 1;
 
   case 0xD0: // Channel aftertouch (1 byte)
-    msg->type = ms->received_data1;
+    msg->type = ms->last_status;
     msg->channel = ms->last_status & 0x0F;
     msg->pressure = b;
     return 1;
@@ -302,7 +314,12 @@ int midi_stream_receive(midi_stream *ms, uint8_t b, midi_message *msg) {
 
   // System ////////////////////////////////////////////////////////////////////////
 
-  case 0xF0: // SysEx - we're ignoring data in SysEx
+  case 0xF0: // SysEx
+    if (ms->sysex_len < MIDI_SYSEX_MAX) {
+      ms->sysex[ms->sysex_len++] = b;
+    } else {
+      ms->sysex_overflow = 1;
+    }
     return 0;
   case 0xF1: // MIDI Time Code Quarter Frame - (1 byte)
     msg->type = ms->last_status;
@@ -342,6 +359,97 @@ int midi_stream_receive(midi_stream *ms, uint8_t b, midi_message *msg) {
   return 0;
 }
 
+/** Returns the broad kind of a parsed message. */
+midi_class midi_message_class(const midi_message *mm) {
+  if (mm->type < 0x80) {
+    // Channel mode messages have their controller number as their type
+    return MIDI_CLASS_CONTROL;
+  }
+  if (mm->type >= 0xF8) {
+    return MIDI_CLASS_REALTIME;
+  }
+  switch (mm->type & 0xF0) {
+  case 0x80:
+  case 0x90:
+  case 0xA0:
+    return MIDI_CLASS_NOTE;
+  case 0xB0:
+    return MIDI_CLASS_CONTROL;
+  case 0xC0:
+    return MIDI_CLASS_PROGRAM;
+  case 0xD0:
+    return MIDI_CLASS_PRESSURE;
+  case 0xE0:
+    return MIDI_CLASS_PITCH_BEND;
+  }
+  return MIDI_CLASS_SYSTEM;
+}
+
+/** Initializes a MIDI output stream: no running status yet. */
+void midi_encoder_init(midi_encoder *me) {
+  me->last_status = MIDI_NONE;
+}
+
+/** Converts a parsed message back into MIDI bytes, using running status
+ * for channel messages. Puts up to MIDI_MAX_ENCODED bytes into out.
+ * Returns how many, or 0 for messages we cannot send (e.g., SysEx).
+ */
+int midi_encode(midi_encoder *me, const midi_message *mm, uint8_t *out) {
+  uint8_t status;
+  int n = 0;
+
+  if (mm->type >= 0xF8) {
+    // Real-time: one byte, and does not affect running status
+    out[0] = mm->type;
+    return 1;
+  }
+
+  if (mm->type >= 0xF0) {
+    // System common cancels running status
+    me->last_status = MIDI_NONE;
+    out[0] = mm->type;
+    switch (mm->type) {
+    case 0xF1: // MIDI Time Code Quarter Frame
+      out[1] = ((mm->tcqf_message_type & 0x07) << 4) | (mm->tcqf_value & 0x0F);
+      return 2;
+    case 0xF2: // Song Position Pointer
+      out[1] = mm->lsb & 0x7F;
+      out[2] = mm->msb & 0x7F;
+      return 3;
+    case 0xF3: // Song select
+      out[1] = mm->data1 & 0x7F;
+      return 2;
+    case 0xF6: // Tune request
+      return 1;
+    }
+    return 0;
+  }
+
+  if (mm->type >= 0x80) {
+    status = mm->type;
+  } else if (mm->type >= MIDI_MODE_ALL_SOUND_OFF) {
+    // Channel mode message: a control change of controller 120-127
+    status = 0xB0 | (mm->channel & 0x0F);
+  } else {
+    return 0;
+  }
+
+  if (status != me->last_status) {
+    out[n++] = status;
+    me->last_status = status;
+  }
+  if (mm->type < 0x80) {
+    out[n++] = mm->type;
+    out[n++] = mm->data2 & 0x7F;
+    return n;
+  }
+  out[n++] = mm->data1 & 0x7F;
+  if ((status & 0xF0) != 0xC0 && (status & 0xF0) != 0xD0) {
+    out[n++] = mm->data2 & 0x7F;
+  }
+  return n;
+}
+
 // 0-101 inclusive
 const char *cc_names[] = {
     "Bank select",
@@ -405,84 +513,188 @@ const char *cc_names[] = {
 };
 const size_t num_cc_names = sizeof(cc_names) / sizeof(cc_names[0]);
 
-/** Output human readable information about a full MIDI message. */
-int midi_snprintf(char *str, size_t size, midi_message *mm) {
+/*
+ * Allocation-free text output for midi_snprintf(), with the semantics
+ * of snprintf(): output beyond size - 1 characters is dropped, the
+ * result is always terminated (if size > 0), and the length of the
+ * complete output is returned. Much faster than newlib's snprintf()
+ * and with almost no stack.
+ */
+typedef struct {
+  char *str;
+  size_t size;
+  size_t len; // Length of the complete output so far
+} text_out;
+
+// "00" to "99"
+static const char dec_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static inline void out_char(text_out *o, char c) {
+  if (o->len + 1 < o->size) {
+    o->str[o->len] = c;
+  }
+  o->len++;
+}
+
+static void out_str(text_out *o, const char *s) {
+  while (*s) {
+    out_char(o, *s++);
+  }
+}
 
+/** Like %d (of a non-negative value) or %u. */
+static void out_dec(text_out *o, uint32_t v) {
+  char digits[10];
+  int n = 0;
+
+  while (v >= 100) {
+    const char *pair = &dec_pairs[(v % 100) * 2];
+    digits[n++] = pair[1];
+    digits[n++] = pair[0];
+    v /= 100;
+  }
+  if (v >= 10) {
+    digits[n++] = dec_pairs[v * 2 + 1];
+    digits[n++] = dec_pairs[v * 2];
+  } else {
+    digits[n++] = '0' + v;
+  }
+  while (n > 0) {
+    out_char(o, digits[--n]);
+  }
+}
+
+/** Like %02X. */
+static void out_hex2(text_out *o, uint8_t v) {
+  out_char(o, hex_digits[v >> 4]);
+  out_char(o, hex_digits[v & 0x0F]);
+}
+
+static int out_end(text_out *o) {
+  if (o->size > 0) {
+    o->str[o->len < o->size ? o->len : o->size - 1] = '\0';
+  }
+  return (int)o->len;
+}
+
+/** ", Chan: n" or similar: a label then a number. */
+static void out_labeled(text_out *o, const char *label, uint32_t v) {
+  out_str(o, label);
+  out_dec(o, v);
+}
+
+/** Output human readable information about a full MIDI message.
+ * Same as snprintf(), including the return value.
+ */
+int midi_snprintf(char *str, size_t size, midi_message *mm) {
+  text_out o = { str, size, 0 };
   const char *cc_name;
-  char ccn_temp[32];
 
   switch (mm->type & 0xF0) {
   case 0x90:
     if (mm->velocity > 0) {
-      return snprintf(str, size, "Note on: Chan %d, Note: %d, Vel: %d",
-                      mm->channel, mm->note, mm->velocity);
+      out_labeled(&o, "Note on: Chan ", mm->channel);
+      out_labeled(&o, ", Note: ", mm->note);
+      out_labeled(&o, ", Vel: ", mm->velocity);
+      return out_end(&o);
     }
     // Fall through
   case 0x80:
-    return snprintf(str, size, "Note off: Chan %d, Note: %d, Vel: %d",
-                    mm->channel, mm->note, mm->velocity);
+    out_labeled(&o, "Note off: Chan ", mm->channel);
+    out_labeled(&o, ", Note: ", mm->note);
+    out_labeled(&o, ", Vel: ", mm->velocity);
+    return out_end(&o);
   case 0xA0:
-    return snprintf(str, size, "Poly AT: Chan %d, Note: %d, Pres: %d",
-                    mm->channel, mm->note, mm->velocity);
+    out_labeled(&o, "Poly AT: Chan ", mm->channel);
+    out_labeled(&o, ", Note: ", mm->note);
+    out_labeled(&o, ", Pres: ", mm->velocity);
+    return out_end(&o);
 
   case 0xB0:
     if (mm->control >= 120) {
       switch (mm->control) {
       case 120:
-        return snprintf(str, size, "All sound off: Chan %d", mm->channel);
+        out_labeled(&o, "All sound off: Chan ", mm->channel);
+        return out_end(&o);
       case 121:
-        return snprintf(str, size, "Reset all controllers: Chan %d", mm->channel);
+        out_labeled(&o, "Reset all controllers: Chan ", mm->channel);
+        return out_end(&o);
       case 122:
-        return snprintf(str, size, "Local control: %s, Chan %d",
-            mm->cc_value == 0 ? "Off" : "On", mm->channel);
+        out_str(&o, mm->cc_value == 0 ? "Local control: Off" : "Local control: On");
+        out_labeled(&o, ", Chan ", mm->channel);
+        return out_end(&o);
       case 123:
-        return snprintf(str, size, "All notes off: Chan %d", mm->channel);
+        out_labeled(&o, "All notes off: Chan ", mm->channel);
+        return out_end(&o);
       case 124:
-        return snprintf(str, size, "Omni mode: Off: Chan %d", mm->channel);
+        out_labeled(&o, "Omni mode: Off: Chan ", mm->channel);
+        return out_end(&o);
       case 125:
-        return snprintf(str, size, "Omni mode: On, Chan %d", mm->channel);
+        out_labeled(&o, "Omni mode: On, Chan ", mm->channel);
+        return out_end(&o);
       case 126:
         if (mm->cc_value == 0) {
-          return snprintf(str, size, "Mono mode: All voices, Chan: %d", mm->channel);
+          out_labeled(&o, "Mono mode: All voices, Chan: ", mm->channel);
+          return out_end(&o);
         }
-        return snprintf(str, size, "Mono mode: Voices: %d, Chan: %d", mm->cc_value, mm->channel);
+        out_labeled(&o, "Mono mode: Voices: ", mm->cc_value);
+        out_labeled(&o, ", Chan: ", mm->channel);
+        return out_end(&o);
       case 127:
-        return snprintf(str, size, "Poly mode: On, Chan: %d", mm->channel);
+        out_labeled(&o, "Poly mode: On, Chan: ", mm->channel);
+        return out_end(&o);
       }
     }
 
-    // First figure out the channel name
+    // First figure out the controller name
+    out_str(&o, "CC: ");
     if (mm->control >= num_cc_names) {
-      snprintf(ccn_temp, sizeof(ccn_temp) - 1, "CC %d", mm->control);
-      cc_name = ccn_temp;
+      out_labeled(&o, "CC ", mm->control);
     } else if (mm->control >= 32 && mm->control <= 63) {
-      const char *name = cc_names[mm->control - 32];
-      if (name == NULL) {
-        snprintf(ccn_temp, sizeof(ccn_temp) - 1, "CC %d LSB", mm->control - 32);
+      cc_name = cc_names[mm->control - 32];
+      if (cc_name == NULL) {
+        out_labeled(&o, "CC ", mm->control - 32);
       } else {
-        snprintf(ccn_temp, sizeof(ccn_temp) - 1, "%s LSB", name);
+        out_str(&o, cc_name);
       }
-      cc_name = ccn_temp;
+      out_str(&o, " LSB");
     } else if (cc_names[mm->control] == NULL) {
-      snprintf(ccn_temp, sizeof(ccn_temp) - 1, "CC %d", mm->control);
-      cc_name = ccn_temp;
+      out_labeled(&o, "CC ", mm->control);
     } else {
-      cc_name = cc_names[mm->control];
+      out_str(&o, cc_names[mm->control]);
     }
-
-    return snprintf(str, size, "CC: %s, Val: %d, Chan: %d", cc_name, mm->cc_value, mm->channel);
+    out_labeled(&o, ", Val: ", mm->cc_value);
+    out_labeled(&o, ", Chan: ", mm->channel);
+    return out_end(&o);
 
   case 0xC0:
-    return snprintf(str, size, "Program: Chan %d, Prog: %d",
-                    mm->channel, mm->program);
+    out_labeled(&o, "Program: Chan ", mm->channel);
+    out_labeled(&o, ", Prog: ", mm->program);
+    return out_end(&o);
   case 0xD0:
-    return snprintf(str, size, "Chan AT: Chan %d, Pres: %d",
-                    mm->channel, mm->pressure);
+    out_labeled(&o, "Chan AT: Chan ", mm->channel);
+    out_labeled(&o, ", Pres: ", mm->pressure);
+    return out_end(&o);
   case 0xE0:
-    return snprintf(str, size, "Bend: Chan %d, Amt: %d",
-                    mm->channel, MIDI_14bits(mm));
+    out_labeled(&o, "Bend: Chan ", mm->channel);
+    out_labeled(&o, ", Amt: ", MIDI_14bits(mm));
+    return out_end(&o);
   }
 
-  return snprintf(str, size, "MIDI msg: %02X, %d, %d",
-                  mm->type, mm->data1, mm->data2);
+  out_str(&o, "MIDI msg: ");
+  out_hex2(&o, mm->type);
+  out_labeled(&o, ", ", mm->data1);
+  out_labeled(&o, ", ", mm->data2);
+  return out_end(&o);
 }
@@ -0,0 +1,100 @@
+/*
+ * midimerge.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * MIDI merge. See midimerge.h.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midimerge.h"
+
+void midimerge_init(midimerge *m, uint8_t num_sources) {
+  if (num_sources > MIDIMERGE_MAX_SOURCES) {
+    num_sources = MIDIMERGE_MAX_SOURCES;
+  }
+  m->num_sources = num_sources;
+  m->next = 0;
+  m->waiting = 0;
+  for (int s = 0; s < MIDIMERGE_MAX_SOURCES; s++) {
+    m->sources[s].head = 0;
+    m->sources[s].tail = 0;
+  }
+  midi_encoder_init(&m->encoder);
+  midimerge_reset_stats(m);
+}
+
+void midimerge_reset_stats(midimerge *m) {
+  for (int s = 0; s < MIDIMERGE_MAX_SOURCES; s++) {
+    midimerge_source *ms = &m->sources[s];
+    ms->sent = 0;
+    ms->drops = 0;
+    ms->max_depth = 0;
+    ms->max_latency = 0;
+    ms->total_latency = 0;
+  }
+}
+
+/** Queues a (non real-time) message from a source.
+ * Returns 0 if it was dropped as that source's queue is full.
+ */
+int midimerge_push(midimerge *m, uint8_t source, const midi_message *mm, uint32_t now) {
+  midimerge_source *ms;
+  uint32_t depth;
+
+  if (source >= m->num_sources) {
+    return 0;
+  }
+  ms = &m->sources[source];
+  depth = ms->head - ms->tail;
+  if (depth >= MIDIMERGE_QUEUE_SIZE) {
+    ms->drops++;
+    return 0;
+  }
+
+  midimerge_entry *e = &ms->queue[ms->head & (MIDIMERGE_QUEUE_SIZE - 1)];
+  e->msg = *mm;
+  e->queued = now;
+  ms->head++;
+  m->waiting++;
+  if (depth + 1 > ms->max_depth) ms->max_depth = depth + 1;
+  return 1;
+}
+
+/** Takes the next message, round-robin across the sources, and encodes
+ * it into out (at least MIDI_MAX_ENCODED bytes).
+ * Returns the number of bytes, or 0 if nothing is waiting.
+ */
+int midimerge_pull(midimerge *m, uint8_t *out, uint32_t now) {
+  while (m->waiting > 0) {
+    for (uint8_t i = 0; i < m->num_sources; i++) {
+      uint8_t s = (m->next + i) % m->num_sources;
+      midimerge_source *ms = &m->sources[s];
+
+      if (ms->head == ms->tail) {
+        continue;
+      }
+      midimerge_entry *e = &ms->queue[ms->tail & (MIDIMERGE_QUEUE_SIZE - 1)];
+      uint32_t latency = now - e->queued;
+      int n = midi_encode(&m->encoder, &e->msg, out);
+
+      ms->tail++;
+      m->waiting--;
+      m->next = (s + 1) % m->num_sources;
+      if (n == 0) {
+        // Not sendable (e.g., SysEx); try the next
+        ms->drops++;
+        break;
+      }
+      ms->sent++;
+      ms->total_latency += latency;
+      if (latency > ms->max_latency) ms->max_latency = latency;
+      return n;
+    }
+  }
+  return 0;
+}
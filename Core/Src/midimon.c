@@ -0,0 +1,179 @@
+/*
+ * midimon.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * MIDI traffic monitor for a small display. See midimon.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "midimon.h"
+
+#define BAR_TOP    2 // Pages of the bars
+#define BAR_BOTTOM 6
+#define BAR_HEIGHT ((BAR_BOTTOM - BAR_TOP + 1) * 8)
+#define LABELS     7 // Page of the channels
+#define CELL       (SSD1306_WIDTH / MIDIMON_CHANNELS) // Columns a channel
+
+void midimon_init(midimon *m, midimon_port_name_fn port_name) {
+  memset(m, 0, sizeof(*m));
+  m->port_name = port_name;
+}
+
+/** Counts one message routed. Call from one context only. */
+void midimon_message(midimon *m, const midi_message *mm) {
+  uint8_t status = mm->type;
+  uint8_t ch = mm->channel & 0x0F;
+
+  m->messages++;
+  switch (status & 0xF0) {
+  case MIDI_NOTE_ON:
+    if (mm->velocity > 0) {
+      m->velocity[ch] = mm->velocity;
+      m->note_ons[ch]++;
+      if (m->held[ch] < UINT8_MAX) {
+        m->held[ch]++;
+      }
+      break;
+    }
+    // Fall through
+  case MIDI_NOTE_OFF:
+    if (m->held[ch] > 0) {
+      m->held[ch]--;
+    }
+    break;
+  case 0xB0:
+    // All sound off, and all notes off & the mode changes that imply it
+    if (mm->control == MIDI_MODE_ALL_SOUND_OFF || mm->control >= MIDI_MODE_ALL_NOTES_OFF) {
+      m->held[ch] = 0;
+    }
+    break;
+  }
+  // Real time messages would hide the rest
+  if (status < MIDI_RT_TIMING_CLOCK) {
+    m->last = ((uint32_t)mm->port << 24) | ((uint32_t)status << 16) | ((uint32_t)mm->data1 << 8) |
+              mm->data2;
+  }
+}
+
+/** The number of data bytes after a status byte, as they are shown. */
+static int data_bytes(uint8_t status) {
+  switch (status & 0xF0) {
+  case 0xC0:
+  case 0xD0:
+    return 1;
+  case 0xF0:
+    return status == MIDI_TIME_CODE_QF || status == MIDI_SONG_SELECT ? 1
+         : status == MIDI_SONG_POSITION ? 2 : 0;
+  default:
+    return 2;
+  }
+}
+
+/** The last message, as text. */
+static void format_last(const midimon *m, char *text, size_t size) {
+  uint32_t last = m->last;
+  uint8_t status = (uint8_t)(last >> 16);
+  uint8_t data1 = (uint8_t)(last >> 8);
+  uint8_t data2 = (uint8_t)last;
+  const char *port = m->port_name((uint8_t)(last >> 24));
+
+  if (last == 0) {
+    snprintf(text, size, "No MIDI yet");
+  } else if (status == MIDI_SYSEX) {
+    // data1 is its length; see midi_stream
+    snprintf(text, size, "%s F0 SysEx %u", port, data1);
+  } else if (data_bytes(status) == 2) {
+    snprintf(text, size, "%s %02X %02X %02X", port, status, data1, data2);
+  } else if (data_bytes(status) == 1) {
+    snprintf(text, size, "%s %02X %02X", port, status, data1);
+  } else {
+    snprintf(text, size, "%s %02X", port, status);
+  }
+}
+
+/** A page's slice of a bar h pixels high, standing on the bottom. */
+static uint8_t bar_slice(uint8_t page, int h) {
+  int top = BAR_HEIGHT - h;         // First row lit, from the top of the bars
+  int first = (page - BAR_TOP) * 8; // Of the page
+
+  if (top <= first) {
+    return 0xFF;
+  }
+  if (top >= first + 8) {
+    return 0;
+  }
+  return (uint8_t)(0xFF << (top - first));
+}
+
+/** Brings the bars & the message rate up to date, elapsed_ms after the
+ * last time, and draws them all into the display's framebuffer.
+ */
+void midimon_render(midimon *m, ssd1306 *d, uint32_t elapsed_ms) {
+  static const char hex[] = "0123456789ABCDEF";
+  uint8_t columns[SSD1306_WIDTH];
+  char text[SSD1306_TEXT_COLUMNS + 1];
+  uint32_t fall = elapsed_ms * (127 << 8) / MIDIMON_FALL_MS;
+  uint8_t heights[MIDIMON_CHANNELS];
+  unsigned held = 0;
+
+  m->rate_ms += elapsed_ms;
+  if (m->rate_ms >= MIDIMON_RATE_MS) {
+    uint32_t messages = m->messages;
+    m->rate = (uint32_t)((uint64_t)(messages - m->rate_messages) * 1000 / m->rate_ms);
+    m->rate_messages = messages;
+    m->rate_ms = 0;
+  }
+
+  for (int ch = 0; ch < MIDIMON_CHANNELS; ch++) {
+    uint32_t note_ons = m->note_ons[ch];
+
+    if (note_ons != m->seen_note_ons[ch]) {
+      m->seen_note_ons[ch] = note_ons;
+      if ((m->velocity[ch] << 8) > m->level[ch]) {
+        m->level[ch] = m->velocity[ch] << 8;
+      }
+    } else {
+      m->level[ch] = m->level[ch] > fall ? m->level[ch] - fall : 0;
+    }
+    heights[ch] = (uint8_t)(((m->level[ch] >> 8) * BAR_HEIGHT + 126) / 127);
+    held += m->held[ch];
+  }
+
+  memset(columns, 0, sizeof(columns));
+  snprintf(text, sizeof(text), "%5u msg/s %3u held", (unsigned)m->rate, held);
+  ssd1306_text(columns, 0, text);
+  ssd1306_put_page(d, 0, columns);
+
+  memset(columns, 0, sizeof(columns));
+  format_last(m, text, sizeof(text));
+  ssd1306_text(columns, 0, text);
+  ssd1306_put_page(d, 1, columns);
+
+  for (uint8_t page = BAR_TOP; page <= BAR_BOTTOM; page++) {
+    memset(columns, 0, sizeof(columns));
+    for (int ch = 0; ch < MIDIMON_CHANNELS; ch++) {
+      uint8_t slice = bar_slice(page, heights[ch]);
+      // A column's gap on either side
+      memset(&columns[ch * CELL + 1], slice, CELL - 2);
+    }
+    ssd1306_put_page(d, page, columns);
+  }
+
+  memset(columns, 0, sizeof(columns));
+  for (int ch = 0; ch < MIDIMON_CHANNELS; ch++) {
+    char label[2] = { hex[ch], 0 };
+
+    ssd1306_text(columns, ch * CELL + 1, label);
+    if (m->held[ch] > 0) {
+      for (int x = ch * CELL; x < ch * CELL + CELL - 1; x++) {
+        columns[x] ^= 0x7F;
+      }
+    }
+  }
+  ssd1306_put_page(d, LABELS, columns);
+}
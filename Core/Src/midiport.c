@@ -0,0 +1,273 @@
+/*
+ * midiport.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * MIDI DIN ports. See midiport.h.
+ *
+ * Receive is by interrupt rather than DMA: every byte needs its own
+ * timestamp, and at 3125 bytes/s per port the interrupts cost little.
+ * (USART2 RX DMA would also collide with SPI3_TX on DMA1 stream 5.)
+ *
+ * The ports beyond USART6 are not in the CubeMX configuration, so
+ * they are set up here with the LL register functions.
+ *
+ * References:
+ * - DS11532 Rev 8 Table 12: alternate functions
+ * - RM0410 Rev 5 section 34.8: USART registers
+ */
+
+#include "main.h"
+#include "stm32f7xx_ll_usart.h"
+#include "midiport.h"
+#include "deferred.h"
+#include "timestamp.h"
+#include "dlog.h"
+
+typedef struct {
+  IRQn_Type irq;
+  GPIO_TypeDef *tx_gpio;
+  uint16_t tx_pin;
+  GPIO_TypeDef *rx_gpio;
+  uint16_t rx_pin;
+  uint8_t af;
+} midi_port_hw;
+
+// Port 0 (USART6) pins & baud rate are set up by MX_USART6_UART_Init()
+static const midi_port_hw port_hw[MIDI_NUM_PORTS] = {
+    { USART6_IRQn, NULL, 0, NULL, 0, 0 },
+    { USART2_IRQn, GPIOD, GPIO_PIN_5,  GPIOD, GPIO_PIN_6, GPIO_AF7_USART2 },
+    { UART4_IRQn,  GPIOD, GPIO_PIN_1,  GPIOD, GPIO_PIN_0, GPIO_AF8_UART4 },
+    { UART5_IRQn,  GPIOC, GPIO_PIN_12, GPIOD, GPIO_PIN_2, GPIO_AF8_UART5 },
+    { UART7_IRQn,  GPIOE, GPIO_PIN_8,  GPIOE, GPIO_PIN_7, GPIO_AF8_UART7 },
+};
+
+midi_port midi_ports[MIDI_NUM_PORTS] = {
+    { .name = "din0", .usart = USART6 },
+    { .name = "din1", .usart = USART2 },
+    { .name = "din2", .usart = UART4 },
+    { .name = "din3", .usart = UART5 },
+    { .name = "din4", .usart = UART7 },
+};
+
+/** Sets up the pins & U(S)ART of one of the ports not set up by CubeMX,
+ * for 31250 baud 8N1 (MIDI 1.0 Electrical Specification).
+ */
+static void init_hw(uint8_t port) {
+  const midi_port_hw *hw = &port_hw[port];
+  USART_TypeDef *usart = midi_ports[port].usart;
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  GPIO_InitStruct.Alternate = hw->af;
+  GPIO_InitStruct.Pin = hw->tx_pin;
+  HAL_GPIO_Init(hw->tx_gpio, &GPIO_InitStruct);
+  GPIO_InitStruct.Pin = hw->rx_pin;
+  HAL_GPIO_Init(hw->rx_gpio, &GPIO_InitStruct);
+
+  // These all default to PCLK1 as their clock (RCC_DCKCFGR2)
+  LL_USART_Disable(usart);
+  LL_USART_SetDataWidth(usart, LL_USART_DATAWIDTH_8B);
+  LL_USART_SetParity(usart, LL_USART_PARITY_NONE);
+  LL_USART_SetStopBitsLength(usart, LL_USART_STOPBITS_1);
+  LL_USART_SetOverSampling(usart, LL_USART_OVERSAMPLING_16);
+  LL_USART_SetBaudRate(usart, HAL_RCC_GetPCLK1Freq(), LL_USART_OVERSAMPLING_16, MIDI_BAUD_RATE);
+  LL_USART_SetTransferDirection(usart, LL_USART_DIRECTION_TX_RX);
+  LL_USART_Enable(usart);
+}
+
+/** Sets up all the ports, and starts receiving by interrupt. */
+void midiport_init(void) {
+  __HAL_RCC_GPIOC_CLK_ENABLE();
+  __HAL_RCC_GPIOD_CLK_ENABLE();
+  __HAL_RCC_GPIOE_CLK_ENABLE();
+  __HAL_RCC_USART2_CLK_ENABLE();
+  __HAL_RCC_UART4_CLK_ENABLE();
+  __HAL_RCC_UART5_CLK_ENABLE();
+  __HAL_RCC_UART7_CLK_ENABLE();
+
+  for (uint8_t p = 0; p < MIDI_NUM_PORTS; p++) {
+    midi_port *mp = &midi_ports[p];
+
+    ring_buffer_init(&mp->in_rb, mp->in_buff, sizeof(mp->in_buff));
+    ring_buffer_init(&mp->out_rb, mp->out_buff, sizeof(mp->out_buff));
+    ring_buffer_init(&mp->rt_rb, mp->rt_buff, sizeof(mp->rt_buff));
+    midi_stream_init(&mp->parser);
+    midimerge_init(&mp->merge, MIDI_NUM_SOURCES);
+
+    if (port_hw[p].tx_gpio != NULL) {
+      init_hw(p);
+    }
+    HAL_NVIC_SetPriority(port_hw[p].irq, PRIO_ISR_MIDI_UART, 0);
+    HAL_NVIC_EnableIRQ(port_hw[p].irq);
+    LL_USART_EnableIT_RXNE(mp->usart);
+  }
+  midiport_reset_stats();
+}
+
+void midiport_reset_stats(void) {
+  for (uint8_t p = 0; p < MIDI_NUM_PORTS; p++) {
+    midi_port *mp = &midi_ports[p];
+    mp->rx_bytes = 0;
+    mp->rx_messages = 0;
+    mp->rt_drops = 0;
+    mp->overruns = 0;
+    mp->in_drops = 0;
+    mp->in_max = 0;
+    mp->out_max = 0;
+    midimerge_reset_stats(&mp->merge);
+  }
+}
+
+/** Interrupt time servicing of one port, called by its IRQ handler
+ * (stm32f7xx_it.c). Queues & timestamps a received byte and requests
+ * it be parsed, or drops & counts it if in_rb is full: only
+ * midiport_receive() may move in_rb's tail, as it reads in_times there.
+ * Sends the next output byte if the transmitter is ready, real-time
+ * first, or turns off the transmit interrupt if there is nothing left
+ * to send (midiport_pump() & midiport_check_tx() turn it back on).
+ */
+void midiport_isr(uint8_t port) {
+  midi_port *mp = &midi_ports[port];
+  USART_TypeDef *usart = mp->usart;
+  char c;
+  uint32_t n;
+
+  if (LL_USART_IsActiveFlag_RXNE(usart)) {
+    c = LL_USART_ReceiveData8(usart);
+    if (ring_buffer_is_full(&mp->in_rb)) {
+      mp->in_drops++;
+    } else {
+      mp->in_times[mp->in_rb.head_index] = timestamp_now();
+      ring_buffer_queue(&mp->in_rb, c);
+      n = ring_buffer_num_items(&mp->in_rb);
+      if (n > mp->in_max) {
+        mp->in_max = n;
+      }
+      mp->rx_bytes++;
+    }
+    deferred_post(DEFER_MIDI_RX);
+  }
+  if (LL_USART_IsActiveFlag_ORE(usart)) {
+    // Lost a byte; the receive interrupt (RXNEIE) also covers this
+    LL_USART_ClearFlag_ORE(usart);
+    mp->overruns++;
+    DLOG("\r\n%s overrun: %lu\r\n", (uintptr_t)mp->name, mp->overruns);
+  }
+
+  if (LL_USART_IsEnabledIT_TXE(usart) && LL_USART_IsActiveFlag_TXE(usart)) {
+    if (ring_buffer_dequeue(&mp->rt_rb, &c)) {
+      // Real-time may go between the bytes of any other message
+      LL_USART_TransmitData8(usart, c);
+    } else if (ring_buffer_dequeue(&mp->out_rb, &c)) {
+      LL_USART_TransmitData8(usart, c);
+      if (ring_buffer_is_empty(&mp->out_rb) && mp->merge.waiting > 0) {
+        // One byte time (320 us) to get more
+        deferred_post(DEFER_MIDI_TX);
+      }
+    } else {
+      LL_USART_DisableIT_TXE(usart);
+    }
+  }
+}
+
+/** If there is output waiting on any port, make sure its transmit
+ * interrupt is on so it will be sent.
+ */
+void midiport_check_tx(void) {
+  for (uint8_t p = 0; p < MIDI_NUM_PORTS; p++) {
+    if (!ring_buffer_is_empty(&midi_ports[p].out_rb) ||
+        !ring_buffer_is_empty(&midi_ports[p].rt_rb)) {
+      LL_USART_EnableIT_TXE(midi_ports[p].usart);
+    }
+  }
+}
+
+/** Parses received bytes until a full message is received.
+ * Returns 1 and fills in the message, including its port & timestamp,
+ * or 0 when there are no more bytes. Call only from DEFER_MIDI_RX.
+ */
+int midiport_receive(uint8_t port, midi_message *mm) {
+  midi_port *mp = &midi_ports[port];
+  ring_buffer_size_t index;
+  char c;
+
+  while (1) {
+    index = mp->in_rb.tail_index;
+    if (!ring_buffer_dequeue(&mp->in_rb, &c)) {
+      return 0;
+    }
+    if (midi_stream_receive(&mp->parser, (uint8_t)c, mm)) {
+      mm->port = port;
+      mm->timestamp = mp->in_times[index];
+      mp->rx_messages++;
+      return 1;
+    }
+  }
+}
+
+/** Moves whole messages from the merge queues to the transmit buffer
+ * while they fit, and starts sending them.
+ * Call from only one context (the deferred MIDI jobs).
+ */
+void midiport_pump(uint8_t port) {
+  midi_port *mp = &midi_ports[port];
+  uint8_t bytes[MIDI_MAX_ENCODED];
+  int n;
+  int queued = 0;
+
+  // The ring buffer holds one less than its size, and drops old data when full
+  while (mp->merge.waiting > 0 &&
+         RING_BUFFER_MASK((&mp->out_rb)) - ring_buffer_num_items(&mp->out_rb) >= MIDI_MAX_ENCODED) {
+    n = midimerge_pull(&mp->merge, bytes, timestamp_now());
+    if (n == 0) {
+      break;
+    }
+    ring_buffer_queue_arr(&mp->out_rb, (const char *)bytes, n);
+    queued = 1;
+  }
+  if (queued) {
+    if (ring_buffer_num_items(&mp->out_rb) > mp->out_max) {
+      mp->out_max = ring_buffer_num_items(&mp->out_rb);
+    }
+    LL_USART_EnableIT_TXE(mp->usart);
+  }
+}
+
+/** The DEFER_MIDI_TX job. */
+void midiport_pump_all(void) {
+  for (uint8_t p = 0; p < MIDI_NUM_PORTS; p++) {
+    midiport_pump(p);
+  }
+}
+
+/** Queues a message to be sent on a port, merged with those of other
+ * sources (by mm->port); call midiport_pump() once done queueing.
+ * Real-time messages skip the queue and are sent right away; SysEx is
+ * not sent, but dropped when its turn comes (see midiport.h).
+ * Returns 0 if it was dropped.
+ * Call from only one context (the deferred MIDI jobs).
+ */
+int midiport_send(uint8_t port, const midi_message *mm) {
+  midi_port *mp = &midi_ports[port];
+
+  if (mm->type >= 0xF8) {
+    if (ring_buffer_is_full(&mp->rt_rb)) {
+      mp->rt_drops++;
+      return 0;
+    }
+    ring_buffer_queue(&mp->rt_rb, (char)mm->type);
+    LL_USART_EnableIT_TXE(mp->usart);
+    return 1;
+  }
+
+  if (!midimerge_push(&mp->merge, mm->port, mm, timestamp_now())) {
+    return 0;
+  }
+  return 1;
+}
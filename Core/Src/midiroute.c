@@ -0,0 +1,55 @@
+/*
+ * midiroute.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * MIDI routing matrix. See midiroute.h.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "midiroute.h"
+
+/** Routes nothing anywhere. */
+void midiroute_clear(midi_route_table *rt) {
+  memset(rt, 0, sizeof(*rt));
+}
+
+/** Adds out_mask to the outputs of every (class, channel) in the masks
+ * received on in_port.
+ */
+void midiroute_connect(midi_route_table *rt, uint8_t in_port, uint32_t class_mask,
+                       uint16_t channel_mask, uint8_t out_mask) {
+  if (in_port >= MIDIROUTE_MAX_PORTS) {
+    return;
+  }
+  for (int c = 0; c < MIDI_NUM_CLASSES; c++) {
+    if (!(class_mask & (1 << c))) continue;
+    for (int ch = 0; ch < 16; ch++) {
+      if (channel_mask & (1 << ch)) {
+        rt->out[in_port][c][ch] |= out_mask;
+      }
+    }
+  }
+}
+
+/** Removes out_mask from the outputs of every (class, channel) in the masks
+ * received on in_port.
+ */
+void midiroute_disconnect(midi_route_table *rt, uint8_t in_port, uint32_t class_mask,
+                          uint16_t channel_mask, uint8_t out_mask) {
+  if (in_port >= MIDIROUTE_MAX_PORTS) {
+    return;
+  }
+  for (int c = 0; c < MIDI_NUM_CLASSES; c++) {
+    if (!(class_mask & (1 << c))) continue;
+    for (int ch = 0; ch < 16; ch++) {
+      if (channel_mask & (1 << ch)) {
+        rt->out[in_port][c][ch] &= ~out_mask;
+      }
+    }
+  }
+}
@@ -0,0 +1,202 @@
+/*
+ * mtc.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * MIDI Time Code follower. See mtc.h.
+ *
+ * References:
+ * - MIDI Time Code specification (MMA RP-004/RP-008): quarter frame
+ *   pieces, full frame message F0 7F cc 01 01 hr mn sc fr F7, and
+ *   the 2 frame offset of a completed quarter frame sequence
+ * - SMPTE 12M: 29.97 drop frame skips frames 0 & 1 of each minute
+ *   except every tenth
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "mtc.h"
+
+static const uint8_t nominal_fps[4] = { 24, 25, 30, 30 };
+// Frame duration = num / den microseconds
+static const uint32_t frame_us_num[4] = { 1000000, 1000000, 1001000, 1000000 };
+static const uint32_t frame_us_den[4] = { 24, 25, 30, 30 };
+static const char *const rate_names[4] = { "24", "25", "29.97df", "30" };
+
+void mtc_init(mtc_state *mtc) {
+  mtc->received = 0;
+  mtc->last_piece = -1;
+  mtc->direction = 0;
+  mtc->valid = 0;
+  mtc->rate = MTC_RATE_30;
+  mtc->quarter_frames = 0;
+  mtc->last_time = 0;
+  mtc->quarter_frame_count = 0;
+  mtc->full_frame_count = 0;
+  mtc->direction_changes = 0;
+  mtc->sequence_breaks = 0;
+}
+
+/** Frames since 00:00:00:00, dropping frames for 29.97 drop frame. */
+static uint32_t to_frames(uint8_t rate, uint8_t h, uint8_t m, uint8_t s, uint8_t f) {
+  uint32_t frames = ((uint32_t)h * 3600 + m * 60 + s) * nominal_fps[rate] + f;
+
+  if (rate == MTC_RATE_29_97) {
+    uint32_t minutes = (uint32_t)h * 60 + m;
+    frames -= 2 * (minutes - minutes / 10);
+  }
+  return frames;
+}
+
+/** Inverse of to_frames(). */
+static void from_frames(uint8_t rate, uint32_t frames, uint8_t *h, uint8_t *m, uint8_t *s, uint8_t *f) {
+  uint32_t fps = nominal_fps[rate];
+
+  if (rate == MTC_RATE_29_97) {
+    // Put back the dropped frame numbers: 17982 frames per 10 minutes
+    uint32_t tens = frames / 17982;
+    uint32_t rest = frames % 17982;
+    frames += 18 * tens;
+    if (rest > 1) {
+      frames += 2 * ((rest - 2) / 1798);
+    }
+  }
+  *f = frames % fps;
+  frames /= fps;
+  *s = frames % 60;
+  frames /= 60;
+  *m = frames % 60;
+  *h = (frames / 60) % 24;
+}
+
+/** A full sequence of pieces has been received: take its time. */
+static void complete(mtc_state *mtc) {
+  const uint8_t *p = mtc->pieces;
+  uint8_t rate = (p[7] >> 1) & 0x03;
+  uint32_t frames = to_frames(rate,
+                              ((p[7] & 0x01) << 4) | p[6],
+                              (p[5] << 4) | p[4],
+                              (p[3] << 4) | p[2],
+                              (p[1] << 4) | p[0]);
+
+  mtc->rate = rate;
+  // The time is that of piece 0: 7 quarter frames ago going forward,
+  // just now going backward
+  mtc->quarter_frames = frames * 4 + (mtc->direction > 0 ? 7 : 0);
+  mtc->valid = 1;
+}
+
+/** Follows quarter frame messages; ignores others. */
+void mtc_receive(mtc_state *mtc, const midi_message *mm) {
+  uint8_t piece;
+  int8_t direction = 0;
+
+  if (mm->type != MIDI_TIME_CODE_QF) {
+    return;
+  }
+  piece = mm->tcqf_message_type & 0x07;
+  mtc->quarter_frame_count++;
+
+  if (mtc->last_piece >= 0) {
+    if (piece == ((mtc->last_piece + 1) & 0x07)) {
+      direction = 1;
+    } else if (piece == ((mtc->last_piece - 1) & 0x07)) {
+      direction = -1;
+    }
+  }
+
+  if (direction == 0) {
+    // Out of sequence: start assembling again
+    if (mtc->last_piece >= 0) {
+      mtc->sequence_breaks++;
+    }
+    mtc->received = 0;
+  } else if (direction != mtc->direction) {
+    // Keep the one piece we have if we did not know the direction yet
+    if (mtc->direction != 0) {
+      mtc->direction_changes++;
+      mtc->received = 0;
+    }
+  }
+  // Running backward stops at 00:00:00:00 rather than wrapping
+  if (direction != 0 && mtc->valid && (direction > 0 || mtc->quarter_frames > 0)) {
+    mtc->quarter_frames += direction;
+  }
+  mtc->direction = direction;
+  mtc->last_piece = piece;
+  mtc->last_time = mm->timestamp;
+
+  mtc->pieces[piece] = mm->tcqf_value & 0x0F;
+  mtc->received |= 1 << piece;
+  if (mtc->received == 0xFF && piece == (direction > 0 ? 7 : 0)) {
+    complete(mtc);
+    mtc->received = 0;
+  }
+}
+
+/** Follows full frame messages (F0 7F cc 01 01 hr mn sc fr F7, given
+ * without the F0 & F7); ignores other SysEx. A full frame is a locate:
+ * the transport is stopped there until quarter frames resume.
+ */
+void mtc_receive_sysex(mtc_state *mtc, const uint8_t *data, size_t len, uint32_t timestamp) {
+  if (len != 8 || data[0] != 0x7F || data[2] != 0x01 || data[3] != 0x01) {
+    return;
+  }
+  mtc->full_frame_count++;
+  mtc->rate = (data[4] >> 5) & 0x03;
+  mtc->quarter_frames = to_frames(mtc->rate, data[4] & 0x1F, data[5] & 0x3F,
+                                  data[6] & 0x3F, data[7] & 0x1F) * 4;
+  mtc->valid = 1;
+  mtc->direction = 0;
+  mtc->received = 0;
+  mtc->last_piece = -1;
+  mtc->last_time = timestamp;
+}
+
+/** Is the time code moving? */
+int mtc_running(const mtc_state *mtc, uint32_t now) {
+  return mtc->valid && mtc->direction != 0 && now - mtc->last_time < MTC_TIMEOUT_US;
+}
+
+/** The time code position at time now, in microseconds since
+ * 00:00:00:00, interpolated up to one quarter frame past the last.
+ */
+uint64_t mtc_position_us(const mtc_state *mtc, uint32_t now) {
+  uint32_t num = frame_us_num[mtc->rate];
+  uint32_t den = frame_us_den[mtc->rate] * 4; // Per quarter frame
+  uint64_t position;
+  uint32_t since;
+  uint32_t quarter_us = num / den;
+
+  if (!mtc->valid) {
+    return 0;
+  }
+  position = (uint64_t)mtc->quarter_frames * num / den;
+  if (!mtc_running(mtc, now)) {
+    return position;
+  }
+  since = now - mtc->last_time;
+  if (since > quarter_us) {
+    since = quarter_us;
+  }
+  if (mtc->direction > 0) {
+    return position + since;
+  }
+  return position > since ? position - since : 0;
+}
+
+/** Human readable time code at time now. */
+int mtc_snprintf(char *str, size_t size, const mtc_state *mtc, uint32_t now) {
+  uint8_t h, m, s, f;
+
+  if (!mtc->valid) {
+    return snprintf(str, size, "MTC: none");
+  }
+  from_frames(mtc->rate, mtc->quarter_frames / 4, &h, &m, &s, &f);
+  return snprintf(str, size, "MTC: %02d:%02d:%02d:%02d.%d @ %s fps, %s",
+                  h, m, s, f, (int)(mtc->quarter_frames % 4), rate_names[mtc->rate],
+                  !mtc_running(mtc, now) ? "stopped" : mtc->direction > 0 ? "forward" : "reverse");
+}
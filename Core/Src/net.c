@@ -0,0 +1,449 @@
+/*
+ * net.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Minimal IPv4 over Ethernet. See net.h.
+ *
+ * Frames are read & written a byte at a time in network byte order:
+ * the IP header follows a 14 byte Ethernet header, so nothing after
+ * it is aligned.
+ */
+
+#include <string.h>
+#include "net.h"
+
+#define ETHERTYPE_IP  0x0800
+#define ETHERTYPE_ARP 0x0806
+
+#define IP_PROTO_ICMP 1
+#define IP_PROTO_UDP  17
+#define IP_TTL        64
+#define IP_DONT_FRAGMENT 0x4000
+#define IP_MORE_FRAGMENTS 0x2000
+#define IP_OFFSET_MASK 0x1FFF
+
+#define ARP_REQUEST 1
+#define ARP_REPLY   2
+#define ARP_LENGTH  28
+
+#define ICMP_ECHO_REPLY   0
+#define ICMP_ECHO_REQUEST 8
+
+static const uint8_t broadcast_mac[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+static uint16_t get16(const uint8_t *p) {
+  return (p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+/** The Internet checksum of data, continuing the partial sum sum
+ * (e.g., of a pseudo header). Data that includes its own correct
+ * checksum sums to 0.
+ */
+uint16_t net_checksum(uint32_t sum, const uint8_t *data, size_t len) {
+  size_t i;
+
+  for (i = 0; i + 1 < len; i += 2) {
+    sum += get16(data + i);
+  }
+  if (i < len) {
+    sum += data[i] << 8;
+  }
+  while (sum >> 16) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return ~sum & 0xFFFF;
+}
+
+/** The partial sum of the UDP pseudo header. */
+static uint32_t pseudo_sum(uint32_t src, uint32_t dst, uint16_t len) {
+  return (src >> 16) + (src & 0xFFFF) + (dst >> 16) + (dst & 0xFFFF) + IP_PROTO_UDP + len;
+}
+
+void net_init(net_if *n, const uint8_t *mac, uint32_t ip, uint32_t netmask, uint32_t gateway,
+              const net_driver *driver) {
+  memset(n, 0, sizeof(*n));
+  memcpy(n->mac, mac, sizeof(n->mac));
+  n->ip = ip;
+  n->netmask = netmask;
+  n->gateway = gateway;
+  n->driver = *driver;
+}
+
+/** Has fn called with the datagrams to port; returns 0 if there are
+ * NET_MAX_PORTS bound already.
+ */
+int net_udp_bind(net_if *n, uint16_t port, net_udp_fn fn, void *ctx) {
+  for (int i = 0; i < NET_MAX_PORTS; i++) {
+    if (n->ports[i].port == 0) {
+      n->ports[i].port = port;
+      n->ports[i].fn = fn;
+      n->ports[i].ctx = ctx;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// ARP ///////////////////////////////////////////////////////////////////////
+
+static net_arp_entry *arp_find(net_if *n, uint32_t ip) {
+  for (int i = 0; i < NET_ARP_ENTRIES; i++) {
+    if (n->arp[i].ip == ip) {
+      return &n->arp[i];
+    }
+  }
+  return NULL;
+}
+
+/** Remembers the MAC address of ip, replacing the least recently used
+ * entry if it is new.
+ */
+static void arp_learn(net_if *n, uint32_t ip, const uint8_t *mac) {
+  net_arp_entry *e = arp_find(n, ip);
+
+  if (ip == 0 || ip == n->ip || (mac[0] & 0x01)) {
+    // Unset, ours, or a group address
+    return;
+  }
+  if (e == NULL) {
+    e = &n->arp[0];
+    for (int i = 1; i < NET_ARP_ENTRIES; i++) {
+      if (n->arp[i].used < e->used) {
+        e = &n->arp[i];
+      }
+    }
+    e->ip = ip;
+  }
+  memcpy(e->mac, mac, sizeof(e->mac));
+  e->used = ++n->arp_clock;
+}
+
+static void put_eth_header(const net_if *n, uint8_t *frame, const uint8_t *dst, uint16_t type) {
+  memcpy(frame, dst, 6);
+  memcpy(frame + 6, n->mac, 6);
+  put16(frame + 12, type);
+}
+
+/** Builds an ARP packet in frame, returning its length. */
+static size_t put_arp(const net_if *n, uint8_t *frame, uint16_t op, const uint8_t *dst_mac,
+                      uint32_t target_ip) {
+  uint8_t *a = frame + NET_ETH_HEADER;
+
+  put_eth_header(n, frame, op == ARP_REQUEST ? broadcast_mac : dst_mac, ETHERTYPE_ARP);
+  put16(a, 1); // Ethernet
+  put16(a + 2, ETHERTYPE_IP);
+  a[4] = 6;
+  a[5] = 4;
+  put16(a + 6, op);
+  memcpy(a + 8, n->mac, 6);
+  put32(a + 14, n->ip);
+  if (op == ARP_REQUEST) {
+    memset(a + 18, 0, 6);
+  } else {
+    memcpy(a + 18, dst_mac, 6);
+  }
+  put32(a + 24, target_ip);
+  return NET_ETH_HEADER + ARP_LENGTH;
+}
+
+static void arp_input(net_if *n, const uint8_t *a, size_t len) {
+  uint32_t sender_ip, target_ip;
+  uint8_t *frame;
+
+  if (len < ARP_LENGTH || get16(a) != 1 || get16(a + 2) != ETHERTYPE_IP || a[4] != 6 ||
+      a[5] != 4) {
+    n->rx_ignored++;
+    return;
+  }
+  sender_ip = get32(a + 14);
+  target_ip = get32(a + 24);
+  if (target_ip != n->ip) {
+    // Only refresh what we know already (RFC 826's merge flag)
+    if (arp_find(n, sender_ip) != NULL) {
+      arp_learn(n, sender_ip, a + 8);
+    }
+    return;
+  }
+  arp_learn(n, sender_ip, a + 8);
+
+  if (get16(a + 6) == ARP_REQUEST) {
+    frame = n->driver.tx_alloc(n->driver.ctx);
+    if (frame == NULL) {
+      n->tx_no_buffer++;
+      return;
+    }
+    n->driver.tx_send(n->driver.ctx, frame, put_arp(n, frame, ARP_REPLY, a + 8, sender_ip));
+    n->tx_frames++;
+  }
+}
+
+// IP ////////////////////////////////////////////////////////////////////////
+
+/** Fills in the Ethernet & IP headers of a frame with a payload of len
+ * bytes after the IP header.
+ */
+static void put_ip_header(net_if *n, uint8_t *frame, const uint8_t *dst_mac, uint32_t dst,
+                          uint8_t proto, size_t len) {
+  uint8_t *ip = frame + NET_ETH_HEADER;
+
+  put_eth_header(n, frame, dst_mac, ETHERTYPE_IP);
+  ip[0] = 0x45; // Version 4, no options
+  ip[1] = 0;
+  put16(ip + 2, NET_IP_HEADER + len);
+  put16(ip + 4, n->ip_id++);
+  put16(ip + 6, IP_DONT_FRAGMENT);
+  ip[8] = IP_TTL;
+  ip[9] = proto;
+  put16(ip + 10, 0);
+  put32(ip + 12, n->ip);
+  put32(ip + 16, dst);
+  if (!n->driver.checksum_offload) {
+    put16(ip + 10, net_checksum(0, ip, NET_IP_HEADER));
+  }
+}
+
+static void icmp_input(net_if *n, uint8_t *eth, const uint8_t *ip, uint8_t *icmp, size_t len) {
+  uint8_t *frame, *reply;
+  uint8_t dst_mac[6];
+  uint32_t dst = get32(ip + 12);
+
+  if (len < 8 || (!n->driver.checksum_offload && net_checksum(0, icmp, len) != 0)) {
+    n->rx_errors++;
+    return;
+  }
+  if (icmp[0] != ICMP_ECHO_REQUEST || len > NET_MAX_FRAME - NET_ETH_HEADER - NET_IP_HEADER) {
+    n->rx_ignored++;
+    return;
+  }
+  memcpy(dst_mac, eth + 6, sizeof(dst_mac));
+  // The same identifier, sequence number & data back: in the request's
+  // own buffer if we may keep it, and it has no IP options to remove
+  if (icmp == eth + NET_ETH_HEADER + NET_IP_HEADER && net_hold(n, eth)) {
+    frame = eth;
+    reply = icmp;
+  } else {
+    frame = n->driver.tx_alloc(n->driver.ctx);
+    if (frame == NULL) {
+      n->tx_no_buffer++;
+      return;
+    }
+    reply = frame + NET_ETH_HEADER + NET_IP_HEADER;
+    memcpy(reply, icmp, len);
+  }
+  reply[0] = ICMP_ECHO_REPLY;
+  put16(reply + 2, 0);
+  if (!n->driver.checksum_offload) {
+    put16(reply + 2, net_checksum(0, reply, len));
+  }
+  put_ip_header(n, frame, dst_mac, dst, IP_PROTO_ICMP, len);
+  n->driver.tx_send(n->driver.ctx, frame, NET_ETH_HEADER + NET_IP_HEADER + len);
+  n->tx_frames++;
+  n->rx_echoes++;
+}
+
+static void udp_input(net_if *n, const uint8_t *ip, const uint8_t *udp, size_t len, uint32_t now) {
+  uint16_t ulen, csum;
+  net_endpoint from;
+
+  if (len < NET_UDP_HEADER) {
+    n->rx_errors++;
+    return;
+  }
+  ulen = get16(udp + 4);
+  csum = get16(udp + 6);
+  if (ulen < NET_UDP_HEADER || ulen > len) {
+    n->rx_errors++;
+    return;
+  }
+  // A checksum of 0 is none at all
+  if (!n->driver.checksum_offload && csum != 0 &&
+      net_checksum(pseudo_sum(get32(ip + 12), get32(ip + 16), ulen), udp, ulen) != 0) {
+    n->rx_errors++;
+    return;
+  }
+
+  n->rx_udp++;
+  for (int i = 0; i < NET_MAX_PORTS; i++) {
+    if (n->ports[i].port != 0 && n->ports[i].port == get16(udp + 2)) {
+      from.ip = get32(ip + 12);
+      from.port = get16(udp);
+      n->ports[i].fn(n->ports[i].ctx, &from, udp + NET_UDP_HEADER, ulen - NET_UDP_HEADER, now);
+      return;
+    }
+  }
+  n->rx_no_port++;
+}
+
+static void ip_input(net_if *n, uint8_t *eth, uint8_t *ip, size_t len, uint32_t now) {
+  size_t hlen, total;
+  uint32_t dst;
+
+  if (len < NET_IP_HEADER || (ip[0] >> 4) != 4) {
+    n->rx_errors++;
+    return;
+  }
+  hlen = (ip[0] & 0x0F) * 4;
+  total = get16(ip + 2);
+  // Anything after total is Ethernet padding
+  if (hlen < NET_IP_HEADER || total < hlen || total > len ||
+      (!n->driver.checksum_offload && net_checksum(0, ip, hlen) != 0)) {
+    n->rx_errors++;
+    return;
+  }
+  dst = get32(ip + 16);
+  if ((dst != n->ip && dst != NET_IP_BROADCAST && dst != (n->ip | ~n->netmask)) ||
+      (get16(ip + 6) & (IP_MORE_FRAGMENTS | IP_OFFSET_MASK)) != 0) {
+    // Not ours, or a fragment
+    n->rx_ignored++;
+    return;
+  }
+  // Replies go straight back to whoever sent this (the gateway, if
+  // it came from elsewhere)
+  arp_learn(n, get32(ip + 12), eth + 6);
+
+  switch (ip[9]) {
+  case IP_PROTO_ICMP:
+    icmp_input(n, eth, ip, ip + hlen, total - hlen);
+    break;
+  case IP_PROTO_UDP:
+    udp_input(n, ip, ip + hlen, total - hlen, now);
+    break;
+  default:
+    n->rx_ignored++;
+    break;
+  }
+}
+
+/** Handles one received frame, without its FCS (any extra bytes at the
+ * end are ignored). now is passed on to the UDP handlers. The frame may
+ * be changed and its buffer kept (net_hold()), so afterwards the driver
+ * drops its own hold on the buffer rather than reusing it.
+ */
+void net_input(net_if *n, uint8_t *frame, size_t len, uint32_t now) {
+  n->rx_frames++;
+  if (len < NET_ETH_HEADER) {
+    n->rx_errors++;
+    return;
+  }
+  if (memcmp(frame, n->mac, 6) != 0 && memcmp(frame, broadcast_mac, 6) != 0) {
+    n->rx_ignored++;
+    return;
+  }
+
+  switch (get16(frame + 12)) {
+  case ETHERTYPE_ARP:
+    arp_input(n, frame + NET_ETH_HEADER, len - NET_ETH_HEADER);
+    break;
+  case ETHERTYPE_IP:
+    ip_input(n, frame, frame + NET_ETH_HEADER, len - NET_ETH_HEADER, now);
+    break;
+  default:
+    n->rx_ignored++;
+    break;
+  }
+}
+
+/** Keeps the buffer of the frame being handled, which data points
+ * into, after the handler it was given to returns; give it back with
+ * net_release(). Returns 0 if the driver cannot: copy what is needed.
+ */
+int net_hold(net_if *n, const uint8_t *data) {
+  return n->driver.rx_hold != NULL && n->driver.rx_hold(n->driver.ctx, data);
+}
+
+void net_release(net_if *n, const uint8_t *data) {
+  if (n->driver.rx_release != NULL) {
+    n->driver.rx_release(n->driver.ctx, data);
+  }
+}
+
+// UDP ///////////////////////////////////////////////////////////////////////
+
+/** Borrows a frame to send a datagram in: returns where its payload
+ * goes, up to NET_MAX_UDP bytes, or NULL if the driver has no buffer
+ * free. Send it with net_udp_send() before beginning another.
+ */
+uint8_t *net_udp_begin(net_if *n) {
+  n->tx_frame = n->driver.tx_alloc(n->driver.ctx);
+  if (n->tx_frame == NULL) {
+    n->tx_no_buffer++;
+    return NULL;
+  }
+  return n->tx_frame + NET_UDP_OFFSET;
+}
+
+/** Sends len bytes of payload from net_udp_begin() to to, from our
+ * port from_port. Returns 0 if to's MAC address is not known yet: an
+ * ARP request for it is sent instead.
+ */
+int net_udp_send(net_if *n, const net_endpoint *to, uint16_t from_port, size_t len) {
+  uint8_t *frame = n->tx_frame;
+  uint8_t *udp = frame + NET_ETH_HEADER + NET_IP_HEADER;
+  uint32_t hop = to->ip;
+  const net_arp_entry *e;
+  const uint8_t *mac;
+
+  n->tx_frame = NULL;
+  if (to->ip == NET_IP_BROADCAST || to->ip == (n->ip | ~n->netmask)) {
+    mac = broadcast_mac;
+  } else {
+    if ((to->ip & n->netmask) != (n->ip & n->netmask)) {
+      hop = n->gateway;
+    }
+    e = arp_find(n, hop);
+    if (e == NULL) {
+      n->tx_no_arp++;
+      n->driver.tx_send(n->driver.ctx, frame, put_arp(n, frame, ARP_REQUEST, NULL, hop));
+      n->tx_frames++;
+      return 0;
+    }
+    mac = e->mac;
+  }
+
+  put16(udp, from_port);
+  put16(udp + 2, to->port);
+  put16(udp + 4, NET_UDP_HEADER + len);
+  put16(udp + 6, 0);
+  put_ip_header(n, frame, mac, to->ip, IP_PROTO_UDP, NET_UDP_HEADER + len);
+  if (!n->driver.checksum_offload) {
+    uint16_t csum = net_checksum(pseudo_sum(n->ip, to->ip, NET_UDP_HEADER + len), udp,
+                                 NET_UDP_HEADER + len);
+    // 0 would mean no checksum
+    put16(udp + 6, csum == 0 ? 0xFFFF : csum);
+  }
+  n->driver.tx_send(n->driver.ctx, frame, NET_UDP_OFFSET + len);
+  n->tx_frames++;
+  return 1;
+}
+
+void net_reset_stats(net_if *n) {
+  n->rx_frames = 0;
+  n->rx_errors = 0;
+  n->rx_ignored = 0;
+  n->rx_no_port = 0;
+  n->rx_udp = 0;
+  n->rx_echoes = 0;
+  n->tx_frames = 0;
+  n->tx_no_buffer = 0;
+  n->tx_no_arp = 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * osc.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Open Sound Control packets, address lookup & timetags. See osc.h.
+ *
+ * Everything in a packet is checked before any of it is used: each
+ * message's arguments against its type tags, so osc_arg_*() need not
+ * check lengths again. A message without type tags (from before OSC
+ * 1.0 made them required) is taken as having no arguments.
+ */
+
+#include <string.h>
+#include "osc.h"
+
+#define BUNDLE_HEADER 16 // "#bundle", then the timetag
+
+static uint32_t get32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t get64(const uint8_t *p) {
+  return ((uint64_t)get32(p) << 32) | get32(p + 4);
+}
+
+/** The length of the OSC-string at p, with its NUL & padding to a
+ * multiple of 4, or 0 if it does not end by end.
+ */
+static size_t string_size(const uint8_t *p, const uint8_t *end) {
+  const uint8_t *nul = memchr(p, 0, end - p);
+
+  if (nul == NULL) {
+    return 0;
+  }
+  return ((nul - p) + 4) & ~(size_t)3;
+}
+
+/** The length of the argument of type tag t at p, in *size; returns
+ * 0 if it does not end by end or t is not a type we know.
+ */
+static int arg_size(char t, const uint8_t *p, const uint8_t *end, size_t *size) {
+  switch (t) {
+  case 'i': // int32
+  case 'f': // float32
+  case 'c': // ASCII character
+  case 'r': // RGBA colour
+  case 'm': // MIDI message
+    *size = 4;
+    break;
+  case 'h': // int64
+  case 'd': // float64
+  case 't': // timetag
+    *size = 8;
+    break;
+  case 's':
+  case 'S': // Symbol
+    *size = string_size(p, end);
+    return *size > 0;
+  case 'b':
+    if (end - p < 4 || get32(p) > (size_t)(end - p) - 4) {
+      return 0;
+    }
+    *size = 4 + ((get32(p) + 3) & ~(size_t)3);
+    break;
+  case 'T': // True
+  case 'F': // False
+  case 'N': // Nil
+  case 'I': // Infinitum
+  case '[': // Array
+  case ']':
+    *size = 0;
+    break;
+  default:
+    return 0;
+  }
+  return *size <= (size_t)(end - p);
+}
+
+// Address trie //////////////////////////////////////////////////////////////
+
+/** The method of the address, or -1 if it is not in the trie. */
+int osc_trie_lookup(const osc_trie_node *trie, const char *address) {
+  const osc_trie_node *n = &trie[0];
+
+  for (; *address; address++) {
+    const osc_trie_node *child = &trie[n->first];
+    const osc_trie_node *last = child + n->children;
+
+    while (child < last && child->c < *address) {
+      child++;
+    }
+    if (child == last || child->c != *address) {
+      return -1;
+    }
+    n = child;
+  }
+  return n->method;
+}
+
+// Clock /////////////////////////////////////////////////////////////////////
+
+static uint64_t timetag_us(uint64_t timetag) {
+  return (timetag >> 32) * 1000000 + (((timetag & 0xFFFFFFFF) * 1000000) >> 32);
+}
+
+/** Brings the sender's time up to now; call at least every 71 minutes,
+ * as our microseconds wrap.
+ */
+static void advance_clock(osc_server *s, uint32_t now) {
+  s->clock_us += (uint32_t)(now - s->clock_local);
+  s->clock_local = now;
+}
+
+/** Sets the sender's time, as a timetag, to now. */
+void osc_set_clock(osc_server *s, uint64_t timetag, uint32_t now) {
+  s->clock_us = timetag_us(timetag);
+  s->clock_local = now;
+  s->synced = 1;
+  s->syncs++;
+}
+
+/** Keeps the clock. Call every few seconds or more often. */
+void osc_poll(osc_server *s, uint32_t now) {
+  advance_clock(s, now);
+}
+
+/** When a message of the timetag should take effect, in *when; returns
+ * 0 if it should not.
+ */
+static int timetag_when(osc_server *s, uint64_t timetag, uint32_t now, uint32_t *when) {
+  int64_t ahead;
+
+  if (timetag == OSC_IMMEDIATELY || !s->synced) {
+    if (timetag != OSC_IMMEDIATELY) {
+      s->rx_unsynced++;
+    }
+    *when = now + s->latency_us;
+    return 1;
+  }
+  advance_clock(s, now);
+  ahead = (int64_t)(timetag_us(timetag) - s->clock_us);
+  if (ahead > OSC_MAX_AHEAD_US) {
+    s->rx_too_far++;
+    return 0;
+  }
+  if (ahead < 0) {
+    s->rx_late++;
+    ahead = 0;
+  }
+  *when = now + (uint32_t)ahead;
+  return 1;
+}
+
+// Packets ///////////////////////////////////////////////////////////////////
+
+static void message_input(osc_server *s, const uint8_t *p, size_t len, uint64_t timetag,
+                          uint32_t now) {
+  const uint8_t *end = p + len;
+  const uint8_t *data;
+  const char *types = "";
+  size_t size;
+  int method;
+  uint32_t when;
+  osc_args args;
+
+  size = string_size(p, end);
+  if (size == 0 || p[0] != '/') {
+    s->rx_errors++;
+    return;
+  }
+  data = p + size;
+  if (data < end && data[0] == ',') {
+    size = string_size(data, end);
+    if (size == 0) {
+      s->rx_errors++;
+      return;
+    }
+    types = (const char *)data + 1;
+    data += size;
+  }
+
+  args.types = types;
+  args.data = data;
+  for (; *types; types++) {
+    if (!arg_size(*types, data, end, &size)) {
+      s->rx_errors++;
+      return;
+    }
+    data += size;
+  }
+
+  s->rx_messages++;
+  method = osc_trie_lookup(s->trie, (const char *)p);
+  if (method < 0) {
+    s->rx_unmatched++;
+    return;
+  }
+  if (!timetag_when(s, timetag, now, &when)) {
+    return;
+  }
+  if (!s->fn(s->ctx, method, &args, when, now)) {
+    s->rx_bad_args++;
+  }
+}
+
+static void element_input(osc_server *s, const uint8_t *p, size_t len, uint64_t timetag,
+                          int depth, uint32_t now) {
+  size_t pos;
+  uint32_t size;
+
+  if (len % 4 != 0) {
+    s->rx_errors++;
+    return;
+  }
+  if (len < 8 || memcmp(p, "#bundle", 8) != 0) {
+    message_input(s, p, len, timetag, now);
+    return;
+  }
+
+  if (len < BUNDLE_HEADER || depth >= OSC_MAX_DEPTH) {
+    s->rx_errors++;
+    return;
+  }
+  s->rx_bundles++;
+  timetag = get64(p + 8);
+  for (pos = BUNDLE_HEADER; pos < len; pos += 4 + size) {
+    if (len - pos < 4) {
+      s->rx_errors++;
+      return;
+    }
+    size = get32(p + pos);
+    if (size > len - pos - 4) {
+      s->rx_errors++;
+      return;
+    }
+    element_input(s, p + pos + 4, size, timetag, depth + 1, now);
+  }
+}
+
+void osc_init(osc_server *s, const osc_trie_node *trie, uint32_t latency_us, osc_method_fn fn,
+              void *ctx) {
+  memset(s, 0, sizeof(*s));
+  s->trie = trie;
+  s->latency_us = latency_us;
+  s->fn = fn;
+  s->ctx = ctx;
+}
+
+/** Handles one packet received (a UDP datagram's payload). */
+void osc_input(osc_server *s, const uint8_t *data, size_t len, uint32_t now) {
+  s->rx_packets++;
+  element_input(s, data, len, OSC_IMMEDIATELY, 0, now);
+}
+
+void osc_reset_stats(osc_server *s) {
+  s->rx_packets = 0;
+  s->rx_messages = 0;
+  s->rx_bundles = 0;
+  s->rx_errors = 0;
+  s->rx_unmatched = 0;
+  s->rx_bad_args = 0;
+  s->rx_unsynced = 0;
+  s->rx_late = 0;
+  s->rx_too_far = 0;
+  s->syncs = 0;
+}
+
+// Arguments /////////////////////////////////////////////////////////////////
+
+/** Reads the next argument, if it is a number (int32, int64, float32,
+ * float64, true or false), as a float. Returns 0, reading nothing, if
+ * it is not.
+ */
+int osc_arg_float(osc_args *a, float *v) {
+  uint32_t u;
+  uint64_t u64;
+  double d;
+
+  switch (*a->types) {
+  case 'f':
+    u = get32(a->data);
+    memcpy(v, &u, sizeof(*v));
+    a->data += 4;
+    break;
+  case 'i':
+    *v = (float)(int32_t)get32(a->data);
+    a->data += 4;
+    break;
+  case 'd':
+    u64 = get64(a->data);
+    memcpy(&d, &u64, sizeof(d));
+    *v = (float)d;
+    a->data += 8;
+    break;
+  case 'h':
+    *v = (float)(int64_t)get64(a->data);
+    a->data += 8;
+    break;
+  case 'T':
+    *v = 1.0f;
+    break;
+  case 'F':
+    *v = 0.0f;
+    break;
+  default:
+    return 0;
+  }
+  a->types++;
+  return 1;
+}
+
+/** Reads the next argument, if it is a timetag. */
+int osc_arg_timetag(osc_args *a, uint64_t *timetag) {
+  if (*a->types != 't') {
+    return 0;
+  }
+  *timetag = get64(a->data);
+  a->data += 8;
+  a->types++;
+  return 1;
+}
+
+/** Whether there are arguments not yet read. */
+int osc_args_left(const osc_args *a) {
+  return *a->types != 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * oscaddr.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * The trie of the OSC addresses in oscaddr.h, made by
+ *   Tools/osctrie.py Core/Inc/oscaddr.h > Core/Src/oscaddr.c
+ * Do not edit.
+ */
+
+#include "oscaddr.h"
+
+const osc_trie_node osc_trie[29] = {
+    { 0, 1, 1, -1 }, // 0 ""
+    { '/', 2, 2, -1 }, // 1 "/"
+    { 'c', 1, 4, -1 }, // 2 "/c"
+    { 's', 1, 5, -1 }, // 3 "/s"
+    { 'l', 1, 6, -1 }, // 4 "/cl"
+    { 'y', 1, 7, -1 }, // 5 "/sy"
+    { 'o', 1, 8, -1 }, // 6 "/clo"
+    { 'n', 1, 9, -1 }, // 7 "/syn"
+    { 'c', 1, 10, -1 }, // 8 "/cloc"
+    { 't', 1, 11, -1 }, // 9 "/synt"
+    { 'k', 0, 0, OSC_CLOCK }, // 10 "/clock"
+    { 'h', 1, 12, -1 }, // 11 "/synth"
+    { '/', 4, 13, -1 }, // 12 "/synth/"
+    { 'f', 1, 17, -1 }, // 13 "/synth/f"
+    { 'l', 1, 18, -1 }, // 14 "/synth/l"
+    { 'n', 1, 19, -1 }, // 15 "/synth/n"
+    { 'o', 1, 20, -1 }, // 16 "/synth/o"
+    { 'r', 1, 21, -1 }, // 17 "/synth/fr"
+    { 'e', 1, 22, -1 }, // 18 "/synth/le"
+    { 'o', 1, 23, -1 }, // 19 "/synth/no"
+    { 'f', 1, 24, -1 }, // 20 "/synth/of"
+    { 'e', 1, 25, -1 }, // 21 "/synth/fre"
+    { 'v', 1, 26, -1 }, // 22 "/synth/lev"
+    { 't', 1, 27, -1 }, // 23 "/synth/not"
+    { 'f', 0, 0, OSC_SYNTH_OFF }, // 24 "/synth/off"
+    { 'q', 0, 0, OSC_SYNTH_FREQ }, // 25 "/synth/freq"
+    { 'e', 1, 28, -1 }, // 26 "/synth/leve"
+    { 'e', 0, 0, OSC_SYNTH_NOTE }, // 27 "/synth/note"
+    { 'l', 0, 0, OSC_SYNTH_LEVEL }, // 28 "/synth/level"
+};
+
+const char *const osc_addresses[OSC_NUM_METHODS] = {
+    [OSC_CLOCK] = "/clock",
+    [OSC_SYNTH_FREQ] = "/synth/freq",
+    [OSC_SYNTH_LEVEL] = "/synth/level",
+    [OSC_SYNTH_NOTE] = "/synth/note",
+    [OSC_SYNTH_OFF] = "/synth/off",
+};
@@ -0,0 +1,102 @@
+/*
+ * pktbuf.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Reference counted packet buffer pool. See pktbuf.h.
+ */
+
+#include <string.h>
+#include "pktbuf.h"
+
+/** Sets up a pool of count buffers of size bytes each, contiguous from
+ * base, all free.
+ */
+void pktbuf_init(pktbuf_pool *pool, uint8_t *base, size_t size, uint8_t count) {
+  if (count > PKTBUF_MAX) {
+    count = PKTBUF_MAX;
+  }
+  pool->base = base;
+  pool->size = size;
+  pool->count = count;
+  memset(pool->refs, 0, sizeof(pool->refs));
+  pool->free = count;
+  pool->next = 0;
+  pool->allocs = 0;
+  pool->exhausted = 0;
+  pool->min_free = count;
+}
+
+/** Returns the index of the buffer p points into, or -1 if none. */
+static int index_of(const pktbuf_pool *pool, const uint8_t *p) {
+  size_t offset;
+
+  if (p < pool->base) {
+    return -1;
+  }
+  offset = (size_t)(p - pool->base);
+  if (offset >= pool->size * pool->count) {
+    return -1;
+  }
+  return (int)(offset / pool->size);
+}
+
+/** Returns a free buffer, with one reference, or NULL if none is.
+ * Buffers are handed out in turn, not the most recently freed first,
+ * so one still being looked at by mistake is not overwritten at once.
+ */
+uint8_t *pktbuf_alloc(pktbuf_pool *pool) {
+  uint8_t i = pool->next;
+
+  if (pool->free == 0) {
+    pool->exhausted++;
+    return NULL;
+  }
+  while (pool->refs[i] != 0) {
+    i = (uint8_t)((i + 1) % pool->count);
+  }
+  pool->refs[i] = 1;
+  pool->next = (uint8_t)((i + 1) % pool->count);
+  pool->free--;
+  if (pool->free < pool->min_free) {
+    pool->min_free = pool->free;
+  }
+  pool->allocs++;
+  return pool->base + i * pool->size;
+}
+
+/** Takes another reference to the buffer p points into, which must
+ * already have one. Returns 0 if p is not in the pool.
+ */
+int pktbuf_ref(pktbuf_pool *pool, const uint8_t *p) {
+  int i = index_of(pool, p);
+
+  if (i < 0 || pool->refs[i] == 0) {
+    return 0;
+  }
+  pool->refs[i]++;
+  return 1;
+}
+
+/** Gives back a reference to the buffer p points into, freeing it if
+ * it was the last. Pointers outside the pool are ignored.
+ */
+void pktbuf_release(pktbuf_pool *pool, const uint8_t *p) {
+  int i = index_of(pool, p);
+
+  if (i < 0 || pool->refs[i] == 0) {
+    return;
+  }
+  if (--pool->refs[i] == 0) {
+    pool->free++;
+  }
+}
+
+void pktbuf_reset_stats(pktbuf_pool *pool) {
+  pool->allocs = 0;
+  pool->exhausted = 0;
+  pool->min_free = pool->free;
+}
@@ -0,0 +1,124 @@
+/*
+ * presets.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Settings in the internal flash. See presets.h.
+ *
+ * Each operation is started with the HAL's interrupt driven calls,
+ * which return at once; the HAL calls back from FLASH_IRQn when it
+ * ends, after each sector of an erase & once more at the end. The
+ * flash is unlocked for each operation & locked again once it is seen
+ * to be over. The store reads it through the AXI bus with the D-cache
+ * off, so there is nothing to invalidate after.
+ */
+
+#include "main.h"
+#include "presets.h"
+#include "deferred.h"
+
+#define INIT_ERASE_MS 10000 // The most presets_init() waits for erases
+
+kvstore presets;
+
+static volatile uint8_t flash_status = KVSTORE_FLASH_DONE;
+static uint8_t erasing; // The operation is an erase
+static uint8_t dual_bank;
+
+static int flash_program(void *ctx, uint32_t offset, uint32_t word) {
+  HAL_FLASH_Unlock();
+  erasing = 0;
+  flash_status = KVSTORE_FLASH_BUSY;
+  if (HAL_FLASH_Program_IT(FLASH_TYPEPROGRAM_WORD, PRESETS_ADDRESS + offset, word) != HAL_OK) {
+    flash_status = KVSTORE_FLASH_DONE;
+    HAL_FLASH_Lock();
+    return 0;
+  }
+  return 1;
+}
+
+static int flash_erase(void *ctx, int area) {
+  FLASH_EraseInitTypeDef erase = {0};
+
+  erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+  erase.VoltageRange = FLASH_VOLTAGE_RANGE_3; // x32, at 2.7-3.6 V
+  if (dual_bank) {
+    erase.Sector = FLASH_SECTOR_20 + area * 2;
+    erase.NbSectors = 2;
+  } else {
+    erase.Sector = FLASH_SECTOR_10 + area;
+    erase.NbSectors = 1;
+  }
+  HAL_FLASH_Unlock();
+  erasing = 1;
+  flash_status = KVSTORE_FLASH_BUSY;
+  if (HAL_FLASHEx_Erase_IT(&erase) != HAL_OK) {
+    flash_status = KVSTORE_FLASH_DONE;
+    HAL_FLASH_Lock();
+    return 0;
+  }
+  return 1;
+}
+
+static int flash_check(void *ctx) {
+  uint8_t status = flash_status;
+
+  if (status != KVSTORE_FLASH_BUSY) {
+    HAL_FLASH_Lock();
+  }
+  return status;
+}
+
+static const kvstore_flash presets_flash = {
+    .base = (const uint8_t *)PRESETS_ADDRESS,
+    .area_size = PRESETS_AREA_SIZE,
+    .ctx = NULL,
+    .program = flash_program,
+    .erase = flash_erase,
+    .status = flash_check,
+};
+
+/** Reads the presets. In single bank mode, first erases whatever needs
+ * it, as that stalls everything: call before the audio starts.
+ */
+void presets_init(void) {
+  uint32_t start;
+
+  dual_bank = (FLASH->OPTCR & FLASH_OPTCR_nDBANK) == 0;
+  HAL_NVIC_SetPriority(FLASH_IRQn, PRIO_ISR_FLASH, 0);
+  HAL_NVIC_EnableIRQ(FLASH_IRQn);
+
+  kvstore_mount(&presets, &presets_flash);
+  start = HAL_GetTick();
+  while (!dual_bank && presets.dirty != 0 && HAL_GetTick() - start < INIT_ERASE_MS) {
+    kvstore_poll(&presets, 1);
+    __WFI();
+  }
+}
+
+/** Writes what has been set, a word at a time. Call every tick or so. */
+void presets_poll(void) {
+  kvstore_poll(&presets, dual_bank);
+}
+
+int presets_dual_bank(void) {
+  return dual_bank;
+}
+
+// HAL flash callbacks ///////////////////////////////////////////////////////
+
+/** A word is programmed, or a sector erased: an erase is over after
+ * its last, when the HAL passes 0xFFFFFFFF.
+ */
+void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue) {
+  if (!erasing || ReturnValue == 0xFFFFFFFFU) {
+    flash_status = KVSTORE_FLASH_DONE;
+  }
+}
+
+void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue) {
+  flash_status = KVSTORE_FLASH_FAILED;
+}
@@ -0,0 +1,94 @@
+/*
+ * prof.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * DWT cycle counter profiling. See prof.h.
+ *
+ * References:
+ * - Arm v7-M Architecture Reference Manual, C1.8 (DWT)
+ * - Cortex-M7 TRM: the DWT must be unlocked via LAR before use
+ */
+
+#include <stdio.h>
+#include "main.h"
+#include "prof.h"
+
+// Kept in DTCM as prof_record() touches these on every probe
+FAST_BSS prof_stats prof_sections[PROF_NUM_SECTIONS];
+
+const char *const prof_section_names[PROF_NUM_SECTIONS] = {
+    "check_io",
+    "check_midi_synth",
+    "fill_i2s_data",
+    "process_user_input",
+};
+
+/** Turns on the DWT cycle counter and clears all statistics.
+ * The counter is turned on even when PROF_ENABLED is 0, as
+ * other modules use it for timing too.
+ */
+void prof_init(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55; // Unlock key
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  prof_reset();
+}
+
+void prof_reset(void) {
+  for (int s = 0; s < PROF_NUM_SECTIONS; s++) {
+    prof_stats *ps = &prof_sections[s];
+    ps->count = 0;
+    ps->min = UINT32_MAX;
+    ps->max = 0;
+    ps->total = 0;
+    for (int b = 0; b < PROF_NUM_BUCKETS; b++) {
+      ps->buckets[b] = 0;
+    }
+  }
+}
+
+/** Human readable summary (in cycles) of one section. */
+int prof_snprintf(char *str, size_t size, prof_section s) {
+  const prof_stats *ps = &prof_sections[s];
+
+  if (ps->count == 0) {
+    return snprintf(str, size, "%s: no samples", prof_section_names[s]);
+  }
+  return snprintf(str, size, "%s: n %lu, min %lu, mean %lu, max %lu",
+                  prof_section_names[s], ps->count, ps->min,
+                  (uint32_t)(ps->total / ps->count), ps->max);
+}
+
+/** Human readable list of the non-empty histogram buckets of one section,
+ * as "2^n:count" where the bucket holds samples of 2^n to 2^(n+1)-1 cycles.
+ * Output is truncated if it does not fit.
+ */
+int prof_snprintf_histogram(char *str, size_t size, prof_section s) {
+  const prof_stats *ps = &prof_sections[s];
+  size_t pos = 0;
+  int l;
+
+  if (size == 0) {
+    return 0;
+  }
+  str[0] = '\0';
+
+  for (int b = 0; b < PROF_NUM_BUCKETS; b++) {
+    if (ps->buckets[b] == 0) {
+      continue;
+    }
+    l = snprintf(str + pos, size - pos, " 2^%d:%lu", b, ps->buckets[b]);
+    if (l < 0 || (size_t)l >= size - pos) {
+      // Truncated; snprintf left it NUL terminated
+      return (int)(size - 1);
+    }
+    pos += l;
+  }
+
+  return (int)pos;
+}
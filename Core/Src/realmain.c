@@ -5,7 +5,7 @@
  * auto-generated.
  *
  *  Created on: 2024-08-25
- *  Updated on: 2024-09-08
+ *  Updated on: 2026-10-19
  *      Author: Douglas P. Fields, Jr.
  *   Copyright: 2024, Douglas P. Fields, Jr.
  *     License: Apache 2.0
@@ -13,7 +13,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include <errno.h>
+#include <math.h>
 #include "stm32f7xx_hal.h"
 #include "stm32f7xx_ll_usart.h"
 #include "string.h" // STM32 Core
@@ -22,15 +24,42 @@
 #include "ringbuffer.h"
 #include "midi.h"
 #include "tonegen.h"
-
-#define FAST_BSS __attribute((section(".fast_bss")))
-#define FAST_DATA __attribute((section(".fast_data")))
-
-#define WELCOME_MSG "Nucleo MIDI console v6\r\n"
+#include "prof.h"
+#include "events.h"
+#include "sched.h"
+#include "deferred.h"
+#include "timestamp.h"
+#include "blockq.h"
+#include "midiport.h"
+#include "midiroute.h"
+#include "tempo.h"
+#include "mtc.h"
+#include "dlog.h"
+#include "capture.h"
+#include "smf.h"
+#include "usbdev.h"
+#include "ethif.h"
+#include "telemetry.h"
+#include "osc.h"
+#include "oscaddr.h"
+#include "display.h"
+#include "midimon.h"
+#include "presets.h"
+
+#define WELCOME_MSG "Nucleo MIDI console v8\r\n"
 #define MAIN_MENU   "Options:\r\n" \
                      "\t1. Toggle LD1 Green LED\r\n" \
                      "\t2. Read USER BUTTON status\r\n" \
                      "\t4. Print counters\r\n" \
+                     "\t5. Print profile\r\n" \
+                     "\t6. Reset profile & stats\r\n" \
+                     "\t7. Print task stats\r\n" \
+                     "\t8. Print MIDI ports\r\n" \
+                     "\tr. Next MIDI routing preset\r\n" \
+                     "\tt. Print MIDI tempo & time code\r\n" \
+                     "\tc. Start/stop binary MIDI capture (any c stops)\r\n" \
+                     "\to. Start/stop recording a MIDI file\r\n" \
+                     "\tp. Play/stop the recording (or a demo)\r\n" \
                      "\tqw. Pause/start sound\r\n" \
                      "\t(. Use all mem\r\n" \
                      "\t). Stack overflow\r\n" \
@@ -40,6 +69,13 @@
 #define NOTE_OFF_START "\x80\x3C\x40"
 
 #define I2S_BUFFER_SIZE 128
+#define SAMPLE_RATE 32000
+// Stereo frames in each half of the I2S buffer, and how long they play
+#define I2S_BLOCK_FRAMES (I2S_BUFFER_SIZE / 2 / 2)
+#define I2S_BLOCK_US (I2S_BLOCK_FRAMES * 1000000 / SAMPLE_RATE)
+// Received MIDI is heard this long after it arrived, so that it
+// always lands in a block not yet rendered
+#define SYNTH_LATENCY_US (2 * I2S_BLOCK_US)
 
 uint8_t NOTE_ON[] = NOTE_ON_START;
 uint8_t NOTE_OFF[] = NOTE_OFF_START;
@@ -54,19 +90,52 @@ static uint32_t uart_error_callbacks = 0;
 static uint32_t usart3_interrupts = 0;
 static uint32_t midi_overrun_errors = 0;
 static uint32_t loops_per_tick;
+static uint32_t console_out_max; // High water mark of s_o_rb, bytes
 
-// I/O buffers: Serial and MIDI, in & out
-FAST_BSS char s_i_buff[16];
+// I/O buffers: Serial in & out (MIDI is in midiport.c). The input
+// holds a USB packet; the output keeps the USB serial port busy
+// between main loop passes.
+FAST_BSS char s_i_buff[128];
 FAST_BSS ring_buffer_t s_i_rb;
-FAST_BSS char m_i_buff[16];
-FAST_BSS ring_buffer_t m_i_rb;
-FAST_BSS char s_o_buff[256];
+// Console input bytes lost as s_i_rb was full
+static volatile uint32_t serial_in_drops = 0;
+FAST_BSS char s_o_buff[1024];
 FAST_BSS ring_buffer_t s_o_rb;
-FAST_BSS char m_o_buff[32];
-FAST_BSS ring_buffer_t m_o_rb;
 
-// MIDI input parsers
-FAST_BSS midi_stream midi_stream_0;
+// Where received MIDI goes
+FAST_BSS midi_route_table midi_routes;
+static int midi_route_preset = 0;
+
+// MIDI clock, transport & time code from this port
+#define SYNC_PORT 0
+tempo_tracker midi_tempo;
+mtc_state midi_time_code;
+
+// Received MIDI messages waiting to be shown on the console.
+// Filled in PendSV, emptied by the main loop.
+#define MIDI_MONITOR_SIZE 16 // Power of 2
+FAST_BSS midi_message midi_monitor[MIDI_MONITOR_SIZE];
+FAST_BSS volatile uint32_t midi_monitor_head;
+FAST_BSS volatile uint32_t midi_monitor_tail;
+static volatile uint32_t midi_monitor_drops = 0;
+static uint32_t midi_monitor_max; // High water mark
+
+// Time from a MIDI message's last byte arriving until it is heard
+static uint32_t midi_latency_last = 0;
+static uint32_t midi_latency_max = 0;
+
+// Audio blocks rendered, and how long before each started playing
+// rendering it finished: negative if too late
+static uint32_t audio_blocks;
+static int32_t audio_headroom_last;
+static int32_t audio_headroom_min = INT32_MAX;
+static uint32_t audio_late_blocks;
+
+// Telemetry (telemetry.h): broadcast on our subnet until a host sends
+// us a datagram on TELEMETRY_PORT, then sent to that host
+static volatile uint8_t telemetry_due;
+static uint32_t telemetry_seq;
+static net_endpoint telemetry_to = { .ip = ETHIF_IP | ~ETHIF_NETMASK, .port = TELEMETRY_PORT };
 
 // Test Fast Data
 FAST_DATA char test_fast_string[] = "This is a fast string test.";
@@ -83,66 +152,174 @@ int16_t i2s_buff[I2S_BUFFER_SIZE];
 FAST_DATA static volatile int16_t *i2s_buff_write;
 // Can we write the next half of the buffer now?
 FAST_DATA int i2s_write_available;
+// When the half we write next will start playing
+FAST_DATA static volatile uint32_t i2s_block_time;
+
+// Received MIDI messages & OSC parameter changes waiting for their
+// sample in the audio
+FAST_BSS blockq synth_queue;
+
+// The synth's parameters, as OSC changes them (blockq_push_param())
+#define SYNTH_PARAM_FREQ  1 // Hz
+#define SYNTH_PARAM_LEVEL 2 // 0-1
+
+// As synth_set_param() last set them, by SYNTH_PARAM_
+static float synth_params[3] = { 0.0f, 1024.0f, 0.0f };
+
+// OSC (osc.h, oscaddr.h), on the Ethernet port
+static osc_server synth_osc;
+
+// Settings kept in flash (presets.h), by key: saved every
+// PRESET_SAVE_MS if changed, and set up from them at start
+#define PRESET_ROUTING 0 // midi_route_preset, a byte
+#define PRESET_SYNTH   1 // synth_params[], frequency & level
+#define PRESET_SAVE_MS 1000
+
+// What the display shows (midimon.h) of everything routed
+static midimon midi_activity;
+
+// Binary capture of received MIDI (console c), which replaces the
+// MIDI monitor & other console output while it runs
+capture_log midi_capture;
+
+// Standard MIDI File recorder (console o) of everything received
+#define SMF_RECORD_SIZE     16384
+#define SMF_RECORD_DIVISION 480
+uint8_t smf_record_buff[SMF_RECORD_SIZE];
+smf_writer smf_recorder;
+volatile uint8_t smf_recording = 0;
+int smf_recorded_len = 0;
+
+// Standard MIDI File player (console p), to the synth & this port
+#define SMF_PLAYER_PORT 0
+FAST_BSS smf_reader smf_player;
+FAST_BSS smf_event smf_player_event;
+FAST_BSS uint8_t smf_player_has_event;
+FAST_BSS uint32_t smf_player_start;
+FAST_BSS uint16_t smf_player_channels; // Used, so to be silenced at the end
+FAST_BSS volatile uint8_t smf_playing;
+FAST_BSS volatile uint8_t smf_player_stop;
+
+// Played when nothing has been recorded: an arpeggio
+static const uint8_t smf_demo[] = {
+    'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0x01, 0xE0, // Format 0, 480 per quarter
+    'M', 'T', 'r', 'k', 0, 0, 0, 40,
+    0x00, 0x90, 0x3C, 0x64, 0x83, 0x60, 0x80, 0x3C, 0x00,
+    0x00, 0x90, 0x40, 0x64, 0x83, 0x60, 0x80, 0x40, 0x00,
+    0x00, 0x90, 0x43, 0x64, 0x83, 0x60, 0x80, 0x43, 0x00,
+    0x00, 0x90, 0x48, 0x64, 0x87, 0x40, 0x80, 0x48, 0x00,
+    0x00, 0xFF, SMF_META_END_OF_TRACK, 0x00,
+};
 
 /** Set up all our i/o buffers */
 void init_ring_buffers() {
   ring_buffer_init(&s_i_rb, s_i_buff, sizeof(s_i_buff));
   ring_buffer_init(&s_o_rb, s_o_buff, sizeof(s_o_buff));
-  ring_buffer_init(&m_i_rb, m_i_buff, sizeof(m_i_buff));
-  ring_buffer_init(&m_o_rb, m_o_buff, sizeof(m_o_buff));
-}
-
-/** initialize our MIDI parsers */
-void init_midi_buffers() {
-  midi_stream_init(&midi_stream_0);
 }
 
-/** Read any waiting input from this USART and stick it in the
- * input ring_buffer. Write any output to the USART if it is ready.
+/** Interrupt time servicing of one USART.
+ * Moves a received byte into the input ring_buffer and posts the
+ * receive event, or drops & counts the byte if the ring buffer is full,
+ * as only the reader may move its tail. Sends the next output byte if
+ * the transmitter is ready, or turns off the transmit interrupt if
+ * there is nothing left to send (check_io() turns it back on).
  */
-void check_uart(USART_TypeDef *usart, ring_buffer_t *in_rb, ring_buffer_t *out_rb) {
+static void uart_service(USART_TypeDef *usart, ring_buffer_t *in_rb, ring_buffer_t *out_rb,
+                         uint32_t rx_event, volatile uint32_t *rx_drops) {
   char c;
 
-  // Check for serial output waiting to go
-  if (ring_buffer_num_items(out_rb) > 0) {
-    // Check if we can send the item now
-    if (LL_USART_IsActiveFlag_TXE(usart)) {
-      ring_buffer_dequeue(out_rb, &c);
+  if (LL_USART_IsActiveFlag_RXNE(usart)) {
+    c = LL_USART_ReceiveData8(usart);
+    if (ring_buffer_is_full(in_rb)) {
+      (*rx_drops)++;
+    } else {
+      ring_buffer_queue(in_rb, c);
+    }
+    event_post(rx_event);
+  }
+
+  if (LL_USART_IsEnabledIT_TXE(usart) && LL_USART_IsActiveFlag_TXE(usart)) {
+    if (ring_buffer_dequeue(out_rb, &c)) {
       LL_USART_TransmitData8(usart, c);
+    } else {
+      LL_USART_DisableIT_TXE(usart);
     }
   }
+}
 
-  // Check for serial input waiting to be read
-  if (LL_USART_IsActiveFlag_RXNE(usart)) {
-    c = LL_USART_ReceiveData8(usart);
-    ring_buffer_queue(in_rb, c);
+/** Called by the USART IRQ handlers (stm32f7xx_it.c) ahead of
+ * HAL_UART_IRQHandler(), which is then left to deal with errors only.
+ * The MIDI ports call midiport_isr() instead.
+ */
+void uart_isr(UART_HandleTypeDef *huart) {
+  if (huart == &huart3) {
+    // Serial port
+    uart_service(huart3.Instance, &s_i_rb, &s_o_rb, EV_SERIAL_RX, &serial_in_drops);
   }
 }
 
-/** If there is input ready, pull it into our input buffers.
- * If there is output waiting, send it when possible.
- * If the input buffers are full, increase counters.
+/** If there is output waiting, make sure the transmit interrupt
+ * is on so it will be sent. Input is received by interrupt.
+ * While a terminal has the USB serial port open the console output
+ * goes there instead, and the UART stops taking it.
  */
 void check_io() {
   // Serial port
-  check_uart(huart3.Instance, &s_i_rb, &s_o_rb);
-  // MIDI port
-  check_uart(huart6.Instance, &m_i_rb, &m_o_rb);
+  int usb = usbdev_cdc_open();
+
+  if (usb) {
+    LL_USART_DisableIT_TXE(huart3.Instance);
+  } else if (!ring_buffer_is_empty(&s_o_rb)) {
+    LL_USART_EnableIT_TXE(huart3.Instance);
+  }
+  usbdev_cdc_service(usb);
+  // MIDI ports
+  midiport_check_tx();
 }
 
-/** Queues data to be sent over our serial output. */
+/** Queues data to be sent over our serial output.
+ * The ring buffer drops the oldest output when full, so this waits
+ * for room instead. Call only from the main loop.
+ */
 void serial_transmit(const uint8_t *msg, uint16_t size) {
-  // TODO: Check for send buffer overflow
-  ring_buffer_queue_arr(&s_o_rb, (const char *)msg, (ring_buffer_size_t)size);
-}
+  ring_buffer_size_t room;
 
-/** Queues data to be sent over our serial output. */
-void midi_transmit(const uint8_t *msg, uint16_t size) {
-  // TODO: Check for send buffer overflow
-  ring_buffer_queue_arr(&m_o_rb, (const char *)msg, (ring_buffer_size_t)size);
+  while (size > 0) {
+    room = RING_BUFFER_MASK((&s_o_rb)) - ring_buffer_num_items(&s_o_rb);
+    if (room == 0) {
+      check_io();
+      // The barrier also makes us re-read the ring buffer indices
+      __DSB();
+      __WFI();
+      continue;
+    }
+    if (room > size) {
+      room = size;
+    }
+    ring_buffer_queue_arr(&s_o_rb, (const char *)msg, room);
+    msg += room;
+    size -= room;
+    if (ring_buffer_num_items(&s_o_rb) > console_out_max) {
+      console_out_max = ring_buffer_num_items(&s_o_rb);
+    }
+  }
 }
 
 
+
+/** Blocks until all queued serial output has been sent.
+ * Use this before queueing more than the output buffer holds,
+ * as the ring buffer drops the oldest output when full.
+ */
+void serial_flush(void) {
+  check_io();
+  while (ring_buffer_num_items(&s_o_rb) > 0) {
+    // The barrier also makes us re-read the ring buffer indices
+    __DSB();
+    __WFI();
+  }
+}
+
 /** Returns >= 256 if there is nothing to be read;
  * otherwise returns a uint8_t of what is next to be read.
  */
@@ -161,6 +338,8 @@ void printWelcomeMessage(void) {
   serial_transmit((uint8_t *)test_fast_string, tfs_len);
   serial_transmit((uint8_t *)"<<<\r\n", 5);
   serial_transmit((uint8_t *)WELCOME_MSG, strlen(WELCOME_MSG));
+  // Together these are bigger than our output buffer
+  serial_flush();
   serial_transmit((uint8_t *)MAIN_MENU, strlen(MAIN_MENU));
 }
 
@@ -209,10 +388,10 @@ void alloc_test() {
   do {
     m = malloc(amount);
     if (NULL == m) {
-      snprintf(msg, sizeof(msg) - 1, "OOM: %d; amt: %u\r\n", errno, amount);
+      snprintf(msg, sizeof(msg) - 1, "OOM: %d; amt: %zu\r\n", errno, amount);
       amount >>= 1;
     } else {
-      snprintf(msg, sizeof(msg) - 1, "Addr: %08lX; amt: %u\r\n", (uint32_t)m, amount);
+      snprintf(msg, sizeof(msg) - 1, "Addr: %08" PRIXPTR "; amt: %zu\r\n", (uintptr_t)m, amount);
     }
     serial_transmit((uint8_t *)msg, strlen(msg));
 
@@ -224,6 +403,403 @@ void alloc_test() {
   } while (m != NULL || amount > 0);
 }
 
+/** Dumps the profile of every section to the serial port. */
+void print_profile(void) {
+  char msg[160];
+  int l;
+
+#if PROF_ENABLED
+  serial_transmit((uint8_t *)"\r\n", 2);
+  for (int s = 0; s < PROF_NUM_SECTIONS; s++) {
+    l = prof_snprintf(msg, sizeof(msg) - 1, s);
+    serial_transmit((uint8_t *)msg, l);
+    serial_transmit((uint8_t *)"\r\n ", 3);
+    l = prof_snprintf_histogram(msg, sizeof(msg) - 1, s);
+    serial_transmit((uint8_t *)msg, l);
+    serial_transmit((uint8_t *)"\r\n", 2);
+    // Each section is well under our output buffer size
+    serial_flush();
+  }
+#else
+  l = snprintf(msg, sizeof(msg) - 1, "\r\nProfiling compiled out");
+  serial_transmit((uint8_t *)msg, l);
+#endif
+}
+
+/** Shows where the console is and what the USB serial port has moved. */
+void print_console_stats(void) {
+  char msg[96];
+  int l;
+
+  l = snprintf(msg, sizeof(msg) - 1, "Console on %s; USB rx %lu bytes, tx %lu bytes in %lu transfers\r\n",
+               usbdev_cdc_open() ? "USB" : "USART3", usb_cdc_stats.rx_bytes,
+               usb_cdc_stats.tx_bytes, usb_cdc_stats.tx_transfers);
+  serial_transmit((uint8_t *)msg, l);
+}
+
+/** Dumps the flash settings store's state to the serial port. */
+void print_presets_stats(void) {
+  char msg[128];
+  int l;
+
+  l = snprintf(msg, sizeof(msg) - 1, "Presets: %s bank, area %d generation %lu, %lu of %lu bytes used%s\r\n",
+               presets_dual_bank() ? "dual" : "single", presets.active, presets.generation,
+               presets.write_pos, presets.flash->area_size,
+               presets.dirty ? ", erase waiting" : "");
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1, "Presets: %lu records, %lu compactions, %lu erases, %lu errors, %lu torn words\r\n",
+               presets.records, presets.compactions, presets.erases, presets.errors,
+               presets.torn_words);
+  serial_transmit((uint8_t *)msg, l);
+}
+
+/** Dumps the CPU idle time and event latencies to the serial port. */
+void print_event_stats(void) {
+  char msg[96];
+  int l;
+  uint32_t idle = events_idle_permille();
+  uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+  l = snprintf(msg, sizeof(msg) - 1, "Idle: %lu.%lu%%\r\n", idle / 10, idle % 10);
+  serial_transmit((uint8_t *)msg, l);
+  for (int i = 0; i < EV_NUM; i++) {
+    const event_latency *el = &event_latencies[i];
+    uint32_t mean = el->count == 0 ? 0 : (uint32_t)(el->total / el->count);
+    l = snprintf(msg, sizeof(msg) - 1, "%s latency: n %lu, last %lu, mean %lu, max %lu us\r\n",
+                 event_names[i], el->count, el->last / cycles_per_us,
+                 mean / cycles_per_us, el->max / cycles_per_us);
+    serial_transmit((uint8_t *)msg, l);
+    serial_flush();
+  }
+}
+
+/** Dumps the deferred (PendSV) job statistics to the serial port. */
+void print_deferred_stats(void) {
+  char msg[112];
+  int l;
+
+  for (int i = 0; i < DEFER_NUM; i++) {
+    const deferred_stats *ds = &deferred_job_stats[i];
+    l = snprintf(msg, sizeof(msg) - 1,
+                 "PendSV %s: runs %lu, latency last %lu max %lu cyc, max run %lu cyc\r\n",
+                 deferred_names[i], ds->count, ds->last_latency, ds->max_latency, ds->max_run);
+    serial_transmit((uint8_t *)msg, l);
+    serial_flush();
+  }
+}
+
+/** Dumps the scheduler statistics of every task to the serial port. */
+void print_task_stats(void) {
+  char msg[128];
+  int l;
+  uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+  serial_transmit((uint8_t *)"\r\n", 2);
+  for (size_t i = 0; i < sched_num_tasks(); i++) {
+    const sched_task *t = sched_get_task(i);
+    l = snprintf(msg, sizeof(msg) - 1,
+                 "%s: runs %lu, max run %lu us, max resp %lu us, misses %lu, overruns %lu\r\n",
+                 t->name, t->runs, t->max_run / cycles_per_us, t->max_response / cycles_per_us,
+                 t->deadline_misses, t->budget_overruns);
+    serial_transmit((uint8_t *)msg, l);
+    serial_flush();
+  }
+  print_deferred_stats();
+  l = snprintf(msg, sizeof(msg) - 1, "MIDI monitor drops: %lu, log drops: %lu, console rx drops: %lu\r\n",
+               midi_monitor_drops, dlog.drops, serial_in_drops);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1, "MIDI receive to sound latency: last %lu, max %lu us\r\n",
+               midi_latency_last, midi_latency_max);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1, "Synth queue late %lu, dropped %lu\r\n",
+               synth_queue.late, synth_queue.dropped);
+  serial_transmit((uint8_t *)msg, l);
+}
+
+// Routing presets, chosen with console r
+static const char *const midi_route_preset_names[] = {
+    "din0 to synth",
+    "all to synth, each thru to itself",
+    "all to synth & every other port",
+    "din0 to synth, channels 1-8 to din1, 9-16 to din2",
+    "din0 & usb0 to synth & each other",
+    "din0 & net0 to synth & each other",
+};
+#define NUM_MIDI_ROUTE_PRESETS (sizeof(midi_route_preset_names) / sizeof(midi_route_preset_names[0]))
+
+/** Sets up one of the routing presets. The table is swapped
+ * with PendSV masked so no message sees half of it.
+ */
+void set_midi_route_preset(int preset) {
+  static midi_route_table next;
+  uint8_t all_ports = (1 << MIDI_NUM_PORTS) - 1;
+
+  midiroute_clear(&next);
+  for (uint8_t p = 0; p < MIDI_NUM_PORTS; p++) {
+    switch (preset) {
+    case 0:
+      if (p == 0) {
+        midiroute_connect(&next, p, MIDIROUTE_ALL_CLASSES, MIDIROUTE_ALL_CHANNELS, MIDIROUTE_SYNTH);
+      }
+      break;
+    case 1:
+      midiroute_connect(&next, p, MIDIROUTE_ALL_CLASSES, MIDIROUTE_ALL_CHANNELS,
+                        MIDIROUTE_SYNTH | (1 << p));
+      break;
+    case 2:
+      midiroute_connect(&next, p, MIDIROUTE_ALL_CLASSES, MIDIROUTE_ALL_CHANNELS,
+                        MIDIROUTE_SYNTH | (all_ports & ~(1 << p)));
+      break;
+    case 3:
+      if (p == 0) {
+        midiroute_connect(&next, p, MIDIROUTE_ALL_CLASSES, MIDIROUTE_ALL_CHANNELS, MIDIROUTE_SYNTH);
+        midiroute_connect(&next, p, MIDIROUTE_ALL_CLASSES, 0x00FF, 1 << 1);
+        midiroute_connect(&next, p, MIDIROUTE_ALL_CLASSES, 0xFF00, 1 << 2);
+      }
+      break;
+    case 4:
+      // A USB to DIN MIDI interface
+      if (p == 0) {
+        midiroute_connect(&next, p, MIDIROUTE_ALL_CLASSES, MIDIROUTE_ALL_CHANNELS,
+                          MIDIROUTE_SYNTH | (1 << MIDI_SOURCE_USB));
+        midiroute_connect(&next, MIDI_SOURCE_USB, MIDIROUTE_ALL_CLASSES, MIDIROUTE_ALL_CHANNELS,
+                          MIDIROUTE_SYNTH | (1 << p));
+      }
+      break;
+    case 5:
+      // A network to DIN MIDI interface
+      if (p == 0) {
+        midiroute_connect(&next, p, MIDIROUTE_ALL_CLASSES, MIDIROUTE_ALL_CHANNELS,
+                          MIDIROUTE_SYNTH | (1 << MIDI_SOURCE_NET));
+        midiroute_connect(&next, MIDI_SOURCE_NET, MIDIROUTE_ALL_CLASSES, MIDIROUTE_ALL_CHANNELS,
+                          MIDIROUTE_SYNTH | (1 << p));
+      }
+      break;
+    }
+  }
+
+  deferred_mask();
+  midi_routes = next;
+  deferred_unmask();
+  midi_route_preset = preset;
+}
+
+/** Shows the tempo, transport & time code followed from SYNC_PORT. */
+void print_tempo(void) {
+  char msg[128];
+  int l;
+  uint32_t bpm = tempo_bpm_x100(&midi_tempo);
+  uint32_t pos = midi_tempo.position;
+
+  l = snprintf(msg, sizeof(msg) - 1,
+               "\r\nTempo: %lu.%02lu BPM, jitter mean %lu max %lu us, %s, position %lu:%lu:%lu\r\n",
+               bpm / 100, bpm % 100, midi_tempo.jitter_q4 >> 4, midi_tempo.jitter_max,
+               midi_tempo.running ? "running" : "stopped",
+               pos / (TEMPO_CLOCKS_PER_BEAT * 4) + 1, // 4/4 bars
+               pos / TEMPO_CLOCKS_PER_BEAT % 4 + 1,
+               pos % TEMPO_CLOCKS_PER_BEAT);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1, "Clocks %lu, relocks %lu, phase now %lu/65536\r\n",
+               midi_tempo.clocks, midi_tempo.relocks, tempo_phase(&midi_tempo, timestamp_now()));
+  serial_transmit((uint8_t *)msg, l);
+  l = mtc_snprintf(msg, sizeof(msg) - 1, &midi_time_code, timestamp_now());
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1, "\r\nQuarter frames %lu, full frames %lu, reversals %lu, breaks %lu\r\n",
+               midi_time_code.quarter_frame_count, midi_time_code.full_frame_count,
+               midi_time_code.direction_changes, midi_time_code.sequence_breaks);
+  serial_transmit((uint8_t *)msg, l);
+}
+
+static const char *midi_source_name(uint8_t s) {
+  if (s < MIDI_NUM_PORTS) {
+    return midi_ports[s].name;
+  }
+  if (s == MIDI_SOURCE_USB) {
+    return "usb0";
+  }
+  return s == MIDI_SOURCE_NET ? "net0" : "player";
+}
+
+/** Dumps the counters of every MIDI port to the serial port. */
+void print_midi_ports(void) {
+  char msg[128];
+  int l;
+
+  l = snprintf(msg, sizeof(msg) - 1, "\r\nRouting: %s\r\n",
+               midi_route_preset_names[midi_route_preset]);
+  serial_transmit((uint8_t *)msg, l);
+  for (uint8_t p = 0; p < MIDI_NUM_PORTS; p++) {
+    const midi_port *mp = &midi_ports[p];
+    l = snprintf(msg, sizeof(msg) - 1,
+                 "%s: rx %lu bytes %lu msgs, ORE %lu, in drops %lu, rt drops %lu\r\n",
+                 mp->name, mp->rx_bytes, mp->rx_messages, mp->overruns, mp->in_drops,
+                 mp->rt_drops);
+    serial_transmit((uint8_t *)msg, l);
+    // What was merged onto this output, from each source
+    for (uint8_t s = 0; s < mp->merge.num_sources; s++) {
+      const midimerge_source *ms = &mp->merge.sources[s];
+      if (ms->sent == 0 && ms->drops == 0) {
+        continue;
+      }
+      l = snprintf(msg, sizeof(msg) - 1,
+                   " from %s: sent %lu, drops %lu, depth %lu max %lu, latency mean %lu max %lu us\r\n",
+                   midi_source_name(s), ms->sent, ms->drops, midimerge_depth(&mp->merge, s),
+                   ms->max_depth, ms->sent == 0 ? 0 : (uint32_t)(ms->total_latency / ms->sent),
+                   ms->max_latency);
+      serial_transmit((uint8_t *)msg, l);
+      serial_flush();
+    }
+    serial_flush();
+  }
+  l = snprintf(msg, sizeof(msg) - 1,
+               "usb0 (%s): rx %lu msgs, ignored %lu, overruns %lu; tx %lu msgs in %lu transfers, drops %lu\r\n",
+               usbdev_configured() ? "configured" : "not configured", usb_midi.rx_messages,
+               usb_midi.rx_ignored, usb_midi.rx_overruns, usb_midi.tx_messages,
+               usb_midi.tx_transfers, usb_midi.tx_drops);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1, "net0 (%s%s%s): link %s%s, changes %lu\r\n",
+               rtpmidi_state_name(eth_session.state), eth_session.state == RTPMIDI_OPEN ? " with " : "",
+               eth_session.state == RTPMIDI_OPEN ? eth_session.peer_name : "",
+               !eth_stats.link_up ? "down" : eth_stats.speed_100 ? "100M" : "10M",
+               !eth_stats.link_up ? "" : eth_stats.full_duplex ? " full duplex" : " half duplex",
+               eth_stats.link_changes);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1, " rx %lu msgs in %lu pkts, lost %lu, recovered %lu, late %lu\r\n",
+               eth_session.rx_messages, eth_session.rx_packets, eth_session.rx_lost,
+               eth_session.rx_recovered, eth_session.rx_late);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1, " tx %lu msgs in %lu pkts, drops %lu, journal resets %lu\r\n",
+               eth_session.tx_messages, eth_session.tx_packets, eth_session.tx_drops,
+               eth_session.journal_resets);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1,
+               " frames rx %lu, dropped %lu, bad %lu; tx %lu; DMA errors %lu\r\n",
+               eth_stats.rx_frames, eth_stats.rx_dropped, eth_net.rx_errors, eth_stats.tx_frames,
+               eth_stats.dma_errors);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1,
+               " buffers %u free, min %u, exhausted %lu; starved rx %lu (unbuffered %lu), tx %lu\r\n",
+               eth_pool.free, eth_pool.min_free, eth_pool.exhausted, eth_stats.rx_starved,
+               eth_stats.rx_unbuffered, eth_stats.tx_starved);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1,
+               "osc (port %u): rx %lu msgs in %lu pkts, %lu bundles; bad %lu, unmatched %lu, bad args %lu\r\n",
+               OSC_PORT, synth_osc.rx_messages, synth_osc.rx_packets, synth_osc.rx_bundles,
+               synth_osc.rx_errors, synth_osc.rx_unmatched, synth_osc.rx_bad_args);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1,
+               " clock %s, syncs %lu; timetags unsynced %lu, late %lu, too far ahead %lu\r\n",
+               synth_osc.synced ? "set" : "not set", synth_osc.syncs, synth_osc.rx_unsynced,
+               synth_osc.rx_late, synth_osc.rx_too_far);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1, "Display (i2c1): %s; %lu transfers, %lu bytes, errors %lu\r\n",
+               oled_stats.present ? "present" : "absent", oled_stats.transfers, oled_stats.bytes,
+               oled_stats.errors);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1, " pages sent %lu, unchanged %lu; set ups %lu; flush max %lu us\r\n",
+               oled.pages_sent, oled.pages_unchanged, oled.set_ups, oled_stats.busy_max_us);
+  serial_transmit((uint8_t *)msg, l);
+  l = snprintf(msg, sizeof(msg) - 1, "Capture: records %lu (repeats %lu), drops %lu, max used %lu of %u bytes\r\n",
+               midi_capture.records, midi_capture.repeats, midi_capture.drops, midi_capture.max_used,
+               CAPTURE_SIZE);
+  serial_transmit((uint8_t *)msg, l);
+}
+
+/** Starts streaming received MIDI in binary (see capture.h) instead
+ * of the console's text, once the text already queued has gone.
+ */
+void start_midi_capture(void) {
+  serial_transmit((uint8_t *)"\r\nCapturing; c stops\r\n", 22);
+  serial_flush();
+  deferred_mask();
+  capture_start(&midi_capture, timestamp_now());
+  deferred_unmask();
+  // Nothing more is queued for the monitor; what is, is not shown
+  midi_monitor_tail = midi_monitor_head;
+}
+
+/** Stops the capture, sending the rest of it before any more text. */
+void stop_midi_capture(void) {
+  uint8_t buff[64];
+  size_t n;
+
+  deferred_mask();
+  capture_stop(&midi_capture);
+  deferred_unmask();
+  while ((n = capture_read(&midi_capture, buff, sizeof(buff))) > 0) {
+    serial_transmit(buff, n);
+  }
+  serial_flush();
+}
+
+/** Starts recording everything received into a Standard MIDI File,
+ * or stops & keeps it to be played.
+ */
+void toggle_smf_recording(void) {
+  char msg[64];
+  int l;
+
+  if (!smf_recording) {
+    deferred_mask();
+    smf_writer_init(&smf_recorder, smf_record_buff, sizeof(smf_record_buff),
+                    SMF_RECORD_DIVISION, timestamp_now());
+    smf_recording = 1;
+    deferred_unmask();
+    serial_transmit((uint8_t *)"\r\nRecording", strlen("\r\nRecording"));
+    return;
+  }
+
+  deferred_mask();
+  smf_recording = 0;
+  deferred_unmask();
+  smf_recorded_len = smf_writer_finish(&smf_recorder);
+  l = snprintf(msg, sizeof(msg) - 1, "\r\nRecorded %d bytes%s", smf_recorded_len,
+               smf_recorder.overflow ? ", cut short as it was full" : "");
+  serial_transmit((uint8_t *)msg, l);
+}
+
+/** Starts playing the recording, or the demo if there is none, or
+ * stops what is playing.
+ */
+void toggle_smf_playing(void) {
+  char msg[40];
+  int l;
+  int err;
+
+  if (smf_playing) {
+    smf_player_stop = 1;
+    serial_transmit((uint8_t *)"\r\nStopping", strlen("\r\nStopping"));
+    return;
+  }
+  if (smf_recording) {
+    serial_transmit((uint8_t *)"\r\nStop recording first", strlen("\r\nStop recording first"));
+    return;
+  }
+
+  if (smf_recorded_len > 0) {
+    err = smf_open(&smf_player, smf_record_buff, smf_recorded_len);
+  } else {
+    err = smf_open(&smf_player, smf_demo, sizeof(smf_demo));
+  }
+  if (err != 0) {
+    l = snprintf(msg, sizeof(msg) - 1, "\r\nCannot play: error %d", err);
+    serial_transmit((uint8_t *)msg, l);
+    return;
+  }
+
+  deferred_mask();
+  smf_player_has_event = 0;
+  smf_player_channels = 0;
+  smf_player_stop = 0;
+  // As received MIDI, it is heard after SYNTH_LATENCY_US
+  smf_player_start = timestamp_now() + SYNTH_LATENCY_US;
+  smf_playing = 1;
+  deferred_unmask();
+  l = snprintf(msg, sizeof(msg) - 1, "\r\nPlaying %s",
+               smf_recorded_len > 0 ? "the recording" : "the demo");
+  serial_transmit((uint8_t *)msg, l);
+}
+
 /** Interprets numbers as menu options.
  * Interprets letters as notes to send via MIDI.
  * Ignores the rest.
@@ -257,6 +833,61 @@ uint8_t process_user_input(uint8_t opt) {
     serial_transmit((uint8_t*)msg, l);
     l = snprintf(msg, sizeof(msg) - 1, "LPT: %lu\r\n", loops_per_tick);
     serial_transmit((uint8_t*)msg, l);
+    print_console_stats();
+    print_presets_stats();
+    print_event_stats();
+    break;
+  case '5':
+    print_profile();
+    break;
+  case '6':
+    prof_reset();
+    events_reset_stats();
+    sched_reset_stats();
+    deferred_reset_stats();
+    midiport_reset_stats();
+    usbmidi_reset_stats(&usb_midi);
+    deferred_mask();
+    ethif_reset_stats();
+    osc_reset_stats(&synth_osc);
+    deferred_unmask();
+    display_reset_stats();
+    tempo_reset_stats(&midi_tempo);
+    midi_latency_max = 0;
+    synth_queue.late = 0;
+    synth_queue.dropped = 0;
+    synth_queue.max_count = 0;
+    audio_headroom_min = INT32_MAX;
+    audio_late_blocks = 0;
+    console_out_max = 0;
+    midi_monitor_max = 0;
+    dlog.drops = 0;
+    serial_in_drops = 0;
+    break;
+  case '7':
+    print_task_stats();
+    break;
+  case '8':
+    print_midi_ports();
+    break;
+  case 't':
+    print_tempo();
+    break;
+  case 'c':
+    start_midi_capture();
+    break;
+  case 'o':
+    toggle_smf_recording();
+    break;
+  case 'p':
+    toggle_smf_playing();
+    break;
+  case 'r':
+    set_midi_route_preset((midi_route_preset + 1) % NUM_MIDI_ROUTE_PRESETS);
+    l = snprintf(msg, sizeof(msg) - 1, "\r\nRouting: ");
+    serial_transmit((uint8_t *)msg, l);
+    serial_transmit((uint8_t *)midi_route_preset_names[midi_route_preset],
+                    strlen(midi_route_preset_names[midi_route_preset]));
     break;
   case 'q':
     // (+) Pause the DMA Transfer using HAL_I2S_DMAPause()
@@ -284,42 +915,6 @@ uint8_t process_user_input(uint8_t opt) {
   return 1;
 }
 
-/** Reads from our MIDI input ring buffer.
- * Returns 0-255 when byte received.
- * Returns 256+ when no byte received.
- */
-uint16_t read_midi(void) {
-  uint8_t c;
-
-  if (!ring_buffer_dequeue(&m_i_rb, (char *)&c)) {
-    // No input available
-    return (uint16_t)0x100U;
-  }
-  return (uint16_t)c;
-}
-
-/**
- * Processes a received MIDI byte.
- * For now, just print it (which will certainly lead to overrun).
- */
-void process_midi(uint8_t midi_byte) {
-  char msg[64];
-  midi_message mm;
-
-  // Don't print every byte anymore
-  /*
-  snprintf(msg, sizeof(msg) - 1, "\r\nMIDI byte: %02X\r\n", midi_byte);
-  serial_transmit((uint8_t *)msg, strlen(msg));
-  */
-
-  if (midi_stream_receive(&midi_stream_0, midi_byte, &mm)) {
-    // Received a full MIDI message
-    midi_snprintf(msg, sizeof(msg) - 1, &mm);
-    serial_transmit((uint8_t *)msg, strlen(msg));
-    serial_transmit((uint8_t *)"\r\n", 2);
-  }
-}
-
 // I2S Callbacks ///////////////////////////////////////////////////////////////
 
 /** We have transmitted half the data; we can now re-fill the front
@@ -327,7 +922,10 @@ void process_midi(uint8_t midi_byte) {
  */
 void HAL_I2S_TxHalfCpltCallback(I2S_HandleTypeDef *hi2s) {
   i2s_buff_write = i2s_buff;
+  // It plays once the other half, just started, is done
+  i2s_block_time = timestamp_now() + I2S_BLOCK_US;
   i2s_write_available = 1;
+  deferred_post(DEFER_AUDIO);
 }
 
 /** We've transmitted all the data; we can start filling the
@@ -335,21 +933,113 @@ void HAL_I2S_TxHalfCpltCallback(I2S_HandleTypeDef *hi2s) {
  */
 void HAL_I2S_TxCpltCallback(I2S_HandleTypeDef *hi2s) {
   i2s_buff_write = &i2s_buff[I2S_BUFFER_SIZE / 2];
+  i2s_block_time = timestamp_now() + I2S_BLOCK_US;
   i2s_write_available = 1;
+  deferred_post(DEFER_AUDIO);
+}
+
+// When > 127, no current note
+static uint8_t current_midi_note;
+
+/** Sets one of the synth's parameters (SYNTH_PARAM_), at full
+ * resolution: the frequency to a hundredth of a Hz, the level to a
+ * step of the tone generator's amplitude.
+ */
+static void synth_set_param(uint8_t param, float value) {
+  switch (param) {
+  case SYNTH_PARAM_FREQ:
+    // Also NaNs
+    if (!(value >= 0.0f)) {
+      value = 0.0f;
+    } else if (value > SAMPLE_RATE / 2) {
+      value = SAMPLE_RATE / 2;
+    }
+    tonegen_set_x100(&tonegen1, (uint32_t)(value * 100.0f + 0.5f), tonegen1.desired_ampl);
+    synth_params[param] = value;
+    break;
+  case SYNTH_PARAM_LEVEL:
+    if (!(value >= 0.0f)) {
+      value = 0.0f;
+    } else if (value > 1.0f) {
+      value = 1.0f;
+    }
+    tonegen_set_x100(&tonegen1, tonegen1.freq_x100, (int16_t)(value * INT16_MAX));
+    synth_params[param] = value;
+    break;
+  }
+}
+
+/** blockq_apply_fn for our synth.
+ *
+ * For note On: Sets the frequency and amplitude and switches
+ * the tone generator to that. Records the current playing note number.
+ *
+ * For note Off: If currently playing note number, turns it off.
+ * Otherwise ignores it.
+ *
+ * Parameter changes (from OSC) are made as they are.
+ */
+static void synth_apply(void *ctx, const blockq_event *e, uint32_t frame) {
+  uint32_t block_time = *(uint32_t *)ctx;
+  const midi_message *mm = &e->msg;
+
+  if (e->param != BLOCKQ_MIDI) {
+    synth_set_param(e->param, e->value);
+    return;
+  }
+
+  if ((mm->type & 0xF0) == MIDI_NOTE_ON) {
+    current_midi_note = mm->note;
+    if (current_midi_note > 127) current_midi_note = 127;
+    // TODO: Set amplitude by velocity
+    tonegen_set_x100(&tonegen1, midi_note_freqX100[current_midi_note], mm->velocity * 250);
+  } else if ((mm->type & 0xF0) == MIDI_NOTE_OFF) {
+    if (current_midi_note == mm->note) {
+      tonegen_set_x100(&tonegen1, tonegen1.freq_x100, 0);
+    }
+  }
+
+  // When it will be heard, relative to when it arrived
+  if (mm->port == MIDI_SOURCE_PLAYER) {
+    return;
+  }
+  midi_latency_last = block_time + frame * 1000000 / SAMPLE_RATE - mm->timestamp;
+  if (midi_latency_last > midi_latency_max) midi_latency_max = midi_latency_last;
+}
+
+/** blockq_render_fn for our synth: fills frames of the half buffer
+ * being written.
+ */
+static void synth_render(void *ctx, uint32_t first_frame, uint32_t frames) {
+  int16_t *next_sample_loc = (int16_t *)i2s_buff_write + first_frame * 2; // Remove volatility
+
+  for (uint32_t i = 0; i < frames * 2; i++) {
+    *next_sample_loc = tonegen_next_sample(&tonegen1);
+    next_sample_loc++;
+  }
 }
 
 /** Fill our send buffer with the next BUFFER_SIZE / 2
- * amount of stuff to do.
+ * amount of stuff to do, applying queued MIDI at its exact sample.
  */
 void fill_i2s_data() {
-  int16_t *next_sample_loc = (int16_t *)i2s_buff_write; // Remove volatility
+  uint32_t block_time = i2s_block_time;
+  int32_t headroom;
 
   HAL_GPIO_WritePin(GPIOB, GPIO_PIN_14, 1); // Red LED
 
-  for (int i = 0; i < I2S_BUFFER_SIZE / 2; i++) {
-    *next_sample_loc = tonegen_next_sample(&tonegen1);
-    next_sample_loc++;
+  blockq_render(&synth_queue, block_time, I2S_BLOCK_FRAMES, SAMPLE_RATE,
+                synth_render, synth_apply, &block_time);
+
+  headroom = (int32_t)(i2s_block_time - timestamp_now());
+  audio_headroom_last = headroom;
+  if (headroom < audio_headroom_min) {
+    audio_headroom_min = headroom;
+  }
+  if (headroom < 0) {
+    audio_late_blocks++;
   }
+  audio_blocks++;
 
   // TODO: Deal with race condition - what if the buffer empties
   // while we're doing this? Should we set the flag to 0 at the
@@ -358,124 +1048,743 @@ void fill_i2s_data() {
   HAL_GPIO_WritePin(GPIOB, GPIO_PIN_14, 0); // Red LED
 }
 
-///////////////////////////////////////////////////////////////////////////////
-
-// When > 127, no current note
-static uint8_t current_midi_note;
+/** At the end of playing, silences the synth and sends an all notes off
+ * for one channel that was played; call each block until it returns 1.
+ */
+static int silence_smf_player(void) {
+  midi_message mm = { 0 };
+
+  tonegen_set(&tonegen1, tonegen1.desired_freq, 0);
+  // One a block, so as not to overflow the merge queue
+  for (uint8_t ch = 0; ch < 16; ch++) {
+    if (smf_player_channels & (1 << ch)) {
+      smf_player_channels &= ~(1 << ch);
+      mm.type = MIDI_MODE_ALL_NOTES_OFF;
+      mm.channel = ch;
+      mm.port = MIDI_SOURCE_PLAYER;
+      midiport_send(SMF_PLAYER_PORT, &mm);
+      midiport_pump(SMF_PLAYER_PORT);
+      return 0;
+    }
+  }
+  return 1;
+}
 
-/** Reads any pending MIDI inputs.
- *
- * For note On: Sets the frequency and amplitude and switches
- * the tone generator to that. Records the current playing note number.
- *
- * For note Off: If currently playing note number, turns it off.
- * Otherwise ignores it.
+/** Plays the MIDI file: queues each event for the synth at its exact
+ * sample, once it falls within the next two blocks, and sends it out
+ * SMF_PLAYER_PORT then (up to that much early). Runs in PendSV before
+ * each block is rendered, starting at block_time.
  */
-void check_midi_synth() {
-  uint16_t midi_in = read_midi();
-  midi_message mm;
-  char msg[64];
+static void play_smf(uint32_t block_time) {
+  uint32_t horizon = block_time + 2 * I2S_BLOCK_US;
+  int sent = 0;
+  int r;
+
+  if (!smf_playing) {
+    return;
+  }
+  if (smf_player_stop) {
+    if (silence_smf_player()) {
+      smf_playing = 0;
+    }
+    return;
+  }
 
-  if (midi_in <= 255) {
-    if (midi_stream_receive(&midi_stream_0, midi_in, &mm)) {
-      // Received a full MIDI message
-
-      // Update our notes playing
-      if ((mm.type & 0xF0) == MIDI_NOTE_ON) {
-        current_midi_note = mm.note;
-        if (current_midi_note > 127) current_midi_note = 127;
-        // TODO: Set amplitude by velocity
-        tonegen_set(&tonegen1, midi_note_freqX100[current_midi_note] / 100, mm.velocity * 250);
-      } else if ((mm.type & 0xF0) == MIDI_NOTE_OFF) {
-        if (current_midi_note == mm.note) {
-          tonegen_set(&tonegen1, tonegen1.desired_freq, 0);
-        }
+  while (1) {
+    if (!smf_player_has_event) {
+      r = smf_next(&smf_player, &smf_player_event);
+      if (r != 1) {
+        // The end, or a damaged file
+        smf_player_stop = 1;
+        break;
       }
+      if (smf_player_event.kind != SMF_EVENT_MIDI) {
+        continue;
+      }
+      smf_player_has_event = 1;
+    }
 
-      // And show what we received
-      midi_snprintf(msg, sizeof(msg) - 1, &mm);
-      serial_transmit((uint8_t *)msg, strlen(msg));
-      serial_transmit((uint8_t *)"\r\n", 2);
+    uint32_t when = smf_player_start + (uint32_t)smf_player_event.time_us;
+    // Later events wait, as do those that do not fit in the queue now
+    if ((int32_t)(when - horizon) >= 0 || synth_queue.count >= BLOCKQ_SIZE) {
+      break;
+    }
+    midi_message *mm = &smf_player_event.msg;
+    mm->port = MIDI_SOURCE_PLAYER;
+    mm->timestamp = when;
+    blockq_push(&synth_queue, when, mm);
+    if (midi_message_class(mm) != MIDI_CLASS_SYSTEM) {
+      smf_player_channels |= 1 << mm->channel;
     }
+    midiport_send(SMF_PLAYER_PORT, mm);
+    smf_player_has_event = 0;
+    sent = 1;
+  }
+  if (sent) {
+    midiport_pump(SMF_PLAYER_PORT);
   }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void realmain() {
-  uint16_t opt = 0;
-  uint32_t last_overrun_errors = overrun_errors;
-  uint32_t last_usart3_interrupts = usart3_interrupts;
-  char msg[36];
-  uint32_t counter = 0;
-  const uint32_t end_counter = 1000000;
-  uint8_t processed_input;
-  uint32_t cur_tick;
-  uint32_t last_tick = HAL_GetTick();
-  uint32_t tick_counter = 0;
+/** Sends one received message where midi_routes says: to other ports,
+ * and/or to be played by fill_i2s_data() at SYNTH_LATENCY_US after it
+ * arrived. sysex is the data of a SysEx. Returns 1 if it was queued
+ * for check_midi_monitor() to show.
+ */
+static int route_message(uint8_t p, const midi_message *mm, const uint8_t *sysex) {
+  uint8_t out = midiroute_lookup(&midi_routes, p, mm);
+
+  midimon_message(&midi_activity, mm);
+  if (p == SYNC_PORT) {
+    tempo_receive(&midi_tempo, mm);
+    mtc_receive(&midi_time_code, mm);
+    if (mm->type == MIDI_SYSEX) {
+      mtc_receive_sysex(&midi_time_code, sysex, mm->data1, mm->timestamp);
+    }
+  }
 
-  // test_i2s();
+  for (uint8_t o = 0; o < MIDI_NUM_PORTS; o++) {
+    if (out & (1 << o)) {
+      midiport_send(o, mm);
+    }
+  }
+  if (out & (1 << MIDI_SOURCE_USB)) {
+    usbmidi_send(&usb_midi, mm, sysex);
+  }
+  if (out & (1 << MIDI_SOURCE_NET)) {
+    rtpmidi_send(&eth_session, mm, sysex, timestamp_now());
+  }
+  if (out & MIDIROUTE_SYNTH) {
+    // Play it on its own sample
+    blockq_push(&synth_queue, mm->timestamp + SYNTH_LATENCY_US, mm);
+  }
 
-  init_ring_buffers();
-  init_midi_buffers();
-  tonegen_init(&tonegen1, 32000);
-  tonegen_set(&tonegen1, 1024, 0); // Frequency, Amplitude
+  if (smf_recording) {
+    smf_writer_add(&smf_recorder, mm);
+  }
 
-  // Start the DMA streams for I²S
-  // HAL_I2S_Transmit_DMA(&hi2s3, triangle_wave, sizeof(triangle_wave) / sizeof(triangle_wave[0]));
-  HAL_I2S_Transmit_DMA(&hi2s3, (uint16_t *)i2s_buff, I2S_BUFFER_SIZE);
+  // And show what we received, later, as formatting it is slow
+  if (midi_capture.active) {
+    capture_message(&midi_capture, mm, sysex);
+    return 1;
+  }
+  if (midi_monitor_head - midi_monitor_tail < MIDI_MONITOR_SIZE) {
+    midi_monitor[midi_monitor_head & (MIDI_MONITOR_SIZE - 1)] = *mm;
+    // Publish the message only once it is all written
+    __DMB();
+    midi_monitor_head++;
+    if (midi_monitor_head - midi_monitor_tail > midi_monitor_max) {
+      midi_monitor_max = midi_monitor_head - midi_monitor_tail;
+    }
+    return 1;
+  }
+  midi_monitor_drops++;
+  return 0;
+}
 
-  printMessage:
-  printWelcomeMessage();
+/** Reads all pending MIDI inputs, of every port and USB, and routes
+ * each message. RTP-MIDI's are routed as they arrive, by deferred_net().
+ * Runs in PendSV, so it never races the audio rendering.
+ */
+void route_midi(void) {
+  midi_message mm;
+  int queued = 0;
 
-  while (1) {
-    // Always check for I/O available for read/write
-    check_io();
+  for (uint8_t p = 0; p < MIDI_NUM_PORTS; p++) {
+    while (midiport_receive(p, &mm)) {
+      queued |= route_message(p, &mm, midi_ports[p].parser.sysex);
+    }
+  }
+  while (usbmidi_receive(&usb_midi, &mm)) {
+    queued |= route_message(MIDI_SOURCE_USB, &mm, usb_midi.rx_sysex.sysex);
+  }
+  // Send what we routed, whole messages round-robin by source, what
+  // is for USB in one transfer, and for RTP-MIDI in one packet
+  midiport_pump_all();
+  usbdev_midi_service();
+  rtpmidi_flush(&eth_session, timestamp_now());
+
+  if (queued) {
+    event_post(EV_MIDI_MSG);
+  }
+}
 
-    // Handle our MIDI state machine
-    check_midi_synth();
+/** Shows the received MIDI messages on the console, a queue's worth
+ * at a time: under sustained input they arrive faster than the console
+ * sends them, and the other console tasks must get a turn.
+ */
+void check_midi_monitor(void) {
+  char msg[64];
+  uint32_t shown = 0;
 
-    if (i2s_write_available) {
-      fill_i2s_data();
+  while (midi_monitor_tail != midi_monitor_head) {
+    if (shown++ == MIDI_MONITOR_SIZE) {
+      event_post(EV_MIDI_MSG); // Run again for the rest
+      return;
     }
+    midi_message *mm = &midi_monitor[midi_monitor_tail & (MIDI_MONITOR_SIZE - 1)];
+    msg[0] = '0' + mm->port;
+    msg[1] = ':';
+    msg[2] = ' ';
+    midi_snprintf(msg + 3, sizeof(msg) - 4, mm);
+    // Done with the slot before the producer may reuse it
+    __DMB();
+    midi_monitor_tail++;
+    serial_transmit((uint8_t *)msg, strlen(msg));
+    serial_transmit((uint8_t *)"\r\n", 2);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
 
-    // Now do everything in an entirely non-blocking way
-    opt = read_user_input();
-    processed_input = process_user_input(opt);
+/** Handles all waiting console input. */
+void check_user_input(void) {
+  uint8_t opt;
+  uint16_t c;
 
-    // Put a dot every N (million) times through this loop
-    counter++;
-    if (counter >= end_counter) {
-      counter = 0;
-      serial_transmit((uint8_t *)".", 1);
+  // Nothing else may go out amidst the binary capture
+  if (midi_capture.active) {
+    while ((c = serial_read()) < 0x100) {
+      if (c == 'c') {
+        stop_midi_capture();
+        prompted = 0;
+        return;
+      }
     }
+    return;
+  }
 
-    // count how many times through the loop we get per tick
-    cur_tick = HAL_GetTick();
-    if (cur_tick != last_tick) {
-      // As of this version of my code, this is usually 114 loops per tick,
-      // which means about 114 kHz through this loop. Not bad.
-      loops_per_tick = tick_counter;
-      tick_counter = 0;
-      last_tick = cur_tick;
-    } else {
-      tick_counter++;
+  // Reading with nothing waiting (re-)displays the prompt
+  while ((opt = read_user_input()) != 0) {
+    if (process_user_input(opt) == 2) {
+      printWelcomeMessage();
     }
+  }
+}
+
+// Times through the main loop since the last tick
+static uint32_t tick_counter = 0;
+
+/** Housekeeping done every SysTick (1 ms). */
+void check_tick(void) {
+  static uint32_t last_overrun_errors = 0;
+  static uint32_t last_usart3_interrupts = 0;
+  static uint32_t ticks = 0;
+
+  // How many times we went through the main loop in this tick.
+  // With the event loop this is how many times we woke up.
+  loops_per_tick = tick_counter;
+  tick_counter = 0;
+
+  ticks++;
+  if (ticks % 1000 == 0) {
+    events_idle_update();
+  }
+  // Put a dot every 10 seconds
+  if (ticks % 10000 == 0 && !midi_capture.active) {
+    serial_transmit((uint8_t *)".", 1);
+  }
+
+  if (overrun_errors != last_overrun_errors) {
+    DLOG("\r\nORE: %lu\r\n", overrun_errors);
+    last_overrun_errors = overrun_errors;
+  }
+  if (usart3_interrupts != last_usart3_interrupts) {
+    DLOG("\r\nUA3I: %lu\r\n", usart3_interrupts);
+    last_usart3_interrupts = usart3_interrupts;
+  }
+}
+
+static void dlog_output(const char *text, size_t len) {
+  serial_transmit((const uint8_t *)text, len);
+}
+
+/** Formats what has been logged with DLOG(), a few entries at a time
+ * so as not to hold up more important tasks.
+ */
+static void task_dlog(void) {
+  if (dlog_pending() > 0 && !midi_capture.active) {
+    dlog_process(dlog_output, 4);
+  }
+}
+
+// Deferred (PendSV) jobs ////////////////////////////////////////////////////
+
+static void deferred_audio(void) {
+  PROF_BEGIN(PROF_FILL_I2S);
+  if (i2s_write_available) {
+    play_smf(i2s_block_time);
+    fill_i2s_data();
+  }
+  PROF_END(PROF_FILL_I2S);
+}
+
+static void deferred_midi_rx(void) {
+  PROF_BEGIN(PROF_MIDI_SYNTH);
+  route_midi();
+  PROF_END(PROF_MIDI_SYNTH);
+}
+
+static void deferred_midi_tx(void) {
+  midiport_pump_all();
+  usbdev_midi_service();
+}
+
+static int net_queued;
+
+/** Routes a message received by RTP-MIDI (rtpmidi_message_fn). */
+static void net_midi_received(void *ctx, const midi_message *mm, const uint8_t *sysex) {
+  (void)ctx;
+  net_queued |= route_message(MIDI_SOURCE_NET, mm, sysex);
+}
+
+/** Sends telemetry to whoever sent us a datagram on TELEMETRY_PORT
+ * (net_udp_fn), instead of broadcasting it.
+ */
+static void telemetry_subscribe(void *ctx, const net_endpoint *from, const uint8_t *data,
+                                size_t len, uint32_t now) {
+  (void)ctx;
+  (void)data;
+  (void)len;
+  (void)now;
+  telemetry_to = *from;
+}
+
+/** Sends one telemetry packet of the counters the console shows
+ * (see telemetry.h for the fields), then another of the profile's,
+ * which would not fit in the first. Runs in PendSV, as the network
+ * does; the main loop's counters may be caught mid update.
+ */
+static void send_telemetry(void) {
+  telemetry_writer w;
+  uint32_t v[PROF_NUM_BUCKETS + 4];
+  uint32_t cycles_per_us = SystemCoreClock / 1000000;
+  uint8_t *buf;
+  size_t i;
+
+  buf = net_udp_begin(&eth_net);
+  if (buf == NULL) {
+    return;
+  }
+  telemetry_begin(&w, buf, NET_MAX_UDP, telemetry_seq++, HAL_GetTick());
+
+  telemetry_section(&w, TELEMETRY_SYSTEM, 9);
+  v[0] = events_idle_permille();
+  v[1] = loops_per_tick;
+  v[2] = SystemCoreClock;
+  v[3] = overrun_errors;
+  v[4] = uart_error_callbacks;
+  v[5] = usart3_interrupts;
+  v[6] = midi_overrun_errors;
+  v[7] = midi_monitor_drops;
+  v[8] = dlog.drops;
+  telemetry_row(&w, "system", v);
+
+  telemetry_section(&w, TELEMETRY_AUDIO, 9);
+  v[0] = audio_blocks;
+  v[1] = (uint32_t)audio_headroom_last;
+  v[2] = (uint32_t)audio_headroom_min;
+  v[3] = audio_late_blocks;
+  v[4] = tonegen1.desired_ampl > 0; // The synth has one voice
+  v[5] = synth_queue.late;
+  v[6] = synth_queue.dropped;
+  v[7] = midi_latency_last;
+  v[8] = midi_latency_max;
+  telemetry_row(&w, "audio", v);
+
+  telemetry_section(&w, TELEMETRY_DEFERRED, 4);
+  for (i = 0; i < DEFER_NUM; i++) {
+    v[0] = deferred_job_stats[i].count;
+    v[1] = deferred_job_stats[i].last_latency;
+    v[2] = deferred_job_stats[i].max_latency;
+    v[3] = deferred_job_stats[i].max_run;
+    telemetry_row(&w, deferred_names[i], v);
+  }
 
-    if (overrun_errors != last_overrun_errors) {
-      snprintf(msg, sizeof(msg) - 1, "\r\nORE: %lu\r\n", overrun_errors);
-      last_overrun_errors = overrun_errors;
-      serial_transmit((uint8_t *)msg, strlen(msg));
+  telemetry_section(&w, TELEMETRY_TASKS, 5);
+  for (i = 0; i < sched_num_tasks(); i++) {
+    sched_task *t = sched_get_task(i);
+    v[0] = t->runs;
+    v[1] = t->max_run / cycles_per_us;
+    v[2] = t->max_response / cycles_per_us;
+    v[3] = t->deadline_misses;
+    v[4] = t->budget_overruns;
+    telemetry_row(&w, t->name, v);
+  }
+
+  telemetry_section(&w, TELEMETRY_EVENTS, 4);
+  for (i = 0; i < EV_NUM; i++) {
+    event_latency *el = &event_latencies[i];
+    v[0] = el->count;
+    v[1] = el->last / cycles_per_us;
+    v[2] = el->count ? (uint32_t)(el->total / el->count) / cycles_per_us : 0;
+    v[3] = el->max / cycles_per_us;
+    telemetry_row(&w, event_names[i], v);
+  }
+
+  telemetry_section(&w, TELEMETRY_PORTS, 6);
+  for (i = 0; i < MIDI_NUM_PORTS; i++) {
+    midi_port *mp = &midi_ports[i];
+    v[0] = mp->rx_bytes;
+    v[1] = mp->rx_messages;
+    v[2] = mp->overruns;
+    v[3] = mp->rt_drops;
+    v[4] = mp->in_max;
+    v[5] = mp->out_max;
+    telemetry_row(&w, midi_source_name(i), v);
+  }
+
+  telemetry_section(&w, TELEMETRY_RINGS, 2);
+  v[0] = console_out_max;
+  v[1] = RING_BUFFER_MASK((&s_o_rb));
+  telemetry_row(&w, "console_out", v);
+  v[0] = midi_monitor_max;
+  v[1] = MIDI_MONITOR_SIZE;
+  telemetry_row(&w, "midi_monitor", v);
+  v[0] = synth_queue.max_count;
+  v[1] = BLOCKQ_SIZE;
+  telemetry_row(&w, "synth_queue", v);
+  v[0] = eth_pool.count - eth_pool.min_free;
+  v[1] = eth_pool.count;
+  telemetry_row(&w, "eth_buffers", v);
+
+  telemetry_section(&w, TELEMETRY_USB, 6);
+  v[0] = usb_midi.rx_messages;
+  v[1] = usb_midi.rx_ignored;
+  v[2] = usb_midi.rx_overruns;
+  v[3] = usb_midi.tx_messages;
+  v[4] = usb_midi.tx_transfers;
+  v[5] = usb_midi.tx_drops;
+  telemetry_row(&w, "usb0", v);
+
+  telemetry_section(&w, TELEMETRY_NET, 15);
+  v[0] = eth_session.state;
+  v[1] = eth_stats.link_up;
+  v[2] = eth_session.rx_packets;
+  v[3] = eth_session.rx_messages;
+  v[4] = eth_session.rx_lost;
+  v[5] = eth_session.rx_recovered;
+  v[6] = eth_session.tx_packets;
+  v[7] = eth_session.tx_messages;
+  v[8] = eth_session.tx_drops;
+  v[9] = eth_stats.rx_frames;
+  v[10] = eth_stats.tx_frames;
+  v[11] = eth_net.rx_errors;
+  v[12] = eth_pool.exhausted;
+  v[13] = eth_stats.rx_starved;
+  v[14] = eth_stats.tx_starved;
+  telemetry_row(&w, "net0", v);
+
+  telemetry_section(&w, TELEMETRY_OSC, 8);
+  v[0] = synth_osc.rx_packets;
+  v[1] = synth_osc.rx_messages;
+  v[2] = synth_osc.rx_bundles;
+  v[3] = synth_osc.rx_errors;
+  v[4] = synth_osc.rx_unmatched;
+  v[5] = synth_osc.rx_bad_args;
+  v[6] = synth_osc.rx_late;
+  v[7] = synth_osc.rx_too_far;
+  telemetry_row(&w, "osc", v);
+
+  net_udp_send(&eth_net, &telemetry_to, TELEMETRY_PORT, telemetry_end(&w));
+
+  buf = net_udp_begin(&eth_net);
+  if (buf == NULL) {
+    return;
+  }
+  telemetry_begin(&w, buf, NET_MAX_UDP, telemetry_seq++, HAL_GetTick());
+  telemetry_section(&w, TELEMETRY_PROFILE, PROF_NUM_BUCKETS + 4);
+  for (i = 0; i < PROF_NUM_SECTIONS; i++) {
+    prof_stats *ps = &prof_sections[i];
+    v[0] = ps->count;
+    v[1] = ps->count ? ps->min : 0;
+    v[2] = ps->max;
+    v[3] = ps->count ? (uint32_t)(ps->total / ps->count) : 0;
+    memcpy(&v[4], ps->buckets, sizeof(ps->buckets));
+    telemetry_row(&w, prof_section_names[i], v);
+  }
+  net_udp_send(&eth_net, &telemetry_to, TELEMETRY_PORT, telemetry_end(&w));
+}
+
+/** Queues the synth parameter changes of an OSC message for when
+ * (osc_method_fn). Runs in PendSV, as the audio does.
+ */
+static int synth_osc_method(void *ctx, int method, osc_args *args, uint32_t when, uint32_t now) {
+  uint64_t timetag;
+  float value;
+
+  (void)ctx;
+  switch (method) {
+  case OSC_CLOCK:
+    if (!osc_arg_timetag(args, &timetag)) {
+      return 0;
     }
-    if (usart3_interrupts != last_usart3_interrupts) {
-      snprintf(msg, sizeof(msg) - 1, "\r\nUA3I: %lu\r\n", usart3_interrupts);
-      last_usart3_interrupts = usart3_interrupts;
-      serial_transmit((uint8_t *)msg, strlen(msg));
+    osc_set_clock(&synth_osc, timetag, now);
+    return 1;
+  case OSC_SYNTH_FREQ:
+    if (!osc_arg_float(args, &value)) {
+      return 0;
     }
+    blockq_push_param(&synth_queue, when, SYNTH_PARAM_FREQ, value);
+    return 1;
+  case OSC_SYNTH_LEVEL:
+    if (!osc_arg_float(args, &value)) {
+      return 0;
+    }
+    blockq_push_param(&synth_queue, when, SYNTH_PARAM_LEVEL, value);
+    return 1;
+  case OSC_SYNTH_NOTE:
+    if (!osc_arg_float(args, &value)) {
+      return 0;
+    }
+    blockq_push_param(&synth_queue, when, SYNTH_PARAM_FREQ, 440.0f * exp2f((value - 69.0f) / 12.0f));
+    if (osc_arg_float(args, &value)) {
+      blockq_push_param(&synth_queue, when, SYNTH_PARAM_LEVEL, value);
+    }
+    return 1;
+  case OSC_SYNTH_OFF:
+    blockq_push_param(&synth_queue, when, SYNTH_PARAM_LEVEL, 0.0f);
+    return 1;
+  }
+  return 0;
+}
+
+/** Hands a datagram to the OSC server (net_udp_fn). */
+static void osc_received(void *ctx, const net_endpoint *from, const uint8_t *data, size_t len,
+                         uint32_t now) {
+  (void)ctx;
+  (void)from;
+  osc_input(&synth_osc, data, len, now);
+}
+
+static void deferred_net(void) {
+  uint32_t now = timestamp_now();
+
+  net_queued = 0;
+  ethif_service(now);
+  osc_poll(&synth_osc, now);
+  if (telemetry_due) {
+    telemetry_due = 0;
+    send_telemetry();
+  }
+  midiport_pump_all();
+  usbdev_midi_service();
+  if (net_queued) {
+    event_post(EV_MIDI_MSG);
+  }
+}
+
+/** Sets the interrupt priority of each tier (see deferred.h),
+ * overriding those generated by CubeMX, and the deferred jobs.
+ * midiport_init() sets those of the MIDI ports, usbdev_init() USB's,
+ * ethif_init() Ethernet's.
+ */
+void init_deferred(void) {
+  HAL_NVIC_SetPriority(DMA1_Stream5_IRQn, PRIO_ISR_AUDIO_DMA, 0);
+  HAL_NVIC_SetPriority(USART3_IRQn, PRIO_ISR_CONSOLE_UART, 0);
+  deferred_init();
+  dlog_init();
+  deferred_register(DEFER_MIDI_RX, deferred_midi_rx);
+  deferred_register(DEFER_AUDIO, deferred_audio);
+  deferred_register(DEFER_MIDI_TX, deferred_midi_tx);
+  deferred_register(DEFER_NET, deferred_net);
+}
+
+// Main loop tasks ///////////////////////////////////////////////////////////
 
-    if (processed_input == 2) {
-      goto printMessage;
+/** Moves as much of the MIDI capture as fits into the console output,
+ * without waiting for room.
+ */
+static void task_capture(void) {
+  uint8_t buff[64];
+  ring_buffer_size_t room;
+  size_t n;
+
+  while (midi_capture.active) {
+    room = RING_BUFFER_MASK((&s_o_rb)) - ring_buffer_num_items(&s_o_rb);
+    if (room > sizeof(buff)) {
+      room = sizeof(buff);
     }
+    n = capture_read(&midi_capture, buff, room);
+    if (n == 0) {
+      break;
+    }
+    ring_buffer_queue_arr(&s_o_rb, (const char *)buff, n);
+  }
+  check_io();
+}
+
+/** Follows the Ethernet link and runs the RTP-MIDI session's timers,
+ * every ETHIF_POLL_MS, and has telemetry sent every TELEMETRY_PERIOD_MS.
+ */
+static void task_net(void) {
+  static uint32_t ticks = 0;
+  static uint32_t telemetry_ticks = 0;
+
+  if (++ticks >= ETHIF_POLL_MS) {
+    ticks = 0;
+    ethif_poll();
+  }
+  if (++telemetry_ticks >= TELEMETRY_PERIOD_MS) {
+    telemetry_ticks = 0;
+    telemetry_due = 1;
+    deferred_post(DEFER_NET);
+  }
+}
+
+/** Redraws the MIDI monitor every DISPLAY_PERIOD_MS, and starts sending
+ * the pages that changed, which goes on in the background.
+ */
+static void task_display(void) {
+  static uint32_t last_tick = 0;
+  uint32_t now = HAL_GetTick();
+
+  // By the clock, as ticks run together while the main loop is busy
+  if (now - last_tick < DISPLAY_PERIOD_MS) {
+    return;
+  }
+  midimon_render(&midi_activity, &oled, now - last_tick);
+  last_tick = now;
+  display_flush();
+}
+
+/** Sets up the routing & synth as they were saved. */
+static void load_presets(void) {
+  uint8_t routing;
+  float params[2];
+
+  if (kvstore_get(&presets, PRESET_ROUTING, &routing, sizeof(routing)) == sizeof(routing) &&
+      routing < NUM_MIDI_ROUTE_PRESETS) {
+    set_midi_route_preset(routing);
+  }
+  if (kvstore_get(&presets, PRESET_SYNTH, params, sizeof(params)) == sizeof(params)) {
+    synth_set_param(SYNTH_PARAM_FREQ, params[0]);
+    synth_set_param(SYNTH_PARAM_LEVEL, params[1]);
+  }
+}
+
+/** Saves the settings every PRESET_SAVE_MS, which writes those that
+ * changed, and goes on writing them to flash, a word a tick.
+ */
+static void task_presets(void) {
+  static uint32_t last_tick = 0;
+  uint32_t now = HAL_GetTick();
+  uint8_t routing;
+  float params[2];
+
+  if (now - last_tick >= PRESET_SAVE_MS) {
+    last_tick = now;
+    routing = (uint8_t)midi_route_preset;
+    // Set in PendSV a word at a time: a change half seen is saved whole next time
+    params[0] = synth_params[SYNTH_PARAM_FREQ];
+    params[1] = synth_params[SYNTH_PARAM_LEVEL];
+    kvstore_set(&presets, PRESET_ROUTING, &routing, sizeof(routing));
+    kvstore_set(&presets, PRESET_SYNTH, params, sizeof(params));
+  }
+  presets_poll();
+}
+
+static void task_user_input(void) {
+  PROF_BEGIN(PROF_USER_INPUT);
+  check_user_input();
+  PROF_END(PROF_USER_INPUT);
+}
+
+// Deadlines & budgets are set in init_tasks() as they depend on the clock speed
+static sched_task tasks[] = {
+    { .name = "midi_monitor", .run = check_midi_monitor, .priority = SCHED_PRIO_UI,         .events = EV_MIDI_MSG },
+    { .name = "user_input",   .run = task_user_input,    .priority = SCHED_PRIO_UI,         .events = EV_SERIAL_RX },
+    { .name = "tick",         .run = check_tick,         .priority = SCHED_PRIO_BACKGROUND, .events = EV_TICK },
+    { .name = "dlog",         .run = task_dlog,          .priority = SCHED_PRIO_BACKGROUND, .events = EV_TICK },
+    { .name = "capture",      .run = task_capture,       .priority = SCHED_PRIO_UI,         .events = EV_MIDI_MSG | EV_TICK },
+    { .name = "net",          .run = task_net,           .priority = SCHED_PRIO_BACKGROUND, .events = EV_TICK },
+    { .name = "display",      .run = task_display,       .priority = SCHED_PRIO_BACKGROUND, .events = EV_TICK },
+    { .name = "presets",      .run = task_presets,       .priority = SCHED_PRIO_BACKGROUND, .events = EV_TICK },
+};
+
+// Deadline, budget in microseconds for each of the above
+static const uint32_t task_times_us[][2] = {
+    { 50000, 2000 },
+    { 100000, 5000 },
+    { 10000, 500 },
+    { 50000, 2000 },
+    { 2000, 200 },
+    { 100000, 5000 }, // Starting the MAC waits a few ms
+    { 50000, 1000 },
+    { 50000, 500 },
+};
+
+/** The scheduler's clock: the DWT cycle counter. */
+static uint32_t cycle_clock(void) {
+  return DWT->CYCCNT;
+}
+
+void init_tasks(void) {
+  uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+  sched_init(cycle_clock);
+  for (size_t i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++) {
+    tasks[i].deadline = task_times_us[i][0] * cycles_per_us;
+    tasks[i].budget = task_times_us[i][1] * cycles_per_us;
+    sched_add(&tasks[i]);
+  }
+}
+
+void realmain() {
+  // test_i2s();
+
+  prof_init();
+  timestamp_init();
+  events_init();
+  init_deferred();
+  init_tasks();
+  init_ring_buffers();
+  set_midi_route_preset(0);
+  capture_init(&midi_capture);
+  tempo_init(&midi_tempo);
+  mtc_init(&midi_time_code);
+  tonegen_init(&tonegen1, SAMPLE_RATE);
+  blockq_init(&synth_queue);
+  tonegen_set(&tonegen1, 1024, 0); // Frequency, Amplitude
+  // Before the audio starts, as it may erase flash
+  presets_init();
+  load_presets();
+
+  // Start the DMA streams for I²S
+  // HAL_I2S_Transmit_DMA(&hi2s3, triangle_wave, sizeof(triangle_wave) / sizeof(triangle_wave[0]));
+  HAL_I2S_Transmit_DMA(&hi2s3, (uint16_t *)i2s_buff, I2S_BUFFER_SIZE);
+
+  // Receive by interrupt; check_io() turns on transmit interrupts as needed
+  LL_USART_EnableIT_RXNE(huart3.Instance);
+  midiport_init();
+  usbdev_init();
+  usbdev_cdc_attach(&s_i_rb, &s_o_rb, EV_SERIAL_RX);
+  ethif_init(MIDI_SOURCE_NET, net_midi_received, NULL);
+  net_udp_bind(&eth_net, TELEMETRY_PORT, telemetry_subscribe, NULL);
+  osc_init(&synth_osc, osc_trie, SYNTH_LATENCY_US, synth_osc_method, NULL);
+  net_udp_bind(&eth_net, OSC_PORT, osc_received, NULL);
+  midimon_init(&midi_activity, midi_source_name);
+  display_init();
+
+  printWelcomeMessage();
+  // Show the first prompt
+  event_post(EV_SERIAL_RX);
+
+  // Sleep until an interrupt posts an event, then run the ready
+  // tasks, most important first. Events posted while a task runs
+  // are picked up before choosing the next task. Audio & MIDI
+  // are handled in PendSV and preempt all of this.
+  while (1) {
+    sched_post(events_wait());
+    do {
+      tick_counter++;
+      // Start sending anything the last task queued
+      PROF_BEGIN(PROF_CHECK_IO);
+      check_io();
+      PROF_END(PROF_CHECK_IO);
+      sched_post(events_take());
+    } while (sched_run_one());
   }
 } // realmain()
 
@@ -512,5 +1821,7 @@ void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
   // Re-enable the interrupts (not sure if this is necessary)
   // This did not work when in the "if" above (it never got invoked).
   __HAL_UART_ENABLE_IT(huart, UART_IT_ERR);
+  // The HAL turns off the receive interrupt on an overrun error
+  LL_USART_EnableIT_RXNE(huart->Instance);
 }
 
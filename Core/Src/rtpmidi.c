@@ -0,0 +1,1252 @@
+/*
+ * rtpmidi.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * RTP-MIDI sessions, commands & recovery journal. See rtpmidi.h.
+ *
+ * The journal's S bits (which let a receiver skip recovery after the
+ * loss of just one packet) are all sent as 0, which is always safe,
+ * and ignored when received. Recovery never re-strikes a note that is
+ * still sounding here.
+ */
+
+#include <string.h>
+#include "rtpmidi.h"
+
+// AppleMIDI session packets
+#define APPLEMIDI_SIGNATURE 0xFFFF
+#define APPLEMIDI_VERSION   2
+#define CMD_IN 0x494E // Invitation
+#define CMD_OK 0x4F4B // Invitation accepted
+#define CMD_NO 0x4E4F // Invitation rejected
+#define CMD_BY 0x4259 // End session
+#define CMD_CK 0x434B // Clock synchronization
+#define CMD_RS 0x5253 // Receiver feedback
+#define SESSION_LENGTH 16 // Without the name
+#define CK_LENGTH      36
+#define RS_LENGTH      12
+
+#define SYNCS_FAST   6 // CKs at first, RTPMIDI_RETRY_US apart
+#define SYNC_SLOW_US 10000000
+
+// RTP
+#define RTP_VERSION      0x80
+#define RTP_PADDING      0x20
+#define RTP_EXTENSION    0x10
+#define RTP_CSRC_MASK    0x0F
+#define RTP_PAYLOAD_TYPE 0x61 // Dynamic, as everybody uses for this
+#define RTP_HEADER       12
+
+// MIDI command section header
+#define CMD_B 0x80 // 12 bit length
+#define CMD_J 0x40 // Journal follows
+#define CMD_Z 0x20 // First command has a delta time
+#define CMD_P 0x10 // First command's status was not in the original stream
+#define DELTA_MAX 0x0FFFFFFF
+
+// Recovery journal header & channel journal table of contents
+#define JOURNAL_Y 0x40 // System journal present
+#define JOURNAL_A 0x20 // Channel journals present
+#define TOC_P 0x80
+#define TOC_C 0x40
+#define TOC_M 0x20
+#define TOC_W 0x10
+#define TOC_N 0x08
+#define CHANNEL_MAX_LENGTH 1023
+
+static uint16_t get16(const uint8_t *p) {
+  return (p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t get64(const uint8_t *p) {
+  return ((uint64_t)get32(p) << 32) | get32(p + 4);
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void put64(uint8_t *p, uint64_t v) {
+  put32(p, v >> 32);
+  put32(p + 4, v);
+}
+
+/** Whether packet seq came after packet than. */
+static int after(uint32_t seq, uint32_t than) {
+  return (int32_t)(seq - than) > 0;
+}
+
+// Clock /////////////////////////////////////////////////////////////////////
+
+static void clock_update(rtpmidi *s, uint32_t now) {
+  s->clock_us += (uint32_t)(now - s->clock_last);
+  s->clock_last = now;
+}
+
+static uint64_t clock_ticks(const rtpmidi *s) {
+  return s->clock_us / RTPMIDI_TICK_US;
+}
+
+/** Our clock at t, no later than now, in ticks. */
+static uint32_t ticks_at(const rtpmidi *s, uint32_t t) {
+  int32_t ago = (int32_t)(s->clock_last - t);
+
+  if (ago < 0) {
+    ago = 0;
+  }
+  return (s->clock_us - ago) / RTPMIDI_TICK_US;
+}
+
+/** Our time for the peer's ticks, if synchronized and plausible;
+ * otherwise now.
+ */
+static uint32_t local_time(const rtpmidi *s, uint32_t ticks, uint32_t now) {
+  int32_t age = (int32_t)((uint32_t)clock_ticks(s) - (ticks - (uint32_t)s->offset));
+
+  if (!s->synced || age < 0 || age > RTPMIDI_MAX_AGE_US / RTPMIDI_TICK_US) {
+    return now;
+  }
+  return now - age * RTPMIDI_TICK_US;
+}
+
+// Session ///////////////////////////////////////////////////////////////////
+
+/** Sets up a session, with its clock starting from now. */
+void rtpmidi_init(rtpmidi *s, net_if *n, uint16_t control_port, const char *name, uint32_t ssrc,
+                  uint8_t port, rtpmidi_message_fn deliver, void *ctx, uint32_t now) {
+  memset(s, 0, sizeof(*s));
+  s->net = n;
+  s->control_port = control_port;
+  strncpy(s->name, name, sizeof(s->name) - 1);
+  s->ssrc = ssrc;
+  s->port = port;
+  s->deliver = deliver;
+  s->ctx = ctx;
+  // Far enough along that ticks_at() never goes below 0
+  s->clock_us = (uint64_t)1 << 32;
+  s->clock_last = now;
+  midi_stream_init(&s->rx_stream);
+}
+
+const char *rtpmidi_state_name(rtpmidi_state state) {
+  static const char *const names[] = { "idle", "inviting", "inviting data", "accepted", "open" };
+
+  return state < sizeof(names) / sizeof(names[0]) ? names[state] : "?";
+}
+
+static net_endpoint peer_data(const rtpmidi *s) {
+  net_endpoint e = { .ip = s->peer.ip, .port = s->peer.port + 1 };
+
+  return e;
+}
+
+/** Sends an IN, OK, NO or BY from one of our ports. */
+static void send_session(rtpmidi *s, const net_endpoint *to, uint16_t from_port, uint16_t command,
+                         uint32_t token) {
+  uint8_t *p = net_udp_begin(s->net);
+  size_t len = SESSION_LENGTH;
+
+  if (p == NULL) {
+    return;
+  }
+  put16(p, APPLEMIDI_SIGNATURE);
+  put16(p + 2, command);
+  put32(p + 4, APPLEMIDI_VERSION);
+  put32(p + 8, token);
+  put32(p + 12, s->ssrc);
+  if (command != CMD_BY) {
+    size_t n = strlen(s->name) + 1;
+    memcpy(p + len, s->name, n);
+    len += n;
+  }
+  net_udp_send(s->net, to, from_port, len);
+}
+
+static void send_ck(rtpmidi *s, uint8_t count, uint64_t ts1, uint64_t ts2, uint64_t ts3) {
+  net_endpoint to = peer_data(s);
+  uint8_t *p = net_udp_begin(s->net);
+
+  if (p == NULL) {
+    return;
+  }
+  put16(p, APPLEMIDI_SIGNATURE);
+  put16(p + 2, CMD_CK);
+  put32(p + 4, s->ssrc);
+  p[8] = count;
+  p[9] = p[10] = p[11] = 0;
+  put64(p + 12, ts1);
+  put64(p + 20, ts2);
+  put64(p + 28, ts3);
+  net_udp_send(s->net, &to, s->control_port + 1, CK_LENGTH);
+}
+
+static void send_rs(rtpmidi *s) {
+  uint8_t *p = net_udp_begin(s->net);
+
+  if (p == NULL) {
+    return;
+  }
+  put16(p, APPLEMIDI_SIGNATURE);
+  put16(p + 2, CMD_RS);
+  put32(p + 4, s->ssrc);
+  put16(p + 8, s->rx_seq);
+  put16(p + 10, 0);
+  net_udp_send(s->net, &s->peer, s->control_port, RS_LENGTH);
+}
+
+static void set_state(rtpmidi *s, rtpmidi_state state, uint32_t now) {
+  s->state = state;
+  s->state_time = now;
+  if (state == RTPMIDI_IDLE) {
+    // Abandon anything not yet sent
+    s->tx_length = 0;
+    s->tx_count = 0;
+    s->tx_channel_count = 0;
+  }
+}
+
+static void open_session(rtpmidi *s, uint32_t now) {
+  set_state(s, RTPMIDI_OPEN, now);
+  s->last_heard = now;
+  s->sessions++;
+
+  s->synced = 0;
+  s->syncs = 0;
+  s->next_sync = now;
+
+  s->rx_started = 0;
+  s->next_feedback = now + RTPMIDI_FEEDBACK_US;
+  midi_stream_init(&s->rx_stream);
+  for (int ch = 0; ch < 16; ch++) {
+    rtpmidi_rx_channel *rc = &s->rx_channels[ch];
+    rc->program = RTPMIDI_UNKNOWN;
+    rc->pitch_lsb = RTPMIDI_UNKNOWN;
+    rc->pitch_msb = RTPMIDI_UNKNOWN;
+    memset(rc->control, RTPMIDI_UNKNOWN, sizeof(rc->control));
+    memset(rc->velocity, 0, sizeof(rc->velocity));
+  }
+
+  // The peer knows nothing yet of what we sent before. Every sequence
+  // number in tx_channels is then 0, well before the checkpoint.
+  memset(s->tx_channels, 0, sizeof(s->tx_channels));
+  s->tx_seq = 0x10000 | ((s->ssrc ^ now) & 0xFFFF);
+  s->checkpoint = s->tx_seq - 1;
+  s->tx_length = 0;
+  s->tx_count = 0;
+  s->tx_channel_count = 0;
+}
+
+/** Sends the next invitation, to the peer's control port or data
+ * port by our state.
+ */
+static void invite(rtpmidi *s, uint32_t now) {
+  net_endpoint data = peer_data(s);
+
+  if (s->state == RTPMIDI_INVITING_CONTROL) {
+    send_session(s, &s->peer, s->control_port, CMD_IN, s->token);
+  } else {
+    send_session(s, &data, s->control_port + 1, CMD_IN, s->token);
+  }
+  s->tries++;
+  s->state_time = now;
+}
+
+/** Starts a session with a peer, given its control port. Returns 0 if
+ * we already have one, or are starting one.
+ */
+int rtpmidi_invite(rtpmidi *s, const net_endpoint *peer, uint32_t now) {
+  if (s->state != RTPMIDI_IDLE) {
+    return 0;
+  }
+  clock_update(s, now);
+  s->initiator = 1;
+  s->peer = *peer;
+  s->token = (s->ssrc * 2654435761U) ^ now;
+  s->tries = 0;
+  set_state(s, RTPMIDI_INVITING_CONTROL, now);
+  invite(s, now);
+  return 1;
+}
+
+/** Ends the session, if any, telling the peer. */
+void rtpmidi_end(rtpmidi *s) {
+  if (s->state != RTPMIDI_IDLE) {
+    send_session(s, &s->peer, s->control_port, CMD_BY, s->token);
+    set_state(s, RTPMIDI_IDLE, s->clock_last);
+  }
+}
+
+/** Keeps the session going: invitations, clock synchronization,
+ * receiver feedback & timeouts. Call every 100 ms or so.
+ */
+void rtpmidi_poll(rtpmidi *s, uint32_t now) {
+  clock_update(s, now);
+
+  switch (s->state) {
+  case RTPMIDI_INVITING_CONTROL:
+  case RTPMIDI_INVITING_DATA:
+    if (now - s->state_time >= RTPMIDI_RETRY_US) {
+      if (s->tries >= RTPMIDI_INVITATIONS) {
+        set_state(s, RTPMIDI_IDLE, now);
+      } else {
+        invite(s, now);
+      }
+    }
+    break;
+
+  case RTPMIDI_ACCEPTED:
+    // Waiting for the invitation on our data port
+    if (now - s->state_time >= RTPMIDI_RETRY_US * RTPMIDI_INVITATIONS) {
+      set_state(s, RTPMIDI_IDLE, now);
+    }
+    break;
+
+  case RTPMIDI_OPEN:
+    if (now - s->last_heard >= RTPMIDI_TIMEOUT_US) {
+      rtpmidi_end(s);
+      break;
+    }
+    if (s->initiator && (int32_t)(now - s->next_sync) >= 0) {
+      send_ck(s, 0, clock_ticks(s), 0, 0);
+      s->syncs++;
+      s->next_sync = now + (s->syncs < SYNCS_FAST ? RTPMIDI_RETRY_US : SYNC_SLOW_US);
+    }
+    if (s->rx_started && s->rx_seq != s->rx_reported &&
+        (int32_t)(now - s->next_feedback) >= 0) {
+      send_rs(s);
+      s->rx_reported = s->rx_seq;
+      s->next_feedback = now + RTPMIDI_FEEDBACK_US;
+    }
+    break;
+
+  case RTPMIDI_IDLE:
+    break;
+  }
+}
+
+static void ck_input(rtpmidi *s, const uint8_t *p) {
+  uint64_t ts1 = get64(p + 12);
+  uint64_t ts2 = get64(p + 20);
+  uint64_t ts3 = get64(p + 28);
+  uint64_t now = clock_ticks(s);
+
+  switch (p[8]) {
+  case 0:
+    send_ck(s, 1, ts1, now, 0);
+    break;
+  case 1:
+    // Our ts1 & now, its ts2 half way between
+    send_ck(s, 2, ts1, ts2, now);
+    s->offset = (int64_t)(ts2 - (ts1 + now) / 2);
+    s->rtt_us = (uint32_t)(now - ts1) * RTPMIDI_TICK_US;
+    s->synced = 1;
+    break;
+  case 2:
+    s->offset = (int64_t)((ts1 + ts3) / 2 - ts2);
+    s->synced = 1;
+    break;
+  }
+}
+
+/** The AppleMIDI packets, on either port. */
+static void session_input(rtpmidi *s, const net_endpoint *from, const uint8_t *p, size_t len,
+                          uint32_t now, int data_port) {
+  uint16_t command = get16(p + 2);
+  uint16_t our_port = s->control_port + data_port;
+  uint32_t token, ssrc;
+  uint32_t seq;
+
+  if (command == CMD_CK || command == CMD_RS) {
+    if (s->state != RTPMIDI_OPEN || len < (command == CMD_CK ? CK_LENGTH : RS_LENGTH) ||
+        get32(p + 4) != s->peer_ssrc) {
+      return;
+    }
+    s->last_heard = now;
+    if (command == CMD_CK && data_port) {
+      ck_input(s, p);
+    } else if (command == CMD_RS) {
+      // The last packet it received: extend its 16 bit sequence number
+      seq = s->tx_seq - 1;
+      seq -= (uint16_t)(seq - get16(p + 8));
+      if (after(seq, s->checkpoint)) {
+        s->checkpoint = seq;
+      }
+    }
+    return;
+  }
+
+  if (len < SESSION_LENGTH) {
+    s->rx_errors++;
+    return;
+  }
+  token = get32(p + 8);
+  ssrc = get32(p + 12);
+
+  switch (command) {
+  case CMD_IN:
+    if (!data_port) {
+      // Busy with someone else? Anyone may start again though
+      if (s->state != RTPMIDI_IDLE &&
+          (s->initiator || from->ip != s->peer.ip || ssrc != s->peer_ssrc)) {
+        send_session(s, from, our_port, CMD_NO, token);
+        break;
+      }
+      s->initiator = 0;
+      s->peer = *from;
+      s->peer_ssrc = ssrc;
+      s->token = token;
+      memset(s->peer_name, 0, sizeof(s->peer_name));
+      if (len > SESSION_LENGTH) {
+        strncpy(s->peer_name, (const char *)p + SESSION_LENGTH,
+                len - SESSION_LENGTH < sizeof(s->peer_name) - 1 ? len - SESSION_LENGTH
+                                                                : sizeof(s->peer_name) - 1);
+      }
+      set_state(s, RTPMIDI_ACCEPTED, now);
+      send_session(s, from, our_port, CMD_OK, token);
+    } else if ((s->state == RTPMIDI_ACCEPTED || s->state == RTPMIDI_OPEN) && !s->initiator &&
+               from->ip == s->peer.ip && ssrc == s->peer_ssrc) {
+      send_session(s, from, our_port, CMD_OK, token);
+      if (s->state == RTPMIDI_ACCEPTED) {
+        open_session(s, now);
+      }
+    } else {
+      send_session(s, from, our_port, CMD_NO, token);
+    }
+    break;
+
+  case CMD_OK:
+    if (token != s->token || from->ip != s->peer.ip) {
+      break;
+    }
+    if (s->state == RTPMIDI_INVITING_CONTROL && !data_port) {
+      s->peer_ssrc = ssrc;
+      memset(s->peer_name, 0, sizeof(s->peer_name));
+      if (len > SESSION_LENGTH) {
+        strncpy(s->peer_name, (const char *)p + SESSION_LENGTH,
+                len - SESSION_LENGTH < sizeof(s->peer_name) - 1 ? len - SESSION_LENGTH
+                                                                : sizeof(s->peer_name) - 1);
+      }
+      set_state(s, RTPMIDI_INVITING_DATA, now);
+      s->tries = 0;
+      invite(s, now);
+    } else if (s->state == RTPMIDI_INVITING_DATA && data_port && ssrc == s->peer_ssrc) {
+      open_session(s, now);
+      // Synchronize at once
+      rtpmidi_poll(s, now);
+    }
+    break;
+
+  case CMD_NO:
+    if (token == s->token && (s->state == RTPMIDI_INVITING_CONTROL ||
+                              s->state == RTPMIDI_INVITING_DATA)) {
+      set_state(s, RTPMIDI_IDLE, now);
+    }
+    break;
+
+  case CMD_BY:
+    if (s->state != RTPMIDI_IDLE && ssrc == s->peer_ssrc && from->ip == s->peer.ip) {
+      set_state(s, RTPMIDI_IDLE, now);
+    }
+    break;
+
+  default:
+    s->rx_errors++;
+    break;
+  }
+}
+
+// Receiving /////////////////////////////////////////////////////////////////
+
+/** Notes what a message received changes. */
+static void track_rx(rtpmidi *s, const midi_message *mm) {
+  rtpmidi_rx_channel *rc = &s->rx_channels[mm->channel & 0x0F];
+
+  if (mm->type < 0x80) {
+    // Channel mode
+    if (mm->type == MIDI_MODE_ALL_SOUND_OFF || mm->type >= MIDI_MODE_ALL_NOTES_OFF) {
+      memset(rc->velocity, 0, sizeof(rc->velocity));
+    } else if (mm->type == MIDI_MODE_RESET_ALL) {
+      memset(rc->control, RTPMIDI_UNKNOWN, sizeof(rc->control));
+      rc->pitch_lsb = RTPMIDI_UNKNOWN;
+      rc->pitch_msb = RTPMIDI_UNKNOWN;
+    }
+    return;
+  }
+  switch (mm->type & 0xF0) {
+  case MIDI_NOTE_ON:
+    rc->velocity[mm->note & 0x7F] = mm->velocity;
+    break;
+  case MIDI_NOTE_OFF:
+    rc->velocity[mm->note & 0x7F] = 0;
+    break;
+  case 0xB0:
+    if (mm->control < 120) {
+      rc->control[mm->control] = mm->cc_value;
+    }
+    break;
+  case 0xC0:
+    rc->program = mm->program;
+    break;
+  case 0xE0:
+    rc->pitch_lsb = mm->lsb;
+    rc->pitch_msb = mm->msb;
+    break;
+  }
+}
+
+static void deliver(rtpmidi *s, midi_message *mm, uint32_t timestamp) {
+  mm->port = s->port;
+  mm->timestamp = timestamp;
+  track_rx(s, mm);
+  s->rx_messages++;
+  s->deliver(s->ctx, mm, mm->type == MIDI_SYSEX ? s->rx_stream.sysex : NULL);
+}
+
+/** Hands over a channel message recovered from a journal. */
+static void recovered(rtpmidi *s, uint8_t status, uint8_t data1, uint8_t data2, uint32_t now) {
+  midi_message mm = { 0 };
+
+  mm.type = status;
+  mm.channel = status & 0x0F;
+  mm.data1 = data1;
+  mm.data2 = data2;
+  s->rx_recovered++;
+  deliver(s, &mm, now);
+}
+
+/** Brings a channel up to date from its journal (toc says which
+ * chapters it has). Returns 0 if it is malformed.
+ */
+static int recover_channel(rtpmidi *s, uint8_t ch, uint8_t toc, const uint8_t *c, size_t len,
+                           uint32_t now) {
+  rtpmidi_rx_channel *rc = &s->rx_channels[ch];
+  size_t p = 0;
+
+  if (toc & TOC_P) {
+    if (p + 3 > len) {
+      return 0;
+    }
+    if (rc->program != (c[p] & 0x7F)) {
+      recovered(s, 0xC0 | ch, c[p] & 0x7F, 0, now);
+    }
+    p += 3;
+  }
+
+  if (toc & TOC_C) {
+    size_t n;
+
+    if (p + 1 > len) {
+      return 0;
+    }
+    n = (c[p++] & 0x7F) + 1;
+    if (p + 2 * n > len) {
+      return 0;
+    }
+    for (size_t i = 0; i < n; i++, p += 2) {
+      uint8_t number = c[p] & 0x7F;
+      // Only values; not the toggle & count forms (A bit)
+      if ((c[p + 1] & 0x80) == 0 && number < 120 && rc->control[number] != c[p + 1]) {
+        recovered(s, 0xB0 | ch, number, c[p + 1], now);
+      }
+    }
+  }
+
+  if (toc & TOC_M) {
+    size_t n;
+
+    // Not for us; its header has its length
+    if (p + 2 > len) {
+      return 0;
+    }
+    n = ((c[p] & 0x03) << 8) | c[p + 1];
+    if (n < 2 || p + n > len) {
+      return 0;
+    }
+    p += n;
+  }
+
+  if (toc & TOC_W) {
+    if (p + 2 > len) {
+      return 0;
+    }
+    if (rc->pitch_lsb != (c[p] & 0x7F) || rc->pitch_msb != (c[p + 1] & 0x7F)) {
+      recovered(s, 0xE0 | ch, c[p] & 0x7F, c[p + 1] & 0x7F, now);
+    }
+    p += 2;
+  }
+
+  if (toc & TOC_N) {
+    const uint8_t *logs, *offbits;
+    size_t logs_n, low, high, offbits_n = 0;
+    uint8_t logged[16] = { 0 };
+
+    if (p + 2 > len) {
+      return 0;
+    }
+    logs_n = c[p] & 0x7F;
+    low = c[p + 1] >> 4;
+    high = c[p + 1] & 0x0F;
+    p += 2;
+    if (logs_n == 127 && low == 15 && high == 0) {
+      logs_n = 128;
+    } else if (low <= high) {
+      offbits_n = high - low + 1;
+    }
+    if (p + 2 * logs_n + offbits_n > len) {
+      return 0;
+    }
+    logs = c + p;
+    offbits = logs + 2 * logs_n;
+
+    for (size_t i = 0; i < logs_n; i++) {
+      uint8_t note = logs[2 * i] & 0x7F;
+      logged[note >> 3] |= 0x80 >> (note & 7);
+    }
+    // Notes turned off (and not on again) since the checkpoint
+    for (size_t i = 0; i < offbits_n; i++) {
+      for (int b = 0; b < 8; b++) {
+        uint8_t note = (low + i) * 8 + b;
+        if ((offbits[i] & (0x80 >> b)) && !(logged[note >> 3] & (0x80 >> b)) &&
+            rc->velocity[note]) {
+          recovered(s, MIDI_NOTE_OFF | ch, note, 0, now);
+        }
+      }
+    }
+    // Notes on, if the sender says they are still worth playing (Y)
+    for (size_t i = 0; i < logs_n; i++) {
+      uint8_t note = logs[2 * i] & 0x7F;
+      uint8_t velocity = logs[2 * i + 1] & 0x7F;
+      if (velocity != 0 && (logs[2 * i + 1] & 0x80) && rc->velocity[note] == 0) {
+        recovered(s, MIDI_NOTE_ON | ch, note, velocity, now);
+      }
+    }
+  }
+  // Chapters E, T & A follow, which we do not need
+  return 1;
+}
+
+/** Recovers from lost packets with the journal of the packet after. */
+static void recover(rtpmidi *s, const uint8_t *j, size_t len, uint32_t now) {
+  size_t pos = 3;
+  size_t channels;
+
+  if (len < 3) {
+    s->rx_errors++;
+    return;
+  }
+  // Does it go back far enough?
+  if ((int16_t)(get16(j + 1) - s->rx_seq) > 0) {
+    s->rx_unrecoverable++;
+  }
+  if (j[0] & JOURNAL_Y) {
+    size_t n;
+    if (pos + 2 > len) {
+      s->rx_errors++;
+      return;
+    }
+    n = ((j[pos] & 0x03) << 8) | j[pos + 1];
+    pos += n;
+  }
+  if (!(j[0] & JOURNAL_A)) {
+    return;
+  }
+  channels = (j[0] & 0x0F) + 1;
+  for (size_t i = 0; i < channels; i++) {
+    size_t n;
+    if (pos + 3 > len) {
+      s->rx_errors++;
+      return;
+    }
+    n = ((j[pos] & 0x03) << 8) | j[pos + 1];
+    if (n < 3 || pos + n > len ||
+        !recover_channel(s, (j[pos] >> 3) & 0x0F, j[pos + 2], j + pos + 3, n - 3, now)) {
+      s->rx_errors++;
+      return;
+    }
+    pos += n;
+  }
+}
+
+/** Feeds one byte of a command to the parser; hands over what it
+ * completes.
+ */
+static void feed(rtpmidi *s, uint8_t b, uint32_t ticks, uint32_t now) {
+  midi_message mm = { 0 };
+
+  if (midi_stream_receive(&s->rx_stream, b, &mm)) {
+    deliver(s, &mm, local_time(s, ticks, now));
+  }
+}
+
+/** Data bytes after each status of a command; 0xFF if it may not be
+ * sent (undefined, or a SysEx, which is handled apart).
+ */
+static uint8_t command_data_bytes(uint8_t status) {
+  switch (status & 0xF0) {
+  case 0xC0:
+  case 0xD0:
+    return 1;
+  case 0xF0:
+    switch (status) {
+    case MIDI_TIME_CODE_QF:
+    case MIDI_SONG_SELECT:
+      return 1;
+    case MIDI_SONG_POSITION:
+      return 2;
+    case MIDI_TUNE_REQUEST:
+      return 0;
+    default:
+      return status >= 0xF8 ? 0 : 0xFF;
+    }
+  default:
+    return 2;
+  }
+}
+
+/** The MIDI list of a command section, at ticks; z if the first
+ * command has a delta time. Returns 0 if it is malformed.
+ */
+static int commands_input(rtpmidi *s, const uint8_t *c, size_t len, int z, uint32_t ticks,
+                          uint32_t now) {
+  size_t pos = 0;
+  uint8_t running = MIDI_NONE;
+  int first = 1;
+
+  // A SysEx may go on from the last packet, but running status may not
+  if (s->rx_stream.last_status != MIDI_SYSEX) {
+    s->rx_stream.last_status = MIDI_NONE;
+  }
+
+  while (pos < len) {
+    uint8_t b;
+
+    if (!first || z) {
+      uint32_t delta = 0;
+      int i;
+      for (i = 0; i < 4 && pos < len; i++) {
+        b = c[pos++];
+        delta = (delta << 7) | (b & 0x7F);
+        if (!(b & 0x80)) {
+          break;
+        }
+      }
+      if (i == 4 || pos >= len) {
+        return 0;
+      }
+      ticks += delta;
+    }
+    first = 0;
+
+    b = c[pos];
+    if (b == MIDI_SYSEX || b == MIDI_EOX) {
+      // A SysEx segment: F0 starts one, F7 goes on with one; F7 ends
+      // it, F0 means more follows later, F4 cancels it. Real-time
+      // may come in between.
+      size_t start = pos++;
+      uint8_t end;
+      while (pos < len && (c[pos] < 0x80 || c[pos] >= 0xF8)) {
+        pos++;
+      }
+      if (pos >= len) {
+        return 0;
+      }
+      end = c[pos++];
+      if (end == 0xF4) {
+        s->rx_stream.last_status = MIDI_NONE;
+        continue;
+      }
+      if (end != MIDI_SYSEX && end != MIDI_EOX) {
+        return 0;
+      }
+      if (b == MIDI_SYSEX) {
+        feed(s, MIDI_SYSEX, ticks, now);
+      }
+      for (size_t i = start + 1; i < pos - 1; i++) {
+        feed(s, c[i], ticks, now);
+      }
+      if (end == MIDI_EOX) {
+        feed(s, MIDI_EOX, ticks, now);
+      }
+      running = MIDI_NONE;
+      continue;
+    }
+
+    uint8_t status = b;
+    uint8_t n;
+    if (b & 0x80) {
+      pos++;
+    } else if (running != MIDI_NONE) {
+      status = running;
+    } else {
+      return 0;
+    }
+    n = command_data_bytes(status);
+    if (n == 0xFF || pos + n > len) {
+      return 0;
+    }
+    for (uint8_t i = 0; i < n; i++) {
+      if (c[pos + i] & 0x80) {
+        return 0;
+      }
+    }
+    feed(s, status, ticks, now);
+    for (uint8_t i = 0; i < n; i++) {
+      feed(s, c[pos + i], ticks, now);
+    }
+    pos += n;
+    if (status < 0xF0) {
+      running = status;
+    } else if (status < 0xF8) {
+      running = MIDI_NONE;
+    }
+  }
+  return 1;
+}
+
+/** An RTP packet on the data port. */
+static void rtp_input(rtpmidi *s, const net_endpoint *from, const uint8_t *p, size_t len,
+                      uint32_t now) {
+  size_t h = RTP_HEADER;
+  size_t cmd_len, cmd_header = 1;
+  const uint8_t *c;
+  uint16_t seq;
+  int16_t gap;
+
+  if (s->state != RTPMIDI_OPEN || from->ip != s->peer.ip) {
+    return;
+  }
+  if (len < RTP_HEADER || (p[0] & 0xC0) != RTP_VERSION) {
+    s->rx_errors++;
+    return;
+  }
+  if (get32(p + 8) != s->peer_ssrc) {
+    return;
+  }
+  h += 4 * (p[0] & RTP_CSRC_MASK);
+  if (p[0] & RTP_EXTENSION) {
+    if (h + 4 > len) {
+      s->rx_errors++;
+      return;
+    }
+    h += 4 + 4 * get16(p + h + 2);
+  }
+  if (p[0] & RTP_PADDING) {
+    if (p[len - 1] > len) {
+      s->rx_errors++;
+      return;
+    }
+    len -= p[len - 1];
+  }
+  if (h + 1 > len) {
+    s->rx_errors++;
+    return;
+  }
+  c = p + h;
+  cmd_len = c[0] & 0x0F;
+  if (c[0] & CMD_B) {
+    if (h + 2 > len) {
+      s->rx_errors++;
+      return;
+    }
+    cmd_len = (cmd_len << 8) | c[1];
+    cmd_header = 2;
+  }
+  if (h + cmd_header + cmd_len > len) {
+    s->rx_errors++;
+    return;
+  }
+
+  s->last_heard = now;
+  s->rx_packets++;
+  seq = get16(p + 2);
+  if (s->rx_started) {
+    gap = (int16_t)(seq - (uint16_t)(s->rx_seq + 1));
+    if (gap < 0) {
+      s->rx_late++;
+      return;
+    }
+    if (gap > 0) {
+      s->rx_lost += gap;
+      // Whatever SysEx the lost packets went on with is broken
+      if (s->rx_stream.last_status == MIDI_SYSEX) {
+        s->rx_stream.last_status = MIDI_NONE;
+      }
+      if (c[0] & CMD_J) {
+        recover(s, c + cmd_header + cmd_len, len - h - cmd_header - cmd_len, now);
+      } else {
+        s->rx_unrecoverable++;
+      }
+    }
+  }
+  s->rx_seq = seq;
+  s->rx_started = 1;
+
+  if (!commands_input(s, c + cmd_header, cmd_len, c[0] & CMD_Z, get32(p + 4), now)) {
+    s->rx_errors++;
+  }
+}
+
+static void control_input(void *ctx, const net_endpoint *from, const uint8_t *data, size_t len,
+                          uint32_t now) {
+  rtpmidi *s = ctx;
+
+  clock_update(s, now);
+  if (len < 4 || get16(data) != APPLEMIDI_SIGNATURE) {
+    s->rx_errors++;
+    return;
+  }
+  session_input(s, from, data, len, now, 0);
+}
+
+static void data_input(void *ctx, const net_endpoint *from, const uint8_t *data, size_t len,
+                       uint32_t now) {
+  rtpmidi *s = ctx;
+
+  clock_update(s, now);
+  if (len >= 4 && get16(data) == APPLEMIDI_SIGNATURE) {
+    session_input(s, from, data, len, now, 1);
+  } else {
+    rtp_input(s, from, data, len, now);
+  }
+}
+
+// Sending ///////////////////////////////////////////////////////////////////
+
+/** Notes what a message sent in packet seq changes. */
+static void track_tx(rtpmidi *s, const midi_message *mm, uint32_t seq) {
+  rtpmidi_tx_channel *tc = &s->tx_channels[mm->channel & 0x0F];
+
+  tc->last_seq = seq;
+  if (mm->type < 0x80) {
+    if (mm->type == MIDI_MODE_ALL_SOUND_OFF || mm->type >= MIDI_MODE_ALL_NOTES_OFF) {
+      for (int n = 0; n < 128; n++) {
+        if (tc->velocity[n]) {
+          tc->velocity[n] = 0;
+          tc->off_seq[n] = seq;
+        }
+      }
+    } else if (mm->type == MIDI_MODE_RESET_ALL) {
+      // Nothing before this is worth recovering
+      memset(tc->control_seq, 0, sizeof(tc->control_seq));
+      tc->pitch_seq = 0;
+    }
+    return;
+  }
+  switch (mm->type & 0xF0) {
+  case MIDI_NOTE_ON:
+  case MIDI_NOTE_OFF:
+    if ((mm->type & 0xF0) == MIDI_NOTE_ON && mm->velocity != 0) {
+      tc->velocity[mm->note & 0x7F] = mm->velocity;
+      tc->on_seq[mm->note & 0x7F] = seq;
+    } else if (tc->velocity[mm->note & 0x7F]) {
+      tc->velocity[mm->note & 0x7F] = 0;
+      tc->off_seq[mm->note & 0x7F] = seq;
+    }
+    break;
+  case 0xB0:
+    if (mm->control < 120) {
+      tc->control[mm->control] = mm->cc_value & 0x7F;
+      tc->control_seq[mm->control] = seq;
+    }
+    break;
+  case 0xC0:
+    tc->program = mm->program & 0x7F;
+    tc->program_seq = seq;
+    break;
+  case 0xE0:
+    tc->pitch = MIDI_14bits(mm);
+    tc->pitch_seq = seq;
+    break;
+  }
+}
+
+/** Writes the journal of the channels changed since the checkpoint
+ * into out. Returns its length, or 0 if it needs more than max.
+ */
+static size_t build_journal(const rtpmidi *s, uint8_t *out, size_t max) {
+  uint32_t cp = s->checkpoint;
+  size_t pos = 3;
+  int channels = 0;
+
+  if (max < 3) {
+    return 0;
+  }
+  for (int ch = 0; ch < 16; ch++) {
+    const rtpmidi_tx_channel *tc = &s->tx_channels[ch];
+    size_t start = pos;
+    uint8_t toc = 0;
+    int n, logs = 0, low = 16, high = -1;
+
+    if (!after(tc->last_seq, cp)) {
+      continue;
+    }
+    pos += 3;
+
+    if (after(tc->program_seq, cp)) {
+      if (pos + 3 > max) {
+        return 0;
+      }
+      out[pos++] = tc->program; // No bank (B = 0)
+      out[pos++] = 0;
+      out[pos++] = 0;
+      toc |= TOC_P;
+    }
+
+    n = 0;
+    for (int c = 0; c < 120; c++) {
+      n += after(tc->control_seq[c], cp);
+    }
+    if (n > 0) {
+      if (pos + 1 + 2 * n > max) {
+        return 0;
+      }
+      out[pos++] = n - 1;
+      for (int c = 0; c < 120; c++) {
+        if (after(tc->control_seq[c], cp)) {
+          out[pos++] = c;
+          out[pos++] = tc->control[c];
+        }
+      }
+      toc |= TOC_C;
+    }
+
+    if (after(tc->pitch_seq, cp)) {
+      if (pos + 2 > max) {
+        return 0;
+      }
+      out[pos++] = tc->pitch & 0x7F;
+      out[pos++] = tc->pitch >> 7;
+      toc |= TOC_W;
+    }
+
+    for (int note = 0; note < 128; note++) {
+      if (tc->velocity[note] && after(tc->on_seq[note], cp)) {
+        logs++;
+      }
+      if (after(tc->off_seq[note], cp)) {
+        if (low == 16) {
+          low = note / 8;
+        }
+        high = note / 8;
+      }
+    }
+    if (logs == 128) {
+      // Every note is on: no room to say which went off, nor need
+      low = 15;
+      high = 0;
+    } else if (high < 0) {
+      low = 1;
+      high = 0;
+    }
+    if (logs > 0 || high >= low) {
+      size_t offbits_n = high >= low ? high - low + 1 : 0;
+      if (pos + 2 + 2 * logs + offbits_n > max) {
+        return 0;
+      }
+      out[pos++] = logs == 128 ? 127 : logs;
+      out[pos++] = (low << 4) | high;
+      for (int note = 0; note < 128; note++) {
+        if (tc->velocity[note] && after(tc->on_seq[note], cp)) {
+          out[pos++] = note;
+          out[pos++] = 0x80 | tc->velocity[note]; // Y: play it
+        }
+      }
+      for (size_t i = 0; i < offbits_n; i++) {
+        uint8_t bits = 0;
+        for (int b = 0; b < 8; b++) {
+          if (after(tc->off_seq[(low + i) * 8 + b], cp)) {
+            bits |= 0x80 >> b;
+          }
+        }
+        out[pos++] = bits;
+      }
+      toc |= TOC_N;
+    }
+
+    n = pos - start;
+    if (n > CHANNEL_MAX_LENGTH) {
+      return 0;
+    }
+    out[start] = (ch << 3) | (n >> 8);
+    out[start + 1] = n;
+    out[start + 2] = toc;
+    channels++;
+  }
+
+  out[0] = channels > 0 ? JOURNAL_A | (channels - 1) : 0;
+  put16(out + 1, cp);
+  return pos;
+}
+
+/** Sends the packet being filled, if any. */
+void rtpmidi_flush(rtpmidi *s, uint32_t now) {
+  net_endpoint to = peer_data(s);
+  uint8_t *p;
+  size_t h = RTP_HEADER, j;
+
+  if (s->tx_count == 0) {
+    return;
+  }
+  clock_update(s, now);
+
+  p = net_udp_begin(s->net);
+  if (p != NULL) {
+    p[0] = RTP_VERSION;
+    p[1] = RTP_PAYLOAD_TYPE;
+    put16(p + 2, s->tx_seq);
+    put32(p + 4, s->tx_time);
+    put32(p + 8, s->ssrc);
+    if (s->tx_length > 0x0F) {
+      p[h++] = CMD_B | CMD_J | (s->tx_length >> 8);
+      p[h++] = s->tx_length;
+    } else {
+      p[h++] = CMD_J | s->tx_length;
+    }
+    memcpy(p + h, s->tx_commands, s->tx_length);
+    h += s->tx_length;
+
+    j = build_journal(s, p + h, NET_MAX_UDP - h);
+    if (j == 0) {
+      // Too much has changed since the peer last told us what it got:
+      // give up recovering anything but this packet's loss
+      s->checkpoint = s->tx_seq - 1;
+      s->journal_resets++;
+      j = build_journal(s, p + h, NET_MAX_UDP - h);
+    }
+    h += j;
+    if (net_udp_send(s->net, &to, s->control_port + 1, h)) {
+      s->tx_packets++;
+    } else {
+      s->tx_unsent++;
+    }
+  } else {
+    s->tx_unsent++;
+  }
+
+  // Sent or not, the packet is numbered: the peer sees one that was
+  // not as lost, and recovers it from the next one's journal
+  for (uint16_t i = 0; i < s->tx_channel_count; i++) {
+    track_tx(s, &s->tx_pending[i], s->tx_seq);
+  }
+  s->tx_seq++;
+  s->tx_length = 0;
+  s->tx_count = 0;
+  s->tx_channel_count = 0;
+}
+
+/** Writes a delta time, most significant 7 bits first, each byte but
+ * the last with bit 7 set; returns its length.
+ */
+static size_t put_delta(uint8_t *out, uint32_t ticks) {
+  size_t n = 1;
+
+  for (uint32_t t = ticks >> 7; t != 0; t >>= 7) {
+    n++;
+  }
+  for (size_t i = 0; i < n; i++) {
+    out[i] = ((ticks >> (7 * (n - 1 - i))) & 0x7F) | (i < n - 1 ? 0x80 : 0);
+  }
+  return n;
+}
+
+/** Adds a message to the packet being filled, at its timestamp; for a
+ * SysEx, sysex is its data. Returns 0 if there is no session, or it
+ * cannot be sent.
+ */
+int rtpmidi_send(rtpmidi *s, const midi_message *mm, const uint8_t *sysex, uint32_t now) {
+  uint8_t bytes[MIDI_SYSEX_MAX + 2];
+  uint8_t delta[4];
+  size_t n, d = 0;
+  uint32_t ticks;
+  midi_encoder me;
+
+  if (s->state != RTPMIDI_OPEN) {
+    return 0;
+  }
+  if (mm->type == MIDI_SYSEX) {
+    if (sysex == NULL || mm->data2 || mm->data1 > MIDI_SYSEX_MAX) {
+      s->tx_drops++;
+      return 0;
+    }
+    bytes[0] = MIDI_SYSEX;
+    memcpy(bytes + 1, sysex, mm->data1);
+    bytes[mm->data1 + 1] = MIDI_EOX;
+    n = mm->data1 + 2;
+  } else {
+    // Every command with its status, which is always allowed
+    midi_encoder_init(&me);
+    n = midi_encode(&me, mm, bytes);
+    if (n == 0) {
+      return 0;
+    }
+  }
+
+  clock_update(s, now);
+  ticks = ticks_at(s, mm->timestamp);
+  if (s->tx_count > 0) {
+    // Commands go in order: none before the last
+    if ((int32_t)(ticks - s->tx_last) < 0) {
+      ticks = s->tx_last;
+    } else if (ticks - s->tx_last > DELTA_MAX) {
+      ticks = s->tx_last + DELTA_MAX;
+    }
+    d = put_delta(delta, ticks - s->tx_last);
+    if (s->tx_length + d + n > RTPMIDI_MAX_COMMANDS ||
+        (mm->type < 0xF0 && s->tx_channel_count == RTPMIDI_MAX_PENDING)) {
+      rtpmidi_flush(s, now);
+      d = 0;
+    }
+  }
+  if (s->tx_count == 0) {
+    s->tx_time = ticks;
+  }
+  s->tx_last = ticks;
+
+  memcpy(s->tx_commands + s->tx_length, delta, d);
+  memcpy(s->tx_commands + s->tx_length + d, bytes, n);
+  s->tx_length += d + n;
+  if (mm->type < 0xF0) {
+    s->tx_pending[s->tx_channel_count++] = *mm;
+  }
+  s->tx_count++;
+  s->tx_messages++;
+  return 1;
+}
+
+void rtpmidi_reset_stats(rtpmidi *s) {
+  s->sessions = 0;
+  s->rx_packets = 0;
+  s->rx_messages = 0;
+  s->rx_lost = 0;
+  s->rx_recovered = 0;
+  s->rx_unrecoverable = 0;
+  s->rx_late = 0;
+  s->rx_errors = 0;
+  s->tx_packets = 0;
+  s->tx_messages = 0;
+  s->tx_drops = 0;
+  s->tx_unsent = 0;
+  s->journal_resets = 0;
+}
+
+/** Listens on our ports. Call once, after rtpmidi_init(). */
+int rtpmidi_bind(rtpmidi *s) {
+  return net_udp_bind(s->net, s->control_port, control_input, s) &&
+         net_udp_bind(s->net, s->control_port + 1, data_input, s);
+}
@@ -0,0 +1,154 @@
+/*
+ * sched.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Cooperative run-to-completion scheduler. See sched.h.
+ *
+ * Times wrap around, so they are only ever compared by
+ * (signed) difference.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sched.h"
+
+static sched_clock_fn sched_clock;
+static sched_task *tasks[SCHED_MAX_TASKS];
+static size_t num_tasks;
+
+static void clear_stats(sched_task *t) {
+  t->runs = 0;
+  t->deadline_misses = 0;
+  t->budget_overruns = 0;
+  t->max_run = 0;
+  t->max_response = 0;
+}
+
+void sched_init(sched_clock_fn clock) {
+  sched_clock = clock;
+  num_tasks = 0;
+}
+
+/** Registers a task; returns 0 if there is no room for it. */
+int sched_add(sched_task *t) {
+  if (num_tasks >= SCHED_MAX_TASKS) {
+    return 0;
+  }
+  t->ready = 0;
+  t->next_release = sched_clock() + t->period;
+  clear_stats(t);
+  tasks[num_tasks++] = t;
+  return 1;
+}
+
+void sched_reset_stats(void) {
+  for (size_t i = 0; i < num_tasks; i++) {
+    clear_stats(tasks[i]);
+  }
+}
+
+size_t sched_num_tasks(void) {
+  return num_tasks;
+}
+
+sched_task *sched_get_task(size_t i) {
+  return i < num_tasks ? tasks[i] : NULL;
+}
+
+/** Makes every task waiting on any of these events ready.
+ * A task that is already ready keeps its original ready time.
+ */
+void sched_post(uint32_t events) {
+  if (events == 0) {
+    return;
+  }
+
+  uint32_t now = sched_clock();
+
+  for (size_t i = 0; i < num_tasks; i++) {
+    sched_task *t = tasks[i];
+    if ((t->events & events) && !t->ready) {
+      t->ready = 1;
+      t->ready_time = now;
+    }
+  }
+}
+
+/** Makes any periodic tasks that are due ready. */
+static void release_periodic(uint32_t now) {
+  for (size_t i = 0; i < num_tasks; i++) {
+    sched_task *t = tasks[i];
+    if (t->period == 0 || (int32_t)(now - t->next_release) < 0) {
+      continue;
+    }
+    if (!t->ready) {
+      t->ready = 1;
+      t->ready_time = t->next_release;
+    }
+    t->next_release += t->period;
+    // If we fell more than a period behind, don't try to catch up
+    if ((int32_t)(now - t->next_release) >= 0) {
+      t->next_release = now + t->period;
+    }
+  }
+}
+
+/** Should ready task a run before ready task b? */
+static int runs_before(const sched_task *a, const sched_task *b) {
+  if (a->priority != b->priority) {
+    return a->priority < b->priority;
+  }
+  // Same class: earliest deadline first; tasks without a deadline last
+  if (a->deadline != 0 && b->deadline != 0) {
+    return (int32_t)((a->ready_time + a->deadline) - (b->ready_time + b->deadline)) < 0;
+  }
+  if (a->deadline != b->deadline) {
+    return a->deadline != 0;
+  }
+  return (int32_t)(a->ready_time - b->ready_time) < 0;
+}
+
+/** Runs the most important ready task to completion.
+ * Returns 1 if a task ran, 0 if none was ready.
+ */
+int sched_run_one(void) {
+  sched_task *best = NULL;
+  uint32_t start, end;
+
+  release_periodic(sched_clock());
+
+  for (size_t i = 0; i < num_tasks; i++) {
+    sched_task *t = tasks[i];
+    if (t->ready && (best == NULL || runs_before(t, best))) {
+      best = t;
+    }
+  }
+  if (best == NULL) {
+    return 0;
+  }
+
+  // Clear first, so an event posted while it runs makes it ready again
+  best->ready = 0;
+  start = sched_clock();
+  best->run();
+  end = sched_clock();
+
+  uint32_t run = end - start;
+  uint32_t response = end - best->ready_time;
+
+  best->runs++;
+  if (run > best->max_run) best->max_run = run;
+  if (response > best->max_response) best->max_response = response;
+  if (best->budget != 0 && run > best->budget) {
+    best->budget_overruns++;
+  }
+  if (best->deadline != 0 && response > best->deadline) {
+    best->deadline_misses++;
+  }
+
+  return 1;
+}
@@ -0,0 +1,424 @@
+/*
+ * smf.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Standard MIDI File reader & writer. See smf.h.
+ */
+
+#include "smf.h"
+
+static uint32_t be32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t be16(const uint8_t *p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static int is_chunk(const uint8_t *p, const char *id) {
+  return p[0] == id[0] && p[1] == id[1] && p[2] == id[2] && p[3] == id[3];
+}
+
+/** Reads a variable length quantity of at most 4 bytes.
+ * Returns 0 if it runs past end.
+ */
+static int read_vlq(const uint8_t **pp, const uint8_t *end, uint32_t *v) {
+  const uint8_t *p = *pp;
+  uint32_t value = 0;
+
+  for (int i = 0; i < 4; i++) {
+    if (p >= end) {
+      return 0;
+    }
+    uint8_t b = *p++;
+    value = (value << 7) | (b & 0x7F);
+    if (!(b & 0x80)) {
+      *pp = p;
+      *v = value;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Track heap //////////////////////////////////////////////////////////////
+
+static int track_before(const smf_reader *r, uint8_t a, uint8_t b) {
+  return r->tracks[a].tick < r->tracks[b].tick ||
+         (r->tracks[a].tick == r->tracks[b].tick && a < b);
+}
+
+static void sift_down(smf_reader *r, uint8_t i) {
+  uint8_t *h = r->heap;
+
+  while (1) {
+    uint8_t least = i;
+    uint8_t l = 2 * i + 1;
+    uint8_t rt = l + 1;
+    if (l < r->heap_len && track_before(r, h[l], h[least])) least = l;
+    if (rt < r->heap_len && track_before(r, h[rt], h[least])) least = rt;
+    if (least == i) {
+      return;
+    }
+    uint8_t t = h[i];
+    h[i] = h[least];
+    h[least] = t;
+    i = least;
+  }
+}
+
+static void sift_up(smf_reader *r, uint8_t i) {
+  uint8_t *h = r->heap;
+
+  while (i > 0) {
+    uint8_t parent = (i - 1) / 2;
+    if (!track_before(r, h[i], h[parent])) {
+      return;
+    }
+    uint8_t t = h[i];
+    h[i] = h[parent];
+    h[parent] = t;
+    i = parent;
+  }
+}
+
+/** Reads the delta time of a track's next event, if it has one.
+ * A track without an end of track event simply ends with its chunk.
+ * One whose delta time runs past its chunk is left with no position,
+ * for smf_next() to report when its turn comes.
+ */
+static int track_advance(smf_track *t) {
+  uint32_t delta;
+
+  if (t->pos >= t->end) {
+    return 0;
+  }
+  if (!read_vlq(&t->pos, t->end, &delta)) {
+    t->pos = NULL;
+    return 1;
+  }
+  t->tick += delta;
+  return 1;
+}
+
+// Reader //////////////////////////////////////////////////////////////////
+
+/** Finds the tracks of the file in data, which must stay where it is
+ * while it is read. Returns 0 or an SMF_ERR_.
+ */
+int smf_open(smf_reader *r, const uint8_t *data, size_t len) {
+  const uint8_t *end = data + len;
+  const uint8_t *p;
+  uint16_t t = 0;
+
+  r->data = data;
+  r->len = len;
+  r->num_tracks = 0;
+  r->heap_len = 0;
+
+  if (len < 14 || !is_chunk(data, "MThd") || be32(data + 4) < 6) {
+    return SMF_ERR_HEADER;
+  }
+  r->format = be16(data + 8);
+  r->division = be16(data + 12);
+  uint16_t num_tracks = be16(data + 10);
+  if (r->format > 1 || num_tracks == 0 || r->division == 0) {
+    return SMF_ERR_FORMAT;
+  }
+  if (num_tracks > SMF_MAX_TRACKS) {
+    return SMF_ERR_TRACKS;
+  }
+  if (be32(data + 4) > len - 8) {
+    return SMF_ERR_TRUNCATED;
+  }
+
+  // Chunks of other types are skipped, as the standard asks
+  p = data + 8 + be32(data + 4);
+  while (t < num_tracks) {
+    if ((size_t)(end - p) < 8) {
+      return SMF_ERR_TRUNCATED;
+    }
+    uint32_t chunk_len = be32(p + 4);
+    if (chunk_len > (size_t)(end - p) - 8) {
+      return SMF_ERR_TRUNCATED;
+    }
+    if (is_chunk(p, "MTrk")) {
+      r->tracks[t].start = p + 8;
+      r->tracks[t].end = p + 8 + chunk_len;
+      t++;
+    }
+    p += 8 + chunk_len;
+  }
+  r->num_tracks = num_tracks;
+
+  smf_rewind(r);
+  return 0;
+}
+
+/** Goes back to the start of every track. */
+void smf_rewind(smf_reader *r) {
+  r->heap_len = 0;
+  r->tempo = SMF_DEFAULT_TEMPO;
+  r->tempo_tick = 0;
+  r->tempo_us = 0;
+  midi_stream_init(&r->parser);
+
+  for (uint8_t t = 0; t < r->num_tracks; t++) {
+    smf_track *tr = &r->tracks[t];
+    tr->pos = tr->start;
+    tr->tick = 0;
+    tr->status = 0;
+    if (track_advance(tr)) {
+      r->heap[r->heap_len] = t;
+      sift_up(r, r->heap_len++);
+    }
+  }
+}
+
+/** Time of a tick in microseconds, given the tempo map so far. */
+static uint64_t tick_time(const smf_reader *r, uint32_t tick) {
+  uint64_t ticks = tick - r->tempo_tick;
+
+  if (r->division & 0x8000) {
+    // SMPTE: frames per second (negated) & ticks per frame; 29 is 29.97
+    uint32_t fps = (uint8_t)-(int8_t)(r->division >> 8);
+    uint32_t tpf = r->division & 0xFF;
+    if (fps == 29) {
+      return r->tempo_us + ticks * 1001000000ULL / (30000ULL * tpf);
+    }
+    return r->tempo_us + ticks * 1000000ULL / (fps * tpf);
+  }
+  return r->tempo_us + ticks * r->tempo / r->division;
+}
+
+/** Reads the next event of all tracks, in time order.
+ * Returns 1 with the event, 0 at the end of the file, or an SMF_ERR_.
+ */
+int smf_next(smf_reader *r, smf_event *ev) {
+  uint32_t len;
+  int n;
+
+  if (r->heap_len == 0) {
+    return 0;
+  }
+  uint8_t t = r->heap[0];
+  smf_track *tr = &r->tracks[t];
+  const uint8_t *p = tr->pos;
+
+  ev->track = t;
+  ev->tick = tr->tick;
+  ev->time_us = tick_time(r, tr->tick);
+  if (p == NULL) {
+    return SMF_ERR_TRUNCATED;
+  }
+
+  uint8_t b = *p;
+  if (b == 0xFF) {
+    if (tr->end - p < 2) {
+      return SMF_ERR_TRUNCATED;
+    }
+    ev->kind = SMF_EVENT_META;
+    ev->status = p[1];
+    p += 2;
+    if (!read_vlq(&p, tr->end, &len) || len > (size_t)(tr->end - p)) {
+      return SMF_ERR_TRUNCATED;
+    }
+    ev->data = p;
+    ev->len = len;
+    p += len;
+    // Meta & SysEx events cancel running status
+    tr->status = 0;
+    if (ev->status == SMF_META_TEMPO && len >= 3) {
+      r->tempo_us = ev->time_us;
+      r->tempo_tick = ev->tick;
+      r->tempo = ((uint32_t)ev->data[0] << 16) | (ev->data[1] << 8) | ev->data[2];
+    } else if (ev->status == SMF_META_END_OF_TRACK) {
+      p = tr->end;
+    }
+
+  } else if (b == MIDI_SYSEX || b == MIDI_EOX) {
+    ev->kind = SMF_EVENT_SYSEX;
+    ev->status = b;
+    p++;
+    if (!read_vlq(&p, tr->end, &len) || len > (size_t)(tr->end - p)) {
+      return SMF_ERR_TRUNCATED;
+    }
+    ev->data = p;
+    ev->len = len;
+    p += len;
+    tr->status = 0;
+
+  } else {
+    if (b & 0x80) {
+      if (b >= 0xF0) {
+        // System common & real-time messages cannot be in a file
+        return SMF_ERR_EVENT;
+      }
+      tr->status = b;
+      p++;
+    } else if (tr->status == 0) {
+      return SMF_ERR_EVENT;
+    }
+    n = ((tr->status & 0xF0) == 0xC0 || (tr->status & 0xF0) == 0xD0) ? 1 : 2;
+    if (tr->end - p < n) {
+      return SMF_ERR_TRUNCATED;
+    }
+    // Parse it just as if it had been received
+    ev->kind = SMF_EVENT_MIDI;
+    ev->status = tr->status;
+    ev->data = p;
+    ev->len = n;
+    midi_stream_receive(&r->parser, tr->status, &ev->msg);
+    for (int i = 0; i < n; i++) {
+      if (p[i] & 0x80) {
+        return SMF_ERR_EVENT;
+      }
+      midi_stream_receive(&r->parser, p[i], &ev->msg);
+    }
+    p += n;
+  }
+
+  tr->pos = p;
+  if (track_advance(tr)) {
+    sift_down(r, 0);
+  } else {
+    r->heap[0] = r->heap[--r->heap_len];
+    sift_down(r, 0);
+  }
+  return 1;
+}
+
+// Writer //////////////////////////////////////////////////////////////////
+
+#define SMF_WRITER_TRACK_START 22 // After MThd & the MTrk chunk header
+#define SMF_WRITER_END_LEN     4  // End of track event, always kept room for
+#define SMF_VLQ_MAX            0x0FFFFFFFUL // The longest delta time
+
+// A delta time of SMF_VLQ_MAX & an empty text event, to span longer ones
+static const uint8_t smf_writer_filler[] = { 0xFF, 0xFF, 0xFF, 0x7F, 0xFF, 0x01, 0 };
+
+static const uint8_t smf_writer_header[] = {
+    'M', 'T', 'h', 'd', 0, 0, 0, 6,
+    0, 0,           // Format 0
+    0, 1,           // One track
+    0, 0,           // Division, filled in
+    'M', 'T', 'r', 'k', 0, 0, 0, 0, // Length, filled in
+    // Tempo, so the file plays back at the times recorded
+    0, 0xFF, SMF_META_TEMPO, 3,
+    (SMF_DEFAULT_TEMPO >> 16) & 0xFF, (SMF_DEFAULT_TEMPO >> 8) & 0xFF, SMF_DEFAULT_TEMPO & 0xFF,
+};
+
+/** Starts recording a file into buff, with tick 0 at the timestamp start
+ * and division ticks per quarter note (at 120 BPM).
+ */
+void smf_writer_init(smf_writer *w, uint8_t *buff, size_t size, uint16_t division, uint32_t start) {
+  w->buff = buff;
+  w->size = size;
+  w->division = division;
+  w->start = start;
+  w->last_tick = 0;
+  w->overflow = 0;
+  w->len = 0;
+  midi_encoder_init(&w->encoder);
+
+  if (size < sizeof(smf_writer_header) + SMF_WRITER_END_LEN) {
+    w->overflow = 1;
+    return;
+  }
+  for (size_t i = 0; i < sizeof(smf_writer_header); i++) {
+    buff[i] = smf_writer_header[i];
+  }
+  buff[12] = division >> 8;
+  buff[13] = division & 0xFF;
+  w->len = sizeof(smf_writer_header);
+}
+
+/** Records a channel message at its timestamp. Returns 1 if it was
+ * recorded, 0 if it is of a kind not recorded, or SMF_ERR_FULL.
+ */
+int smf_writer_add(smf_writer *w, const midi_message *mm) {
+  uint8_t bytes[4 + MIDI_MAX_ENCODED];
+  midi_class mc = midi_message_class(mm);
+  size_t n = 0;
+
+  if (mc == MIDI_CLASS_SYSTEM || mc == MIDI_CLASS_REALTIME) {
+    return 0;
+  }
+  if (w->overflow) {
+    return SMF_ERR_FULL;
+  }
+
+  uint32_t tick = (uint64_t)(mm->timestamp - w->start) * w->division / SMF_DEFAULT_TEMPO;
+  // Messages from several ports may come slightly out of order
+  if (tick < w->last_tick) {
+    tick = w->last_tick;
+  }
+
+  // Delta time, as a variable length quantity
+  uint32_t delta = tick - w->last_tick;
+  while (delta > SMF_VLQ_MAX) {
+    if (w->len + sizeof(smf_writer_filler) + SMF_WRITER_END_LEN > w->size) {
+      w->overflow = 1;
+      return SMF_ERR_FULL;
+    }
+    for (size_t i = 0; i < sizeof(smf_writer_filler); i++) {
+      w->buff[w->len++] = smf_writer_filler[i];
+    }
+    // Meta events cancel running status
+    midi_encoder_init(&w->encoder);
+    w->last_tick += SMF_VLQ_MAX;
+    delta -= SMF_VLQ_MAX;
+  }
+  uint8_t tmp[4];
+  int l = 0;
+  do {
+    tmp[l++] = delta & 0x7F;
+    delta >>= 7;
+  } while (delta != 0);
+  while (l > 0) {
+    l--;
+    bytes[n++] = tmp[l] | (l > 0 ? 0x80 : 0);
+  }
+
+  midi_encoder saved = w->encoder;
+  int m = midi_encode(&w->encoder, mm, bytes + n);
+  if (m == 0) {
+    return 0;
+  }
+  n += m;
+  if (w->len + n + SMF_WRITER_END_LEN > w->size) {
+    w->encoder = saved;
+    w->overflow = 1;
+    return SMF_ERR_FULL;
+  }
+  for (size_t i = 0; i < n; i++) {
+    w->buff[w->len++] = bytes[i];
+  }
+  w->last_tick = tick;
+  return 1;
+}
+
+/** Ends the track; returns the length of the file, which is complete
+ * even if it overflowed (check overflow), or SMF_ERR_FULL if the buffer
+ * could not even hold the header.
+ */
+int smf_writer_finish(smf_writer *w) {
+  static const uint8_t end_of_track[SMF_WRITER_END_LEN] = { 0, 0xFF, SMF_META_END_OF_TRACK, 0 };
+
+  if (w->len == 0) {
+    return SMF_ERR_FULL;
+  }
+  for (int i = 0; i < SMF_WRITER_END_LEN; i++) {
+    w->buff[w->len++] = end_of_track[i];
+  }
+  uint32_t track_len = w->len - SMF_WRITER_TRACK_START;
+  w->buff[18] = track_len >> 24;
+  w->buff[19] = (track_len >> 16) & 0xFF;
+  w->buff[20] = (track_len >> 8) & 0xFF;
+  w->buff[21] = track_len & 0xFF;
+  return w->len;
+}
@@ -0,0 +1,242 @@
+/*
+ * ssd1306.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * SSD1306 framebuffer, dirty pages & font. See ssd1306.h.
+ */
+
+#include <string.h>
+#include "ssd1306.h"
+
+// Commands (datasheet section 9)
+#define CMD_SET_CONTRAST      0x81
+#define CMD_RESUME_RAM        0xA4 // Show the display RAM (rather than all on)
+#define CMD_NORMAL            0xA6 // Not inverted
+#define CMD_DISPLAY_OFF       0xAE
+#define CMD_DISPLAY_ON        0xAF
+#define CMD_COLUMN_LOW        0x00 // | low nibble, page addressing mode
+#define CMD_COLUMN_HIGH       0x10 // | high nibble
+#define CMD_ADDRESSING_MODE   0x20
+#define CMD_PAGE              0xB0 // | page, page addressing mode
+#define CMD_START_LINE        0x40
+#define CMD_SEGMENT_REMAP     0xA1 // Column 127 is SEG0
+#define CMD_MULTIPLEX         0xA8
+#define CMD_COM_SCAN_DOWN     0xC8 // COM[N-1] to COM0
+#define CMD_DISPLAY_OFFSET    0xD3
+#define CMD_CLOCK             0xD5
+#define CMD_PRECHARGE         0xD9
+#define CMD_COM_PINS          0xDA
+#define CMD_VCOMH             0xDB
+#define CMD_CHARGE_PUMP       0x8D
+
+#define ADDRESSING_PAGE 0x02
+
+// The application note's, for a 128x64 module on the internal charge
+// pump, mounted the usual way up
+static const uint8_t set_up[] = {
+    SSD1306_CONTROL_COMMAND,
+    CMD_DISPLAY_OFF,
+    CMD_CLOCK, 0x80,
+    CMD_MULTIPLEX, SSD1306_HEIGHT - 1,
+    CMD_DISPLAY_OFFSET, 0x00,
+    CMD_START_LINE | 0,
+    CMD_CHARGE_PUMP, 0x14,
+    CMD_ADDRESSING_MODE, ADDRESSING_PAGE,
+    CMD_SEGMENT_REMAP,
+    CMD_COM_SCAN_DOWN,
+    CMD_COM_PINS, 0x12,
+    CMD_SET_CONTRAST, 0xCF,
+    CMD_PRECHARGE, 0xF1,
+    CMD_VCOMH, 0x40,
+    CMD_RESUME_RAM,
+    CMD_NORMAL,
+    CMD_DISPLAY_ON,
+};
+
+// 5x7 characters ' ' to '~', a column a byte, LSB at the top
+static const uint8_t font[][5] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+    { 0x00, 0x00, 0x5F, 0x00, 0x00 }, // !
+    { 0x00, 0x07, 0x00, 0x07, 0x00 }, // "
+    { 0x14, 0x7F, 0x14, 0x7F, 0x14 }, // #
+    { 0x24, 0x2A, 0x7F, 0x2A, 0x12 }, // $
+    { 0x23, 0x13, 0x08, 0x64, 0x62 }, // %
+    { 0x36, 0x49, 0x55, 0x22, 0x50 }, // &
+    { 0x00, 0x05, 0x03, 0x00, 0x00 }, // '
+    { 0x00, 0x1C, 0x22, 0x41, 0x00 }, // (
+    { 0x00, 0x41, 0x22, 0x1C, 0x00 }, // )
+    { 0x14, 0x08, 0x3E, 0x08, 0x14 }, // *
+    { 0x08, 0x08, 0x3E, 0x08, 0x08 }, // +
+    { 0x00, 0x50, 0x30, 0x00, 0x00 }, // ,
+    { 0x08, 0x08, 0x08, 0x08, 0x08 }, // -
+    { 0x00, 0x60, 0x60, 0x00, 0x00 }, // .
+    { 0x20, 0x10, 0x08, 0x04, 0x02 }, // /
+    { 0x3E, 0x51, 0x49, 0x45, 0x3E }, // 0
+    { 0x00, 0x42, 0x7F, 0x40, 0x00 }, // 1
+    { 0x42, 0x61, 0x51, 0x49, 0x46 }, // 2
+    { 0x21, 0x41, 0x45, 0x4B, 0x31 }, // 3
+    { 0x18, 0x14, 0x12, 0x7F, 0x10 }, // 4
+    { 0x27, 0x45, 0x45, 0x45, 0x39 }, // 5
+    { 0x3C, 0x4A, 0x49, 0x49, 0x30 }, // 6
+    { 0x01, 0x71, 0x09, 0x05, 0x03 }, // 7
+    { 0x36, 0x49, 0x49, 0x49, 0x36 }, // 8
+    { 0x06, 0x49, 0x49, 0x29, 0x1E }, // 9
+    { 0x00, 0x36, 0x36, 0x00, 0x00 }, // :
+    { 0x00, 0x56, 0x36, 0x00, 0x00 }, // ;
+    { 0x08, 0x14, 0x22, 0x41, 0x00 }, // <
+    { 0x14, 0x14, 0x14, 0x14, 0x14 }, // =
+    { 0x00, 0x41, 0x22, 0x14, 0x08 }, // >
+    { 0x02, 0x01, 0x51, 0x09, 0x06 }, // ?
+    { 0x32, 0x49, 0x79, 0x41, 0x3E }, // @
+    { 0x7E, 0x11, 0x11, 0x11, 0x7E }, // A
+    { 0x7F, 0x49, 0x49, 0x49, 0x36 }, // B
+    { 0x3E, 0x41, 0x41, 0x41, 0x22 }, // C
+    { 0x7F, 0x41, 0x41, 0x22, 0x1C }, // D
+    { 0x7F, 0x49, 0x49, 0x49, 0x41 }, // E
+    { 0x7F, 0x09, 0x09, 0x09, 0x01 }, // F
+    { 0x3E, 0x41, 0x49, 0x49, 0x7A }, // G
+    { 0x7F, 0x08, 0x08, 0x08, 0x7F }, // H
+    { 0x00, 0x41, 0x7F, 0x41, 0x00 }, // I
+    { 0x20, 0x40, 0x41, 0x3F, 0x01 }, // J
+    { 0x7F, 0x08, 0x14, 0x22, 0x41 }, // K
+    { 0x7F, 0x40, 0x40, 0x40, 0x40 }, // L
+    { 0x7F, 0x02, 0x0C, 0x02, 0x7F }, // M
+    { 0x7F, 0x04, 0x08, 0x10, 0x7F }, // N
+    { 0x3E, 0x41, 0x41, 0x41, 0x3E }, // O
+    { 0x7F, 0x09, 0x09, 0x09, 0x06 }, // P
+    { 0x3E, 0x41, 0x51, 0x21, 0x5E }, // Q
+    { 0x7F, 0x09, 0x19, 0x29, 0x46 }, // R
+    { 0x46, 0x49, 0x49, 0x49, 0x31 }, // S
+    { 0x01, 0x01, 0x7F, 0x01, 0x01 }, // T
+    { 0x3F, 0x40, 0x40, 0x40, 0x3F }, // U
+    { 0x1F, 0x20, 0x40, 0x20, 0x1F }, // V
+    { 0x3F, 0x40, 0x38, 0x40, 0x3F }, // W
+    { 0x63, 0x14, 0x08, 0x14, 0x63 }, // X
+    { 0x07, 0x08, 0x70, 0x08, 0x07 }, // Y
+    { 0x61, 0x51, 0x49, 0x45, 0x43 }, // Z
+    { 0x00, 0x7F, 0x41, 0x41, 0x00 }, // [
+    { 0x02, 0x04, 0x08, 0x10, 0x20 }, // backslash
+    { 0x00, 0x41, 0x41, 0x7F, 0x00 }, // ]
+    { 0x04, 0x02, 0x01, 0x02, 0x04 }, // ^
+    { 0x40, 0x40, 0x40, 0x40, 0x40 }, // _
+    { 0x00, 0x01, 0x02, 0x04, 0x00 }, // `
+    { 0x20, 0x54, 0x54, 0x54, 0x78 }, // a
+    { 0x7F, 0x48, 0x44, 0x44, 0x38 }, // b
+    { 0x38, 0x44, 0x44, 0x44, 0x20 }, // c
+    { 0x38, 0x44, 0x44, 0x48, 0x7F }, // d
+    { 0x38, 0x54, 0x54, 0x54, 0x18 }, // e
+    { 0x08, 0x7E, 0x09, 0x01, 0x02 }, // f
+    { 0x0C, 0x52, 0x52, 0x52, 0x3E }, // g
+    { 0x7F, 0x08, 0x04, 0x04, 0x78 }, // h
+    { 0x00, 0x44, 0x7D, 0x40, 0x00 }, // i
+    { 0x20, 0x40, 0x44, 0x3D, 0x00 }, // j
+    { 0x7F, 0x10, 0x28, 0x44, 0x00 }, // k
+    { 0x00, 0x41, 0x7F, 0x40, 0x00 }, // l
+    { 0x7C, 0x04, 0x18, 0x04, 0x78 }, // m
+    { 0x7C, 0x08, 0x04, 0x04, 0x78 }, // n
+    { 0x38, 0x44, 0x44, 0x44, 0x38 }, // o
+    { 0x7C, 0x14, 0x14, 0x14, 0x08 }, // p
+    { 0x08, 0x14, 0x14, 0x18, 0x7C }, // q
+    { 0x7C, 0x08, 0x04, 0x04, 0x08 }, // r
+    { 0x48, 0x54, 0x54, 0x54, 0x20 }, // s
+    { 0x04, 0x3F, 0x44, 0x40, 0x20 }, // t
+    { 0x3C, 0x40, 0x40, 0x20, 0x7C }, // u
+    { 0x1C, 0x20, 0x40, 0x20, 0x1C }, // v
+    { 0x3C, 0x40, 0x30, 0x40, 0x3C }, // w
+    { 0x44, 0x28, 0x10, 0x28, 0x44 }, // x
+    { 0x0C, 0x50, 0x50, 0x50, 0x3C }, // y
+    { 0x44, 0x64, 0x54, 0x4C, 0x44 }, // z
+    { 0x00, 0x08, 0x36, 0x41, 0x00 }, // {
+    { 0x00, 0x00, 0x7F, 0x00, 0x00 }, // |
+    { 0x00, 0x41, 0x36, 0x08, 0x00 }, // }
+    { 0x08, 0x04, 0x08, 0x10, 0x08 }, // ~
+};
+
+void ssd1306_init(ssd1306 *d) {
+  memset(d, 0, sizeof(*d));
+  ssd1306_reset(d);
+}
+
+/** Has the controller set up again, and all of it redrawn: after it
+ * was powered up, or did not answer.
+ */
+void ssd1306_reset(ssd1306 *d) {
+  d->set_up = 0;
+  d->dirty = (1 << SSD1306_PAGES) - 1;
+}
+
+/** Replaces a page of the framebuffer, marking it to be sent if it
+ * changed.
+ */
+void ssd1306_put_page(ssd1306 *d, uint8_t page, const uint8_t *columns) {
+  if (memcmp(d->fb[page], columns, SSD1306_WIDTH) == 0) {
+    d->pages_unchanged++;
+    return;
+  }
+  memcpy(d->fb[page], columns, SSD1306_WIDTH);
+  // Only once it is all there, as it may be sent at any time
+  d->dirty |= 1 << page;
+}
+
+/** Makes the next I2C transfer to the controller in d->tx, returning
+ * its length, or 0 when there is nothing more to send. Each dirty page
+ * is taken as it is copied in, so it may be redrawn while it is sent.
+ */
+size_t ssd1306_next(ssd1306 *d) {
+  uint8_t dirty = d->dirty;
+  uint8_t page = 0;
+  uint8_t *p = d->tx;
+
+  if (!d->set_up) {
+    d->set_up = 1;
+    d->set_ups++;
+    memcpy(d->tx, set_up, sizeof(set_up));
+    return sizeof(set_up);
+  }
+  if (dirty == 0) {
+    return 0;
+  }
+  while (!(dirty & (1 << page))) {
+    page++;
+  }
+  d->dirty = dirty & ~(1 << page);
+
+  *p++ = SSD1306_CONTROL_COMMAND_BYTE;
+  *p++ = CMD_PAGE | page;
+  *p++ = SSD1306_CONTROL_COMMAND_BYTE;
+  *p++ = CMD_COLUMN_LOW | 0;
+  *p++ = SSD1306_CONTROL_COMMAND_BYTE;
+  *p++ = CMD_COLUMN_HIGH | 0;
+  *p++ = SSD1306_CONTROL_DATA;
+  memcpy(p, d->fb[page], SSD1306_WIDTH);
+  d->pages_sent++;
+  return SSD1306_TRANSFER_MAX;
+}
+
+void ssd1306_reset_stats(ssd1306 *d) {
+  d->set_ups = 0;
+  d->pages_sent = 0;
+  d->pages_unchanged = 0;
+}
+
+/** Draws text into a page's columns from column x, as far as it fits;
+ * characters outside ' ' to '~' are drawn as '?'. Returns the column
+ * after the last character.
+ */
+int ssd1306_text(uint8_t *columns, int x, const char *s) {
+  for (; *s && x + SSD1306_FONT_WIDTH <= SSD1306_WIDTH; s++) {
+    uint8_t c = (uint8_t)*s;
+
+    if (c < ' ' || c > '~') {
+      c = '?';
+    }
+    memcpy(&columns[x], font[c - ' '], 5);
+    columns[x + 5] = 0;
+    x += SSD1306_FONT_WIDTH;
+  }
+  return x;
+}
@@ -22,6 +22,10 @@
 #include "stm32f7xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "realmain.h"
+#include "events.h"
+#include "deferred.h"
+#include "midiport.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -59,6 +63,10 @@ extern DMA_HandleTypeDef hdma_spi3_tx;
 extern UART_HandleTypeDef huart3;
 extern UART_HandleTypeDef huart6;
 /* USER CODE BEGIN EV */
+extern PCD_HandleTypeDef hpcd_USB_OTG_FS;
+extern ETH_HandleTypeDef heth;
+extern I2C_HandleTypeDef hi2c1;
+extern DMA_HandleTypeDef hdma_i2c1_tx;
 
 /* USER CODE END EV */
 
@@ -172,7 +180,7 @@ void DebugMon_Handler(void)
 void PendSV_Handler(void)
 {
   /* USER CODE BEGIN PendSV_IRQn 0 */
-
+  deferred_run();
   /* USER CODE END PendSV_IRQn 0 */
   /* USER CODE BEGIN PendSV_IRQn 1 */
 
@@ -189,6 +197,7 @@ void SysTick_Handler(void)
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
+  event_post(EV_TICK);
 
   /* USER CODE END SysTick_IRQn 1 */
 }
@@ -220,6 +229,7 @@ void DMA1_Stream5_IRQHandler(void)
 void USART3_IRQHandler(void)
 {
   /* USER CODE BEGIN USART3_IRQn 0 */
+  uart_isr(&huart3);
 
   /* USER CODE END USART3_IRQn 0 */
   HAL_UART_IRQHandler(&huart3);
@@ -234,6 +244,7 @@ void USART3_IRQHandler(void)
 void USART6_IRQHandler(void)
 {
   /* USER CODE BEGIN USART6_IRQn 0 */
+  midiport_isr(0);
 
   /* USER CODE END USART6_IRQn 0 */
   HAL_UART_IRQHandler(&huart6);
@@ -244,4 +255,73 @@ void USART6_IRQHandler(void)
 
 /* USER CODE BEGIN 1 */
 
+/**
+  * @brief MIDI port interrupts (midiport.h); not in the CubeMX configuration.
+  */
+void USART2_IRQHandler(void)
+{
+  midiport_isr(1);
+}
+
+void UART4_IRQHandler(void)
+{
+  midiport_isr(2);
+}
+
+void UART5_IRQHandler(void)
+{
+  midiport_isr(3);
+}
+
+void UART7_IRQHandler(void)
+{
+  midiport_isr(4);
+}
+
+/**
+  * @brief USB On The Go FS global interrupt (usbdev.h); its NVIC
+  * setup is not in the CubeMX configuration either.
+  */
+void OTG_FS_IRQHandler(void)
+{
+  HAL_PCD_IRQHandler(&hpcd_USB_OTG_FS);
+}
+
+/**
+  * @brief Ethernet global interrupt (ethif.h); its NVIC setup is not
+  * in the CubeMX configuration either.
+  */
+void ETH_IRQHandler(void)
+{
+  HAL_ETH_IRQHandler(&heth);
+}
+
+/**
+  * @brief I2C1 event & error interrupts, and its transmit DMA
+  * (display.h); not in the CubeMX configuration either.
+  */
+void I2C1_EV_IRQHandler(void)
+{
+  HAL_I2C_EV_IRQHandler(&hi2c1);
+}
+
+void I2C1_ER_IRQHandler(void)
+{
+  HAL_I2C_ER_IRQHandler(&hi2c1);
+}
+
+void DMA1_Stream6_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_i2c1_tx);
+}
+
+/**
+  * @brief Flash global interrupt: the end of each program or erase
+  * (presets.h); not in the CubeMX configuration either.
+  */
+void FLASH_IRQHandler(void)
+{
+  HAL_FLASH_IRQHandler();
+}
+
 /* USER CODE END 1 */
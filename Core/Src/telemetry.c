@@ -0,0 +1,86 @@
+/*
+ * telemetry.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Telemetry packet writer. See telemetry.h.
+ */
+
+#include <string.h>
+#include "telemetry.h"
+
+static void put32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+/** Starts a packet in buf, of size bytes. */
+void telemetry_begin(telemetry_writer *w, uint8_t *buf, size_t size, uint32_t seq,
+                     uint32_t uptime_ms) {
+  w->buf = buf;
+  w->size = size;
+  w->rows = NULL;
+  w->fields = 0;
+  w->overflow = size < TELEMETRY_HEADER;
+  if (w->overflow) {
+    w->len = 0;
+    return;
+  }
+  buf[0] = 'M';
+  buf[1] = 'T';
+  buf[2] = TELEMETRY_VERSION;
+  buf[3] = 0;
+  put32(buf + 4, seq);
+  put32(buf + 8, uptime_ms);
+  w->len = TELEMETRY_HEADER;
+}
+
+/** Starts a section whose rows each have fields values. */
+void telemetry_section(telemetry_writer *w, telemetry_section_id id, uint8_t fields) {
+  if (w->overflow || w->len + 3 > w->size) {
+    w->overflow = 1;
+    return;
+  }
+  w->buf[w->len] = id;
+  w->buf[w->len + 1] = fields;
+  w->buf[w->len + 2] = 0;
+  w->rows = &w->buf[w->len + 2];
+  w->fields = fields;
+  w->len += 3;
+}
+
+/** Adds a row to the section: its name and its fields values. */
+void telemetry_row(telemetry_writer *w, const char *name, const uint32_t *values) {
+  size_t name_len = strlen(name);
+  uint8_t *p;
+
+  if (name_len > TELEMETRY_NAME_MAX) {
+    name_len = TELEMETRY_NAME_MAX;
+  }
+  if (w->overflow || w->rows == NULL || *w->rows == 0xFF ||
+      w->len + name_len + 1 + 4 * w->fields > w->size) {
+    w->overflow = 1;
+    return;
+  }
+  p = w->buf + w->len;
+  memcpy(p, name, name_len);
+  p[name_len] = 0;
+  p += name_len + 1;
+  for (uint8_t i = 0; i < w->fields; i++) {
+    put32(p + 4 * i, values[i]);
+  }
+  w->len += name_len + 1 + 4 * w->fields;
+  (*w->rows)++;
+}
+
+/** Returns the length of the packet: what fit, whole rows, if not all
+ * did (overflow is then set).
+ */
+size_t telemetry_end(telemetry_writer *w) {
+  return w->len;
+}
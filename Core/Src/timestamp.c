@@ -0,0 +1,38 @@
+/*
+ * timestamp.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * TIM2 as a 1 MHz free-running 32 bit counter. See timestamp.h.
+ *
+ * The HAL TIM module is not enabled (stm32f7xx_hal_conf.h), and we need
+ * nothing but a counting timer, so this sets up the registers directly.
+ *
+ * References:
+ * - RM0410 Rev 5 section 6.2: timer clocks are twice the APB clock
+ *   unless the APB prescaler is 1
+ * - RM0410 Rev 5 section 28.4: TIM2 to TIM5 registers
+ */
+
+#include "main.h"
+#include "timestamp.h"
+
+void timestamp_init(void) {
+  uint32_t timer_clock = HAL_RCC_GetPCLK1Freq();
+
+  if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) {
+    timer_clock *= 2;
+  }
+
+  __HAL_RCC_TIM2_CLK_ENABLE();
+  TIMESTAMP_TIMER->CR1 = 0;
+  TIMESTAMP_TIMER->PSC = timer_clock / TIMESTAMP_HZ - 1;
+  TIMESTAMP_TIMER->ARR = 0xFFFFFFFF;
+  TIMESTAMP_TIMER->CNT = 0;
+  // Load the prescaler now rather than at the first overflow
+  TIMESTAMP_TIMER->EGR = TIM_EGR_UG;
+  TIMESTAMP_TIMER->CR1 = TIM_CR1_CEN;
+}
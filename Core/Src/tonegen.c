@@ -16,6 +16,7 @@
 void tonegen_init(tonegen_state *tgs, uint32_t sample_rate) {
   tgs->sample_rate = sample_rate;
   tgs->desired_freq = 0;
+  tgs->freq_x100 = 0;
   tgs->desired_ampl = 0;
 
   tgs->delta = 0;
@@ -27,12 +28,21 @@ void tonegen_init(tonegen_state *tgs, uint32_t sample_rate) {
 
 void tonegen_set(tonegen_state *tgs, uint32_t desired_freq, int16_t desired_ampl) {
   if (desired_freq > tgs->sample_rate / 2)
-    tgs->desired_freq = tgs->sample_rate / 2;
-  else if (desired_freq < 1)
-    // Prevent later divide by zero
-    tgs->desired_freq = 1;
+    desired_freq = tgs->sample_rate / 2;
+  tonegen_set_x100(tgs, desired_freq * 100, desired_ampl);
+}
+
+/** As tonegen_set(), with the frequency in hundredths of a Hz, e.g.
+ * from midi_note_freqX100[] or OSC, rather than rounded to a Hz.
+ */
+void tonegen_set_x100(tonegen_state *tgs, uint32_t freq_x100, int16_t desired_ampl) {
+  if (freq_x100 > tgs->sample_rate * 50)
+    tgs->freq_x100 = tgs->sample_rate * 50;
+  else if (freq_x100 < 100)
+    tgs->freq_x100 = 100;
   else
-    tgs->desired_freq = desired_freq;
+    tgs->freq_x100 = freq_x100;
+  tgs->desired_freq = (tgs->freq_x100 + 50) / 100;
 
   if (desired_ampl < 0)
     tgs->desired_ampl = 0;
@@ -64,9 +74,17 @@ void tonegen_set(tonegen_state *tgs, uint32_t desired_freq, int16_t desired_ampl
   tgs->delta = tgs->desired_ampl / samples * 4; // Moving * 4 earlier doesn't help
   */
 
+  /* // PREVIOUS VERSION, to the nearest Hz
   // Scale by 256 (2^8) to get more accurate delta
   uint32_t samplesX256 = 256 * tgs->sample_rate / tgs->desired_freq;
   tgs->delta = tgs->desired_ampl * 4 * 256 / samplesX256;
+  */
+
+  // Four amplitudes a cycle, from the frequency in hundredths of a Hz.
+  // Above a quarter of the sample rate at full amplitude that is more
+  // than an int16_t: keep the fastest slope there is.
+  uint64_t delta = (uint64_t)tgs->desired_ampl * 4 * tgs->freq_x100 / (tgs->sample_rate * 100ULL);
+  tgs->delta = delta > INT16_MAX ? INT16_MAX : (int16_t)delta;
 }
 
 int16_t tonegen_next_sample(tonegen_state *tgs) {
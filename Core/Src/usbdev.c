@@ -0,0 +1,702 @@
+/*
+ * usbdev.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Full speed USB device on the HAL PCD driver. See usbdev.h.
+ *
+ * Only what a MIDI adapter & serial port need of chapter 9: no remote
+ * wakeup, no alternate settings, one configuration. Control transfers
+ * on endpoint 0 are sent a packet at a time, as the PCD driver only
+ * starts one packet of an endpoint 0 transfer.
+ */
+
+#include <string.h>
+#include "main.h"
+#include "usbdev.h"
+#include "midiport.h"
+#include "deferred.h"
+#include "timestamp.h"
+#include "events.h"
+
+// From main.c
+extern PCD_HandleTypeDef hpcd_USB_OTG_FS;
+
+#define EP0_SIZE    64
+#define MIDI_EP_OUT 0x01
+#define MIDI_EP_IN  0x81
+#define CDC_EP_OUT  0x02
+#define CDC_EP_IN   0x82
+#define CDC_EP_NOTIFY 0x83
+
+#define CDC_PACKET_SIZE 64 // Full speed bulk max packet size
+#define CDC_TX_SIZE     (4 * CDC_PACKET_SIZE) // Each of the two transfers sent in turn
+#define CDC_NOTIFY_SIZE 8
+#define CDC_COMM_IFACE  2
+#define CDC_DATA_IFACE  3
+
+// pid.codes' test VID & PID: fine on the bench, not for a product
+#define USB_VID 0x1209
+#define USB_PID 0x0001
+
+#define LO(x) ((uint8_t)((x) & 0xFF))
+#define HI(x) ((uint8_t)(((x) >> 8) & 0xFF))
+
+// Standard requests (USB 2.0 Table 9-4), descriptor types (Table 9-5)
+// and features (Table 9-6)
+#define REQ_GET_STATUS        0x00
+#define REQ_CLEAR_FEATURE     0x01
+#define REQ_SET_FEATURE       0x03
+#define REQ_SET_ADDRESS       0x05
+#define REQ_GET_DESCRIPTOR    0x06
+#define REQ_GET_CONFIGURATION 0x08
+#define REQ_SET_CONFIGURATION 0x09
+#define REQ_GET_INTERFACE     0x0A
+#define REQ_SET_INTERFACE     0x0B
+
+#define REQ_TYPE_MASK         0x60
+#define REQ_TYPE_STANDARD     0x00
+#define REQ_TYPE_CLASS        0x20
+#define REQ_RECIPIENT_MASK    0x1F
+#define REQ_RECIPIENT_DEVICE  0x00
+#define REQ_RECIPIENT_IFACE   0x01
+#define REQ_RECIPIENT_EP      0x02
+
+#define DESC_DEVICE        1
+#define DESC_CONFIGURATION 2
+#define DESC_STRING        3
+#define DESC_INTERFACE     4
+#define DESC_ENDPOINT      5
+#define DESC_IAD           0x0B
+#define DESC_CS_INTERFACE  0x24
+#define DESC_CS_ENDPOINT   0x25
+
+#define FEATURE_ENDPOINT_HALT 0
+
+// CDC PSTN requests (PSTN120 Table 13)
+#define CDC_SET_LINE_CODING        0x20
+#define CDC_GET_LINE_CODING        0x21
+#define CDC_SET_CONTROL_LINE_STATE 0x22
+#define CDC_LINE_CODING_SIZE       7
+#define CDC_DTR                    0x01
+
+// The class-specific MIDIStreaming descriptors, header to the last endpoint
+#define MIDI_CS_LENGTH (7 + 6 + 6 + 9 + 9 + 9 + 5 + 9 + 5)
+// The serial port's function, association to its last endpoint
+#define CDC_LENGTH     (8 + 9 + 5 + 5 + 4 + 5 + 7 + 9 + 7 + 7)
+#define CONFIG_LENGTH  (9 + 8 + 9 + 9 + 9 + MIDI_CS_LENGTH + CDC_LENGTH)
+#define NUM_INTERFACES 4
+
+static const uint8_t device_descriptor[] = {
+    18, DESC_DEVICE,
+    0x00, 0x02,       // USB 2.0
+    0xEF, 0x02, 0x01, // Functions by Interface Association descriptors
+    EP0_SIZE,
+    LO(USB_VID), HI(USB_VID), LO(USB_PID), HI(USB_PID),
+    0x01, 0x01,       // Release 1.01: hosts cache descriptors by release
+    1, 2, 0,          // Manufacturer & product strings, no serial number
+    1,                // Configurations
+};
+
+// USB MIDI 1.0 Appendix B, less the external jacks' second pair, then
+// a CDC ACM serial port, each function under its own association
+static const uint8_t config_descriptor[CONFIG_LENGTH] = {
+    9, DESC_CONFIGURATION, LO(CONFIG_LENGTH), HI(CONFIG_LENGTH),
+    NUM_INTERFACES,
+    1,    // This configuration
+    0,    // No string
+    0xC0, // Self powered, by the ST-LINK's USB
+    50,   // 100 mA
+
+    8, DESC_IAD, 0, 2, 0x01, 0x01, 0x00, 0,
+
+    // Interface 0: Audio Control, with just the header naming interface 1
+    9, DESC_INTERFACE, 0, 0, 0, 0x01, 0x01, 0x00, 0,
+    9, DESC_CS_INTERFACE, 0x01, 0x00, 0x01, 9, 0, 1, 1,
+
+    // Interface 1: MIDIStreaming
+    9, DESC_INTERFACE, 1, 0, 2, 0x01, 0x03, 0x00, 0,
+    7, DESC_CS_INTERFACE, 0x01, 0x00, 0x01, LO(MIDI_CS_LENGTH), HI(MIDI_CS_LENGTH),
+    6, DESC_CS_INTERFACE, 0x02, 0x01, 1, 0,          // IN jack 1, embedded: from the host
+    6, DESC_CS_INTERFACE, 0x02, 0x02, 2, 0,          // IN jack 2, external
+    9, DESC_CS_INTERFACE, 0x03, 0x01, 3, 1, 2, 1, 0, // OUT jack 3, embedded: to the host, from 2
+    9, DESC_CS_INTERFACE, 0x03, 0x02, 4, 1, 1, 1, 0, // OUT jack 4, external, from 1
+    9, DESC_ENDPOINT, MIDI_EP_OUT, 0x02, LO(USBMIDI_TRANSFER_SIZE), HI(USBMIDI_TRANSFER_SIZE), 0, 0, 0,
+    5, DESC_CS_ENDPOINT, 0x01, 1, 1,                 // Into jack 1
+    9, DESC_ENDPOINT, MIDI_EP_IN, 0x02, LO(USBMIDI_TRANSFER_SIZE), HI(USBMIDI_TRANSFER_SIZE), 0, 0, 0,
+    5, DESC_CS_ENDPOINT, 0x01, 1, 3,                 // From jack 3
+
+    8, DESC_IAD, CDC_COMM_IFACE, 2, 0x02, 0x02, 0x00, 0,
+
+    // Interface 2: CDC Communication, Abstract Control Model, no AT commands
+    9, DESC_INTERFACE, CDC_COMM_IFACE, 0, 1, 0x02, 0x02, 0x00, 0,
+    5, DESC_CS_INTERFACE, 0x00, 0x10, 0x01,                     // Header, CDC 1.10
+    5, DESC_CS_INTERFACE, 0x01, 0x00, CDC_DATA_IFACE,           // Call management: none
+    4, DESC_CS_INTERFACE, 0x02, 0x02,                           // ACM: line coding & state
+    5, DESC_CS_INTERFACE, 0x06, CDC_COMM_IFACE, CDC_DATA_IFACE, // Union
+    7, DESC_ENDPOINT, CDC_EP_NOTIFY, 0x03, CDC_NOTIFY_SIZE, 0, 16,
+
+    // Interface 3: CDC Data
+    9, DESC_INTERFACE, CDC_DATA_IFACE, 0, 2, 0x0A, 0x00, 0x00, 0,
+    7, DESC_ENDPOINT, CDC_EP_OUT, 0x02, LO(CDC_PACKET_SIZE), HI(CDC_PACKET_SIZE), 0,
+    7, DESC_ENDPOINT, CDC_EP_IN, 0x02, LO(CDC_PACKET_SIZE), HI(CDC_PACKET_SIZE), 0,
+};
+
+static const char *const strings[] = {
+    NULL, // Languages
+    "Douglas P. Fields, Jr.",
+    "Nucleo MIDI",
+};
+#define NUM_STRINGS (sizeof(strings) / sizeof(strings[0]))
+
+typedef struct {
+  uint8_t type;
+  uint8_t request;
+  uint16_t value;
+  uint16_t index;
+  uint16_t length;
+} usb_setup;
+
+typedef enum {
+  EP0_IDLE = 0,
+  EP0_DATA_IN,
+  EP0_DATA_OUT,
+  EP0_STATUS_IN,
+  EP0_STATUS_OUT,
+} ep0_stage;
+
+usbmidi usb_midi;
+
+static uint8_t configuration;
+static uint16_t halted; // Endpoint halt features set: bit n OUT n, bit 8 + n IN n
+
+// Control transfer being sent
+static ep0_stage ep0;
+static const uint8_t *ep0_data;
+static uint32_t ep0_left;
+static uint8_t ep0_zlp; // Ends with an empty packet
+static uint8_t ep0_buff[EP0_SIZE];
+
+// Received MIDI transfer
+static uint8_t midi_rx_buff[USBMIDI_TRANSFER_SIZE];
+static volatile uint8_t midi_out_waiting; // NAKing until there is room
+
+usbdev_cdc_stats usb_cdc_stats;
+
+// The serial port: the console's ring buffers, once attached
+static ring_buffer_t *cdc_in_rb;
+static ring_buffer_t *cdc_out_rb;
+static uint32_t cdc_rx_event;
+static volatile uint8_t cdc_dtr; // A terminal has the port open
+static uint8_t cdc_line_coding[CDC_LINE_CODING_SIZE] = {
+    LO(460800), HI(460800), LO(460800 >> 16), HI(460800 >> 16), // Like the UART, which it ignores
+    0, 0, 8, // 1 stop bit, no parity, 8 data bits
+};
+static uint8_t cdc_rx_buff[CDC_PACKET_SIZE];
+static volatile uint8_t cdc_out_waiting; // NAKing until there is room
+// Transfers being sent: cdc_tx_fill is topped up from the output ring
+// buffer while the other is sent, if cdc_tx_busy
+static uint8_t cdc_tx_buff[2][CDC_TX_SIZE];
+static uint16_t cdc_tx_len[2];
+static uint8_t cdc_tx_fill;
+static volatile uint8_t cdc_tx_busy;
+static uint8_t cdc_tx_zlp; // The last transfer sent ended on a whole packet
+
+// Endpoint 0 ////////////////////////////////////////////////////////////////
+
+/** Starts the data stage of a control read: len bytes, no more than
+ * the host asked for.
+ */
+static void ep0_send(PCD_HandleTypeDef *hpcd, const uint8_t *data, uint32_t len, uint16_t max) {
+  if (len > max) {
+    len = max;
+  }
+  ep0_data = data;
+  ep0_left = len;
+  // Short of what was asked, it must end with a short packet
+  ep0_zlp = len > 0 && len < max && len % EP0_SIZE == 0;
+  ep0 = EP0_DATA_IN;
+  HAL_PCD_EP_Transmit(hpcd, 0x80, (uint8_t *)data, len);
+}
+
+/** Starts the data stage of a control write of len bytes, which must
+ * fit in one packet, into ep0_buff.
+ */
+static void ep0_receive(PCD_HandleTypeDef *hpcd, uint16_t len) {
+  ep0 = EP0_DATA_OUT;
+  HAL_PCD_EP_Receive(hpcd, 0x00, ep0_buff, len);
+}
+
+/** Status stage of a request with no data stage. */
+static void ep0_status(PCD_HandleTypeDef *hpcd) {
+  ep0 = EP0_STATUS_IN;
+  HAL_PCD_EP_Transmit(hpcd, 0x80, NULL, 0);
+}
+
+/** Refuses a request; the next SETUP clears the stall. */
+static void ep0_stall(PCD_HandleTypeDef *hpcd) {
+  ep0 = EP0_IDLE;
+  HAL_PCD_EP_SetStall(hpcd, 0x80);
+  HAL_PCD_EP_SetStall(hpcd, 0x00);
+}
+
+static void ep0_data_in(PCD_HandleTypeDef *hpcd) {
+  uint32_t sent;
+
+  if (ep0 != EP0_DATA_IN) {
+    ep0 = EP0_IDLE;
+    return;
+  }
+  sent = ep0_left < EP0_SIZE ? ep0_left : EP0_SIZE;
+  ep0_data += sent;
+  ep0_left -= sent;
+  if (ep0_left > 0) {
+    HAL_PCD_EP_Transmit(hpcd, 0x80, (uint8_t *)ep0_data, ep0_left);
+  } else if (ep0_zlp) {
+    ep0_zlp = 0;
+    HAL_PCD_EP_Transmit(hpcd, 0x80, NULL, 0);
+  } else {
+    ep0 = EP0_STATUS_OUT;
+    HAL_PCD_EP_Receive(hpcd, 0x00, NULL, 0);
+  }
+}
+
+// MIDI endpoints ////////////////////////////////////////////////////////////
+
+/** Takes the next transfer from the host if there is room for it. */
+static void midi_out_arm(PCD_HandleTypeDef *hpcd) {
+  if (usbmidi_rx_room(&usb_midi) >= USBMIDI_TRANSFER_PACKETS) {
+    midi_out_waiting = 0;
+    HAL_PCD_EP_Receive(hpcd, MIDI_EP_OUT, midi_rx_buff, sizeof(midi_rx_buff));
+  } else {
+    midi_out_waiting = 1;
+  }
+}
+
+static void midi_open(PCD_HandleTypeDef *hpcd) {
+  HAL_PCD_EP_Open(hpcd, MIDI_EP_OUT, USBMIDI_TRANSFER_SIZE, EP_TYPE_BULK);
+  HAL_PCD_EP_Open(hpcd, MIDI_EP_IN, USBMIDI_TRANSFER_SIZE, EP_TYPE_BULK);
+  midi_out_arm(hpcd);
+}
+
+static void midi_close(PCD_HandleTypeDef *hpcd) {
+  HAL_PCD_EP_Close(hpcd, MIDI_EP_OUT);
+  HAL_PCD_EP_Close(hpcd, MIDI_EP_IN);
+  midi_out_waiting = 0;
+  // Whatever was being sent is gone
+  usbmidi_tx_done(&usb_midi);
+}
+
+/** Sends the transfer filled since the last one went, if that has,
+ * and takes more from the host once there is room. Runs in PendSV
+ * after routing and when the last transfer has gone.
+ */
+void usbdev_midi_service(void) {
+  PCD_HandleTypeDef *hpcd = &hpcd_USB_OTG_FS;
+  const uint8_t *data;
+  size_t len;
+
+  // The PCD driver is not reentrant, and (re)configuration happens
+  // in its interrupt
+  HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+  len = usbmidi_tx_take(&usb_midi, &data);
+  if (configuration == 0) {
+    // Nobody to send it to
+    usbmidi_tx_done(&usb_midi);
+  } else {
+    if (len > 0) {
+      HAL_PCD_EP_Transmit(hpcd, MIDI_EP_IN, (uint8_t *)data, len);
+    }
+    if (midi_out_waiting) {
+      midi_out_arm(hpcd);
+    }
+  }
+  HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+}
+
+// Serial port endpoints /////////////////////////////////////////////////////
+
+/** Takes the next transfer from the host if the console input has
+ * room for it.
+ */
+static void cdc_out_arm(PCD_HandleTypeDef *hpcd) {
+  if (cdc_in_rb != NULL &&
+      RING_BUFFER_MASK(cdc_in_rb) - ring_buffer_num_items(cdc_in_rb) >= CDC_PACKET_SIZE) {
+    cdc_out_waiting = 0;
+    HAL_PCD_EP_Receive(hpcd, CDC_EP_OUT, cdc_rx_buff, sizeof(cdc_rx_buff));
+  } else {
+    cdc_out_waiting = 1;
+  }
+}
+
+/** Tops up the transfer being filled from the console output and, if
+ * nothing is being sent, sends it and starts filling the other. A
+ * transfer ending on a whole packet is followed by an empty one once
+ * there is nothing more, so the host sees where the output stops.
+ */
+static void cdc_tx_pump(PCD_HandleTypeDef *hpcd) {
+  uint8_t b = cdc_tx_fill;
+  uint16_t len = cdc_tx_len[b];
+
+  len += ring_buffer_dequeue_arr(cdc_out_rb, (char *)cdc_tx_buff[b] + len, CDC_TX_SIZE - len);
+  cdc_tx_len[b] = len;
+  if (cdc_tx_busy || (len == 0 && !cdc_tx_zlp)) {
+    return;
+  }
+
+  cdc_tx_zlp = len > 0 && len % CDC_PACKET_SIZE == 0;
+  cdc_tx_busy = 1;
+  cdc_tx_fill = b ^ 1;
+  usb_cdc_stats.tx_bytes += len;
+  usb_cdc_stats.tx_transfers++;
+  HAL_PCD_EP_Transmit(hpcd, CDC_EP_IN, cdc_tx_buff[b], len);
+  // So the next is ready the moment this one has gone
+  cdc_tx_len[b ^ 1] = ring_buffer_dequeue_arr(cdc_out_rb, (char *)cdc_tx_buff[b ^ 1], CDC_TX_SIZE);
+}
+
+static void cdc_open(PCD_HandleTypeDef *hpcd) {
+  HAL_PCD_EP_Open(hpcd, CDC_EP_NOTIFY, CDC_NOTIFY_SIZE, EP_TYPE_INTR);
+  HAL_PCD_EP_Open(hpcd, CDC_EP_OUT, CDC_PACKET_SIZE, EP_TYPE_BULK);
+  HAL_PCD_EP_Open(hpcd, CDC_EP_IN, CDC_PACKET_SIZE, EP_TYPE_BULK);
+  cdc_out_arm(hpcd);
+}
+
+static void cdc_close(PCD_HandleTypeDef *hpcd) {
+  HAL_PCD_EP_Close(hpcd, CDC_EP_NOTIFY);
+  HAL_PCD_EP_Close(hpcd, CDC_EP_OUT);
+  HAL_PCD_EP_Close(hpcd, CDC_EP_IN);
+  cdc_out_waiting = 0;
+  // Output not yet sent is lost; what is still queued goes to the UART
+  cdc_dtr = 0;
+  cdc_tx_busy = 0;
+  cdc_tx_zlp = 0;
+  cdc_tx_len[0] = 0;
+  cdc_tx_len[1] = 0;
+}
+
+/** Has the serial port send the console output while a terminal has it
+ * open, and put what it receives into the console input, posting
+ * rx_event. The USART3 interrupt may also be putting received bytes
+ * into in_rb: it has the same priority as ours, so neither interrupts
+ * the other.
+ */
+void usbdev_cdc_attach(ring_buffer_t *in_rb, ring_buffer_t *out_rb, uint32_t rx_event) {
+  HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+  cdc_in_rb = in_rb;
+  cdc_out_rb = out_rb;
+  cdc_rx_event = rx_event;
+  HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+}
+
+/** Whether the serial port, rather than the UART, is to send the
+ * console output: a terminal has it open (DTR).
+ */
+int usbdev_cdc_open(void) {
+  return cdc_dtr && cdc_out_rb != NULL;
+}
+
+/** Takes more input from the host once there is room and, if send,
+ * starts sending console output if the serial port is idle. Call from
+ * the main loop; send only once the UART has stopped sending the
+ * console output, as this takes it from the ring buffer too.
+ */
+void usbdev_cdc_service(int send) {
+  PCD_HandleTypeDef *hpcd = &hpcd_USB_OTG_FS;
+
+  if (!(send && usbdev_cdc_open()) && !cdc_out_waiting) {
+    // Nothing to do, as every main loop pass while unplugged
+    return;
+  }
+  // Keep usbdev_midi_service() from turning our interrupt back on
+  // while we have it off
+  deferred_mask();
+  HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+  if (configuration != 0) {
+    if (send && usbdev_cdc_open()) {
+      cdc_tx_pump(hpcd);
+    }
+    if (cdc_out_waiting) {
+      cdc_out_arm(hpcd);
+    }
+  }
+  HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+  deferred_unmask();
+}
+
+/** Handles a CDC request to the communication interface; returns 0 to
+ * stall it.
+ */
+static int cdc_request(PCD_HandleTypeDef *hpcd, const usb_setup *req) {
+  if ((req->type & REQ_RECIPIENT_MASK) != REQ_RECIPIENT_IFACE || req->index != CDC_COMM_IFACE) {
+    return 0;
+  }
+
+  switch (req->request) {
+  case CDC_SET_LINE_CODING:
+    if (req->length != CDC_LINE_CODING_SIZE) {
+      return 0;
+    }
+    // Finished in HAL_PCD_DataOutStageCallback()
+    ep0_receive(hpcd, req->length);
+    return 1;
+
+  case CDC_GET_LINE_CODING:
+    ep0_send(hpcd, cdc_line_coding, sizeof(cdc_line_coding), req->length);
+    return 1;
+
+  case CDC_SET_CONTROL_LINE_STATE:
+    cdc_dtr = (req->value & CDC_DTR) != 0;
+    if (!cdc_dtr) {
+      // Not for whoever opens it next
+      cdc_tx_len[cdc_tx_fill] = 0;
+    }
+    ep0_status(hpcd);
+    return 1;
+  }
+  return 0;
+}
+
+// Standard requests /////////////////////////////////////////////////////////
+
+static void set_configuration(PCD_HandleTypeDef *hpcd, uint8_t value) {
+  if (configuration != 0) {
+    midi_close(hpcd);
+    cdc_close(hpcd);
+  }
+  configuration = value;
+  halted = 0;
+  if (configuration != 0) {
+    midi_open(hpcd);
+    cdc_open(hpcd);
+  }
+}
+
+static uint16_t halt_bit(uint8_t ep_addr) {
+  return 1 << ((ep_addr & 0x0F) + (ep_addr & 0x80 ? 8 : 0));
+}
+
+static int get_descriptor(PCD_HandleTypeDef *hpcd, const usb_setup *req) {
+  uint8_t index = req->value & 0xFF;
+  size_t n;
+
+  switch (req->value >> 8) {
+  case DESC_DEVICE:
+    ep0_send(hpcd, device_descriptor, sizeof(device_descriptor), req->length);
+    return 1;
+  case DESC_CONFIGURATION:
+    ep0_send(hpcd, config_descriptor, sizeof(config_descriptor), req->length);
+    return 1;
+  case DESC_STRING:
+    if (index >= NUM_STRINGS) {
+      return 0;
+    }
+    if (index == 0) {
+      n = 1;
+      ep0_buff[2] = 0x09; // English (United States)
+      ep0_buff[3] = 0x04;
+    } else {
+      // In UTF-16LE, as much as fits in one packet
+      n = strlen(strings[index]);
+      if (n > (EP0_SIZE - 2) / 2) {
+        n = (EP0_SIZE - 2) / 2;
+      }
+      for (size_t i = 0; i < n; i++) {
+        ep0_buff[2 + 2 * i] = strings[index][i];
+        ep0_buff[3 + 2 * i] = 0;
+      }
+    }
+    ep0_buff[0] = 2 + 2 * n;
+    ep0_buff[1] = DESC_STRING;
+    ep0_send(hpcd, ep0_buff, ep0_buff[0], req->length);
+    return 1;
+  }
+  // Including the device qualifier: we are full speed only
+  return 0;
+}
+
+/** Handles a standard request; returns 0 to stall it. */
+static int standard_request(PCD_HandleTypeDef *hpcd, const usb_setup *req) {
+  uint8_t recipient = req->type & REQ_RECIPIENT_MASK;
+  uint8_t ep_addr = req->index & 0x8F;
+
+  switch (req->request) {
+  case REQ_GET_STATUS:
+    ep0_buff[0] = 0;
+    ep0_buff[1] = 0;
+    if (recipient == REQ_RECIPIENT_DEVICE) {
+      ep0_buff[0] = 0x01; // Self powered
+    } else if (recipient == REQ_RECIPIENT_EP) {
+      ep0_buff[0] = (halted & halt_bit(ep_addr)) ? 0x01 : 0;
+    }
+    ep0_send(hpcd, ep0_buff, 2, req->length);
+    return 1;
+
+  case REQ_CLEAR_FEATURE:
+  case REQ_SET_FEATURE:
+    if (recipient == REQ_RECIPIENT_EP && req->value == FEATURE_ENDPOINT_HALT &&
+        (ep_addr & 0x0F) != 0) {
+      if (req->request == REQ_SET_FEATURE) {
+        HAL_PCD_EP_SetStall(hpcd, ep_addr);
+        halted |= halt_bit(ep_addr);
+      } else {
+        // Also resets the data toggle
+        HAL_PCD_EP_ClrStall(hpcd, ep_addr);
+        halted &= ~halt_bit(ep_addr);
+      }
+    }
+    // Remote wakeup & test modes: nothing to do
+    ep0_status(hpcd);
+    return 1;
+
+  case REQ_SET_ADDRESS:
+    // The OTG core is given it before the status stage, unlike most
+    HAL_PCD_SetAddress(hpcd, req->value & 0x7F);
+    ep0_status(hpcd);
+    return 1;
+
+  case REQ_GET_DESCRIPTOR:
+    return get_descriptor(hpcd, req);
+
+  case REQ_GET_CONFIGURATION:
+    ep0_buff[0] = configuration;
+    ep0_send(hpcd, ep0_buff, 1, req->length);
+    return 1;
+
+  case REQ_SET_CONFIGURATION:
+    if (req->value > 1) {
+      return 0;
+    }
+    set_configuration(hpcd, req->value);
+    ep0_status(hpcd);
+    return 1;
+
+  case REQ_GET_INTERFACE:
+    if (configuration == 0 || req->index >= NUM_INTERFACES) {
+      return 0;
+    }
+    ep0_buff[0] = 0;
+    ep0_send(hpcd, ep0_buff, 1, req->length);
+    return 1;
+
+  case REQ_SET_INTERFACE:
+    if (configuration == 0 || req->index >= NUM_INTERFACES || req->value != 0) {
+      return 0;
+    }
+    ep0_status(hpcd);
+    return 1;
+  }
+  return 0;
+}
+
+// PCD callbacks (OTG_FS interrupt) //////////////////////////////////////////
+
+void HAL_PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd) {
+  const uint8_t *s = (const uint8_t *)hpcd->Setup;
+  usb_setup req = {
+      .type = s[0],
+      .request = s[1],
+      .value = s[2] | (s[3] << 8),
+      .index = s[4] | (s[5] << 8),
+      .length = s[6] | (s[7] << 8),
+  };
+
+  // The MIDI class has no requests of its own
+  switch (req.type & REQ_TYPE_MASK) {
+  case REQ_TYPE_STANDARD:
+    if (standard_request(hpcd, &req)) {
+      return;
+    }
+    break;
+  case REQ_TYPE_CLASS:
+    if (configuration != 0 && cdc_request(hpcd, &req)) {
+      return;
+    }
+    break;
+  }
+  ep0_stall(hpcd);
+}
+
+void HAL_PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum) {
+  if (epnum == 0) {
+    ep0_data_in(hpcd);
+  } else if (epnum == (MIDI_EP_IN & 0x0F)) {
+    usbmidi_tx_done(&usb_midi);
+    // Send what was routed meanwhile
+    deferred_post(DEFER_MIDI_TX);
+  } else if (epnum == (CDC_EP_IN & 0x0F)) {
+    cdc_tx_busy = 0;
+    if (usbdev_cdc_open()) {
+      // The other transfer was filled meanwhile
+      cdc_tx_pump(hpcd);
+    }
+  }
+}
+
+void HAL_PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum) {
+  uint32_t n;
+
+  if (epnum == 0) {
+    if (ep0 == EP0_DATA_OUT) {
+      // SET_LINE_CODING's, the only control write with data
+      memcpy(cdc_line_coding, ep0_buff, sizeof(cdc_line_coding));
+      ep0_status(hpcd);
+    } else {
+      // Status stage of a control read
+      ep0 = EP0_IDLE;
+    }
+  } else if (epnum == (MIDI_EP_OUT & 0x0F)) {
+    usbmidi_rx_put(&usb_midi, midi_rx_buff, HAL_PCD_EP_GetRxCount(hpcd, MIDI_EP_OUT),
+                   timestamp_now());
+    deferred_post(DEFER_MIDI_RX);
+    midi_out_arm(hpcd);
+  } else if (epnum == (CDC_EP_OUT & 0x0F)) {
+    n = HAL_PCD_EP_GetRxCount(hpcd, CDC_EP_OUT);
+    ring_buffer_queue_arr(cdc_in_rb, (const char *)cdc_rx_buff, n);
+    usb_cdc_stats.rx_bytes += n;
+    event_post(cdc_rx_event);
+    cdc_out_arm(hpcd);
+  }
+}
+
+void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd) {
+  set_configuration(hpcd, 0);
+  ep0 = EP0_IDLE;
+  HAL_PCD_EP_Open(hpcd, 0x00, EP0_SIZE, EP_TYPE_CTRL);
+  HAL_PCD_EP_Open(hpcd, 0x80, EP0_SIZE, EP_TYPE_CTRL);
+}
+
+void HAL_PCD_DisconnectCallback(PCD_HandleTypeDef *hpcd) {
+  set_configuration(hpcd, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/** Sets up the FIFOs & interrupt and connects to the host. Call after
+ * MX_USB_OTG_FS_PCD_Init().
+ */
+void usbdev_init(void) {
+  PCD_HandleTypeDef *hpcd = &hpcd_USB_OTG_FS;
+
+  usbmidi_init(&usb_midi, MIDI_SOURCE_USB);
+
+  // In words, of the 1.25 kB the OTG_FS has (RM0410 section 42): all
+  // OUT endpoints share the receive FIFO, each IN endpoint has its own.
+  // The serial port's holds a whole transfer, so the core can send
+  // its packets back to back.
+  HAL_PCDEx_SetRxFiFo(hpcd, 0x80);
+  HAL_PCDEx_SetTxFiFo(hpcd, 0, 0x20);
+  HAL_PCDEx_SetTxFiFo(hpcd, 1, 0x40);
+  HAL_PCDEx_SetTxFiFo(hpcd, 2, CDC_TX_SIZE / 4);
+  HAL_PCDEx_SetTxFiFo(hpcd, 3, 0x10);
+
+  HAL_NVIC_SetPriority(OTG_FS_IRQn, PRIO_ISR_USB, 0);
+  HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+  HAL_PCD_Start(hpcd);
+}
+
+int usbdev_configured(void) {
+  return configuration != 0;
+}
@@ -0,0 +1,312 @@
+/*
+ * usbmidi.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * USB MIDI 1.0 event packets. See usbmidi.h.
+ */
+
+#include <string.h>
+#include "usbmidi.h"
+
+void usbmidi_init(usbmidi *u, uint8_t port) {
+  memset(u, 0, sizeof(*u));
+  midi_stream_init(&u->rx_sysex);
+  u->port = port;
+}
+
+/** Encodes anything but a SysEx as one packet; returns 0 if it cannot be. */
+int usbmidi_encode(const midi_message *mm, uint8_t cable, uint8_t *packet) {
+  midi_encoder me;
+  uint8_t bytes[MIDI_MAX_ENCODED] = { 0 };
+  uint8_t cin;
+  int n;
+
+  // Every packet carries its own status byte
+  midi_encoder_init(&me);
+  n = midi_encode(&me, mm, bytes);
+  if (n == 0) {
+    return 0;
+  }
+  if (bytes[0] < 0xF0) {
+    cin = bytes[0] >> 4;
+  } else if (bytes[0] >= 0xF8) {
+    cin = USBMIDI_CIN_SINGLE_BYTE;
+  } else if (n == 1) {
+    cin = USBMIDI_CIN_SYSEX_END_1; // Tune request
+  } else if (n == 2) {
+    cin = USBMIDI_CIN_SYSCOMMON_2;
+  } else {
+    cin = USBMIDI_CIN_SYSCOMMON_3;
+  }
+
+  packet[0] = (cable << 4) | cin;
+  packet[1] = bytes[0];
+  packet[2] = n > 1 ? bytes[1] : 0;
+  packet[3] = n > 2 ? bytes[2] : 0;
+  return 1;
+}
+
+/** Encodes a SysEx of len data bytes (without F0 & F7) into
+ * USBMIDI_SYSEX_PACKETS(len) packets; returns how many.
+ */
+size_t usbmidi_encode_sysex(const uint8_t *data, size_t len, uint8_t cable, uint8_t *packets) {
+  size_t total = len + 2;
+  size_t count = 0;
+
+  for (size_t i = 0; i < total; i += 3, count++) {
+    uint8_t *p = packets + count * USBMIDI_PACKET_SIZE;
+    size_t left = total - i;
+
+    if (left > 3) {
+      p[0] = (cable << 4) | USBMIDI_CIN_SYSEX;
+    } else {
+      p[0] = (cable << 4) | (USBMIDI_CIN_SYSEX_END_1 + left - 1);
+    }
+    for (size_t j = 0; j < 3; j++) {
+      size_t k = i + j;
+      if (k == 0) {
+        p[1 + j] = MIDI_SYSEX;
+      } else if (k == total - 1) {
+        p[1 + j] = MIDI_EOX;
+      } else if (k < total) {
+        p[1 + j] = data[k - 1] & 0x7F;
+      } else {
+        p[1 + j] = 0;
+      }
+    }
+  }
+  return count;
+}
+
+/** Feeds bytes of a packet through the SysEx parser; returns 1 if they
+ * ended a message.
+ */
+static int decode_bytes(usbmidi *u, const uint8_t *bytes, int n, midi_message *mm) {
+  int got = 0;
+
+  for (int i = 0; i < n; i++) {
+    if (midi_stream_receive(&u->rx_sysex, bytes[i], mm)) {
+      got = 1;
+    }
+  }
+  return got;
+}
+
+/** Decodes one packet. Returns 1 if it completed a message, which is
+ * then in mm (a SysEx's data is in u->rx_sysex.sysex), or 0. Channel
+ * messages are given as midi_stream_receive() would: a note on of
+ * velocity 0 is a note off, and controllers 120-127 are channel mode
+ * messages.
+ */
+int usbmidi_decode(usbmidi *u, const uint8_t *packet, midi_message *mm) {
+  uint8_t cin = packet[0] & 0x0F;
+  uint8_t status = packet[1];
+
+  if (packet[0] == 0) {
+    // Padding
+    return 0;
+  }
+  if ((packet[0] >> 4) != USBMIDI_CABLE) {
+    u->rx_ignored++;
+    return 0;
+  }
+
+  switch (cin) {
+  case 0x8:
+  case 0x9:
+  case 0xA:
+  case 0xB:
+  case 0xC:
+  case 0xD:
+  case 0xE:
+    if ((status >> 4) != cin) {
+      break;
+    }
+    // As on a DIN input, a channel message ends any SysEx
+    u->rx_sysex.last_status = MIDI_NONE;
+    mm->type = status;
+    mm->channel = status & 0x0F;
+    mm->data1 = packet[2] & 0x7F;
+    mm->data2 = cin == 0xC || cin == 0xD ? 0 : packet[3] & 0x7F;
+    if (cin == 0x9 && mm->velocity == 0) {
+      mm->type = MIDI_NOTE_OFF | mm->channel;
+    } else if (cin == 0xB && mm->control >= MIDI_MODE_ALL_SOUND_OFF) {
+      mm->type = mm->control;
+      mm->data1 = mm->data2;
+    }
+    return 1;
+
+  case USBMIDI_CIN_SYSCOMMON_2:
+    if (status != MIDI_TIME_CODE_QF && status != MIDI_SONG_SELECT) {
+      break;
+    }
+    u->rx_sysex.last_status = MIDI_NONE;
+    mm->type = status;
+    if (status == MIDI_TIME_CODE_QF) {
+      mm->tcqf_message_type = (packet[2] & 0x70) >> 4;
+      mm->tcqf_value = packet[2] & 0x0F;
+    } else {
+      mm->data1 = packet[2] & 0x7F;
+    }
+    return 1;
+
+  case USBMIDI_CIN_SYSCOMMON_3:
+    if (status != MIDI_SONG_POSITION) {
+      break;
+    }
+    u->rx_sysex.last_status = MIDI_NONE;
+    mm->type = status;
+    mm->lsb = packet[2] & 0x7F;
+    mm->msb = packet[3] & 0x7F;
+    return 1;
+
+  case USBMIDI_CIN_SYSEX:
+    return decode_bytes(u, packet + 1, 3, mm);
+
+  case USBMIDI_CIN_SYSEX_END_1:
+    if (status == MIDI_TUNE_REQUEST) {
+      u->rx_sysex.last_status = MIDI_NONE;
+      mm->type = status;
+      return 1;
+    }
+    if (status != MIDI_EOX) {
+      break;
+    }
+    return decode_bytes(u, packet + 1, 1, mm);
+
+  case USBMIDI_CIN_SYSEX_END_2:
+  case USBMIDI_CIN_SYSEX_END_3:
+    return decode_bytes(u, packet + 1, cin - USBMIDI_CIN_SYSEX_END_1 + 1, mm);
+
+  case USBMIDI_CIN_SINGLE_BYTE:
+    if (status >= 0xF8) {
+      // Real-time does not disturb a SysEx
+      mm->type = status;
+      return 1;
+    }
+    // Otherwise it is a byte of a stream, e.g., within a SysEx
+    return decode_bytes(u, packet + 1, 1, mm);
+  }
+
+  u->rx_ignored++;
+  return 0;
+}
+
+/** Packets that can be queued now. */
+uint32_t usbmidi_rx_room(const usbmidi *u) {
+  return USBMIDI_RX_PACKETS - (u->rx_head - u->rx_tail);
+}
+
+/** Queues the packets of a received transfer of len bytes, which
+ * arrived at now. Packets that do not fit are lost.
+ */
+void usbmidi_rx_put(usbmidi *u, const uint8_t *data, size_t len, uint32_t now) {
+  uint32_t head = u->rx_head;
+
+  for (size_t n = 0; n + USBMIDI_PACKET_SIZE <= len; n += USBMIDI_PACKET_SIZE) {
+    if (head - u->rx_tail == USBMIDI_RX_PACKETS) {
+      u->rx_overruns += (len - n) / USBMIDI_PACKET_SIZE;
+      break;
+    }
+    memcpy(u->rx_packets[head & (USBMIDI_RX_PACKETS - 1)], data + n, USBMIDI_PACKET_SIZE);
+    u->rx_times[head & (USBMIDI_RX_PACKETS - 1)] = now;
+    head++;
+  }
+  // Publish the packets only once they are all written
+  __sync_synchronize();
+  u->rx_head = head;
+}
+
+/** Decodes queued packets until one completes a message; returns 1
+ * with it in mm, or 0 when they are all decoded.
+ */
+int usbmidi_receive(usbmidi *u, midi_message *mm) {
+  uint32_t tail = u->rx_tail;
+  int got = 0;
+
+  __sync_synchronize();
+  while (!got && tail != u->rx_head) {
+    uint32_t i = tail & (USBMIDI_RX_PACKETS - 1);
+    got = usbmidi_decode(u, u->rx_packets[i], mm);
+    mm->timestamp = u->rx_times[i];
+    tail++;
+  }
+  // Done with the packets before the producer may reuse them
+  __sync_synchronize();
+  u->rx_tail = tail;
+
+  if (got) {
+    mm->port = u->port;
+    u->rx_messages++;
+  }
+  return got;
+}
+
+/** Adds a message to the transfer being filled; for a SysEx, sysex is
+ * its data. Returns 0 if it did not fit, or cannot be sent.
+ */
+int usbmidi_send(usbmidi *u, const midi_message *mm, const uint8_t *sysex) {
+  uint8_t *buff = u->tx_buff[u->tx_fill];
+  size_t len = u->tx_len[u->tx_fill];
+  size_t n;
+
+  if (mm->type == MIDI_SYSEX) {
+    // One cut short (data2) is not worth sending
+    if (sysex == NULL || mm->data2 ||
+        len + USBMIDI_SYSEX_PACKETS(mm->data1) * USBMIDI_PACKET_SIZE > USBMIDI_TRANSFER_SIZE) {
+      u->tx_drops++;
+      return 0;
+    }
+    n = usbmidi_encode_sysex(sysex, mm->data1, USBMIDI_CABLE, buff + len) * USBMIDI_PACKET_SIZE;
+  } else {
+    if (len + USBMIDI_PACKET_SIZE > USBMIDI_TRANSFER_SIZE) {
+      u->tx_drops++;
+      return 0;
+    }
+    if (!usbmidi_encode(mm, USBMIDI_CABLE, buff + len)) {
+      return 0;
+    }
+    n = USBMIDI_PACKET_SIZE;
+  }
+
+  u->tx_len[u->tx_fill] = len + n;
+  u->tx_messages++;
+  return 1;
+}
+
+/** If nothing is being sent and there are packets waiting, hands them
+ * over as the next transfer: returns its length, with *data pointing
+ * at it until usbmidi_tx_done(). Otherwise returns 0.
+ */
+size_t usbmidi_tx_take(usbmidi *u, const uint8_t **data) {
+  uint8_t sent = u->tx_fill;
+  size_t len = u->tx_len[sent];
+
+  if (u->tx_busy || len == 0) {
+    return 0;
+  }
+  u->tx_fill = sent ^ 1;
+  u->tx_len[u->tx_fill] = 0;
+  u->tx_busy = 1;
+  u->tx_transfers++;
+  *data = u->tx_buff[sent];
+  return len;
+}
+
+/** The transfer from usbmidi_tx_take() has gone (or was abandoned). */
+void usbmidi_tx_done(usbmidi *u) {
+  u->tx_busy = 0;
+}
+
+void usbmidi_reset_stats(usbmidi *u) {
+  u->rx_messages = 0;
+  u->rx_ignored = 0;
+  u->rx_overruns = 0;
+  u->tx_messages = 0;
+  u->tx_transfers = 0;
+  u->tx_drops = 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * bench.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Host benchmark of the hot paths in Core/: MIDI parsing, encoding &
+ * formatting, tone generation, the ring buffer and the synth's block
+ * queue. Each reports a rate; see the Makefile.
+ *
+ * Usage: bench [thresholds file]
+ *
+ * With a thresholds file (lines of "name minimum-rate"; # comments),
+ * exits 1 if any rate is below its minimum.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "midi.h"
+#include "ringbuffer.h"
+#include "tonegen.h"
+#include "blockq.h"
+
+#define BENCH_SECONDS 0.25 // Minimum time to run each
+
+// Results go here so that nothing is optimized away
+static volatile uint32_t sink;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Repeatable pseudo-random numbers. */
+static uint32_t lcg_state = 12345;
+static uint32_t lcg(void) {
+  lcg_state = lcg_state * 1664525 + 1013904223;
+  return lcg_state >> 8;
+}
+
+// MIDI //////////////////////////////////////////////////////////////////////
+
+#define STREAM_SIZE 65536
+static uint8_t midi_stream_bytes[STREAM_SIZE];
+static size_t midi_stream_len;
+
+#define NUM_MESSAGES 4096
+static midi_message messages[NUM_MESSAGES];
+static size_t num_messages;
+
+/** A stream like busy live playing: mostly notes under running status,
+ * some controllers & pitch bend, clock, and the odd SysEx.
+ */
+static void make_midi_stream(void) {
+  size_t n = 0;
+  uint8_t status = 0;
+
+  while (n < STREAM_SIZE - 40) {
+    uint32_t r = lcg() % 100;
+    if (r < 5) {
+      midi_stream_bytes[n++] = MIDI_RT_TIMING_CLOCK;
+    } else if (r < 6) {
+      midi_stream_bytes[n++] = MIDI_SYSEX;
+      for (int i = lcg() % 30; i > 0; i--) {
+        midi_stream_bytes[n++] = lcg() & 0x7F;
+      }
+      midi_stream_bytes[n++] = MIDI_EOX;
+      status = 0;
+    } else {
+      static const uint8_t kinds[] = { 0x90, 0x90, 0x90, 0x80, 0xB0, 0xE0, 0xC0, 0xD0 };
+      uint8_t s = kinds[lcg() % sizeof(kinds)] | (lcg() % 2);
+      if (s != status || lcg() % 4 == 0) {
+        midi_stream_bytes[n++] = s;
+        status = s;
+      }
+      midi_stream_bytes[n++] = lcg() & 0x7F;
+      if ((s & 0xF0) != 0xC0 && (s & 0xF0) != 0xD0) {
+        midi_stream_bytes[n++] = lcg() & 0x7F;
+      }
+    }
+  }
+  midi_stream_len = n;
+
+  // And the messages it holds
+  midi_stream ms;
+  midi_stream_init(&ms);
+  for (size_t i = 0; i < midi_stream_len && num_messages < NUM_MESSAGES; i++) {
+    if (midi_stream_receive(&ms, midi_stream_bytes[i], &messages[num_messages])) {
+      num_messages++;
+    }
+  }
+}
+
+static void bench_midi_parse(uint64_t *units) {
+  midi_stream ms;
+  midi_message mm;
+  uint32_t count = 0;
+
+  midi_stream_init(&ms);
+  for (size_t i = 0; i < midi_stream_len; i++) {
+    count += midi_stream_receive(&ms, midi_stream_bytes[i], &mm);
+  }
+  sink += count;
+  *units = midi_stream_len;
+}
+
+static void bench_midi_encode(uint64_t *units) {
+  midi_encoder me;
+  uint8_t out[MIDI_MAX_ENCODED];
+  uint32_t bytes = 0;
+
+  midi_encoder_init(&me);
+  for (size_t i = 0; i < num_messages; i++) {
+    bytes += midi_encode(&me, &messages[i], out);
+  }
+  sink += bytes;
+  *units = num_messages;
+}
+
+static void bench_midi_format(uint64_t *units) {
+  char text[64];
+  uint32_t len = 0;
+
+  for (size_t i = 0; i < num_messages; i++) {
+    len += midi_snprintf(text, sizeof(text), &messages[i]);
+  }
+  sink += len;
+  *units = num_messages;
+}
+
+// Audio /////////////////////////////////////////////////////////////////////
+
+#define SAMPLE_RATE 32000
+
+static void bench_tonegen(uint64_t *units) {
+  static tonegen_state tg;
+  static int initialized = 0;
+  int32_t sum = 0;
+
+  if (!initialized) {
+    tonegen_init(&tg, SAMPLE_RATE);
+    initialized = 1;
+  }
+  // A new note every so often, as the synth does
+  tonegen_set(&tg, midi_note_freqX100[lcg() % 128] / 100, 16000);
+  for (int i = 0; i < 16384; i++) {
+    sum += tonegen_next_sample(&tg);
+  }
+  sink += sum;
+  *units = 16384;
+}
+
+// The synth's block queue: a few events rendered into each 32 frame block
+static void render_nothing(void *ctx, uint32_t first, uint32_t frames) {
+  *(uint32_t *)ctx += frames;
+}
+
+static void apply_nothing(void *ctx, const blockq_event *e, uint32_t frame) {
+  *(uint32_t *)ctx += frame;
+}
+
+static void bench_blockq(uint64_t *units) {
+  static blockq q;
+  uint32_t frames = 0;
+  uint32_t t = 0;
+
+  blockq_init(&q);
+  for (int block = 0; block < 1024; block++, t += 1000) {
+    for (int e = 0; e < 4; e++) {
+      blockq_push(&q, t + lcg() % 1000, &messages[(block * 4 + e) % num_messages]);
+    }
+    blockq_render(&q, t, 32, SAMPLE_RATE, render_nothing, apply_nothing, &frames);
+  }
+  sink += frames;
+  *units = 1024 * 4;
+}
+
+// Ring buffer ///////////////////////////////////////////////////////////////
+
+static void bench_ring_byte(uint64_t *units) {
+  static char buff[256];
+  ring_buffer_t rb;
+  char c;
+  uint32_t sum = 0;
+
+  ring_buffer_init(&rb, buff, sizeof(buff));
+  for (int i = 0; i < 65536; i++) {
+    ring_buffer_queue(&rb, (char)i);
+    if (i & 1) {
+      ring_buffer_dequeue(&rb, &c);
+      sum += c;
+      ring_buffer_dequeue(&rb, &c);
+      sum += c;
+    }
+  }
+  sink += sum;
+  *units = 65536 * 2; // Each queued & dequeued
+}
+
+static void bench_ring_array(uint64_t *units) {
+  static char buff[256];
+  static char block[64];
+  ring_buffer_t rb;
+  uint32_t n = 0;
+
+  ring_buffer_init(&rb, buff, sizeof(buff));
+  for (int i = 0; i < 4096; i++) {
+    ring_buffer_queue_arr(&rb, block, sizeof(block));
+    n += ring_buffer_dequeue_arr(&rb, block, sizeof(block));
+  }
+  sink += n;
+  *units = 4096 * sizeof(block) * 2;
+}
+
+// Driver ////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  const char *name;
+  const char *unit;
+  void (*run)(uint64_t *units); // Does one round of work
+} bench;
+
+static const bench benches[] = {
+    { "midi_parse",  "bytes/s",    bench_midi_parse },
+    { "midi_encode", "messages/s", bench_midi_encode },
+    { "midi_format", "messages/s", bench_midi_format },
+    { "tonegen",     "samples/s",  bench_tonegen },
+    { "blockq",      "events/s",   bench_blockq },
+    { "ring_byte",   "ops/s",      bench_ring_byte },
+    { "ring_array",  "bytes/s",    bench_ring_array },
+};
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+/** Looks up name's minimum rate in the thresholds file; 0 if none. */
+static double threshold(FILE *f, const char *name) {
+  char line[128];
+  char key[64];
+  double value;
+
+  rewind(f);
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (line[0] == '#') {
+      continue;
+    }
+    if (sscanf(line, "%63s %lf", key, &value) == 2 && strcmp(key, name) == 0) {
+      return value;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  FILE *thresholds = NULL;
+  int failed = 0;
+
+  if (argc > 1) {
+    thresholds = fopen(argv[1], "r");
+    if (thresholds == NULL) {
+      perror(argv[1]);
+      return 2;
+    }
+  }
+
+  make_midi_stream();
+
+  for (size_t b = 0; b < NUM_BENCHES; b++) {
+    uint64_t total = 0;
+    uint64_t units;
+    double start = now();
+    double elapsed;
+
+    do {
+      benches[b].run(&units);
+      total += units;
+      elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+
+    double rate = total / elapsed;
+    printf("%-12s %14.0f %s", benches[b].name, rate, benches[b].unit);
+    if (thresholds != NULL) {
+      double min = threshold(thresholds, benches[b].name);
+      if (rate < min) {
+        printf("  SLOWER than %.0f", min);
+        failed = 1;
+      }
+    }
+    printf("\n");
+  }
+
+  if (thresholds != NULL) {
+    fclose(thresholds);
+    printf(failed ? "FAILED\n" : "OK\n");
+  }
+  return failed;
+}
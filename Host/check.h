@@ -0,0 +1,85 @@
+/*
+ * check.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * What every check_*.c program shares: CHECK() and its failure count,
+ * a seeded xorshift32 rnd(), the -n & -s arguments and the ending.
+ * Each program is one .c file, so this is all static.
+ */
+
+#ifndef HOST_CHECK_H_
+#define HOST_CHECK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+      fprintf(stderr, "FAILED: " __VA_ARGS__); \
+      fprintf(stderr, "\n"); \
+      failures++; \
+    } \
+  } while (0)
+
+static uint32_t seed = 1;
+
+static inline uint32_t rnd(void) {
+  // xorshift32
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+/** Takes argv[*i] if it is -n (into *n) or -s (the seed for rnd()),
+ * with its value, leaving *i at the last one used.
+ * Returns 1 if it did, for programs with their own arguments too.
+ */
+static inline int check_arg(int argc, char **argv, int *i, long *n) {
+  if (strcmp(argv[*i], "-n") == 0 && *i + 1 < argc) {
+    *n = atol(argv[++*i]);
+    return 1;
+  }
+  if (strcmp(argv[*i], "-s") == 0 && *i + 1 < argc) {
+    seed = strtoul(argv[++*i], NULL, 0);
+    if (seed == 0) {
+      seed = 1;
+    }
+    return 1;
+  }
+  return 0;
+}
+
+/** Reads -n & -s, leaving *n alone if there is none.
+ * Returns 0, or prints usage and returns 2, the exit code, on any
+ * other argument.
+ */
+static inline int check_args(int argc, char **argv, long *n, const char *usage) {
+  for (int i = 1; i < argc; i++) {
+    if (!check_arg(argc, argv, &i, n)) {
+      fprintf(stderr, "usage: %s\n", usage);
+      return 2;
+    }
+  }
+  return 0;
+}
+
+/** Reports the failures, if any. Returns the exit code. */
+static inline int check_result(void) {
+  if (failures > 0) {
+    fprintf(stderr, "%d failures\n", failures);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
+
+#endif /* HOST_CHECK_H_ */
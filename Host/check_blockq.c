@@ -0,0 +1,262 @@
+/*
+ * check_blockq.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Checks the audio block event queue (blockq.h) applies every event at
+ * the frame its time falls on: worked examples across block boundaries
+ * and timestamp wrap, late events, a full queue, then many random event
+ * lists rendered in blocks of random sizes. Rendering must cover every
+ * frame of every block once, in order, with each event applied between
+ * the frames before & after it.
+ *
+ * Usage: check_blockq [-n blocks] [-s seed]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blockq.h"
+#include "check.h"
+
+// Renderer //////////////////////////////////////////////////////////////////
+
+#define MAX_EVENTS 100000
+
+/** Stands in for the synth: follows which frame of the timeline it
+ * has rendered up to, and notes the frame each event is applied at.
+ * Events carry their number in the message timestamp or the value.
+ */
+typedef struct {
+  uint32_t block_start; // Frame of the timeline the block starts at
+  uint32_t block_frames;
+  uint32_t frame;       // Next to render, in the block
+  uint32_t applied_at[MAX_EVENTS];
+  uint32_t applied[MAX_EVENTS]; // Event numbers, in the order applied
+  uint32_t num_applied;
+} timeline;
+
+static void render(void *ctx, uint32_t first_frame, uint32_t frames) {
+  timeline *tl = ctx;
+
+  CHECK(first_frame == tl->frame && frames > 0 && first_frame + frames <= tl->block_frames,
+        "render: frames %lu+%lu of %lu, after %lu rendered", (unsigned long)first_frame,
+        (unsigned long)frames, (unsigned long)tl->block_frames, (unsigned long)tl->frame);
+  tl->frame = first_frame + frames;
+}
+
+static void apply(void *ctx, const blockq_event *e, uint32_t frame) {
+  timeline *tl = ctx;
+  uint32_t n = e->param == BLOCKQ_MIDI ? e->msg.timestamp : (uint32_t)e->value;
+
+  CHECK(frame == tl->frame && frame < tl->block_frames,
+        "apply: event %lu at frame %lu, after %lu rendered", (unsigned long)n,
+        (unsigned long)frame, (unsigned long)tl->frame);
+  if (n < MAX_EVENTS && tl->num_applied < MAX_EVENTS) {
+    tl->applied_at[n] = tl->block_start + frame;
+    tl->applied[tl->num_applied++] = n;
+  }
+}
+
+static void render_block(blockq *q, timeline *tl, uint32_t block_time, uint32_t block_frames,
+                         uint32_t sample_rate) {
+  tl->block_frames = block_frames;
+  tl->frame = 0;
+  blockq_render(q, block_time, block_frames, sample_rate, render, apply, tl);
+  CHECK(tl->frame == block_frames, "render: %lu of %lu frames", (unsigned long)tl->frame,
+        (unsigned long)block_frames);
+  tl->block_start += block_frames;
+}
+
+static void push(blockq *q, uint32_t time, uint32_t n) {
+  midi_message mm;
+
+  memset(&mm, 0, sizeof(mm));
+  mm.type = MIDI_NOTE_ON;
+  mm.note = 60;
+  mm.velocity = 100;
+  mm.timestamp = n;
+  CHECK(blockq_push(q, time, &mm) == 1, "push: event %lu", (unsigned long)n);
+}
+
+// Worked examples ///////////////////////////////////////////////////////////
+
+/** 48 kHz in blocks of 48 frames, a millisecond each, starting just
+ * before the timestamps wrap.
+ */
+static void check_examples(void) {
+  static blockq q;
+  static timeline tl;
+  const uint32_t t0 = 0xFFFFF000;
+  static const struct {
+    uint32_t offset; // Microseconds after t0
+    uint32_t frame;  // Of the timeline
+  } events[] = {
+    { 0, 0 },        // The first frame
+    { 20, 0 },       // 0.96 of a frame
+    { 21, 1 },       // 1.008
+    { 21, 1 },       // The same time: after the one before
+    { 500, 24 },
+    { 999, 47 },     // The last frame of the block
+    { 1000, 48 },    // The first of the next
+    { 1021, 49 },
+    { 3000, 144 },   // Skipping a block
+    { 4095, 196 },   // The last microsecond before the wrap
+    { 4096, 196 },   // The wrap: 196.608
+    { 4117, 197 },   // 197.616
+  };
+  const uint32_t count = sizeof(events) / sizeof(events[0]);
+
+  blockq_init(&q);
+  memset(&tl, 0, sizeof(tl));
+  // Out of order, to be sorted; 2 & 3 have the same time
+  static const uint8_t order[] = { 11, 5, 0, 8, 2, 7, 3, 1, 10, 4, 9, 6 };
+  for (uint32_t i = 0; i < count; i++) {
+    push(&q, t0 + events[order[i]].offset, order[i]);
+  }
+  blockq_push_param(&q, t0 + 2500, 1, 1000.0f); // A parameter, at 120
+  for (uint32_t b = 0; b < 5; b++) {
+    render_block(&q, &tl, t0 + b * 1000, 48, 48000);
+  }
+  CHECK(tl.num_applied == count + 1 && q.count == 0 && q.late == 0 && q.dropped == 0,
+        "examples: %lu applied, %lu left, %lu late, %lu dropped", (unsigned long)tl.num_applied,
+        (unsigned long)q.count, (unsigned long)q.late, (unsigned long)q.dropped);
+  for (uint32_t i = 0; i < count; i++) {
+    CHECK(tl.applied_at[i] == events[i].frame, "examples: event %lu at frame %lu, not %lu",
+          (unsigned long)i, (unsigned long)tl.applied_at[i], (unsigned long)events[i].frame);
+  }
+  CHECK(tl.applied_at[1000] == 120, "examples: parameter at frame %lu",
+        (unsigned long)tl.applied_at[1000]);
+  CHECK(tl.applied[2] == 2 && tl.applied[3] == 3, "examples: same time out of order");
+
+  // Late: pushed after its block was rendered, it is applied at the start of the next
+  blockq_init(&q);
+  memset(&tl, 0, sizeof(tl));
+  render_block(&q, &tl, t0, 48, 48000);
+  push(&q, t0 + 10, 0);
+  push(&q, t0 + 1500, 1);
+  push(&q, t0 + 999, 2);
+  render_block(&q, &tl, t0 + 1000, 48, 48000);
+  CHECK(tl.applied_at[0] == 48 && tl.applied_at[2] == 48 && tl.applied_at[1] == 72,
+        "late: at %lu, %lu & %lu", (unsigned long)tl.applied_at[0],
+        (unsigned long)tl.applied_at[2], (unsigned long)tl.applied_at[1]);
+  CHECK(tl.applied[0] == 0 && tl.applied[1] == 2 && tl.applied[2] == 1, "late: order");
+  CHECK(q.late == 2, "late: %lu counted", (unsigned long)q.late);
+
+  // Full: the newest are dropped, wherever they would have gone
+  blockq_init(&q);
+  memset(&tl, 0, sizeof(tl));
+  for (uint32_t i = 0; i < BLOCKQ_SIZE; i++) {
+    push(&q, t0 + 100 + i * 30, i);
+  }
+  midi_message mm;
+  memset(&mm, 0, sizeof(mm));
+  mm.timestamp = 999;
+  CHECK(blockq_push(&q, t0, &mm) == 0, "full: earlier dropped");
+  CHECK(blockq_push(&q, t0 + 5000, &mm) == 0, "full: later dropped");
+  CHECK(blockq_push_param(&q, t0 + 500, 1, 999.0f) == 0, "full: parameter dropped");
+  CHECK(q.dropped == 3 && q.max_count == BLOCKQ_SIZE, "full: %lu dropped",
+        (unsigned long)q.dropped);
+  for (uint32_t b = 0; b < 2; b++) {
+    render_block(&q, &tl, t0 + b * 1000, 48, 48000);
+  }
+  CHECK(tl.num_applied == BLOCKQ_SIZE, "full: %lu applied", (unsigned long)tl.num_applied);
+  for (uint32_t i = 0; i < BLOCKQ_SIZE; i++) {
+    uint32_t frame = (100 + i * 30) * 48 / 1000;
+    CHECK(tl.applied_at[i] == frame, "full: event %lu at frame %lu, not %lu", (unsigned long)i,
+          (unsigned long)tl.applied_at[i], (unsigned long)frame);
+  }
+  // There is room again
+  push(&q, t0 + 2000, 0);
+  CHECK(q.count == 1, "full: room again");
+}
+
+// Random ////////////////////////////////////////////////////////////////////
+
+/** At 50 kHz a frame is 20 us, so an event's frame of the timeline is
+ * its time from the start over 20, in blocks of any size; a late one's
+ * is the first frame of the block it was rendered in.
+ */
+static void check_random(long blocks) {
+  static blockq q;
+  static timeline tl;
+  static uint32_t expected[MAX_EVENTS];
+  static uint32_t pushed_time[MAX_EVENTS];
+  static uint8_t was_late[MAX_EVENTS];
+  const uint32_t rate = 50000;
+  uint32_t t0 = rnd();
+  uint32_t n = 0;
+  uint32_t late = 0;
+
+  blockq_init(&q);
+  memset(&tl, 0, sizeof(tl));
+  for (long b = 0; b < blocks && n + BLOCKQ_SIZE < MAX_EVENTS; b++) {
+    uint32_t block_frames = 1 + rnd() % 256;
+    uint32_t block_time = t0 + tl.block_start * 20;
+
+    // Up to a queue full, mostly within the next few blocks
+    for (uint32_t k = rnd() % 8; k > 0 && q.count < BLOCKQ_SIZE; k--) {
+      uint32_t frame;
+      if (rnd() % 32 == 0 && tl.block_start > 0) {
+        frame = tl.block_start - 1 - rnd() % (tl.block_start < 100 ? tl.block_start : 100);
+        late++;
+        was_late[n] = 1;
+        expected[n] = tl.block_start;
+      } else {
+        frame = tl.block_start + rnd() % 1024;
+        was_late[n] = 0;
+        expected[n] = frame;
+      }
+      // Anywhere within the frame
+      pushed_time[n] = t0 + frame * 20 + rnd() % 20;
+      if (rnd() % 4 == 0) {
+        push(&q, pushed_time[n], n);
+      } else {
+        CHECK(blockq_push_param(&q, pushed_time[n], 1 + rnd() % 8, (float)n) == 1,
+              "random: push parameter");
+      }
+      n++;
+    }
+    render_block(&q, &tl, block_time, block_frames, rate);
+  }
+  // Then the rest
+  while (q.count > 0) {
+    render_block(&q, &tl, t0 + tl.block_start * 20, 256, rate);
+  }
+
+  CHECK(tl.num_applied == n, "random: %lu of %lu applied", (unsigned long)tl.num_applied,
+        (unsigned long)n);
+  CHECK(q.late == late && q.dropped == 0, "random: %lu late, not %lu; %lu dropped",
+        (unsigned long)q.late, (unsigned long)late, (unsigned long)q.dropped);
+  for (uint32_t i = 0; i < n; i++) {
+    CHECK(tl.applied_at[i] == expected[i], "random: event %lu at frame %lu, not %lu",
+          (unsigned long)i, (unsigned long)tl.applied_at[i], (unsigned long)expected[i]);
+  }
+  // In frame order; those on time in time order, and at the same time in the order pushed
+  for (uint32_t i = 1; i < tl.num_applied; i++) {
+    uint32_t a = tl.applied[i - 1];
+    uint32_t b = tl.applied[i];
+    int32_t d = (int32_t)(pushed_time[b] - pushed_time[a]);
+    CHECK(tl.applied_at[a] <= tl.applied_at[b] &&
+          (was_late[a] || was_late[b] || d > 0 || (d == 0 && a < b)),
+          "random: event %lu applied before %lu", (unsigned long)a, (unsigned long)b);
+  }
+  printf("%ld blocks, %lu frames: %lu events, %lu late\n", blocks,
+         (unsigned long)tl.block_start, (unsigned long)n, (unsigned long)late);
+}
+
+int main(int argc, char **argv) {
+  long blocks = 10000;
+
+  if (check_args(argc, argv, &blocks, "check_blockq [-n blocks] [-s seed]") != 0) {
+    return 2;
+  }
+
+  check_examples();
+  check_random(blocks);
+  return check_result();
+}
@@ -0,0 +1,163 @@
+/*
+ * check_format.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Differential check of midi_snprintf() against the snprintf() based
+ * formatter it replaced, kept here as the oracle: every (type, data1,
+ * data2) - all 2^24 of them by default - formatted by both into a
+ * roomy buffer and into one of a random size, usually truncating.
+ * The text, the bytes after it and the return value must all agree.
+ *
+ * Usage: check_format [-n messages] [-s seed]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "midi.h"
+#include "check.h"
+
+extern const char *cc_names[];
+extern const size_t num_cc_names;
+
+// Oracle ////////////////////////////////////////////////////////////////////
+
+/** midi_snprintf() as it was, with snprintf(). */
+static int old_midi_snprintf(char *str, size_t size, midi_message *mm) {
+
+  const char *cc_name;
+  char ccn_temp[32];
+
+  switch (mm->type & 0xF0) {
+  case 0x90:
+    if (mm->velocity > 0) {
+      return snprintf(str, size, "Note on: Chan %d, Note: %d, Vel: %d",
+                      mm->channel, mm->note, mm->velocity);
+    }
+    // Fall through
+  case 0x80:
+    return snprintf(str, size, "Note off: Chan %d, Note: %d, Vel: %d",
+                    mm->channel, mm->note, mm->velocity);
+  case 0xA0:
+    return snprintf(str, size, "Poly AT: Chan %d, Note: %d, Pres: %d",
+                    mm->channel, mm->note, mm->velocity);
+
+  case 0xB0:
+    if (mm->control >= 120) {
+      switch (mm->control) {
+      case 120:
+        return snprintf(str, size, "All sound off: Chan %d", mm->channel);
+      case 121:
+        return snprintf(str, size, "Reset all controllers: Chan %d", mm->channel);
+      case 122:
+        return snprintf(str, size, "Local control: %s, Chan %d",
+            mm->cc_value == 0 ? "Off" : "On", mm->channel);
+      case 123:
+        return snprintf(str, size, "All notes off: Chan %d", mm->channel);
+      case 124:
+        return snprintf(str, size, "Omni mode: Off: Chan %d", mm->channel);
+      case 125:
+        return snprintf(str, size, "Omni mode: On, Chan %d", mm->channel);
+      case 126:
+        if (mm->cc_value == 0) {
+          return snprintf(str, size, "Mono mode: All voices, Chan: %d", mm->channel);
+        }
+        return snprintf(str, size, "Mono mode: Voices: %d, Chan: %d", mm->cc_value, mm->channel);
+      case 127:
+        return snprintf(str, size, "Poly mode: On, Chan: %d", mm->channel);
+      }
+    }
+
+    // First figure out the channel name
+    if (mm->control >= num_cc_names) {
+      snprintf(ccn_temp, sizeof(ccn_temp) - 1, "CC %d", mm->control);
+      cc_name = ccn_temp;
+    } else if (mm->control >= 32 && mm->control <= 63) {
+      const char *name = cc_names[mm->control - 32];
+      if (name == NULL) {
+        snprintf(ccn_temp, sizeof(ccn_temp) - 1, "CC %d LSB", mm->control - 32);
+      } else {
+        snprintf(ccn_temp, sizeof(ccn_temp) - 1, "%s LSB", name);
+      }
+      cc_name = ccn_temp;
+    } else if (cc_names[mm->control] == NULL) {
+      snprintf(ccn_temp, sizeof(ccn_temp) - 1, "CC %d", mm->control);
+      cc_name = ccn_temp;
+    } else {
+      cc_name = cc_names[mm->control];
+    }
+
+    return snprintf(str, size, "CC: %s, Val: %d, Chan: %d", cc_name, mm->cc_value, mm->channel);
+
+  case 0xC0:
+    return snprintf(str, size, "Program: Chan %d, Prog: %d",
+                    mm->channel, mm->program);
+  case 0xD0:
+    return snprintf(str, size, "Chan AT: Chan %d, Pres: %d",
+                    mm->channel, mm->pressure);
+  case 0xE0:
+    return snprintf(str, size, "Bend: Chan %d, Amt: %d",
+                    mm->channel, MIDI_14bits(mm));
+  }
+
+  return snprintf(str, size, "MIDI msg: %02X, %d, %d",
+                  mm->type, mm->data1, mm->data2);
+}
+
+// Differential //////////////////////////////////////////////////////////////
+
+#define TEXT_SIZE 96
+
+/** Formats the message both ways into buffers of the given size at the
+ * start of a larger, filled one, so writes past the end show too.
+ */
+static void compare(midi_message *mm, size_t size) {
+  char old_text[TEXT_SIZE];
+  char new_text[TEXT_SIZE];
+
+  memset(old_text, 0xA5, sizeof(old_text));
+  memset(new_text, 0xA5, sizeof(new_text));
+  int old_len = old_midi_snprintf(old_text, size, mm);
+  int new_len = midi_snprintf(new_text, size, mm);
+  if (old_len != new_len || memcmp(old_text, new_text, sizeof(old_text)) != 0) {
+    CHECK(0, "%02X %02X %02X size %zu: \"%.*s\" (%d), not \"%.*s\" (%d)", mm->type, mm->data1,
+          mm->data2, size, (int)(size ? size - 1 : 0), new_text, new_len,
+          (int)(size ? size - 1 : 0), old_text, old_len);
+  }
+}
+
+int main(int argc, char **argv) {
+  long messages = 1L << 24;
+  midi_message mm;
+
+  if (check_args(argc, argv, &messages, "check_format [-n messages] [-s seed]") != 0) {
+    return 2;
+  }
+
+  for (long i = 0; i < messages && failures < 100; i++) {
+    // Every type, data1 & data2, in turn
+    memset(&mm, 0, sizeof(mm));
+    mm.type = (uint8_t)(i >> 16);
+    mm.channel = mm.type & 0x0F;
+    mm.data1 = (uint8_t)(i >> 8);
+    mm.data2 = (uint8_t)i;
+    compare(&mm, 80);
+    compare(&mm, rnd() % 64);
+  }
+  // A named controller's LSB, truncated at every size
+  mm.type = 0xB0 | 15;
+  mm.channel = 15;
+  mm.control = 39;
+  mm.cc_value = 127;
+  for (size_t size = 0; size <= 80; size++) {
+    compare(&mm, size);
+  }
+
+  printf("%ld messages\n", messages);
+  return check_result();
+}
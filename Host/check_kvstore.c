@@ -0,0 +1,456 @@
+/*
+ * check_kvstore.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Checks the flash key/value store (kvstore.h) on a flash of RAM that
+ * keeps NOR's rules: programming only clears bits, a word is never
+ * programmed unless blank, one operation at a time, each taking a
+ * while. First worked examples (formatting, setting & erasing values,
+ * compaction, erases held off, torn records, garbage), then many random
+ * values set with the power cut at random, part way through whatever
+ * the flash was doing, and the odd operation failing. After each cut
+ * the store is mounted afresh, and every key must have either the value
+ * it had when everything was last written, or one set since.
+ *
+ * Usage: check_kvstore [-n values] [-s seed]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kvstore.h"
+#include "check.h"
+
+// The flash /////////////////////////////////////////////////////////////////
+
+#define AREA_SIZE  4096 // Small, so compaction comes often
+#define AREA_WORDS (AREA_SIZE / 4)
+#define BLANK      0xFFFFFFFFU
+
+#define OP_NONE    0
+#define OP_PROGRAM 1
+#define OP_ERASE   2
+
+typedef struct {
+  uint32_t mem[KVSTORE_AREAS * AREA_WORDS];
+  int op;
+  uint32_t word_at;   // Of the program, in words
+  uint32_t word;
+  int area;           // Of the erase
+  int polls;          // Until it is done
+  int may_erase;      // Whether the store was let erase
+  uint32_t fail_one_in; // Operations; 0 for none
+  uint32_t programs;
+  uint32_t erases;
+} flash_sim;
+
+static flash_sim flash;
+
+static int flash_program(void *ctx, uint32_t offset, uint32_t word) {
+  flash_sim *f = ctx;
+
+  CHECK(f->op == OP_NONE, "program at %u while busy", offset);
+  CHECK(offset % 4 == 0 && offset < sizeof(f->mem), "program at %u", offset);
+  if (f->op != OP_NONE || offset % 4 != 0 || offset >= sizeof(f->mem)) {
+    return 0;
+  }
+  CHECK(f->mem[offset / 4] == BLANK, "program at %u, not blank", offset);
+  f->op = OP_PROGRAM;
+  f->word_at = offset / 4;
+  f->word = word;
+  f->polls = rnd() % 3;
+  f->programs++;
+  return 1;
+}
+
+static int flash_erase(void *ctx, int area) {
+  flash_sim *f = ctx;
+
+  CHECK(f->op == OP_NONE, "erase of %d while busy", area);
+  CHECK(f->may_erase, "erase of %d when not let", area);
+  CHECK(area >= 0 && area < KVSTORE_AREAS, "erase of %d", area);
+  if (f->op != OP_NONE || area < 0 || area >= KVSTORE_AREAS) {
+    return 0;
+  }
+  f->op = OP_ERASE;
+  f->area = area;
+  f->polls = rnd() % 20;
+  f->erases++;
+  return 1;
+}
+
+/** Part of a program: some of the bits it clears; or of an erase: the
+ * words up to one, which is partly set.
+ */
+static void flash_partial(flash_sim *f) {
+  if (f->op == OP_PROGRAM) {
+    f->mem[f->word_at] &= f->word | rnd();
+  } else if (f->op == OP_ERASE) {
+    uint32_t *area = &f->mem[f->area * AREA_WORDS];
+    uint32_t n = rnd() % AREA_WORDS;
+    memset(area, 0xFF, n * 4);
+    area[n] |= rnd();
+  }
+}
+
+static int flash_status(void *ctx) {
+  flash_sim *f = ctx;
+
+  if (f->op == OP_NONE) {
+    return KVSTORE_FLASH_DONE;
+  }
+  if (f->polls-- > 0) {
+    return KVSTORE_FLASH_BUSY;
+  }
+  if (f->fail_one_in != 0 && rnd() % f->fail_one_in == 0) {
+    flash_partial(f);
+    f->op = OP_NONE;
+    return KVSTORE_FLASH_FAILED;
+  }
+  if (f->op == OP_PROGRAM) {
+    f->mem[f->word_at] &= f->word;
+  } else {
+    memset(&f->mem[f->area * AREA_WORDS], 0xFF, AREA_SIZE);
+  }
+  f->op = OP_NONE;
+  return KVSTORE_FLASH_DONE;
+}
+
+/** The power goes, part way through anything under way. */
+static void power_cut(flash_sim *f) {
+  flash_partial(f);
+  f->op = OP_NONE;
+}
+
+static const kvstore_flash flash_if = {
+    .base = (const uint8_t *)flash.mem,
+    .area_size = AREA_SIZE,
+    .ctx = &flash,
+    .program = flash_program,
+    .erase = flash_erase,
+    .status = flash_status,
+};
+
+static void flash_reset(void) {
+  memset(&flash, 0, sizeof(flash));
+  memset(flash.mem, 0xFF, sizeof(flash.mem));
+}
+
+// Helpers ///////////////////////////////////////////////////////////////////
+
+static kvstore store;
+
+static void poll(int may_erase) {
+  flash.may_erase = may_erase;
+  kvstore_poll(&store, may_erase);
+}
+
+/** Polls until everything is written; 0 if it never is. */
+static int drain(int may_erase) {
+  for (long i = 0; i < 1000000; i++) {
+    if (kvstore_idle(&store)) {
+      return 1;
+    }
+    poll(may_erase);
+  }
+  return 0;
+}
+
+static void remount(void) {
+  CHECK(kvstore_mount(&store, &flash_if), "mount");
+}
+
+static void set_string(uint16_t key, const char *s) {
+  CHECK(kvstore_set(&store, key, s, strlen(s)), "set %u to %s", key, s);
+}
+
+static int has_string(uint16_t key, const char *s) {
+  char value[KVSTORE_MAX_VALUE + 1];
+  size_t len = kvstore_get(&store, key, value, KVSTORE_MAX_VALUE);
+
+  value[len] = 0;
+  return len == strlen(s) && strcmp(value, s) == 0;
+}
+
+/** Sets keys 24-27 to a count until the store has compacted. */
+static uint32_t fill_until_compacted(int may_erase) {
+  uint32_t compactions = store.compactions;
+  uint32_t n = 0;
+  char text[16];
+
+  while (store.compactions == compactions && n < 100000) {
+    snprintf(text, sizeof(text), "count %u", (unsigned)n);
+    set_string(24 + n % 4, text);
+    for (int i = 0; i < 20; i++) {
+      poll(may_erase);
+    }
+    n++;
+  }
+  drain(may_erase);
+  return n;
+}
+
+// Worked examples ///////////////////////////////////////////////////////////
+
+static void check_vectors(void) {
+  uint8_t big[KVSTORE_MAX_VALUE + 1] = { 0 };
+  uint32_t records, n;
+
+  // Blank: formatted by the first polls, without an erase
+  flash_reset();
+  remount();
+  CHECK(store.active == -1 && store.dirty == 0, "blank: active %d dirty %x", store.active, store.dirty);
+  CHECK(!kvstore_idle(&store), "blank is idle");
+  CHECK(drain(0), "formatting");
+  CHECK(store.active == 0 && store.generation == 1, "formatted %d generation %u", store.active,
+        (unsigned)store.generation);
+  CHECK(flash.programs == 3 && flash.erases == 0, "formatting took %u programs, %u erases",
+        (unsigned)flash.programs, (unsigned)flash.erases);
+
+  // Values are seen at once, then written & kept
+  set_string(1, "hello");
+  set_string(2, "world");
+  CHECK(has_string(1, "hello") && has_string(2, "world"), "set values not seen");
+  CHECK(drain(0), "writing");
+  CHECK(store.records == 2, "%u records", (unsigned)store.records);
+  remount();
+  CHECK(has_string(1, "hello") && has_string(2, "world"), "values not kept");
+  CHECK(kvstore_get(&store, 3, big, sizeof(big)) == 0, "key never set has a value");
+  CHECK(kvstore_idle(&store), "remounted not idle");
+
+  // Setting what is there writes nothing; setting twice, once
+  records = store.records;
+  set_string(1, "hello");
+  CHECK(kvstore_idle(&store), "unchanged value queued");
+  set_string(1, "first");
+  set_string(1, "second");
+  CHECK(drain(0) && store.records == records + 1, "set twice: %u records",
+        (unsigned)(store.records - records));
+  CHECK(has_string(1, "second"), "set twice");
+
+  // Erasing a key, which sticks
+  CHECK(kvstore_set(&store, 2, NULL, 0), "erase key 2");
+  CHECK(kvstore_get(&store, 2, big, sizeof(big)) == 0, "erased key has a value");
+  CHECK(drain(0), "writing erasure");
+  remount();
+  CHECK(kvstore_get(&store, 2, big, sizeof(big)) == 0, "erased key back after mount");
+  CHECK(has_string(1, "second"), "other key lost by erasure");
+
+  // Out of range, & too many waiting
+  CHECK(!kvstore_set(&store, KVSTORE_MAX_KEYS, "x", 1), "key out of range set");
+  CHECK(!kvstore_set(&store, 5, big, sizeof(big)), "value too long set");
+  CHECK(kvstore_set(&store, 5, big, KVSTORE_MAX_VALUE), "longest value not set");
+  for (int k = 0; k < KVSTORE_PENDING - 1; k++) {
+    big[0] = (uint8_t)(k + 1);
+    CHECK(kvstore_set(&store, (uint16_t)(10 + k), big, 1), "set %d of %d", k, KVSTORE_PENDING);
+  }
+  CHECK(!kvstore_set(&store, 20, big, 1), "more than KVSTORE_PENDING waiting");
+  CHECK(kvstore_set(&store, 10, big, 2), "replacing one waiting");
+  CHECK(drain(0), "writing many");
+
+  // Compaction into the erased area; the old one is left until erases are let
+  n = fill_until_compacted(0);
+  CHECK(store.compactions == 1 && store.active == 1 && store.generation == 2,
+        "compaction: %u, active %d, generation %u", (unsigned)store.compactions, store.active,
+        (unsigned)store.generation);
+  CHECK(flash.erases == 0 && store.dirty == 1, "compacted with %u erases, dirty %x",
+        (unsigned)flash.erases, store.dirty);
+  CHECK(has_string(1, "second") && kvstore_get(&store, 2, big, sizeof(big)) == 0 &&
+        kvstore_get(&store, 5, big, sizeof(big)) == KVSTORE_MAX_VALUE &&
+        kvstore_get(&store, 10, big, sizeof(big)) == 2, "values lost by compaction");
+  remount();
+  CHECK(store.active == 1 && store.dirty == 1, "remounted compaction: active %d dirty %x",
+        store.active, store.dirty);
+  CHECK(kvstore_get(&store, 16, big, sizeof(big)) == 1 && big[0] == KVSTORE_PENDING - 1,
+        "values lost by compaction, remounted");
+
+  // Full again with the other area not erased: writes wait for an erase
+  while (store.write_pos + 16 <= AREA_SIZE) {
+    set_string(30, store.write_pos % 8 ? "odd" : "even");
+    drain(0);
+  }
+  set_string(31, "waiting");
+  for (int i = 0; i < 1000; i++) {
+    poll(0);
+  }
+  CHECK(!kvstore_idle(&store) && store.compactions == 0 && has_string(31, "waiting"),
+        "wrote with the spare area unerased");
+  CHECK(drain(1), "writing once erases are let");
+  CHECK(store.compactions == 1 && store.active == 0 && flash.erases == 2,
+        "compactions %u, active %d, erases %u", (unsigned)store.compactions, store.active,
+        (unsigned)flash.erases);
+  remount();
+  CHECK(has_string(31, "waiting") && kvstore_get(&store, 10, big, sizeof(big)) == 2,
+        "values lost by second compaction");
+  printf("compaction after %u values\n", (unsigned)n);
+
+  // A record torn at each of its words: the old value stays, and the
+  // next is written after it
+  for (int cut = 0; cut < 5; cut++) {
+    flash_reset();
+    remount();
+    set_string(7, "old");
+    drain(0);
+    set_string(7, "newer value");
+    poll(0);
+    for (int i = 0; i < cut; i++) {
+      while (flash.op != OP_NONE) {
+        poll(0);
+      }
+      poll(0);
+    }
+    power_cut(&flash);
+    remount();
+    CHECK(has_string(7, "old") || has_string(7, "newer value"), "torn at %d: neither value", cut);
+    set_string(8, "after");
+    CHECK(drain(0), "torn at %d: writing after", cut);
+    remount();
+    CHECK(has_string(8, "after"), "torn at %d: value after lost", cut);
+  }
+
+  // Garbage in both areas: erased, formatted & used
+  flash_reset();
+  for (size_t i = 0; i < sizeof(flash.mem) / 4; i++) {
+    flash.mem[i] = rnd();
+  }
+  remount();
+  CHECK(store.active == -1 && store.dirty == 3, "garbage: active %d dirty %x", store.active,
+        store.dirty);
+  set_string(0, "clean");
+  CHECK(!drain(0), "garbage written without erasing");
+  CHECK(drain(1), "garbage not erased");
+  remount();
+  CHECK(has_string(0, "clean"), "garbage: value lost");
+}
+
+// Random, with the power cut ////////////////////////////////////////////////
+
+#define KEYS  12 // Used, so each is set often
+#define SINCE 16 // Values set since all were last written, kept of each key
+
+typedef struct {
+  uint8_t len;
+  uint8_t data[KVSTORE_MAX_VALUE];
+} value;
+
+static value latest[KEYS];        // As last set
+static value durable[KEYS];       // When all were last written
+static value since[KEYS][SINCE];  // Set since then
+static int num_since[KEYS];
+
+static int same(const value *v, const uint8_t *data, size_t len) {
+  return v->len == len && memcmp(v->data, data, len) == 0;
+}
+
+/** Now all are written: what each was set to last is what it has. */
+static void all_durable(void) {
+  memcpy(durable, latest, sizeof(durable));
+  memset(num_since, 0, sizeof(num_since));
+}
+
+static void check_latest(const char *when) {
+  uint8_t data[KVSTORE_MAX_VALUE];
+
+  for (int k = 0; k < KEYS; k++) {
+    size_t len = kvstore_get(&store, (uint16_t)k, data, sizeof(data));
+    CHECK(same(&latest[k], data, len), "%s: key %d not as last set", when, k);
+  }
+}
+
+/** After a power cut: every key is as when last all were written, or
+ * has a value set since; which is now as it is.
+ */
+static void check_after_cut(long n) {
+  uint8_t data[KVSTORE_MAX_VALUE];
+
+  for (int k = 0; k < KEYS; k++) {
+    size_t len = kvstore_get(&store, (uint16_t)k, data, sizeof(data));
+    int ok = same(&durable[k], data, len);
+
+    for (int i = 0; i < num_since[k] && !ok; i++) {
+      ok = same(&since[k][i], data, len);
+    }
+    CHECK(ok, "cut %ld: key %d has a value never set", n, k);
+    latest[k].len = (uint8_t)len;
+    memcpy(latest[k].data, data, len);
+  }
+  all_durable();
+}
+
+static void random_values(long values) {
+  uint32_t cuts = 0, torn = 0, compactions = 0, errors = 0, records = 0;
+
+  flash_reset();
+  flash.fail_one_in = 500;
+  remount();
+  memset(latest, 0, sizeof(latest));
+  all_durable();
+
+  for (long n = 0; n < values; n++) {
+    uint16_t key = rnd() % KEYS;
+    value v;
+    int polls = rnd() % 24;
+
+    v.len = rnd() % 4 == 0 ? 0 : (uint8_t)(1 + rnd() % KVSTORE_MAX_VALUE);
+    for (int i = 0; i < v.len; i++) {
+      v.data[i] = (uint8_t)rnd();
+    }
+    if (num_since[key] == SINCE) {
+      CHECK(drain(1), "value %ld: not all written", n);
+      all_durable();
+    }
+    if (kvstore_set(&store, key, v.data, v.len)) {
+      latest[key] = v;
+      since[key][num_since[key]++] = v;
+    }
+    check_latest("set");
+
+    // Erases let half the time, as if the audio were paused for them
+    for (int i = 0; i < polls; i++) {
+      poll(rnd() % 2);
+    }
+    if (kvstore_idle(&store)) {
+      all_durable();
+    }
+
+    if (rnd() % 64 == 0) {
+      power_cut(&flash);
+      records += store.records;
+      compactions += store.compactions;
+      errors += store.errors;
+      remount();
+      torn += store.torn_words;
+      check_after_cut(n);
+      cuts++;
+    }
+  }
+
+  CHECK(drain(1), "not all written at the end");
+  check_latest("end");
+  records += store.records;
+  compactions += store.compactions;
+  errors += store.errors;
+  remount();
+  check_latest("end, remounted");
+  printf("%ld values: %u records written, %u power cuts, %u compactions, %u flash errors, "
+         "%u torn words, %u erases\n",
+         values, (unsigned)records, (unsigned)cuts, (unsigned)compactions, (unsigned)errors,
+         (unsigned)torn, (unsigned)flash.erases);
+}
+
+int main(int argc, char **argv) {
+  long values = 100000;
+
+  if (check_args(argc, argv, &values, "check_kvstore [-n values] [-s seed]") != 0) {
+    return 2;
+  }
+
+  check_vectors();
+  random_values(values);
+  return check_result();
+}
@@ -0,0 +1,471 @@
+/*
+ * check_osc.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Checks the OSC server (osc.h): the address trie against a plain
+ * search of oscaddr.h's list, packets worked out from the
+ * specification (messages, bundles, timetags before & after the clock
+ * is set, malformed ones), then many random & mutated packets, which
+ * must neither upset the sanitizers nor reach a method with arguments
+ * other than their type tags say.
+ *
+ * Usage: check_osc [-n packets] [-s seed]
+ *
+ * References:
+ * - The Open Sound Control 1.0 Specification
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "osc.h"
+#include "oscaddr.h"
+#include "check.h"
+
+#define LATENCY_US 2000
+#define SECONDS_1900_TO_2026 3976214400ULL // 2026-01-01, a time to set the clock to
+
+// Packets ///////////////////////////////////////////////////////////////////
+
+typedef struct {
+  uint8_t data[1024];
+  size_t len;
+} packet;
+
+static void put32(packet *p, uint32_t v) {
+  p->data[p->len++] = v >> 24;
+  p->data[p->len++] = v >> 16;
+  p->data[p->len++] = v >> 8;
+  p->data[p->len++] = v;
+}
+
+static void put64(packet *p, uint64_t v) {
+  put32(p, v >> 32);
+  put32(p, v);
+}
+
+static void put_string(packet *p, const char *s) {
+  size_t n = strlen(s) + 1;
+
+  memcpy(&p->data[p->len], s, n);
+  p->len += n;
+  while (p->len % 4 != 0) {
+    p->data[p->len++] = 0;
+  }
+}
+
+static void put_float(packet *p, float f) {
+  uint32_t u;
+
+  memcpy(&u, &f, sizeof(u));
+  put32(p, u);
+}
+
+static void put_double(packet *p, double d) {
+  uint64_t u;
+
+  memcpy(&u, &d, sizeof(u));
+  put64(p, u);
+}
+
+/** Starts a bundle: its header, then put_element() each element. */
+static void begin_bundle(packet *p, uint64_t timetag) {
+  put_string(p, "#bundle");
+  put64(p, timetag);
+}
+
+/** Appends packet e to p as a bundle element. */
+static void put_element(packet *p, const packet *e) {
+  put32(p, e->len);
+  memcpy(&p->data[p->len], e->data, e->len);
+  p->len += e->len;
+}
+
+static void message_f(packet *p, const char *address, float f) {
+  p->len = 0;
+  put_string(p, address);
+  put_string(p, ",f");
+  put_float(p, f);
+}
+
+static uint64_t timetag_of_us(uint64_t us) {
+  return ((us / 1000000) << 32) | (((us % 1000000) << 32) / 1000000 + 1);
+}
+
+// The method ////////////////////////////////////////////////////////////////
+
+#define MAX_CALLS 64
+
+typedef struct {
+  int method;
+  uint32_t when;
+  int nvalues;
+  float values[4];
+  int has_timetag;
+  uint64_t timetag;
+} call;
+
+static call calls[MAX_CALLS];
+static int num_calls;
+static osc_server server;
+
+/** Records the call, reading every argument it can. */
+static int record(void *ctx, int method, osc_args *args, uint32_t when, uint32_t now) {
+  call *c = &calls[num_calls < MAX_CALLS ? num_calls : MAX_CALLS - 1];
+  float v;
+
+  CHECK(method >= 0 && method < OSC_NUM_METHODS, "method %d", method);
+  memset(c, 0, sizeof(*c));
+  c->method = method;
+  c->when = when;
+  while (osc_args_left(args)) {
+    if (osc_arg_float(args, &v)) {
+      if (c->nvalues < 4) {
+        c->values[c->nvalues++] = v;
+      }
+    } else if (osc_arg_timetag(args, &c->timetag)) {
+      c->has_timetag = 1;
+    } else {
+      // Nothing else is read: the rest are left
+      break;
+    }
+  }
+  if (method == OSC_CLOCK && c->has_timetag) {
+    osc_set_clock(&server, c->timetag, now);
+  }
+  if (num_calls < MAX_CALLS) {
+    num_calls++;
+  }
+  return 1;
+}
+
+static void input(const packet *p, uint32_t now) {
+  num_calls = 0;
+  osc_input(&server, p->data, p->len, now);
+}
+
+// Trie //////////////////////////////////////////////////////////////////////
+
+static int linear_lookup(const char *address) {
+  for (int i = 0; i < OSC_NUM_METHODS; i++) {
+    if (strcmp(osc_addresses[i], address) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void check_trie(long tries) {
+  char a[32];
+  const char alphabet[] = "/synthclockfreqlevnoe*?x";
+
+  for (int i = 0; i < OSC_NUM_METHODS; i++) {
+    const char *address = osc_addresses[i];
+    size_t n = strlen(address);
+
+    CHECK(osc_trie_lookup(osc_trie, address) == i, "%s is not method %d", address, i);
+    for (size_t k = 0; k < n; k++) {
+      memcpy(a, address, k);
+      a[k] = 0;
+      CHECK(osc_trie_lookup(osc_trie, a) == linear_lookup(a), "prefix %s", a);
+    }
+    snprintf(a, sizeof(a), "%s/", address);
+    CHECK(osc_trie_lookup(osc_trie, a) == -1, "%s", a);
+    snprintf(a, sizeof(a), "%sx", address);
+    CHECK(osc_trie_lookup(osc_trie, a) == -1, "%s", a);
+  }
+  CHECK(osc_trie_lookup(osc_trie, "/synth/*") == -1, "patterns are not expanded");
+  CHECK(osc_trie_lookup(osc_trie, "/SYNTH/FREQ") == -1, "addresses are case sensitive");
+
+  // Random strings, mostly of the addresses' characters
+  for (long t = 0; t < tries; t++) {
+    size_t n = rnd() % 14;
+
+    for (size_t k = 0; k < n; k++) {
+      a[k] = (rnd() % 8 == 0) ? (char)(rnd() % 255 + 1) : alphabet[rnd() % (sizeof(alphabet) - 1)];
+    }
+    a[n] = 0;
+    if (n > 0 && rnd() % 2) {
+      a[0] = '/';
+    }
+    CHECK(osc_trie_lookup(osc_trie, a) == linear_lookup(a), "random address %s", a);
+  }
+}
+
+// Vectors ///////////////////////////////////////////////////////////////////
+
+static void check_vectors(void) {
+  packet p;
+  packet m;
+  packet inner;
+  uint32_t now = 1000000;
+  uint64_t clock_us = SECONDS_1900_TO_2026 * 1000000;
+
+  osc_init(&server, osc_trie, LATENCY_US, record, NULL);
+
+  // A message on its own: after the latency
+  message_f(&p, "/synth/freq", 440.5f);
+  input(&p, now);
+  CHECK(num_calls == 1 && calls[0].method == OSC_SYNTH_FREQ && calls[0].nvalues == 1 &&
+        calls[0].values[0] == 440.5f && calls[0].when == now + LATENCY_US, "message");
+
+  // Numbers of every kind, as floats
+  p.len = 0;
+  put_string(&p, "/synth/note");
+  put_string(&p, ",ihdTF");
+  put32(&p, (uint32_t)-3);
+  put64(&p, 60);
+  put_double(&p, 0.25);
+  input(&p, now);
+  CHECK(num_calls == 1 && calls[0].nvalues == 4 && calls[0].values[0] == -3.0f &&
+        calls[0].values[1] == 60.0f && calls[0].values[2] == 0.25f && calls[0].values[3] == 1.0f,
+        "numbers");
+
+  // No type tags at all, as before OSC 1.0: no arguments
+  p.len = 0;
+  put_string(&p, "/synth/off");
+  input(&p, now);
+  CHECK(num_calls == 1 && calls[0].method == OSC_SYNTH_OFF && calls[0].nvalues == 0, "no type tags");
+
+  // Strings & blobs are skipped over correctly
+  p.len = 0;
+  put_string(&p, "/synth/level");
+  put_string(&p, ",sbf");
+  put_string(&p, "abcd");
+  put32(&p, 5);
+  put_string(&p, "12345"); // A 5 byte blob, padded
+  put_float(&p, 0.5f);
+  osc_init(&server, osc_trie, LATENCY_US, record, NULL);
+  input(&p, now);
+  CHECK(num_calls == 1 && server.rx_errors == 0, "strings & blobs");
+
+  // Not ours
+  message_f(&p, "/synth/wobble", 1.0f);
+  input(&p, now);
+  CHECK(num_calls == 0 && server.rx_unmatched == 1, "unmatched");
+
+  // A bundle timed immediately, of two messages
+  p.len = 0;
+  begin_bundle(&p, OSC_IMMEDIATELY);
+  message_f(&m, "/synth/freq", 220.0f);
+  put_element(&p, &m);
+  message_f(&m, "/synth/level", 0.75f);
+  put_element(&p, &m);
+  input(&p, now);
+  CHECK(num_calls == 2 && calls[0].method == OSC_SYNTH_FREQ && calls[1].method == OSC_SYNTH_LEVEL &&
+        calls[1].values[0] == 0.75f && calls[1].when == now + LATENCY_US, "bundle immediately");
+
+  // A timed bundle before the clock is set: immediately
+  p.len = 0;
+  begin_bundle(&p, timetag_of_us(clock_us + 500000));
+  message_f(&m, "/synth/freq", 330.0f);
+  put_element(&p, &m);
+  input(&p, now);
+  CHECK(num_calls == 1 && calls[0].when == now + LATENCY_US && server.rx_unsynced == 1, "unsynced");
+
+  // Set the clock, then a bundle half a second ahead
+  p.len = 0;
+  put_string(&p, "/clock");
+  put_string(&p, ",t");
+  put64(&p, timetag_of_us(clock_us));
+  input(&p, now);
+  CHECK(num_calls == 1 && server.synced && server.syncs == 1, "clock");
+  now += 1000;
+  clock_us += 1000;
+  p.len = 0;
+  begin_bundle(&p, timetag_of_us(clock_us + 500000));
+  message_f(&m, "/synth/freq", 330.0f);
+  put_element(&p, &m);
+  input(&p, now);
+  CHECK(num_calls == 1 && calls[0].when - (now + 500000) + 1 <= 2, "timed: %u for %u",
+        num_calls ? calls[0].when : 0, now + 500000);
+
+  // Passed: as soon as possible
+  p.len = 0;
+  begin_bundle(&p, timetag_of_us(clock_us - 10000));
+  put_element(&p, &m);
+  input(&p, now);
+  CHECK(num_calls == 1 && calls[0].when == now && server.rx_late == 1, "late");
+
+  // Too far ahead: refused
+  p.len = 0;
+  begin_bundle(&p, timetag_of_us(clock_us + OSC_MAX_AHEAD_US + 100000));
+  put_element(&p, &m);
+  input(&p, now);
+  CHECK(num_calls == 0 && server.rx_too_far == 1, "too far");
+
+  // Nested bundles take their own timetags
+  inner.len = 0;
+  begin_bundle(&inner, timetag_of_us(clock_us + 20000));
+  put_element(&inner, &m);
+  p.len = 0;
+  begin_bundle(&p, timetag_of_us(clock_us + 10000));
+  put_element(&p, &m);
+  put_element(&p, &inner);
+  input(&p, now);
+  CHECK(num_calls == 2 && calls[0].when - (now + 10000) + 1 <= 2 &&
+        calls[1].when - (now + 20000) + 1 <= 2, "nested");
+
+  // Too deep
+  p = m;
+  for (int d = 0; d <= OSC_MAX_DEPTH; d++) {
+    inner.len = 0;
+    begin_bundle(&inner, OSC_IMMEDIATELY);
+    put_element(&inner, &p);
+    p = inner;
+  }
+  input(&p, now);
+  CHECK(num_calls == 0, "too deep");
+
+  // Our microseconds wrapping: the clock keeps up
+  osc_set_clock(&server, timetag_of_us(clock_us), 0xFFFF0000);
+  now = 0x00010000;
+  clock_us += 0x20000;
+  p.len = 0;
+  begin_bundle(&p, timetag_of_us(clock_us + 1000));
+  put_element(&p, &m);
+  input(&p, now);
+  CHECK(num_calls == 1 && calls[0].when - (now + 1000) + 1 <= 2, "wrap");
+
+  // Malformed
+  osc_init(&server, osc_trie, LATENCY_US, record, NULL);
+  message_f(&p, "/synth/freq", 1.0f);
+  p.len -= 4; // The float missing
+  input(&p, now);
+  CHECK(num_calls == 0 && server.rx_errors == 1, "truncated argument");
+  message_f(&p, "/synth/freq", 1.0f);
+  p.len -= 1;
+  input(&p, now);
+  CHECK(num_calls == 0 && server.rx_errors == 2, "not a multiple of 4");
+  p.len = 0;
+  put_string(&p, "/synth/freq");
+  put_string(&p, ",Q");
+  input(&p, now);
+  CHECK(num_calls == 0 && server.rx_errors == 3, "unknown type");
+  p.len = 0;
+  put_string(&p, "/synth/freq");
+  put_string(&p, ",b");
+  put32(&p, 0xFFFFFFFC);
+  input(&p, now);
+  CHECK(num_calls == 0 && server.rx_errors == 4, "blob too long");
+  p.len = 0;
+  put_string(&p, "synth");
+  input(&p, now);
+  CHECK(num_calls == 0 && server.rx_errors == 5, "no /");
+  p.len = 0;
+  begin_bundle(&p, OSC_IMMEDIATELY);
+  put32(&p, 8);
+  put32(&p, 0);
+  input(&p, now);
+  CHECK(num_calls == 0 && server.rx_errors == 6, "element too long");
+}
+
+// Random packets ////////////////////////////////////////////////////////////
+
+/** A random, well formed message, to an address of ours or not. */
+static void random_message(packet *p) {
+  static const char types[] = "ifhdtsbTFNcrm";
+  char tags[8] = ",";
+  int n = rnd() % 5;
+  const char *address;
+
+  address = rnd() % 4 ? osc_addresses[rnd() % OSC_NUM_METHODS] : "/synth/nothing";
+  for (int i = 0; i < n; i++) {
+    tags[i + 1] = types[rnd() % (sizeof(types) - 1)];
+  }
+  tags[n + 1] = 0;
+  p->len = 0;
+  put_string(p, address);
+  put_string(p, tags);
+  for (int i = 0; i < n; i++) {
+    switch (tags[i + 1]) {
+    case 'h':
+    case 'd':
+    case 't':
+      put64(p, ((uint64_t)rnd() << 32) | rnd());
+      break;
+    case 's':
+      put_string(p, rnd() % 2 ? "x" : "abcdef");
+      break;
+    case 'b':
+      put32(p, 3);
+      put32(p, rnd());
+      break;
+    case 'T':
+    case 'F':
+    case 'N':
+      break;
+    default:
+      put32(p, rnd());
+      break;
+    }
+  }
+}
+
+static void random_packets(long packets) {
+  packet p;
+  packet m;
+  long calls_made = 0;
+  uint32_t now = 0;
+
+  osc_init(&server, osc_trie, LATENCY_US, record, NULL);
+  for (long i = 0; i < packets; i++) {
+    now += rnd() % 100000;
+    if (rnd() % 2) {
+      random_message(&p);
+    } else {
+      p.len = 0;
+      begin_bundle(&p, rnd() % 4 ? OSC_IMMEDIATELY : ((uint64_t)rnd() << 32) | rnd());
+      for (int e = rnd() % 4; e > 0 && p.len < 512; e--) {
+        random_message(&m);
+        put_element(&p, &m);
+      }
+    }
+    // Mutate some: flip, cut short or lengthen
+    switch (rnd() % 4) {
+    case 0:
+      for (int k = rnd() % 4; k >= 0; k--) {
+        p.data[rnd() % p.len] ^= 1 << (rnd() % 8);
+      }
+      break;
+    case 1:
+      p.len = rnd() % (p.len + 1);
+      break;
+    case 2:
+      while (p.len < sizeof(p.data) && rnd() % 8) {
+        p.data[p.len++] = rnd();
+      }
+      break;
+    }
+    // Exactly as long, so the sanitizers catch reading past the end
+    uint8_t *copy = malloc(p.len ? p.len : 1);
+    memcpy(copy, p.data, p.len);
+    num_calls = 0;
+    osc_input(&server, copy, p.len, now);
+    calls_made += num_calls;
+    free(copy);
+  }
+  printf("%ld packets: %lu messages, %lu bundles, %lu malformed, %lu unmatched, %ld methods called\n",
+         packets, (unsigned long)server.rx_messages, (unsigned long)server.rx_bundles,
+         (unsigned long)server.rx_errors, (unsigned long)server.rx_unmatched, calls_made);
+  CHECK(server.rx_packets == (uint32_t)packets, "every packet counted");
+  CHECK(calls_made > 0 && server.rx_errors > 0, "both good & bad packets seen");
+}
+
+int main(int argc, char **argv) {
+  long packets = 100000;
+
+  if (check_args(argc, argv, &packets, "check_osc [-n packets] [-s seed]") != 0) {
+    return 2;
+  }
+
+  check_trie(packets);
+  check_vectors();
+  random_packets(packets);
+  return check_result();
+}
@@ -0,0 +1,748 @@
+/*
+ * check_rtpmidi.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Checks RTP-MIDI (rtpmidi.h) & the IP stack under it (net.h) with two
+ * of them, A & B, on a simulated Ethernet between them: frames arrive
+ * in order after a random latency, and some may be dropped. Each has
+ * its own clock, started at a different time.
+ *
+ * - A invites B: the first invitation goes out as an ARP request, and
+ *   the session opens on a later one. Clock synchronization must then
+ *   find the difference between their clocks.
+ * - Random MIDI both ways, with nothing lost: what arrives must be
+ *   what was sent, in order, with its timestamp mapped to the
+ *   receiver's clock.
+ * - Random channel messages both ways with packets lost: once the
+ *   last packets get through, each receiver must have recovered the
+ *   state of the notes, controllers, programs & pitch wheels sent.
+ * - A packet built by hand from RFC 6295's examples: running status,
+ *   delta times, a SysEx in two segments and real-time.
+ * - Zero copy, with a third interface on a pool of buffers (pktbuf.h)
+ *   as ethif.c uses: a ping is answered in its own buffer, a UDP
+ *   handler keeps its datagram's, and every buffer comes back.
+ *
+ * Usage: check_rtpmidi [-n messages] [-l loss %] [-s seed]
+ *
+ * References:
+ * - RFC 6295: RTP Payload Format for MIDI
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "midi.h"
+#include "net.h"
+#include "rtpmidi.h"
+#include "pktbuf.h"
+#include "check.h"
+
+// The Ethernet //////////////////////////////////////////////////////////////
+
+#define WIRE_FRAMES 256 // Power of 2
+#define LATENCY_MIN_US 100
+#define LATENCY_MAX_US 500
+
+typedef struct {
+  uint8_t frame[NET_MAX_FRAME];
+  size_t len;
+  uint32_t at; // When it arrives
+} wire_frame;
+
+/* Frames in flight to one node */
+typedef struct {
+  wire_frame frames[WIRE_FRAMES];
+  uint32_t head, tail;
+} wire;
+
+typedef struct node node;
+
+#define MAX_EXPECTED 4096 // Power of 2
+
+typedef struct {
+  midi_message msg;
+  uint8_t sysex[MIDI_SYSEX_MAX];
+  uint32_t sent; // Absolute time
+} expected;
+
+/* What a stream of channel messages leaves each channel at */
+typedef struct {
+  uint8_t velocity[16][128];
+  int16_t control[16][120]; // -1 if never set
+  int16_t program[16];
+  int32_t pitch[16];
+} channel_state;
+
+struct node {
+  const char *name;
+  uint32_t base;    // Its clock less absolute time
+  net_if net;
+  rtpmidi session;
+  uint8_t tx_buff[NET_MAX_FRAME];
+  uint8_t tx_busy;
+  wire *out;        // To the other node
+  node *peer;
+
+  channel_state sent;     // By this node
+  channel_state received; // From the other
+  expected expect[MAX_EXPECTED]; // Sent, not yet received by the other
+  uint32_t expect_head, expect_tail;
+  long received_count;
+};
+
+static wire to_a, to_b;
+static node a, b;
+static uint32_t t;       // Absolute time, us
+static int loss_percent; // Of frames, while lossy
+static int lossy;
+static int checking_order;
+static long dropped;
+
+static uint8_t *tx_alloc(void *ctx) {
+  node *n = ctx;
+
+  if (n->tx_busy) {
+    return NULL;
+  }
+  n->tx_busy = 1;
+  return n->tx_buff;
+}
+
+static void tx_send(void *ctx, uint8_t *frame, size_t len) {
+  node *n = ctx;
+  wire *w = n->out;
+  wire_frame *f;
+  uint32_t at = t + LATENCY_MIN_US + rnd() % (LATENCY_MAX_US - LATENCY_MIN_US);
+
+  n->tx_busy = 0;
+  CHECK(len <= NET_MAX_FRAME, "%s sent a frame of %zu bytes", n->name, len);
+  if (lossy && (int)(rnd() % 100) < loss_percent) {
+    dropped++;
+    return;
+  }
+  if (w->head - w->tail == WIRE_FRAMES) {
+    CHECK(0, "the wire to %s is full", n->peer->name);
+    return;
+  }
+  // In order: never before the last
+  if (w->head != w->tail && (int32_t)(at - w->frames[(w->head - 1) & (WIRE_FRAMES - 1)].at) < 0) {
+    at = w->frames[(w->head - 1) & (WIRE_FRAMES - 1)].at;
+  }
+  f = &w->frames[w->head & (WIRE_FRAMES - 1)];
+  memcpy(f->frame, frame, len);
+  f->len = len;
+  f->at = at;
+  w->head++;
+}
+
+static uint32_t now_of(const node *n) {
+  return t + n->base;
+}
+
+/** Delivers the frames that have arrived by now. */
+static void wire_deliver(wire *w, node *to) {
+  while (w->head != w->tail && (int32_t)(t - w->frames[w->tail & (WIRE_FRAMES - 1)].at) >= 0) {
+    wire_frame *f = &w->frames[w->tail & (WIRE_FRAMES - 1)];
+    net_input(&to->net, f->frame, f->len, now_of(to));
+    w->tail++;
+  }
+}
+
+// MIDI //////////////////////////////////////////////////////////////////////
+
+static void state_init(channel_state *cs) {
+  memset(cs->velocity, 0, sizeof(cs->velocity));
+  for (int ch = 0; ch < 16; ch++) {
+    for (int c = 0; c < 120; c++) {
+      cs->control[ch][c] = -1;
+    }
+    cs->program[ch] = -1;
+    cs->pitch[ch] = -1;
+  }
+}
+
+static void state_apply(channel_state *cs, const midi_message *mm) {
+  uint8_t ch = mm->channel & 0x0F;
+
+  if (mm->type < 0x80) {
+    if (mm->type == MIDI_MODE_ALL_NOTES_OFF || mm->type == MIDI_MODE_ALL_SOUND_OFF) {
+      memset(cs->velocity[ch], 0, sizeof(cs->velocity[ch]));
+    }
+    return;
+  }
+  switch (mm->type & 0xF0) {
+  case MIDI_NOTE_ON:
+    cs->velocity[ch][mm->note] = mm->velocity;
+    break;
+  case MIDI_NOTE_OFF:
+    cs->velocity[ch][mm->note] = 0;
+    break;
+  case 0xB0:
+    cs->control[ch][mm->control] = mm->cc_value;
+    break;
+  case 0xC0:
+    cs->program[ch] = mm->program;
+    break;
+  case 0xE0:
+    cs->pitch[ch] = MIDI_14bits(mm);
+    break;
+  }
+}
+
+static int same_message(const midi_message *x, const midi_message *y) {
+  if (x->type != y->type) {
+    return 0;
+  }
+  if (x->type < 0xF0) {
+    return x->channel == y->channel && x->data1 == y->data1 &&
+           ((x->type & 0xF0) == 0xC0 || (x->type & 0xF0) == 0xD0 || x->data2 == y->data2);
+  }
+  switch (x->type) {
+  case MIDI_SYSEX:
+  case MIDI_SONG_POSITION:
+  case MIDI_TIME_CODE_QF:
+    return x->data1 == y->data1 && x->data2 == y->data2;
+  case MIDI_SONG_SELECT:
+    return x->data1 == y->data1;
+  }
+  return 1;
+}
+
+#define CHANNELS   4  // Used, to keep the journals to a packet
+#define CONTROLS   32
+#define MAX_ON     24 // Notes on in a channel
+
+/** A random message as midi_stream_receive() would give it; with_system
+ * adds SysEx, system common & real-time to the channel messages.
+ */
+static void random_message(const channel_state *cs, midi_message *mm, uint8_t *sysex,
+                           int with_system) {
+  uint32_t r = rnd() % 100;
+  uint8_t ch = rnd() % CHANNELS;
+  int on = 0;
+
+  memset(mm, 0, sizeof(*mm));
+  for (int n = 0; n < 128; n++) {
+    on += cs->velocity[ch][n] != 0;
+  }
+  mm->channel = ch;
+  if (with_system && r >= 90) {
+    switch (r % 5) {
+    case 0:
+    case 1:
+      mm->type = MIDI_SYSEX;
+      mm->data1 = rnd() % (MIDI_SYSEX_MAX + 1);
+      for (int i = 0; i < mm->data1; i++) {
+        sysex[i] = rnd() & 0x7F;
+      }
+      break;
+    case 2:
+      mm->type = MIDI_SONG_POSITION;
+      mm->lsb = rnd() & 0x7F;
+      mm->msb = rnd() & 0x7F;
+      break;
+    case 3:
+      mm->type = MIDI_RT_TIMING_CLOCK;
+      break;
+    default:
+      mm->type = MIDI_SONG_SELECT;
+      mm->data1 = rnd() & 0x7F;
+      break;
+    }
+    mm->channel = 0;
+  } else if (r < 40 && on < MAX_ON) {
+    mm->type = MIDI_NOTE_ON | ch;
+    mm->note = rnd() & 0x7F;
+    mm->velocity = 1 + rnd() % 127;
+  } else if (r < 70 && on > 0) {
+    int k = rnd() % on;
+    mm->type = MIDI_NOTE_OFF | ch;
+    for (int n = 0; n < 128; n++) {
+      if (cs->velocity[ch][n] && k-- == 0) {
+        mm->note = n;
+        break;
+      }
+    }
+    mm->velocity = rnd() & 0x7F;
+  } else if (r < 85) {
+    mm->type = 0xB0 | ch;
+    mm->control = rnd() % CONTROLS;
+    mm->cc_value = rnd() & 0x7F;
+  } else if (r < 89) {
+    mm->type = 0xE0 | ch;
+    mm->lsb = rnd() & 0x7F;
+    mm->msb = rnd() & 0x7F;
+  } else if (r == 89 && rnd() % 8 == 0) {
+    mm->type = MIDI_MODE_ALL_NOTES_OFF;
+  } else {
+    mm->type = 0xC0 | ch;
+    mm->program = rnd() & 0x7F;
+  }
+}
+
+static void deliver(void *ctx, const midi_message *mm, const uint8_t *sysex) {
+  node *n = ctx;        // The receiver
+  node *from = n->peer; // ... of what this sent
+
+  n->received_count++;
+  state_apply(&n->received, mm);
+  CHECK(mm->port == 9, "port %u", mm->port);
+  if (!checking_order) {
+    return;
+  }
+
+  if (from->expect_head == from->expect_tail) {
+    CHECK(0, "%s received type %02X, but nothing was sent", n->name, mm->type);
+    return;
+  }
+  expected *e = &from->expect[from->expect_tail++ & (MAX_EXPECTED - 1)];
+  CHECK(same_message(mm, &e->msg), "%s received type %02X data %02X %02X, sent type %02X "
+        "data %02X %02X", n->name, mm->type, mm->data1, mm->data2, e->msg.type, e->msg.data1,
+        e->msg.data2);
+  if (mm->type == MIDI_SYSEX && e->msg.type == MIDI_SYSEX) {
+    CHECK(memcmp(sysex, e->sysex, mm->data1) == 0, "%s received a different SysEx", n->name);
+  }
+  // The sender's time, less the synchronization's error & the ticks'
+  int32_t error = (int32_t)(mm->timestamp - (e->sent + n->base));
+  CHECK(error > -400 && error < 400, "%s received type %02X stamped %ld us off", n->name,
+        mm->type, (long)error);
+  if (failures > 10) {
+    exit(1);
+  }
+}
+
+static void node_init(node *n, const char *name, uint8_t last, uint32_t base, wire *out,
+                      node *peer) {
+  const uint8_t mac[6] = { 0x02, 0, 0, 0, 0, last };
+  net_driver driver = { .tx_alloc = tx_alloc, .tx_send = tx_send, .ctx = n };
+
+  n->name = name;
+  n->base = base;
+  n->out = out;
+  n->peer = peer;
+  state_init(&n->sent);
+  state_init(&n->received);
+  net_init(&n->net, mac, NET_IP(10, 0, 0, last), NET_IP(255, 255, 255, 0), NET_IP(10, 0, 0, 1),
+           &driver);
+  rtpmidi_init(&n->session, &n->net, RTPMIDI_CONTROL_PORT, name, 0x1000 + last, 9, deliver, n,
+               now_of(n));
+  CHECK(rtpmidi_bind(&n->session), "%s: cannot bind", name);
+}
+
+/** Runs both nodes for us microseconds; each sends MIDI if it is to. */
+static void run(uint32_t us, long *to_send, int with_system) {
+  uint32_t end = t + us;
+
+  while ((int32_t)(t - end) < 0) {
+    node *nodes[2] = { &a, &b };
+    uint32_t step = 20 + rnd() % 100;
+
+    // Whole milliseconds & 100 ms pass on the way
+    if ((t + step) / 1000 != t / 1000) {
+      step = 1000 - t % 1000;
+    }
+    t += step;
+    wire_deliver(&to_a, &a);
+    wire_deliver(&to_b, &b);
+
+    for (int i = 0; i < 2; i++) {
+      node *n = nodes[i];
+      if (to_send != NULL && *to_send > 0 && rnd() % 4 == 0 &&
+          n->expect_head - n->expect_tail < MAX_EXPECTED) {
+        // Only expected in order while nothing is lost
+        expected *e = &n->expect[n->expect_head & (MAX_EXPECTED - 1)];
+        random_message(&n->sent, &e->msg, e->sysex, with_system);
+        e->msg.timestamp = now_of(n);
+        e->sent = t;
+        if (rtpmidi_send(&n->session, &e->msg, e->sysex, now_of(n))) {
+          state_apply(&n->sent, &e->msg);
+          n->expect_head += checking_order;
+          (*to_send)--;
+        } else {
+          CHECK(0, "%s could not send type %02X", n->name, e->msg.type);
+        }
+      }
+      if (t % 1000 == 0) {
+        rtpmidi_flush(&n->session, now_of(n));
+      }
+      if (t % 100000 == 0) {
+        rtpmidi_poll(&n->session, now_of(n));
+      }
+    }
+  }
+}
+
+// Checks ////////////////////////////////////////////////////////////////////
+
+static void check_session(void) {
+  net_endpoint peer = { .ip = b.net.ip, .port = RTPMIDI_CONTROL_PORT };
+  int64_t want;
+
+  CHECK(rtpmidi_invite(&a.session, &peer, now_of(&a)), "A cannot invite");
+  CHECK(!rtpmidi_invite(&a.session, &peer, now_of(&a)), "A invites twice");
+  run(100000, NULL, 0);
+  CHECK(a.net.tx_no_arp == 1, "A sent %lu ARP requests", (unsigned long)a.net.tx_no_arp);
+  CHECK(a.session.state == RTPMIDI_INVITING_CONTROL, "A is %s after an ARP request",
+        rtpmidi_state_name(a.session.state));
+  run(3000000, NULL, 0);
+  CHECK(a.session.state == RTPMIDI_OPEN && b.session.state == RTPMIDI_OPEN,
+        "A is %s, B %s", rtpmidi_state_name(a.session.state),
+        rtpmidi_state_name(b.session.state));
+  CHECK(strcmp(a.session.peer_name, "B") == 0 && strcmp(b.session.peer_name, "A") == 0,
+        "peers are named %s & %s", a.session.peer_name, b.session.peer_name);
+  CHECK(a.session.synced && b.session.synced, "clocks not synchronized");
+
+  // B's session clock started 123456 us before A's
+  want = 123456 / RTPMIDI_TICK_US;
+  CHECK(llabs(a.session.offset - want) <= 3 && llabs(b.session.offset + want) <= 3,
+        "offsets %lld & %lld, not %lld & %lld", (long long)a.session.offset,
+        (long long)b.session.offset, (long long)want, (long long)-want);
+  printf("session: offsets %lld & %lld ticks, round trip %lu us\n", (long long)a.session.offset,
+         (long long)b.session.offset, (unsigned long)a.session.rtt_us);
+
+  // Anyone else is turned away. C's frames go to B, and B's replies to
+  // A, which must ignore them; C knows B's address already.
+  static node c;
+  node_init(&c, "C", 3, 0, &to_b, &b);
+  c.net.arp[0].ip = b.net.ip;
+  memcpy(c.net.arp[0].mac, b.net.mac, sizeof(b.net.mac));
+  CHECK(rtpmidi_invite(&c.session, &peer, now_of(&c)), "C cannot invite");
+  wire_deliver(&to_b, &b);
+  t += LATENCY_MAX_US;
+  wire_deliver(&to_b, &b);
+  CHECK(b.session.state == RTPMIDI_OPEN && b.session.peer_ssrc == a.session.ssrc,
+        "B left A for C");
+  run(10000, NULL, 0);
+  CHECK(a.session.state == RTPMIDI_OPEN, "A is %s after B turned C away",
+        rtpmidi_state_name(a.session.state));
+}
+
+static void check_ordered(long messages) {
+  long to_send = messages;
+
+  checking_order = 1;
+  while (to_send > 0) {
+    run(100000, &to_send, 1);
+  }
+  run(100000, NULL, 0);
+  checking_order = 0;
+
+  for (node *n = &a; n != NULL; n = n == &a ? &b : NULL) {
+    CHECK(n->expect_head == n->expect_tail, "%lu sent by %s not received",
+          (unsigned long)(n->expect_head - n->expect_tail), n->name);
+    CHECK(n->session.rx_lost == 0 && n->session.rx_errors == 0 && n->session.rx_late == 0,
+          "%s: %lu lost, %lu errors, %lu late", n->name, (unsigned long)n->session.rx_lost,
+          (unsigned long)n->session.rx_errors, (unsigned long)n->session.rx_late);
+  }
+  printf("in order: %lu & %lu messages in %lu & %lu packets\n",
+         (unsigned long)a.session.tx_messages, (unsigned long)b.session.tx_messages,
+         (unsigned long)a.session.tx_packets, (unsigned long)b.session.tx_packets);
+}
+
+static void compare_state(const node *sender, const node *receiver) {
+  const channel_state *s = &sender->sent;
+  const channel_state *r = &receiver->received;
+
+  for (int ch = 0; ch < 16; ch++) {
+    for (int n = 0; n < 128; n++) {
+      CHECK(!s->velocity[ch][n] == !r->velocity[ch][n], "%s: channel %d note %d is %s, "
+            "at %s it is %s", sender->name, ch + 1, n, s->velocity[ch][n] ? "on" : "off",
+            receiver->name, r->velocity[ch][n] ? "on" : "off");
+    }
+    for (int c = 0; c < 120; c++) {
+      CHECK(s->control[ch][c] == r->control[ch][c], "%s: channel %d controller %d is %d, "
+            "at %s %d", sender->name, ch + 1, c, s->control[ch][c], receiver->name,
+            r->control[ch][c]);
+    }
+    CHECK(s->program[ch] == r->program[ch], "%s: channel %d program %d, at %s %d",
+          sender->name, ch + 1, s->program[ch], receiver->name, r->program[ch]);
+    CHECK(s->pitch[ch] == r->pitch[ch], "%s: channel %d pitch %ld, at %s %ld", sender->name,
+          ch + 1, (long)s->pitch[ch], receiver->name, (long)r->pitch[ch]);
+  }
+}
+
+static void check_recovery(long messages) {
+  long to_send = messages;
+  midi_message probe = { .type = MIDI_RT_ACTIVE_SENSE };
+
+  lossy = 1;
+  while (to_send > 0) {
+    run(100000, &to_send, 0);
+  }
+  run(100000, NULL, 0);
+  lossy = 0;
+  // A packet that gets through, with a journal of what did not
+  for (node *n = &a; n != NULL; n = n == &a ? &b : NULL) {
+    probe.timestamp = now_of(n);
+    rtpmidi_send(&n->session, &probe, NULL, now_of(n));
+  }
+  run(100000, NULL, 0);
+
+  compare_state(&a, &b);
+  compare_state(&b, &a);
+  for (node *n = &a; n != NULL; n = n == &a ? &b : NULL) {
+    CHECK(n->session.rx_unrecoverable == 0 && n->session.rx_errors == 0,
+          "%s: %lu losses unrecoverable, %lu errors", n->name,
+          (unsigned long)n->session.rx_unrecoverable, (unsigned long)n->session.rx_errors);
+    CHECK(n->session.journal_resets == 0, "%s: %lu journals too long", n->name,
+          (unsigned long)n->session.journal_resets);
+  }
+  CHECK(a.session.state == RTPMIDI_OPEN && b.session.state == RTPMIDI_OPEN,
+        "session lost to the losses");
+  printf("lossy: %ld frames dropped; %lu & %lu packets lost, %lu & %lu messages recovered\n",
+         dropped, (unsigned long)a.session.rx_lost, (unsigned long)b.session.rx_lost,
+         (unsigned long)a.session.rx_recovered, (unsigned long)b.session.rx_recovered);
+}
+
+static midi_message vector_got[8];
+static uint8_t vector_sysex[MIDI_SYSEX_MAX];
+static int vector_count;
+
+static void vector_deliver(void *ctx, const midi_message *mm, const uint8_t *sysex) {
+  if (vector_count < 8) {
+    vector_got[vector_count] = *mm;
+  }
+  if (sysex != NULL) {
+    memcpy(vector_sysex, sysex, mm->data1);
+  }
+  vector_count++;
+}
+
+/** A packet from A, built by hand, that B must parse. */
+static void check_vector(void) {
+  static const uint8_t commands[] = {
+    0x90, 0x3C, 0x40,       // Note on
+    0x00, 0x3E, 0x41,       // Delta 0, running status
+    0x81, 0x00, 0xB0, 0x07, 0x64, // Delta 128 ticks, controller 7
+    0x00, 0xF0, 0x01, 0x02, 0xF0, // First segment of a SysEx
+    0x00, 0xF7, 0x03, 0xF8, 0x04, 0xF7, // Last, with a clock in it
+  };
+  static const midi_message want[] = {
+    { .type = 0x90, .data1 = 0x3C, .data2 = 0x40 },
+    { .type = 0x90, .data1 = 0x3E, .data2 = 0x41 },
+    { .type = 0xB0, .data1 = 0x07, .data2 = 0x64 },
+    { .type = MIDI_RT_TIMING_CLOCK },
+    { .type = MIDI_SYSEX, .data1 = 4 },
+  };
+  static const uint8_t want_sysex[] = { 1, 2, 3, 4 };
+  net_endpoint to = { .ip = b.net.ip, .port = RTPMIDI_CONTROL_PORT + 1 };
+  uint8_t *p;
+  uint32_t ticks, expect_ts;
+
+  // 20 ms ago by A's session clock, brought up to now
+  rtpmidi_poll(&a.session, now_of(&a));
+  ticks = (uint32_t)(a.session.clock_us / RTPMIDI_TICK_US) - 200;
+  expect_ts = now_of(&b) - 20000;
+  b.session.deliver = vector_deliver;
+  p = net_udp_begin(&a.net);
+  p[0] = 0x80;
+  p[1] = 0x61;
+  p[2] = a.session.tx_seq >> 8;
+  p[3] = a.session.tx_seq;
+  p[4] = ticks >> 24;
+  p[5] = ticks >> 16;
+  p[6] = ticks >> 8;
+  p[7] = ticks;
+  p[8] = a.session.ssrc >> 24;
+  p[9] = a.session.ssrc >> 16;
+  p[10] = a.session.ssrc >> 8;
+  p[11] = a.session.ssrc;
+  p[12] = 0x80 | (sizeof(commands) >> 8); // B, no journal
+  p[13] = sizeof(commands);
+  memcpy(p + 14, commands, sizeof(commands));
+  CHECK(net_udp_send(&a.net, &to, RTPMIDI_CONTROL_PORT + 1, 14 + sizeof(commands)),
+        "A cannot send to B");
+  a.session.tx_seq++;
+  run(1000, NULL, 0);
+
+  CHECK(vector_count == 5, "%d messages from the vector", vector_count);
+  for (int i = 0; i < 5 && i < vector_count; i++) {
+    int32_t error;
+    CHECK(same_message(&vector_got[i], &want[i]), "vector message %d is type %02X data %02X "
+          "%02X", i, vector_got[i].type, vector_got[i].data1, vector_got[i].data2);
+    // As at their delta times (the session clock may be a tick out,
+    // and the packet took time to arrive)
+    error = (int32_t)(vector_got[i].timestamp - (expect_ts + (i >= 2 ? 12800 : 0)));
+    CHECK(error > -400 && error < 400 + LATENCY_MAX_US, "vector message %d stamped %ld us off",
+          i, (long)error);
+  }
+  CHECK(memcmp(vector_sysex, want_sysex, sizeof(want_sysex)) == 0, "vector SysEx differs");
+  b.session.deliver = deliver;
+}
+
+static void check_end(void) {
+  rtpmidi_end(&a.session);
+  CHECK(a.session.state == RTPMIDI_IDLE, "A is %s after ending",
+        rtpmidi_state_name(a.session.state));
+  run(10000, NULL, 0);
+  CHECK(b.session.state == RTPMIDI_IDLE, "B is %s after A ended",
+        rtpmidi_state_name(b.session.state));
+}
+
+// Zero copy //////////////////////////////////////////////////////////////////
+
+#define POOL_BUFFERS 4
+#define POOL_SIZE    1536
+
+static uint8_t pool_storage[POOL_BUFFERS][POOL_SIZE];
+static pktbuf_pool pool;
+static net_if pooled;
+static uint8_t *pool_sent;   // The last frame sent, and its length
+static size_t pool_sent_len;
+static const uint8_t *held;  // By the UDP handler
+
+static uint8_t *pool_tx_alloc(void *ctx) {
+  return pktbuf_alloc(&pool);
+}
+
+static void pool_tx_send(void *ctx, uint8_t *frame, size_t len) {
+  // Sent at once: look, then give back
+  pool_sent = frame;
+  pool_sent_len = len;
+  CHECK(frame[0] == 0x02 && frame[12] == 0x08 && frame[13] == 0x00, "sent a garbled frame");
+  pktbuf_release(&pool, frame);
+}
+
+static int pool_rx_hold(void *ctx, const uint8_t *p) {
+  return pktbuf_ref(&pool, p);
+}
+
+static void pool_rx_release(void *ctx, const uint8_t *p) {
+  pktbuf_release(&pool, p);
+}
+
+static void pool_udp(void *ctx, const net_endpoint *from, const uint8_t *data, size_t len,
+                     uint32_t now) {
+  CHECK(net_hold(&pooled, data), "cannot hold a datagram");
+  held = data;
+}
+
+/** Builds an IPv4 frame from 10.0.0.2 to the pooled interface in a
+ * buffer of the pool, with hlen bytes of IP header and the payload,
+ * whose checksum is at csum (if any). Returns its length.
+ */
+static size_t pool_frame(uint8_t *f, size_t hlen, uint8_t proto, const uint8_t *payload, size_t len,
+                         int csum) {
+  static const uint8_t peer_mac[6] = { 0x02, 0, 0, 0, 0, 2 };
+  uint8_t *ip = f + NET_ETH_HEADER;
+  uint16_t sum;
+
+  memcpy(f, pooled.mac, 6);
+  memcpy(f + 6, peer_mac, 6);
+  f[12] = 0x08;
+  f[13] = 0x00;
+  memset(ip, 0, hlen);
+  ip[0] = 0x40 | (hlen / 4);
+  ip[2] = (hlen + len) >> 8;
+  ip[3] = hlen + len;
+  ip[8] = 64;
+  ip[9] = proto;
+  ip[12] = 10;
+  ip[15] = 2;
+  ip[16] = pooled.ip >> 24;
+  ip[17] = pooled.ip >> 16;
+  ip[18] = pooled.ip >> 8;
+  ip[19] = pooled.ip;
+  if (hlen > NET_IP_HEADER) {
+    memset(ip + NET_IP_HEADER, 1, hlen - NET_IP_HEADER); // NOP options
+  }
+  sum = net_checksum(0, ip, hlen);
+  ip[10] = sum >> 8;
+  ip[11] = sum;
+  memcpy(ip + hlen, payload, len);
+  if (csum >= 0) {
+    sum = net_checksum(0, ip + hlen, len);
+    ip[hlen + csum] = sum >> 8;
+    ip[hlen + csum + 1] = sum;
+  }
+  return NET_ETH_HEADER + hlen + len;
+}
+
+static void check_buffers(void) {
+  static const uint8_t mac[6] = { 0x02, 0, 0, 0, 0, 3 };
+  static const uint8_t echo[] = { 8, 0, 0, 0, 0x12, 0x34, 0, 1, 'p', 'i', 'n', 'g' };
+  static const uint8_t udp[] = { 0x30, 0x39, 0x1F, 0x90, 0, 12, 0, 0, 'h', 'e', 'l', 'd' };
+  net_driver driver = {
+    .tx_alloc = pool_tx_alloc, .tx_send = pool_tx_send,
+    .rx_hold = pool_rx_hold, .rx_release = pool_rx_release,
+  };
+  uint8_t *f;
+  size_t len;
+
+  pktbuf_init(&pool, pool_storage[0], POOL_SIZE, POOL_BUFFERS);
+  net_init(&pooled, mac, NET_IP(10, 0, 0, 3), NET_IP(255, 255, 255, 0), 0, &driver);
+  net_udp_bind(&pooled, 8080, pool_udp, NULL);
+
+  // Answered where it lies
+  f = pktbuf_alloc(&pool);
+  len = pool_frame(f, NET_IP_HEADER, 1, echo, sizeof(echo), 2);
+  net_input(&pooled, f, len, 0);
+  pktbuf_release(&pool, f);
+  CHECK(pool_sent == f, "the echo reply was not sent from the request's buffer");
+  CHECK(pool_sent_len == len && f[NET_ETH_HEADER + NET_IP_HEADER] == 0 &&
+        memcmp(f + NET_ETH_HEADER + NET_IP_HEADER + 4, echo + 4, sizeof(echo) - 4) == 0 &&
+        net_checksum(0, f + NET_ETH_HEADER + NET_IP_HEADER, sizeof(echo)) == 0,
+        "bad echo reply");
+  CHECK(pool.free == POOL_BUFFERS, "%d buffers in use after a ping", POOL_BUFFERS - pool.free);
+
+  // With IP options, the reply cannot be made in place
+  f = pktbuf_alloc(&pool);
+  len = pool_frame(f, NET_IP_HEADER + 4, 1, echo, sizeof(echo), 2);
+  net_input(&pooled, f, len, 0);
+  pktbuf_release(&pool, f);
+  CHECK(pool_sent != f && pool_sent_len == NET_ETH_HEADER + NET_IP_HEADER + sizeof(echo),
+        "the echo reply with options was not copied");
+  CHECK(pool.free == POOL_BUFFERS, "%d buffers in use after a ping with options",
+        POOL_BUFFERS - pool.free);
+
+  // Kept by its handler until it lets go
+  f = pktbuf_alloc(&pool);
+  len = pool_frame(f, NET_IP_HEADER, 17, udp, sizeof(udp), -1);
+  net_input(&pooled, f, len, 0);
+  pktbuf_release(&pool, f);
+  CHECK(held != NULL && memcmp(held, "held", 4) == 0, "the datagram was not held");
+  CHECK(pool.free == POOL_BUFFERS - 1, "%d buffers in use while one is held",
+        POOL_BUFFERS - pool.free);
+  net_release(&pooled, held);
+  CHECK(pool.free == POOL_BUFFERS, "%d buffers in use after the datagram was let go",
+        POOL_BUFFERS - pool.free);
+
+  // Until none is left
+  while (pktbuf_alloc(&pool) != NULL) {
+  }
+  CHECK(pool.exhausted == 1 && pool.min_free == 0, "pool exhaustion not counted");
+  printf("zero copy: %lu buffers handed out, none lost\n", (unsigned long)pool.allocs);
+}
+
+int main(int argc, char **argv) {
+  long messages = 100000;
+
+  loss_percent = 10;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      loss_percent = atoi(argv[++i]);
+    } else if (!check_arg(argc, argv, &i, &messages)) {
+      fprintf(stderr, "usage: check_rtpmidi [-n messages] [-l loss %%] [-s seed]\n");
+      return 2;
+    }
+  }
+
+  // Clocks that wrap during the run, B's session started first
+  t = 1000000;
+  node_init(&b, "B", 2, 0xFFF00000U, &to_a, &a);
+  t += 123456;
+  node_init(&a, "A", 1, 0x12345678U, &to_b, &b);
+
+  check_session();
+  check_ordered(messages);
+  check_recovery(messages);
+  check_vector();
+  check_end();
+  check_buffers();
+  return check_result();
+}
@@ -0,0 +1,345 @@
+/*
+ * check_sched.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Checks the main loop scheduler (sched.h) on a clock the check moves
+ * by hand: worked examples of priority order, earliest deadline first,
+ * periodic release, deadline misses & budget overruns, across the
+ * clock's wrap, then many random task sets, posts & run times against
+ * a model of the same rules, task by task & statistic by statistic.
+ *
+ * Usage: check_sched [-n task sets] [-s seed]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sched.h"
+#include "check.h"
+
+// Clock & tasks /////////////////////////////////////////////////////////////
+
+static uint32_t now;
+
+static uint32_t clock_now(void) {
+  return now;
+}
+
+static sched_task tasks[SCHED_MAX_TASKS + 1];
+
+// What the next task to run does: takes run_cost, posting post_during halfway
+static uint32_t run_cost;
+static uint32_t post_during;
+
+#define MAX_LOG 64
+static int ran[MAX_LOG];
+static int num_ran;
+
+static void task_ran(int n) {
+  if (num_ran < MAX_LOG) {
+    ran[num_ran++] = n;
+  }
+  now += run_cost / 2;
+  sched_post(post_during);
+  now += run_cost - run_cost / 2;
+}
+
+#define TASK_FN(n) static void run_##n(void) { task_ran(n); }
+TASK_FN(0) TASK_FN(1) TASK_FN(2) TASK_FN(3) TASK_FN(4) TASK_FN(5) TASK_FN(6) TASK_FN(7)
+TASK_FN(8) TASK_FN(9) TASK_FN(10) TASK_FN(11) TASK_FN(12) TASK_FN(13) TASK_FN(14) TASK_FN(15)
+TASK_FN(16)
+
+static void (*const run_fns[SCHED_MAX_TASKS + 1])(void) = {
+  run_0, run_1, run_2, run_3, run_4, run_5, run_6, run_7,
+  run_8, run_9, run_10, run_11, run_12, run_13, run_14, run_15, run_16
+};
+
+/** Task n, configured, not yet added. */
+static sched_task *task(int n, sched_priority priority, uint32_t events, uint32_t period,
+                        uint32_t deadline, uint32_t budget) {
+  sched_task *t = &tasks[n];
+
+  memset(t, 0, sizeof(*t));
+  t->name = "task";
+  t->run = run_fns[n];
+  t->priority = priority;
+  t->events = events;
+  t->period = period;
+  t->deadline = deadline;
+  t->budget = budget;
+  return t;
+}
+
+/** Runs ready tasks until none is, each taking cost. */
+static void run_all(uint32_t cost) {
+  run_cost = cost;
+  post_during = 0;
+  num_ran = 0;
+  while (num_ran < MAX_LOG && sched_run_one()) {
+  }
+}
+
+// Worked examples ///////////////////////////////////////////////////////////
+
+static void check_examples(void) {
+  // Priority before deadline: the UI task, then earliest deadline first
+  now = 0xFFFFFF00; // Wrapping as it goes
+  sched_init(clock_now);
+  sched_add(task(0, SCHED_PRIO_BACKGROUND, 1, 0, 100, 0));
+  sched_add(task(1, SCHED_PRIO_BACKGROUND, 2, 0, 0, 0));
+  sched_add(task(2, SCHED_PRIO_UI, 4, 0, 0, 0));
+  sched_add(task(3, SCHED_PRIO_BACKGROUND, 8, 0, 50, 0));
+  sched_add(task(4, SCHED_PRIO_BACKGROUND, 16, 0, 0, 0));
+  CHECK(sched_num_tasks() == 5 && sched_get_task(2) == &tasks[2] && sched_get_task(5) == NULL,
+        "examples: tasks");
+  CHECK(sched_run_one() == 0, "examples: none ready");
+  sched_post(16 | 2); // Neither has a deadline: first ready, then first added
+  sched_post(1);
+  now += 10;
+  sched_post(8 | 4); // 3's deadline is 0xFFFFFF0A + 50, before 0's
+  run_all(20);
+  CHECK(num_ran == 5 && ran[0] == 2 && ran[1] == 3 && ran[2] == 0 && ran[3] == 1 && ran[4] == 4,
+        "examples: order %d %d %d %d %d", ran[0], ran[1], ran[2], ran[3], ran[4]);
+  // 3 finished 40 after it was ready, 0 70 after, 4 110 after
+  CHECK(tasks[0].max_response == 70 && tasks[3].max_response == 40 &&
+        tasks[4].max_response == 110 && tasks[0].deadline_misses == 0 &&
+        tasks[3].deadline_misses == 0, "examples: responses");
+
+  // Deadline misses: behind a 60 long UI task, 3 finishes 80 after it was ready
+  sched_post(4 | 8 | 1);
+  run_cost = 60;
+  num_ran = 0;
+  CHECK(sched_run_one() == 1 && ran[0] == 2, "examples: UI first");
+  run_cost = 20;
+  sched_run_one();
+  sched_run_one();
+  CHECK(tasks[3].deadline_misses == 1 && tasks[3].max_response == 80,
+        "examples: 3 missed its deadline, %lu", (unsigned long)tasks[3].max_response);
+  CHECK(tasks[0].deadline_misses == 0 && tasks[0].max_response == 100,
+        "examples: 0 made its deadline exactly");
+
+  // Posting to a ready task keeps when it became ready
+  sched_post(1);
+  now += 200;
+  sched_post(1);
+  run_all(0);
+  CHECK(num_ran == 1 && tasks[0].deadline_misses == 1 && tasks[0].max_response == 200,
+        "examples: ready time kept");
+
+  // Posting its own event while it runs makes it ready again
+  sched_post(1);
+  run_cost = 10;
+  post_during = 1;
+  num_ran = 0;
+  CHECK(sched_run_one() == 1 && tasks[0].ready == 1, "examples: ready again");
+  post_during = 0;
+  CHECK(sched_run_one() == 1 && tasks[0].ready == 0 && tasks[0].max_response == 200,
+        "examples: ran again");
+
+  // Budgets: overrun only when longer
+  sched_reset_stats();
+  CHECK(tasks[0].runs == 0 && tasks[0].deadline_misses == 0 && tasks[0].max_response == 0,
+        "examples: reset");
+  sched_init(clock_now);
+  sched_add(task(0, SCHED_PRIO_UI, 1, 0, 0, 20));
+  sched_post(1);
+  run_all(20);
+  sched_post(1);
+  run_all(21);
+  CHECK(tasks[0].runs == 2 && tasks[0].budget_overruns == 1 && tasks[0].max_run == 21,
+        "examples: budget");
+
+  // Periodic: first due a period after being added; too far behind, it skips
+  now = 0xFFFFF000;
+  sched_init(clock_now);
+  sched_add(task(0, SCHED_PRIO_BACKGROUND, 0, 1000, 100, 0));
+  now += 999;
+  CHECK(sched_run_one() == 0, "periodic: not yet");
+  now += 1;
+  run_all(5);
+  CHECK(num_ran == 1 && tasks[0].max_response == 5, "periodic: on time");
+  now += 2500; // 1505 after it was next due
+  run_all(5);
+  CHECK(num_ran == 1 && tasks[0].deadline_misses == 1 && tasks[0].max_response == 1510,
+        "periodic: late, response %lu", (unsigned long)tasks[0].max_response);
+  CHECK(tasks[0].next_release == now - 5 + 1000, "periodic: skipped ahead");
+  now += 1000 - 5;
+  run_all(5);
+  CHECK(num_ran == 1 && tasks[0].runs == 3 && tasks[0].deadline_misses == 1,
+        "periodic: back on time");
+
+  // Full
+  sched_init(clock_now);
+  for (int i = 0; i < SCHED_MAX_TASKS; i++) {
+    CHECK(sched_add(task(i, SCHED_PRIO_UI, 1, 0, 0, 0)) == 1, "full: add %d", i);
+  }
+  CHECK(sched_add(task(SCHED_MAX_TASKS, SCHED_PRIO_UI, 1, 0, 0, 0)) == 0, "full: one too many");
+}
+
+// Model /////////////////////////////////////////////////////////////////////
+
+/** The scheduling rules of sched.h, written out again. */
+typedef struct {
+  sched_priority priority;
+  uint32_t events, period, deadline, budget;
+  int ready;
+  uint32_t ready_time, next_release;
+  uint32_t runs, deadline_misses, budget_overruns, max_run, max_response;
+} model_task;
+
+static model_task model[SCHED_MAX_TASKS];
+static int model_tasks;
+
+static void model_post(uint32_t events, uint32_t at) {
+  for (int i = 0; i < model_tasks; i++) {
+    if ((model[i].events & events) && !model[i].ready) {
+      model[i].ready = 1;
+      model[i].ready_time = at;
+    }
+  }
+}
+
+/** Is a to be chosen over b? Relative to now, times need not wrap. */
+static int model_before(const model_task *a, const model_task *b) {
+  int64_t a_due = (int32_t)(a->ready_time + a->deadline - now);
+  int64_t b_due = (int32_t)(b->ready_time + b->deadline - now);
+
+  if (a->priority != b->priority) {
+    return a->priority < b->priority;
+  }
+  if ((a->deadline == 0) != (b->deadline == 0)) {
+    return a->deadline != 0;
+  }
+  if (a->deadline != 0) {
+    return a_due < b_due;
+  }
+  return (int32_t)(a->ready_time - now) < (int32_t)(b->ready_time - now);
+}
+
+/** The task that should run next (after releasing periodic ones), or -1. */
+static int model_pick(void) {
+  int best = -1;
+
+  for (int i = 0; i < model_tasks; i++) {
+    model_task *t = &model[i];
+    if (t->period != 0 && (int32_t)(now - t->next_release) >= 0) {
+      if (!t->ready) {
+        t->ready = 1;
+        t->ready_time = t->next_release;
+      }
+      t->next_release += t->period;
+      if ((int32_t)(now - t->next_release) >= 0) {
+        t->next_release = now + t->period;
+      }
+    }
+  }
+  for (int i = 0; i < model_tasks; i++) {
+    if (model[i].ready && (best < 0 || model_before(&model[i], &model[best]))) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+static void model_ran(int n, uint32_t start, uint32_t end) {
+  model_task *t = &model[n];
+  uint32_t run = end - start;
+  uint32_t response = end - t->ready_time;
+
+  t->runs++;
+  if (run > t->max_run) {
+    t->max_run = run;
+  }
+  if (response > t->max_response) {
+    t->max_response = response;
+  }
+  t->budget_overruns += t->budget != 0 && run > t->budget;
+  t->deadline_misses += t->deadline != 0 && response > t->deadline;
+}
+
+// Random ////////////////////////////////////////////////////////////////////
+
+static void check_random(long sets) {
+  unsigned long total_runs = 0;
+  unsigned long total_misses = 0;
+  unsigned long total_overruns = 0;
+
+  for (long s = 0; s < sets; s++) {
+    now = rnd();
+    sched_init(clock_now);
+    model_tasks = 1 + rnd() % SCHED_MAX_TASKS;
+    for (int i = 0; i < model_tasks; i++) {
+      model_task *m = &model[i];
+      memset(m, 0, sizeof(*m));
+      m->priority = rnd() % 2 ? SCHED_PRIO_UI : SCHED_PRIO_BACKGROUND;
+      m->events = 1u << (rnd() % 8) | (rnd() % 4 == 0 ? 1u << (rnd() % 8) : 0);
+      m->period = rnd() % 2 ? 0 : 100 + rnd() % 5000;
+      m->deadline = rnd() % 3 == 0 ? 0 : 50 + rnd() % 3000;
+      m->budget = rnd() % 2 ? 0 : 10 + rnd() % 500;
+      m->next_release = now + m->period;
+      sched_add(task(i, m->priority, m->events, m->period, m->deadline, m->budget));
+    }
+
+    for (int step = 0; step < 2000; step++) {
+      if (rnd() % 4 == 0) {
+        now += rnd() % 2000;
+      }
+      if (rnd() % 2 == 0) {
+        uint32_t events = rnd() & 0xFF & rnd();
+        sched_post(events);
+        model_post(events, now);
+      }
+      run_cost = rnd() % 8 == 0 ? rnd() % 2000 : rnd() % 300;
+      post_during = rnd() % 8 == 0 ? 1u << (rnd() % 8) : 0;
+      num_ran = 0;
+
+      uint32_t start = now;
+      int expected = model_pick();
+      int n = sched_run_one();
+      if (expected < 0) {
+        CHECK(n == 0 && num_ran == 0, "random: set %ld step %d ran %d, none ready", s, step,
+              num_ran ? ran[0] : -1);
+        continue;
+      }
+      CHECK(n == 1 && num_ran == 1 && ran[0] == expected,
+            "random: set %ld step %d ran %d, not %d", s, step, num_ran ? ran[0] : -1, expected);
+      model[expected].ready = 0;
+      model_post(post_during, start + run_cost / 2);
+      model_ran(expected, start, now);
+    }
+
+    for (int i = 0; i < model_tasks; i++) {
+      const sched_task *t = &tasks[i];
+      const model_task *m = &model[i];
+      CHECK(t->runs == m->runs && t->deadline_misses == m->deadline_misses &&
+            t->budget_overruns == m->budget_overruns && t->max_run == m->max_run &&
+            t->max_response == m->max_response,
+            "random: set %ld task %d: runs %lu/%lu, misses %lu/%lu, overruns %lu/%lu", s, i,
+            (unsigned long)t->runs, (unsigned long)m->runs, (unsigned long)t->deadline_misses,
+            (unsigned long)m->deadline_misses, (unsigned long)t->budget_overruns,
+            (unsigned long)m->budget_overruns);
+      total_runs += m->runs;
+      total_misses += m->deadline_misses;
+      total_overruns += m->budget_overruns;
+    }
+  }
+  printf("%ld task sets: %lu runs, %lu deadline misses, %lu budget overruns\n", sets, total_runs,
+         total_misses, total_overruns);
+}
+
+int main(int argc, char **argv) {
+  long sets = 1000;
+
+  if (check_args(argc, argv, &sets, "check_sched [-n task sets] [-s seed]") != 0) {
+    return 2;
+  }
+
+  check_examples();
+  check_random(sets);
+  return check_result();
+}
@@ -0,0 +1,679 @@
+/*
+ * check_smf.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Checks the Standard MIDI File reader & writer (smf.h): worked
+ * examples of truncated & malformed tracks, then large random format 1
+ * files (up to 16 tracks, tempo changes, running status, SysEx, meta
+ * events, PPQ & SMPTE divisions, chunks of other types) whose events
+ * smf_next() must return in the order of a plain merge of the tracks
+ * on (tick, track), at the times the tempo map gives, then cut short &
+ * mutated, which must neither upset the sanitizers nor go on for ever.
+ * Last, random recordings by the writer are read back.
+ *
+ * Usage: check_smf [-n files] [-s seed]
+ *
+ * References:
+ * - Standard MIDI Files 1.0 (MIDI Manufacturers Association, 1996)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smf.h"
+#include "check.h"
+
+// Byte buffers //////////////////////////////////////////////////////////////
+
+typedef struct {
+  uint8_t *data;
+  size_t len;
+  size_t size;
+} bytes;
+
+static void put(bytes *b, uint8_t v) {
+  if (b->len == b->size) {
+    b->size = b->size ? b->size * 2 : 4096;
+    b->data = realloc(b->data, b->size);
+    if (b->data == NULL) {
+      perror("realloc");
+      exit(2);
+    }
+  }
+  b->data[b->len++] = v;
+}
+
+static void put32(bytes *b, uint32_t v) {
+  put(b, v >> 24);
+  put(b, v >> 16);
+  put(b, v >> 8);
+  put(b, v);
+}
+
+static void put_vlq(bytes *b, uint32_t v) {
+  uint8_t tmp[5];
+  int l = 0;
+
+  do {
+    tmp[l++] = v & 0x7F;
+    v >>= 7;
+  } while (v != 0);
+  while (l > 0) {
+    l--;
+    put(b, tmp[l] | (l > 0 ? 0x80 : 0));
+  }
+}
+
+static void put_chunk(bytes *file, const char *id, const bytes *body) {
+  for (int i = 0; i < 4; i++) {
+    put(file, id[i]);
+  }
+  put32(file, body->len);
+  for (size_t i = 0; i < body->len; i++) {
+    put(file, body->data[i]);
+  }
+}
+
+static void put_header(bytes *file, uint16_t format, uint16_t tracks, uint16_t division) {
+  bytes h = { 0 };
+
+  put(&h, format >> 8);
+  put(&h, format);
+  put(&h, tracks >> 8);
+  put(&h, tracks);
+  put(&h, division >> 8);
+  put(&h, division);
+  put_chunk(file, "MThd", &h);
+  free(h.data);
+}
+
+/** A copy of exactly len bytes, so the sanitizer sees any read past it. */
+static uint8_t *exact_copy(const uint8_t *data, size_t len) {
+  uint8_t *p = malloc(len ? len : 1);
+
+  memcpy(p, data, len);
+  return p;
+}
+
+// Worked examples ///////////////////////////////////////////////////////////
+
+/** A format 0 file of one track of the given bytes, opened. */
+static int open_track(smf_reader *r, bytes *file, const uint8_t *track, size_t len) {
+  bytes t = { 0 };
+
+  file->len = 0;
+  for (size_t i = 0; i < len; i++) {
+    put(&t, track[i]);
+  }
+  put_header(file, 0, 1, 96);
+  put_chunk(file, "MTrk", &t);
+  free(t.data);
+  return smf_open(r, file->data, file->len);
+}
+
+static void check_vectors(void) {
+  static smf_reader r;
+  bytes file = { 0 };
+  smf_event ev;
+
+  // A track may end with its chunk, without an end of track event
+  static const uint8_t no_end[] = { 0x00, 0x90, 0x3C, 0x40, 0x60, 0x3C, 0x00 };
+  CHECK(open_track(&r, &file, no_end, sizeof(no_end)) == 0, "no end: open");
+  CHECK(smf_next(&r, &ev) == 1 && ev.kind == SMF_EVENT_MIDI && ev.msg.type == 0x90 &&
+        ev.msg.note == 0x3C && ev.msg.velocity == 0x40 && ev.tick == 0, "no end: note on");
+  CHECK(smf_next(&r, &ev) == 1 && ev.msg.type == 0x80 && ev.tick == 0x60 &&
+        ev.time_us == 500000, "no end: running status note off at a beat");
+  CHECK(smf_next(&r, &ev) == 0, "no end: the end");
+
+  // A delta time cut off by the end of its chunk
+  static const uint8_t cut_delta[] = { 0x00, 0x90, 0x3C, 0x40, 0x81 };
+  CHECK(open_track(&r, &file, cut_delta, sizeof(cut_delta)) == 0, "cut delta: open");
+  CHECK(smf_next(&r, &ev) == 1 && ev.kind == SMF_EVENT_MIDI, "cut delta: the event before");
+  CHECK(smf_next(&r, &ev) == SMF_ERR_TRUNCATED, "cut delta: truncated");
+
+  static const uint8_t only_cut_delta[] = { 0x83, 0xFF };
+  CHECK(open_track(&r, &file, only_cut_delta, sizeof(only_cut_delta)) == 0, "only cut delta: open");
+  CHECK(smf_next(&r, &ev) == SMF_ERR_TRUNCATED, "only cut delta: truncated");
+
+  // Longer than the 4 bytes a variable length quantity may have
+  static const uint8_t long_delta[] = { 0x80, 0x80, 0x80, 0x80, 0x00, 0x90, 0x3C, 0x40 };
+  CHECK(open_track(&r, &file, long_delta, sizeof(long_delta)) == 0, "long delta: open");
+  CHECK(smf_next(&r, &ev) == SMF_ERR_TRUNCATED, "long delta: rejected");
+
+  // Events cut off by the end of the chunk
+  static const uint8_t cut_note[] = { 0x00, 0x90, 0x3C };
+  CHECK(open_track(&r, &file, cut_note, sizeof(cut_note)) == 0, "cut note: open");
+  CHECK(smf_next(&r, &ev) == SMF_ERR_TRUNCATED, "cut note: truncated");
+
+  static const uint8_t cut_sysex[] = { 0x00, 0xF0, 0x05, 0x7E, 0x7F, 0xF7 };
+  CHECK(open_track(&r, &file, cut_sysex, sizeof(cut_sysex)) == 0, "cut SysEx: open");
+  CHECK(smf_next(&r, &ev) == SMF_ERR_TRUNCATED, "cut SysEx: truncated");
+
+  // A data byte with no running status, & one after a meta event
+  static const uint8_t no_status[] = { 0x00, 0x3C, 0x40 };
+  CHECK(open_track(&r, &file, no_status, sizeof(no_status)) == 0, "no status: open");
+  CHECK(smf_next(&r, &ev) == SMF_ERR_EVENT, "no status: rejected");
+
+  static const uint8_t meta_cancels[] = { 0x00, 0x90, 0x3C, 0x40, 0x00, 0xFF, 0x01, 0x00,
+                                          0x00, 0x3C, 0x00 };
+  CHECK(open_track(&r, &file, meta_cancels, sizeof(meta_cancels)) == 0, "meta cancels: open");
+  CHECK(smf_next(&r, &ev) == 1 && smf_next(&r, &ev) == 1 && ev.kind == SMF_EVENT_META,
+        "meta cancels: note & text");
+  CHECK(smf_next(&r, &ev) == SMF_ERR_EVENT, "meta cancels: running status gone");
+
+  // Tempo: 96 ticks a beat at 120 BPM, then 60 BPM from tick 96
+  static const uint8_t tempo[] = { 0x60, 0xFF, 0x51, 0x03, 0x0F, 0x42, 0x40,
+                                   0x60, 0xC0, 0x05, 0x00, 0xFF, 0x2F, 0x00 };
+  CHECK(open_track(&r, &file, tempo, sizeof(tempo)) == 0, "tempo: open");
+  CHECK(smf_next(&r, &ev) == 1 && ev.kind == SMF_EVENT_META && ev.status == SMF_META_TEMPO &&
+        ev.time_us == 500000, "tempo: change at a beat");
+  CHECK(smf_next(&r, &ev) == 1 && ev.msg.type == 0xC0 && ev.msg.program == 5 &&
+        ev.time_us == 1500000, "tempo: a beat later at 60 BPM, %llu", (unsigned long long)ev.time_us);
+  CHECK(smf_next(&r, &ev) == 1 && ev.status == SMF_META_END_OF_TRACK, "tempo: end of track");
+  CHECK(smf_next(&r, &ev) == 0, "tempo: the end");
+
+  // Headers
+  file.len = 0;
+  put_header(&file, 2, 1, 96);
+  CHECK(smf_open(&r, file.data, file.len) == SMF_ERR_FORMAT, "format 2");
+  file.len = 0;
+  put_header(&file, 1, SMF_MAX_TRACKS + 1, 96);
+  CHECK(smf_open(&r, file.data, file.len) == SMF_ERR_TRACKS, "too many tracks");
+  file.len = 0;
+  put_header(&file, 1, 2, 96);
+  CHECK(smf_open(&r, file.data, file.len) == SMF_ERR_TRUNCATED, "missing tracks");
+  CHECK(smf_open(&r, file.data, 10) == SMF_ERR_HEADER, "short header");
+
+  free(file.data);
+}
+
+// Random files //////////////////////////////////////////////////////////////
+
+typedef struct {
+  uint32_t tick;
+  uint8_t track;
+  uint32_t seq;     // Within its track
+  uint8_t kind;     // SMF_EVENT_
+  uint8_t status;
+  uint32_t offset;  // Of its data in the track, then in the file
+  uint32_t len;
+  uint32_t tempo;   // Set by a tempo event, else 0
+} ref_event;
+
+typedef struct {
+  ref_event *events;
+  size_t len;
+  size_t size;
+} ref_list;
+
+static void add_ref(ref_list *l, const ref_event *e) {
+  if (l->len == l->size) {
+    l->size = l->size ? l->size * 2 : 4096;
+    l->events = realloc(l->events, l->size * sizeof(ref_event));
+    if (l->events == NULL) {
+      perror("realloc");
+      exit(2);
+    }
+  }
+  l->events[l->len++] = *e;
+}
+
+static int ref_order(const void *a, const void *b) {
+  const ref_event *x = a;
+  const ref_event *y = b;
+
+  if (x->tick != y->tick) {
+    return x->tick < y->tick ? -1 : 1;
+  }
+  if (x->track != y->track) {
+    return x->track < y->track ? -1 : 1;
+  }
+  return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static uint32_t random_delta(void) {
+  uint32_t r = rnd() % 1024;
+
+  if (r < 256) {
+    return 0;
+  } else if (r < 896) {
+    return rnd() % 128;
+  } else if (r < 1023) {
+    return rnd() % 16384;
+  }
+  return rnd() % (1 << 20);
+}
+
+/** A track of events ending at the last, with or without an end of
+ * track event, adding what smf_next() should return to refs.
+ */
+static void random_track(bytes *t, ref_list *refs, uint8_t track, long events) {
+  uint32_t tick = 0;
+  uint8_t running = 0;
+  ref_event e;
+
+  for (long i = 0; i < events; i++) {
+    uint32_t delta = random_delta();
+    uint32_t r = rnd() % 100;
+
+    tick += delta;
+    put_vlq(t, delta);
+    memset(&e, 0, sizeof(e));
+    e.tick = tick;
+    e.track = track;
+    e.seq = (uint32_t)i;
+
+    if (r < 80) {
+      // Channel message, under running status three times in four
+      uint8_t status = 0x80 | (rnd() % 7) << 4 | (rnd() % 16);
+      int n = ((status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0) ? 1 : 2;
+      if (status != running || rnd() % 4 == 0) {
+        put(t, status);
+      }
+      running = status;
+      e.kind = SMF_EVENT_MIDI;
+      e.status = status;
+      e.offset = t->len;
+      e.len = n;
+      for (int k = 0; k < n; k++) {
+        put(t, rnd() % 128);
+      }
+    } else if (r < 86) {
+      // SysEx, or an escape, which need not end in F7
+      uint32_t len = rnd() % 8 == 0 ? rnd() % 4000 : rnd() % 40;
+      e.kind = SMF_EVENT_SYSEX;
+      e.status = rnd() % 4 == 0 ? MIDI_EOX : MIDI_SYSEX;
+      put(t, e.status);
+      put_vlq(t, len);
+      e.offset = t->len;
+      e.len = len;
+      for (uint32_t k = 0; k < len; k++) {
+        put(t, k + 1 == len && e.status == MIDI_SYSEX ? MIDI_EOX : rnd() % 128);
+      }
+      running = 0;
+    } else {
+      // Meta: tempo in the first track, text & others anywhere
+      uint32_t len;
+      e.kind = SMF_EVENT_META;
+      if (track == 0 && r < 94) {
+        e.status = SMF_META_TEMPO;
+        e.tempo = 100000 + rnd() % 1900000;
+        len = 3;
+      } else {
+        static const uint8_t types[] = { 0x01, 0x03, 0x06, 0x20, 0x58, 0x59, 0x7F };
+        e.status = types[rnd() % sizeof(types)];
+        len = rnd() % 64;
+      }
+      put(t, 0xFF);
+      put(t, e.status);
+      put_vlq(t, len);
+      e.offset = t->len;
+      e.len = len;
+      for (uint32_t k = 0; k < len; k++) {
+        put(t, e.tempo ? e.tempo >> (16 - 8 * k) : rnd());
+      }
+      running = 0;
+    }
+    add_ref(refs, &e);
+  }
+
+  if (rnd() % 8 != 0) {
+    uint32_t delta = random_delta();
+    memset(&e, 0, sizeof(e));
+    put_vlq(t, delta);
+    e.tick = tick + delta;
+    e.track = track;
+    e.seq = (uint32_t)events;
+    e.kind = SMF_EVENT_META;
+    e.status = SMF_META_END_OF_TRACK;
+    put(t, 0xFF);
+    put(t, SMF_META_END_OF_TRACK);
+    put(t, 0);
+    e.offset = t->len;
+    add_ref(refs, &e);
+  }
+}
+
+/** The time of a tick from the tempo map up to it, exactly, in
+ * microseconds; the reader rounds down at each tempo change.
+ */
+typedef struct {
+  uint16_t division;
+  uint32_t tempo;
+  uint32_t tempo_tick;
+  uint64_t tempo_num; // Time of tempo_tick × the divisor
+  uint32_t changes;
+} ref_clock;
+
+static uint64_t ref_divisor(const ref_clock *c) {
+  if (c->division & 0x8000) {
+    uint32_t fps = (uint8_t)-(int8_t)(c->division >> 8);
+    uint32_t tpf = c->division & 0xFF;
+    return fps == 29 ? 30000ULL * tpf : (uint64_t)fps * tpf;
+  }
+  return c->division;
+}
+
+static uint64_t ref_num(const ref_clock *c, uint32_t tick) {
+  uint64_t ticks = tick - c->tempo_tick;
+
+  if (c->division & 0x8000) {
+    uint32_t fps = (uint8_t)-(int8_t)(c->division >> 8);
+    return c->tempo_num + ticks * (fps == 29 ? 1001000000ULL : 1000000ULL);
+  }
+  return c->tempo_num + ticks * c->tempo;
+}
+
+static uint16_t random_division(void) {
+  if (rnd() % 8 == 0) {
+    static const uint8_t fps[] = { 24, 25, 29, 30 };
+    return (uint16_t)(((256 - fps[rnd() % 4]) << 8) | (1 + rnd() % 255));
+  }
+  return rnd() % 4 == 0 ? 1 + rnd() % 32767 : 1 + rnd() % 960;
+}
+
+/** Reads the file, checking every event against the merged references. */
+static void check_file(const uint8_t *data, size_t len, const ref_list *refs, uint16_t division,
+                       uint16_t tracks) {
+  static smf_reader r;
+  ref_clock clock = { division, SMF_DEFAULT_TEMPO, 0, 0, 0 };
+  smf_event ev;
+  size_t i;
+  int n;
+
+  CHECK(smf_open(&r, data, len) == 0, "random: open");
+  CHECK(r.format == 1 && r.num_tracks == tracks && r.division == division, "random: header");
+  for (i = 0; (n = smf_next(&r, &ev)) == 1; i++) {
+    if (i >= refs->len) {
+      CHECK(0, "random: more events than written");
+      return;
+    }
+    const ref_event *e = &refs->events[i];
+    uint64_t exact = ref_num(&clock, e->tick) / ref_divisor(&clock);
+    CHECK(ev.kind == e->kind && ev.track == e->track && ev.tick == e->tick && ev.status == e->status,
+          "random: event %zu is kind %u track %u tick %lu status %02X, not %u %u %lu %02X", i,
+          ev.kind, ev.track, (unsigned long)ev.tick, ev.status, e->kind, e->track,
+          (unsigned long)e->tick, e->status);
+    CHECK(ev.time_us <= exact && ev.time_us + clock.changes >= exact,
+          "random: event %zu at %llu us, not %llu", i, (unsigned long long)ev.time_us,
+          (unsigned long long)exact);
+    if (e->status != SMF_META_END_OF_TRACK || e->kind != SMF_EVENT_META) {
+      CHECK(ev.data == data + e->offset && ev.len == e->len, "random: event %zu data", i);
+    }
+    if (ev.kind == SMF_EVENT_MIDI) {
+      uint8_t type = e->status;
+      uint8_t data1 = data[e->offset];
+      if ((type & 0xF0) == 0x90 && data[e->offset + 1] == 0) {
+        type = 0x80 | (type & 0x0F);
+      } else if ((type & 0xF0) == 0xB0 && data[e->offset] >= 120) {
+        type = data[e->offset]; // Channel mode, with its value
+        data1 = data[e->offset + 1];
+      }
+      CHECK(ev.msg.type == type && ev.msg.channel == (e->status & 0x0F) && ev.msg.data1 == data1,
+            "random: event %zu message", i);
+    }
+    if (e->tempo != 0) {
+      clock.tempo_num = ref_num(&clock, e->tick);
+      clock.tempo_tick = e->tick;
+      clock.tempo = e->tempo;
+      clock.changes++;
+    }
+  }
+  CHECK(n == 0, "random: smf_next() returned %d after %zu events", n, i);
+  CHECK(i == refs->len, "random: %zu events read of %zu", i, refs->len);
+
+  // Again from the start
+  smf_rewind(&r);
+  CHECK(refs->len == 0 || (smf_next(&r, &ev) == 1 && ev.tick == refs->events[0].tick &&
+                           ev.track == refs->events[0].track), "random: rewind");
+}
+
+/** Cut short anywhere, and mutated: errors or the end, never a read
+ * outside the file, and never more events than it has bytes.
+ */
+static void check_damaged(const uint8_t *data, size_t len) {
+  static smf_reader r;
+  smf_event ev;
+  size_t cut = rnd() % len;
+  uint8_t *p = exact_copy(data, cut);
+  long events = 0;
+  int n;
+
+  n = smf_open(&r, p, cut);
+  CHECK(n == SMF_ERR_HEADER || n == SMF_ERR_TRUNCATED, "damaged: cut at %zu of %zu opens as %d",
+        cut, len, n);
+  free(p);
+
+  p = exact_copy(data, len);
+  for (int k = 1 + rnd() % 8; k > 0; k--) {
+    p[rnd() % len] ^= 1 << (rnd() % 8);
+  }
+  if (smf_open(&r, p, len) == 0) {
+    while ((n = smf_next(&r, &ev)) == 1 && events <= (long)len) {
+      events++;
+    }
+    CHECK(events <= (long)len, "damaged: endless");
+  }
+  free(p);
+}
+
+static void random_files(long files) {
+  bytes file = { 0 };
+  bytes track = { 0 };
+  ref_list refs = { 0 };
+  unsigned long long total_events = 0;
+  uint32_t largest = 0;
+
+  for (long f = 0; f < files; f++) {
+    uint16_t tracks = 1 + rnd() % SMF_MAX_TRACKS;
+    uint16_t division = random_division();
+    long per_track = rnd() % 64 == 0 ? 100000 / tracks + rnd() % (200000 / tracks) : rnd() % 200;
+
+    file.len = 0;
+    refs.len = 0;
+    put_header(&file, 1, tracks, division);
+    for (uint16_t t = 0; t < tracks; t++) {
+      size_t first = refs.len;
+      track.len = 0;
+      random_track(&track, &refs, (uint8_t)t, per_track);
+      if (rnd() % 8 == 0) {
+        // An unknown chunk, to be skipped
+        bytes other = { 0 };
+        for (uint32_t k = rnd() % 100; k > 0; k--) {
+          put(&other, rnd());
+        }
+        put_chunk(&file, "XFIH", &other);
+        free(other.data);
+      }
+      put_chunk(&file, "MTrk", &track);
+      for (size_t k = first; k < refs.len; k++) {
+        refs.events[k].offset += file.len - track.len;
+      }
+    }
+    qsort(refs.events, refs.len, sizeof(ref_event), ref_order);
+
+    uint8_t *copy = exact_copy(file.data, file.len);
+    check_file(copy, file.len, &refs, division, tracks);
+    free(copy);
+    check_damaged(file.data, file.len);
+    total_events += refs.len;
+    if (file.len > largest) {
+      largest = file.len;
+    }
+  }
+  printf("%ld files: %llu events, the largest %lu bytes\n", files, total_events,
+         (unsigned long)largest);
+  free(file.data);
+  free(track.data);
+  free(refs.events);
+}
+
+// Writer ////////////////////////////////////////////////////////////////////
+
+static void random_channel_message(midi_message *mm) {
+  memset(mm, 0, sizeof(*mm));
+  mm->channel = rnd() % 16;
+  mm->type = (0x80 | (rnd() % 7) << 4) | mm->channel;
+  mm->data1 = rnd() % 128;
+  mm->data2 = rnd() % 128;
+  if ((mm->type & 0xF0) == 0x90 && mm->data2 == 0) {
+    mm->data2 = 1; // Would read back as a note off
+  } else if ((mm->type & 0xF0) == 0xB0 && mm->data1 >= 120) {
+    mm->type = mm->data1; // Channel mode
+    mm->data1 = mm->data2;
+  }
+}
+
+static int same_recorded(const midi_message *a, const midi_message *b) {
+  if (a->type != b->type || a->channel != b->channel || a->data1 != b->data1) {
+    return 0;
+  }
+  if (a->type < 0x80 || (a->type & 0xF0) == 0xC0 || (a->type & 0xF0) == 0xD0) {
+    return 1;
+  }
+  return a->data2 == b->data2;
+}
+
+/** Reads a recording back: the tempo, what was recorded at its ticks,
+ * any empty text events spanning long gaps, & the end of track.
+ */
+static void check_recording(const uint8_t *data, size_t len, uint16_t division,
+                            const midi_message *msgs, const uint32_t *ticks, long count) {
+  static smf_reader r;
+  smf_event ev;
+  long i = 0;
+  int n;
+
+  CHECK(smf_open(&r, data, len) == 0 && r.format == 0 && r.division == division,
+        "writer: open");
+  CHECK(smf_next(&r, &ev) == 1 && ev.kind == SMF_EVENT_META && ev.status == SMF_META_TEMPO,
+        "writer: tempo first");
+  while ((n = smf_next(&r, &ev)) == 1) {
+    if (ev.kind == SMF_EVENT_META && ev.status == 0x01 && ev.len == 0) {
+      continue;
+    }
+    if (ev.kind == SMF_EVENT_META && ev.status == SMF_META_END_OF_TRACK) {
+      break;
+    }
+    if (i >= count) {
+      CHECK(0, "writer: more read back than recorded");
+      return;
+    }
+    CHECK(ev.kind == SMF_EVENT_MIDI && same_recorded(&ev.msg, &msgs[i]),
+          "writer: message %ld read back as %02X %02X", i, ev.msg.type, ev.msg.data1);
+    CHECK(ev.tick == ticks[i], "writer: message %ld at tick %lu, not %lu", i,
+          (unsigned long)ev.tick, (unsigned long)ticks[i]);
+    CHECK(ev.time_us == (uint64_t)ticks[i] * SMF_DEFAULT_TEMPO / division,
+          "writer: message %ld time", i);
+    i++;
+  }
+  CHECK(n == 1 && smf_next(&r, &ev) == 0, "writer: ends with end of track");
+  CHECK(i == count, "writer: %ld read back of %ld", i, count);
+}
+
+#define MAX_RECORDED 4096
+
+static void check_writer(long recordings) {
+  static midi_message msgs[MAX_RECORDED];
+  static uint32_t ticks[MAX_RECORDED];
+  static uint8_t buff[4 * MAX_RECORDED + 64];
+  smf_writer w;
+  midi_message mm;
+  long total = 0;
+
+  for (long k = 0; k < recordings; k++) {
+    uint16_t division = rnd() % 4 == 0 ? 1 + rnd() % 32767 : 1 + rnd() % 960;
+    uint32_t start = rnd();
+    uint32_t ts = start;
+    size_t size = rnd() % 4 == 0 ? rnd() % sizeof(buff) : sizeof(buff);
+    long count = 0;
+    long tries = rnd() % MAX_RECORDED;
+    uint32_t last_tick = 0;
+    int full = 0;
+
+    smf_writer_init(&w, buff, size, division, start);
+    for (long i = 0; i < tries; i++) {
+      uint32_t gap = rnd() % 16 == 0 ? rnd() % 5000000 : rnd() % 20000;
+      if (rnd() % 64 == 0) {
+        ts -= rnd() % 1000; // A little out of order
+      } else {
+        ts += gap;
+      }
+      // Kinds not recorded
+      if (rnd() % 16 == 0) {
+        memset(&mm, 0, sizeof(mm));
+        mm.type = rnd() % 2 ? MIDI_RT_TIMING_CLOCK : MIDI_SONG_SELECT;
+        mm.timestamp = ts;
+        CHECK(smf_writer_add(&w, &mm) == 0, "writer: not recorded");
+        continue;
+      }
+      random_channel_message(&mm);
+      mm.timestamp = ts;
+      uint64_t tick = (uint64_t)(uint32_t)(ts - start) * division / SMF_DEFAULT_TEMPO;
+      if (tick < last_tick) {
+        tick = last_tick;
+      }
+      int n = smf_writer_add(&w, &mm);
+      if (full) {
+        CHECK(n == SMF_ERR_FULL, "writer: stays full");
+      } else if (n == SMF_ERR_FULL) {
+        full = 1;
+        CHECK(w.overflow, "writer: overflow set");
+      } else {
+        CHECK(n == 1, "writer: recorded");
+        msgs[count] = mm;
+        ticks[count++] = (uint32_t)tick;
+        last_tick = (uint32_t)tick;
+      }
+    }
+    int len = smf_writer_finish(&w);
+    if (size < 27) {
+      CHECK(len == SMF_ERR_FULL, "writer: no room for the header");
+      continue;
+    }
+    CHECK(len > 0 && (size_t)len <= size, "writer: finished at %d of %zu", len, size);
+    uint8_t *copy = exact_copy(buff, len);
+    check_recording(copy, len, division, msgs, ticks, count);
+    free(copy);
+    total += count;
+  }
+
+  // A gap longer than a delta time can hold, under running status
+  smf_writer_init(&w, buff, sizeof(buff), 32767, 0);
+  memset(&mm, 0, sizeof(mm));
+  mm.type = 0x91;
+  mm.channel = 1;
+  mm.note = 60;
+  mm.velocity = 100;
+  msgs[0] = mm;
+  ticks[0] = 0;
+  CHECK(smf_writer_add(&w, &mm) == 1, "long gap: first");
+  mm.note = 61;
+  mm.timestamp = 0xFFFFFFF0;
+  msgs[1] = mm;
+  ticks[1] = (uint32_t)((uint64_t)mm.timestamp * 32767 / SMF_DEFAULT_TEMPO);
+  CHECK(ticks[1] > 0x0FFFFFFF, "long gap: longer than a delta time");
+  CHECK(smf_writer_add(&w, &mm) == 1, "long gap: second");
+  int len = smf_writer_finish(&w);
+  check_recording(buff, len, 32767, msgs, ticks, 2);
+
+  printf("%ld recordings: %ld messages\n", recordings, total);
+}
+
+int main(int argc, char **argv) {
+  long files = 1000;
+
+  if (check_args(argc, argv, &files, "check_smf [-n files] [-s seed]") != 0) {
+    return 2;
+  }
+
+  check_vectors();
+  random_files(files);
+  check_writer(files);
+  return check_result();
+}
@@ -0,0 +1,383 @@
+/*
+ * check_usbmidi.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Checks the USB MIDI packet codec (usbmidi.h): first against packets
+ * worked out by hand from the class specification, then by sending
+ * random MIDI from one usbmidi to another through a stand-in for the
+ * USB host between them. The host takes each transfer the sender hands
+ * over and gives it to the receiver once that has room for it (until
+ * then the OUT endpoint would NAK), all at random times. What comes out
+ * must be what went in, in order, and every packet must decode to what
+ * midi_stream_receive() makes of its bytes.
+ *
+ * Usage: check_usbmidi [-n messages] [-s seed]
+ *
+ * References:
+ * - Universal Serial Bus Device Class Definition for MIDI Devices,
+ *   Release 1.0, section 4: USB-MIDI Event Packets
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "midi.h"
+#include "usbmidi.h"
+#include "check.h"
+
+static int same_message(const midi_message *a, const midi_message *b) {
+  if (a->type != b->type) {
+    return 0;
+  }
+  if (a->type < 0x80) {
+    // Channel mode: midi_stream_receive() gives the value in both
+    return a->channel == b->channel && a->data1 == b->data1 && a->data2 == b->data2;
+  }
+  switch (a->type & 0xF0) {
+  case 0x80:
+  case 0x90:
+  case 0xA0:
+  case 0xB0:
+  case 0xE0:
+    return a->channel == b->channel && a->data1 == b->data1 && a->data2 == b->data2;
+  case 0xC0:
+  case 0xD0:
+    return a->channel == b->channel && a->data1 == b->data1;
+  }
+  switch (a->type) {
+  case MIDI_SYSEX:
+  case MIDI_SONG_POSITION:
+  case MIDI_TIME_CODE_QF:
+    return a->data1 == b->data1 && a->data2 == b->data2;
+  case MIDI_SONG_SELECT:
+    return a->data1 == b->data1;
+  }
+  return 1;
+}
+
+/** Parses bytes into the one message they make; returns 0 if they don't. */
+static int parse(const uint8_t *bytes, size_t n, midi_stream *ms, midi_message *mm) {
+  int got = 0;
+
+  midi_stream_init(ms);
+  for (size_t i = 0; i < n; i++) {
+    got = midi_stream_receive(ms, bytes[i], mm);
+  }
+  return got;
+}
+
+// Class specification examples //////////////////////////////////////////////
+
+typedef struct {
+  const char *name;
+  uint8_t bytes[8];     // MIDI
+  size_t len;
+  uint8_t packets[12];  // USB
+  size_t num_packets;
+} vector;
+
+static const vector vectors[] = {
+    { "note on",        { 0x90, 0x3C, 0x7F }, 3, { 0x09, 0x90, 0x3C, 0x7F }, 1 },
+    { "note off",       { 0x85, 0x40, 0x10 }, 3, { 0x08, 0x85, 0x40, 0x10 }, 1 },
+    { "poly pressure",  { 0xA1, 0x40, 0x10 }, 3, { 0x0A, 0xA1, 0x40, 0x10 }, 1 },
+    { "control change", { 0xB0, 0x07, 0x64 }, 3, { 0x0B, 0xB0, 0x07, 0x64 }, 1 },
+    { "all notes off",  { 0xB2, 0x7B, 0x00 }, 3, { 0x0B, 0xB2, 0x7B, 0x00 }, 1 },
+    { "program change", { 0xC0, 0x05 },       2, { 0x0C, 0xC0, 0x05, 0x00 }, 1 },
+    { "pressure",       { 0xDF, 0x22 },       2, { 0x0D, 0xDF, 0x22, 0x00 }, 1 },
+    { "pitch bend",     { 0xE3, 0x00, 0x40 }, 3, { 0x0E, 0xE3, 0x00, 0x40 }, 1 },
+    { "quarter frame",  { 0xF1, 0x35 },       2, { 0x02, 0xF1, 0x35, 0x00 }, 1 },
+    { "song position",  { 0xF2, 0x10, 0x20 }, 3, { 0x03, 0xF2, 0x10, 0x20 }, 1 },
+    { "song select",    { 0xF3, 0x07 },       2, { 0x02, 0xF3, 0x07, 0x00 }, 1 },
+    { "tune request",   { 0xF6 },             1, { 0x05, 0xF6, 0x00, 0x00 }, 1 },
+    { "clock",          { 0xF8 },             1, { 0x0F, 0xF8, 0x00, 0x00 }, 1 },
+    { "reset",          { 0xFF },             1, { 0x0F, 0xFF, 0x00, 0x00 }, 1 },
+    { "sysex 0",        { 0xF0, 0xF7 },       2, { 0x06, 0xF0, 0xF7, 0x00 }, 1 },
+    { "sysex 1",        { 0xF0, 0x01, 0xF7 }, 3, { 0x07, 0xF0, 0x01, 0xF7 }, 1 },
+    { "sysex 2",        { 0xF0, 0x01, 0x02, 0xF7 }, 4,
+                        { 0x04, 0xF0, 0x01, 0x02, 0x05, 0xF7, 0x00, 0x00 }, 2 },
+    { "sysex 3",        { 0xF0, 0x01, 0x02, 0x03, 0xF7 }, 5,
+                        { 0x04, 0xF0, 0x01, 0x02, 0x06, 0x03, 0xF7, 0x00 }, 2 },
+    { "sysex 4",        { 0xF0, 0x7E, 0x7F, 0x09, 0x01, 0xF7 }, 6,
+                        { 0x04, 0xF0, 0x7E, 0x7F, 0x07, 0x09, 0x01, 0xF7 }, 2 },
+};
+#define NUM_VECTORS (sizeof(vectors) / sizeof(vectors[0]))
+
+static void check_vectors(void) {
+  usbmidi u;
+  midi_stream ms;
+  midi_message want, got;
+  uint8_t packets[12];
+  size_t n;
+  int decoded;
+
+  for (size_t v = 0; v < NUM_VECTORS; v++) {
+    const vector *t = &vectors[v];
+
+    CHECK(parse(t->bytes, t->len, &ms, &want), "%s: does not parse", t->name);
+    memset(packets, 0xAA, sizeof(packets));
+    if (want.type == MIDI_SYSEX) {
+      n = usbmidi_encode_sysex(ms.sysex, want.data1, 0, packets);
+      CHECK(n == (size_t)USBMIDI_SYSEX_PACKETS(want.data1), "%s: %zu packets, not %d", t->name, n,
+            USBMIDI_SYSEX_PACKETS(want.data1));
+    } else {
+      n = usbmidi_encode(&want, 0, packets);
+    }
+    CHECK(n == t->num_packets && memcmp(packets, t->packets, n * USBMIDI_PACKET_SIZE) == 0,
+          "%s: encoded wrong", t->name);
+
+    usbmidi_init(&u, 0);
+    decoded = 0;
+    for (size_t p = 0; p < t->num_packets; p++) {
+      decoded = usbmidi_decode(&u, t->packets + p * USBMIDI_PACKET_SIZE, &got);
+      CHECK(decoded == (p == t->num_packets - 1), "%s: packet %zu decoded %d", t->name, p, decoded);
+    }
+    CHECK(same_message(&got, &want), "%s: decoded type %02X data %02X %02X", t->name,
+          got.type, got.data1, got.data2);
+    if (want.type == MIDI_SYSEX) {
+      CHECK(memcmp(u.rx_sysex.sysex, ms.sysex, want.data1) == 0, "%s: SysEx data differs", t->name);
+    }
+  }
+
+  // Other cables' messages and reserved CINs are not for us
+  static const uint8_t cable1[] = { 0x19, 0x90, 0x3C, 0x7F };
+  static const uint8_t reserved[] = { 0x01, 0x90, 0x3C, 0x7F };
+  static const uint8_t mismatch[] = { 0x09, 0x80, 0x3C, 0x7F };
+  static const uint8_t padding[] = { 0x00, 0x00, 0x00, 0x00 };
+  usbmidi_init(&u, 0);
+  CHECK(!usbmidi_decode(&u, cable1, &got), "cable 1 decoded");
+  CHECK(!usbmidi_decode(&u, reserved, &got), "CIN 1 decoded");
+  CHECK(!usbmidi_decode(&u, mismatch, &got), "CIN 9 of a note off decoded");
+  CHECK(!usbmidi_decode(&u, padding, &got), "padding decoded");
+  CHECK(u.rx_ignored == 3, "%lu ignored, not 3", (unsigned long)u.rx_ignored);
+
+  // Note on of velocity 0 is a note off, as from a DIN input
+  static const uint8_t zero_velocity[] = { 0x09, 0x93, 0x3C, 0x00 };
+  CHECK(usbmidi_decode(&u, zero_velocity, &got) && got.type == (MIDI_NOTE_OFF | 3) &&
+        got.channel == 3 && got.note == 0x3C, "velocity 0 note on is not a note off");
+
+  // A SysEx sent a byte at a time (CIN F), with real-time amidst it
+  static const uint8_t bytewise[][4] = {
+      { 0x0F, 0xF0 }, { 0x0F, 0x43 }, { 0x0F, 0xF8 }, { 0x0F, 0x12 }, { 0x0F, 0xF7 },
+  };
+  usbmidi_init(&u, 0);
+  CHECK(!usbmidi_decode(&u, bytewise[0], &got), "bytewise: F0 decoded");
+  CHECK(!usbmidi_decode(&u, bytewise[1], &got), "bytewise: 43 decoded");
+  CHECK(usbmidi_decode(&u, bytewise[2], &got) && got.type == MIDI_RT_TIMING_CLOCK,
+        "bytewise: clock not decoded");
+  CHECK(!usbmidi_decode(&u, bytewise[3], &got), "bytewise: 12 decoded");
+  CHECK(usbmidi_decode(&u, bytewise[4], &got) && got.type == MIDI_SYSEX && got.data1 == 2 &&
+        u.rx_sysex.sysex[0] == 0x43 && u.rx_sysex.sysex[1] == 0x12, "bytewise: SysEx wrong");
+
+  // A transfer too many is lost, and counted
+  uint8_t transfer[USBMIDI_TRANSFER_SIZE];
+  for (size_t i = 0; i < sizeof(transfer); i += USBMIDI_PACKET_SIZE) {
+    memcpy(transfer + i, vectors[0].packets, USBMIDI_PACKET_SIZE);
+  }
+  usbmidi_init(&u, 0);
+  for (int i = 0; i <= USBMIDI_RX_PACKETS / USBMIDI_TRANSFER_PACKETS; i++) {
+    usbmidi_rx_put(&u, transfer, sizeof(transfer), i);
+  }
+  CHECK(u.rx_overruns == USBMIDI_TRANSFER_PACKETS, "%lu overruns, not %d",
+        (unsigned long)u.rx_overruns, USBMIDI_TRANSFER_PACKETS);
+  CHECK(usbmidi_rx_room(&u) == 0, "room after overrun");
+
+  // A SysEx cut short is not sent
+  midi_message cut = { .type = MIDI_SYSEX, .data1 = MIDI_SYSEX_MAX, .data2 = 1 };
+  usbmidi_init(&u, 0);
+  CHECK(!usbmidi_send(&u, &cut, ms.sysex) && u.tx_drops == 1, "cut short SysEx sent");
+}
+
+// Random round trip through the stand-in host ///////////////////////////////
+
+// Data bytes of each CIN's packet
+static const uint8_t cin_bytes[16] = { 0, 0, 2, 3, 3, 1, 2, 3, 3, 3, 3, 3, 2, 2, 3, 1 };
+
+/** Random MIDI bytes of one message, of every kind. */
+static size_t random_message(uint8_t *out) {
+  uint32_t r = rnd();
+  uint8_t ch = r & 0x0F;
+  size_t n = 0;
+
+  switch ((r >> 4) % 12) {
+  case 0: case 1: case 2:
+    out[n++] = 0x80 | (((r >> 8) % 7) << 4) | ch; // 8n-En
+    out[n++] = rnd() & 0x7F;
+    if ((out[0] & 0xE0) != 0xC0) {
+      out[n++] = rnd() & 0x7F;
+    }
+    break;
+  case 3:
+    out[n++] = 0xB0 | ch;
+    out[n++] = 120 + rnd() % 8; // Channel mode
+    out[n++] = rnd() & 0x7F;
+    break;
+  case 4:
+    out[n++] = 0xF1;
+    out[n++] = rnd() & 0x7F;
+    break;
+  case 5:
+    out[n++] = 0xF2;
+    out[n++] = rnd() & 0x7F;
+    out[n++] = rnd() & 0x7F;
+    break;
+  case 6:
+    out[n++] = 0xF3;
+    out[n++] = rnd() & 0x7F;
+    break;
+  case 7:
+    out[n++] = 0xF6;
+    break;
+  case 8: {
+    static const uint8_t rt[] = { 0xF8, 0xFA, 0xFB, 0xFC, 0xFE, 0xFF };
+    out[n++] = rt[rnd() % sizeof(rt)];
+    break;
+  }
+  default: {
+    size_t len = rnd() % (MIDI_SYSEX_MAX + 1);
+    out[n++] = MIDI_SYSEX;
+    for (size_t i = 0; i < len; i++) {
+      out[n++] = rnd() & 0x7F;
+    }
+    out[n++] = MIDI_EOX;
+    break;
+  }
+  }
+  return n;
+}
+
+/** Each packet must decode as its bytes parse. SysEx packets only
+ * make sense together, so they are left to the round trip.
+ */
+static void check_packets(const uint8_t *data, size_t len) {
+  usbmidi u;
+  midi_stream ms;
+  midi_message want, got;
+
+  for (size_t i = 0; i < len; i += USBMIDI_PACKET_SIZE) {
+    const uint8_t *p = data + i;
+    uint8_t cin = p[0] & 0x0F;
+    if (cin == USBMIDI_CIN_SYSEX || cin == USBMIDI_CIN_SYSEX_END_2 ||
+        cin == USBMIDI_CIN_SYSEX_END_3 || (cin == USBMIDI_CIN_SYSEX_END_1 && p[1] == MIDI_EOX)) {
+      continue;
+    }
+    usbmidi_init(&u, 0);
+    int w = parse(p + 1, cin_bytes[cin], &ms, &want);
+    int g = usbmidi_decode(&u, p, &got);
+    CHECK(w == g && (!g || same_message(&got, &want)),
+          "packet %02X %02X %02X %02X decodes unlike its bytes parse", p[0], p[1], p[2], p[3]);
+  }
+}
+
+#define MAX_EXPECTED 4096 // Power of 2
+
+typedef struct {
+  midi_message msg;
+  uint8_t sysex[MIDI_SYSEX_MAX];
+} expected;
+
+static expected expect[MAX_EXPECTED];
+static uint32_t expect_head, expect_tail;
+
+static void check_received(usbmidi *rx) {
+  midi_message got;
+
+  while (usbmidi_receive(rx, &got)) {
+    if (expect_head == expect_tail) {
+      CHECK(0, "type %02X received, but nothing was sent", got.type);
+      return;
+    }
+    expected *e = &expect[expect_tail++ & (MAX_EXPECTED - 1)];
+    CHECK(got.port == 5, "port %u", got.port);
+    CHECK(same_message(&got, &e->msg), "message %lu: received type %02X data %02X %02X, "
+          "sent type %02X data %02X %02X", (unsigned long)expect_tail - 1, got.type, got.data1,
+          got.data2, e->msg.type, e->msg.data1, e->msg.data2);
+    if (got.type == MIDI_SYSEX) {
+      CHECK(memcmp(rx->rx_sysex.sysex, e->sysex, got.data1) == 0, "message %lu: SysEx differs",
+            (unsigned long)expect_tail - 1);
+    }
+    if (failures > 10) {
+      exit(1);
+    }
+  }
+}
+
+static usbmidi tx, rx;
+
+static void round_trip(long messages) {
+  uint8_t host_buff[USBMIDI_TRANSFER_SIZE];
+  size_t host_len = 0; // Transfer the host has taken, not yet given on
+  const uint8_t *data;
+  uint8_t bytes[MIDI_SYSEX_MAX + 2];
+  midi_stream ms;
+  midi_message mm;
+  uint32_t now = 0;
+  long sent = 0;
+
+  usbmidi_init(&tx, 0);
+  usbmidi_init(&rx, 5);
+
+  while (sent < messages || host_len > 0 || tx.tx_len[tx.tx_fill] > 0 ||
+         expect_head != expect_tail) {
+    uint32_t r = rnd();
+    now++;
+
+    if (r % 8 < 4 && sent < messages && expect_head - expect_tail < MAX_EXPECTED) {
+      // Routed to USB
+      size_t n = random_message(bytes);
+      CHECK(parse(bytes, n, &ms, &mm), "generated bytes do not parse");
+      if (usbmidi_send(&tx, &mm, ms.sysex)) {
+        expected *e = &expect[expect_head++ & (MAX_EXPECTED - 1)];
+        e->msg = mm;
+        memcpy(e->sysex, ms.sysex, sizeof(e->sysex));
+      } else {
+        // Only ever as the transfer is full
+        size_t need = mm.type == MIDI_SYSEX ?
+            USBMIDI_SYSEX_PACKETS(mm.data1) * USBMIDI_PACKET_SIZE : USBMIDI_PACKET_SIZE;
+        CHECK(tx.tx_len[tx.tx_fill] + need > USBMIDI_TRANSFER_SIZE,
+              "type %02X not sent with room for it", mm.type);
+      }
+      sent++;
+    } else if (r % 8 < 6) {
+      // The host: an IN transfer completes, then goes to the OUT
+      // endpoint when it is armed
+      if (host_len == 0 && (host_len = usbmidi_tx_take(&tx, &data)) > 0) {
+        CHECK(host_len % USBMIDI_PACKET_SIZE == 0 && host_len <= USBMIDI_TRANSFER_SIZE,
+              "transfer of %zu bytes", host_len);
+        memcpy(host_buff, data, host_len);
+        check_packets(host_buff, host_len);
+        usbmidi_tx_done(&tx);
+      }
+      if (host_len > 0 && usbmidi_rx_room(&rx) >= USBMIDI_TRANSFER_PACKETS) {
+        usbmidi_rx_put(&rx, host_buff, host_len, now);
+        host_len = 0;
+      }
+    } else {
+      // Routing takes what was received
+      check_received(&rx);
+    }
+  }
+
+  CHECK(rx.rx_overruns == 0, "%lu packets lost", (unsigned long)rx.rx_overruns);
+  CHECK(rx.rx_ignored == 0, "%lu packets ignored", (unsigned long)rx.rx_ignored);
+  printf("%ld messages: %lu sent in %lu transfers (%.1f messages each), %lu dropped as full\n",
+         sent, (unsigned long)tx.tx_messages, (unsigned long)tx.tx_transfers,
+         tx.tx_transfers == 0 ? 0.0 : (double)tx.tx_messages / tx.tx_transfers,
+         (unsigned long)tx.tx_drops);
+}
+
+int main(int argc, char **argv) {
+  long messages = 1000000;
+
+  if (check_args(argc, argv, &messages, "check_usbmidi [-n messages] [-s seed]") != 0) {
+    return 2;
+  }
+
+  check_vectors();
+  round_trip(messages);
+  return check_result();
+}
@@ -0,0 +1,503 @@
+/*
+ * fuzz_midi.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Fuzz & property test of midi_stream_receive(). Every byte of a stream
+ * goes both to the parser and to a reference model written from the
+ * MIDI 1.0 specification, and they must agree on whether a message was
+ * completed and on every field midi.h defines for its type. Also:
+ * - Real-time bytes are transparent: without them, the same other
+ *   messages result
+ * - Round trip: the messages re-encoded by midi_encode() parse back
+ *   to the same messages
+ *
+ * Build one of three ways (see the Makefile):
+ * - As is: runs the files/directories given (the corpus), then that
+ *   many random & mutated streams
+ *     fuzz_midi [-n iterations] [-s seed] [file|dir ...]
+ *   Also what AFL runs (fuzz_midi @@), built with afl-cc.
+ * - With -DFUZZ_LIBFUZZER & -fsanitize=fuzzer: LLVMFuzzerTestOneInput()
+ *
+ * References:
+ * - MIDI 1.0 Detailed Specification 4.2: running status; real-time
+ *   messages may occur anywhere, even within other messages, and do not
+ *   affect running status; system common messages cancel it; any status
+ *   byte other than real-time ends a SysEx; undefined status bytes
+ *   (F4, F5) are ignored & cancel running status
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include "midi.h"
+
+// Reference model ///////////////////////////////////////////////////////////
+
+typedef struct {
+  uint8_t status;   // Running status, or system common awaiting data; 0 none
+  uint8_t have;     // Data bytes of it so far
+  uint8_t data[2];
+  int in_sysex;
+  uint8_t sysex[MIDI_SYSEX_MAX];
+  uint32_t sysex_len; // All received, not just kept
+} ref_stream;
+
+/** Data bytes that follow a status byte. */
+static int data_bytes(uint8_t status) {
+  switch (status & 0xF0) {
+  case 0xC0:
+  case 0xD0:
+    return 1;
+  case 0xF0:
+    return status == MIDI_TIME_CODE_QF || status == MIDI_SONG_SELECT ? 1 :
+           status == MIDI_SONG_POSITION ? 2 : 0;
+  default:
+    return 2;
+  }
+}
+
+/** The message a status & its data bytes make, as midi.h describes it. */
+static void ref_message(uint8_t status, const uint8_t *data, midi_message *mm) {
+  memset(mm, 0, sizeof(*mm));
+  mm->type = status;
+  mm->channel = status & 0x0F;
+  switch (status & 0xF0) {
+  case 0x90:
+    if (data[1] == 0) {
+      mm->type = MIDI_NOTE_OFF | mm->channel; // Note on, velocity 0
+    }
+    // Fall through
+  case 0x80:
+  case 0xA0:
+    mm->note = data[0];
+    mm->velocity = data[1];
+    break;
+  case 0xB0:
+    if (data[0] >= MIDI_MODE_ALL_SOUND_OFF) {
+      mm->type = data[0]; // Channel mode: the controller number is the type
+    }
+    mm->control = data[0];
+    mm->cc_value = data[1];
+    break;
+  case 0xC0:
+    mm->program = data[0];
+    break;
+  case 0xD0:
+    mm->pressure = data[0];
+    break;
+  case 0xE0:
+    mm->lsb = data[0];
+    mm->msb = data[1];
+    break;
+  case 0xF0:
+    if (status == MIDI_TIME_CODE_QF) {
+      mm->tcqf_message_type = data[0] >> 4;
+      mm->tcqf_value = data[0] & 0x0F;
+    } else if (status == MIDI_SONG_POSITION) {
+      mm->lsb = data[0];
+      mm->msb = data[1];
+    } else {
+      mm->data1 = data[0];
+    }
+    break;
+  }
+}
+
+static int ref_receive(ref_stream *r, uint8_t b, midi_message *mm) {
+  if (b >= 0xF8) {
+    // Real-time, undefined ones (F9, FD) too: passed on, state untouched
+    memset(mm, 0, sizeof(*mm));
+    mm->type = b;
+    return 1;
+  }
+  if (b & 0x80) {
+    int was_sysex = r->in_sysex;
+    r->in_sysex = 0;
+    r->status = 0;
+    r->have = 0;
+    switch (b) {
+    case MIDI_EOX:
+      if (!was_sysex) {
+        return 0;
+      }
+      memset(mm, 0, sizeof(*mm));
+      mm->type = MIDI_SYSEX;
+      mm->data1 = r->sysex_len < MIDI_SYSEX_MAX ? r->sysex_len : MIDI_SYSEX_MAX;
+      mm->data2 = r->sysex_len > MIDI_SYSEX_MAX;
+      return 1;
+    case MIDI_SYSEX:
+      r->in_sysex = 1;
+      r->sysex_len = 0;
+      return 0;
+    case 0xF4:
+    case 0xF5:
+      return 0;
+    case MIDI_TUNE_REQUEST:
+      memset(mm, 0, sizeof(*mm));
+      mm->type = b;
+      return 1;
+    default:
+      r->status = b;
+      return 0;
+    }
+  }
+
+  if (r->in_sysex) {
+    if (r->sysex_len < MIDI_SYSEX_MAX) {
+      r->sysex[r->sysex_len] = b;
+    }
+    r->sysex_len++;
+    return 0;
+  }
+  if (r->status == 0) {
+    return 0; // No status to go with it
+  }
+  r->data[r->have++] = b;
+  if (r->have < data_bytes(r->status)) {
+    return 0;
+  }
+  ref_message(r->status, r->data, mm);
+  r->have = 0;
+  if (r->status >= 0xF0) {
+    r->status = 0; // System common has no running status
+  }
+  return 1;
+}
+
+// Properties ////////////////////////////////////////////////////////////////
+
+/** Whether two messages agree on every field midi.h defines for the type. */
+static int same_message(const midi_message *a, const midi_message *b) {
+  if (a->type != b->type) {
+    return 0;
+  }
+  if (a->type < 0x80) {
+    // Channel mode
+    return a->channel == b->channel && a->data2 == b->data2;
+  }
+  switch (a->type & 0xF0) {
+  case 0x80:
+  case 0x90:
+  case 0xA0:
+  case 0xB0:
+  case 0xE0:
+    return a->channel == b->channel && a->data1 == b->data1 && a->data2 == b->data2;
+  case 0xC0:
+  case 0xD0:
+    return a->channel == b->channel && a->data1 == b->data1;
+  }
+  switch (a->type) {
+  case MIDI_SYSEX:
+  case MIDI_SONG_POSITION:
+  case MIDI_TIME_CODE_QF:
+    return a->data1 == b->data1 && a->data2 == b->data2;
+  case MIDI_SONG_SELECT:
+    return a->data1 == b->data1;
+  }
+  return 1;
+}
+
+static const uint8_t *failed_data;
+static size_t failed_len;
+
+static void fail(const char *why, size_t at, const midi_message *got, const midi_message *want) {
+  fprintf(stderr, "FAILED: %s at byte %zu of %zu\n", why, at, failed_len);
+  if (got != NULL) {
+    fprintf(stderr, "  parser:    type %02X ch %u data %02X %02X\n",
+            got->type, got->channel, got->data1, got->data2);
+  }
+  if (want != NULL) {
+    fprintf(stderr, "  reference: type %02X ch %u data %02X %02X\n",
+            want->type, want->channel, want->data1, want->data2);
+  }
+  fprintf(stderr, "  stream:");
+  for (size_t i = 0; i < failed_len; i++) {
+    fprintf(stderr, "%s%02X", i % 24 == 0 ? "\n    " : " ", failed_data[i]);
+  }
+  fprintf(stderr, "\n");
+  abort();
+}
+
+#define MAX_MESSAGES 4096
+
+/** Parses a stream, checking it against the reference; returns its
+ * messages (up to max) & how many there were.
+ */
+static size_t check_reference(const uint8_t *data, size_t len, midi_message *out, size_t max) {
+  midi_stream ms;
+  ref_stream r;
+  midi_message got, want;
+  size_t n = 0;
+
+  midi_stream_init(&ms);
+  memset(&r, 0, sizeof(r));
+  for (size_t i = 0; i < len; i++) {
+    int g = midi_stream_receive(&ms, data[i], &got);
+    int w = ref_receive(&r, data[i], &want);
+    if (g != w) {
+      fail(g ? "parser completed a message the reference did not" :
+               "parser missed a message", i, g ? &got : NULL, w ? &want : NULL);
+    }
+    if (!g) {
+      continue;
+    }
+    if (!same_message(&got, &want)) {
+      fail("messages differ", i, &got, &want);
+    }
+    if (got.type == MIDI_SYSEX && memcmp(ms.sysex, r.sysex, got.data1) != 0) {
+      fail("SysEx data differs", i, &got, &want);
+    }
+    if (n < max) {
+      out[n] = got;
+    }
+    n++;
+  }
+  return n;
+}
+
+static midi_message messages[MAX_MESSAGES];
+static midi_message others[MAX_MESSAGES];
+static uint8_t scratch[MAX_MESSAGES * MIDI_MAX_ENCODED];
+
+/** Checks the messages other than real-time are the same without real-time bytes. */
+static void check_realtime_transparent(const uint8_t *data, size_t len, size_t n) {
+  size_t slen = 0;
+  size_t i = 0;
+
+  if (n > MAX_MESSAGES || len > sizeof(scratch)) {
+    return;
+  }
+  for (size_t b = 0; b < len; b++) {
+    if (data[b] < 0xF8) {
+      scratch[slen++] = data[b];
+    }
+  }
+  size_t m = check_reference(scratch, slen, others, MAX_MESSAGES);
+  for (size_t k = 0; k < n; k++) {
+    if (messages[k].type >= 0xF8) {
+      continue;
+    }
+    if (i >= m || !same_message(&messages[k], &others[i])) {
+      fail("real-time bytes changed other messages", k, i < m ? &others[i] : NULL, &messages[k]);
+    }
+    i++;
+  }
+  if (i != m) {
+    fail("real-time bytes hid messages", len, NULL, NULL);
+  }
+}
+
+/** Checks that what midi_encode() makes of the messages parses back the same. */
+static void check_round_trip(size_t n) {
+  midi_encoder me;
+  midi_stream ms;
+  midi_message back;
+
+  if (n > MAX_MESSAGES) {
+    return;
+  }
+  midi_encoder_init(&me);
+  midi_stream_init(&ms);
+  for (size_t i = 0; i < n; i++) {
+    uint8_t out[MIDI_MAX_ENCODED];
+    int len = midi_encode(&me, &messages[i], out);
+    int got = 0;
+
+    if (messages[i].type == MIDI_SYSEX) {
+      continue; // midi_encode() leaves SysEx to the caller
+    }
+    if (len == 0) {
+      fail("midi_encode() could not encode a parsed message", i, &messages[i], NULL);
+    }
+    for (int b = 0; b < len; b++) {
+      if (got) {
+        fail("encoding parsed as more than one message", i, &back, &messages[i]);
+      }
+      got = midi_stream_receive(&ms, out[b], &back);
+    }
+    if (!got || !same_message(&back, &messages[i])) {
+      fail("round trip through midi_encode() changed a message", i, got ? &back : NULL, &messages[i]);
+    }
+  }
+}
+
+static uint64_t total_streams;
+static uint64_t total_bytes;
+static uint64_t total_messages;
+
+static void check_stream(const uint8_t *data, size_t len) {
+  failed_data = data;
+  failed_len = len;
+  size_t n = check_reference(data, len, messages, MAX_MESSAGES);
+  check_realtime_transparent(data, len, n);
+  check_round_trip(n);
+  total_streams++;
+  total_bytes += len;
+  total_messages += n;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  check_stream(data, size);
+  return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+// Driver ////////////////////////////////////////////////////////////////////
+
+#define MAX_STREAM 4096
+#define MAX_CORPUS 256
+
+static uint8_t *corpus[MAX_CORPUS];
+static size_t corpus_len[MAX_CORPUS];
+static size_t corpus_count;
+
+static uint32_t seed = 1;
+static uint32_t lcg(void) {
+  seed = seed * 1664525 + 1013904223;
+  return seed >> 8;
+}
+
+static void load_file(const char *path) {
+  FILE *f = fopen(path, "rb");
+  uint8_t *buff = malloc(MAX_STREAM);
+  size_t len;
+
+  if (f == NULL || buff == NULL) {
+    perror(path);
+    exit(2);
+  }
+  len = fread(buff, 1, MAX_STREAM, f);
+  fclose(f);
+  check_stream(buff, len);
+  if (corpus_count < MAX_CORPUS) {
+    corpus[corpus_count] = buff;
+    corpus_len[corpus_count++] = len;
+  } else {
+    free(buff);
+  }
+}
+
+static void load(const char *path) {
+  DIR *dir = opendir(path);
+  struct dirent *de;
+  char name[1024];
+
+  if (dir == NULL) {
+    load_file(path);
+    return;
+  }
+  while ((de = readdir(dir)) != NULL) {
+    if (de->d_name[0] != '.') {
+      snprintf(name, sizeof(name), "%s/%s", path, de->d_name);
+      load_file(name);
+    }
+  }
+  closedir(dir);
+}
+
+/** A byte, weighted towards what makes the parser work: data mostly,
+ * then channel status, then the system bytes.
+ */
+static uint8_t random_byte(void) {
+  uint32_t r = lcg() % 100;
+  if (r < 60) return lcg() & 0x7F;
+  if (r < 85) return 0x80 | (lcg() & 0x7F & 0x73); // 8n-Fn, a few channels
+  if (r < 90) return MIDI_SYSEX;
+  if (r < 93) return MIDI_EOX;
+  if (r < 97) return 0xF8 + lcg() % 8;
+  return 0xF1 + lcg() % 6;
+}
+
+/** A new stream, either random or a corpus entry mutated. */
+static size_t make_stream(uint8_t *out) {
+  size_t len;
+
+  if (corpus_count == 0 || lcg() % 3 == 0) {
+    len = lcg() % 256;
+    for (size_t i = 0; i < len; i++) {
+      out[i] = random_byte();
+    }
+    return len;
+  }
+
+  size_t c = lcg() % corpus_count;
+  len = corpus_len[c];
+  memcpy(out, corpus[c], len);
+  for (int m = 1 + lcg() % 4; m > 0; m--) {
+    size_t at = len == 0 ? 0 : lcg() % len;
+    switch (lcg() % 5) {
+    case 0: // Change a byte
+      if (len > 0) out[at] = random_byte();
+      break;
+    case 1: // Flip a bit
+      if (len > 0) out[at] ^= 1 << (lcg() % 8);
+      break;
+    case 2: // Insert a byte
+      if (len < MAX_STREAM) {
+        memmove(out + at + 1, out + at, len - at);
+        out[at] = random_byte();
+        len++;
+      }
+      break;
+    case 3: // Delete a byte
+      if (len > 0) {
+        memmove(out + at, out + at + 1, len - at - 1);
+        len--;
+      }
+      break;
+    case 4: { // Splice in part of another
+      size_t o = lcg() % corpus_count;
+      size_t from = corpus_len[o] == 0 ? 0 : lcg() % corpus_len[o];
+      size_t n = corpus_len[o] - from;
+      if (n > MAX_STREAM - at) n = MAX_STREAM - at;
+      memcpy(out + at, corpus[o] + from, n);
+      if (at + n > len) len = at + n;
+      break;
+    }
+    }
+  }
+  return len;
+}
+
+int main(int argc, char **argv) {
+  static uint8_t stream[MAX_STREAM];
+  unsigned long iterations = 0;
+  int i;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i += 2) {
+    if (i + 1 >= argc) {
+      break;
+    }
+    if (strcmp(argv[i], "-n") == 0) {
+      iterations = strtoul(argv[i + 1], NULL, 10);
+    } else if (strcmp(argv[i], "-s") == 0) {
+      seed = strtoul(argv[i + 1], NULL, 10);
+    } else {
+      break;
+    }
+  }
+  if (i < argc && argv[i][0] == '-') {
+    fprintf(stderr, "usage: fuzz_midi [-n iterations] [-s seed] [file|dir ...]\n");
+    return 2;
+  }
+  for (; i < argc; i++) {
+    load(argv[i]);
+  }
+  printf("corpus: %zu streams\n", corpus_count);
+
+  for (unsigned long n = 0; n < iterations; n++) {
+    check_stream(stream, make_stream(stream));
+  }
+  printf("OK: %llu streams, %llu bytes, %llu messages\n", (unsigned long long)total_streams,
+         (unsigned long long)total_bytes, (unsigned long long)total_messages);
+  return 0;
+}
+
+#endif // FUZZ_LIBFUZZER
@@ -0,0 +1,1130 @@
+/*
+ * sim.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Register-level STM32F767 simulation for running the firmware on
+ * Linux. See sim.h.
+ *
+ * References:
+ * - Arm v7-M Architecture Reference Manual B1.5.4 (priority grouping,
+ *   BASEPRI & preemption), B1.5.19 (WFI wakes on a pending interrupt
+ *   even while PRIMASK is set)
+ * - RM0410 34.8.8 (USART_ISR: RXNE, ORE, TXE & TC)
+ * - SSD1306 datasheet Rev 1.1 8.1.5 (I2C control bytes) & 9 (commands)
+ * - RM0410 3.3 (flash sectors in single & dual bank), 3.3.7 & 3.3.8
+ *   (erasing & programming); DS11532 table 40 (their times)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "stm32f7xx_hal.h"
+#include "stm32f7xx_ll_usart.h"
+#include "stm32f7xx_it.h"
+#include "sim.h"
+
+uint32_t SystemCoreClock = 16000000; // HSI until sim_main sets it
+
+CoreDebug_Type sim_core_debug;
+RCC_TypeDef sim_rcc;
+GPIO_TypeDef sim_gpio[11];
+USART_TypeDef sim_usart[9];
+I2C_TypeDef sim_i2c1;
+DMA_Stream_TypeDef sim_dma1_stream6;
+FLASH_TypeDef sim_flash_regs;
+
+static DWT_Type dwt;
+static SCB_Type scb;
+static TIM_TypeDef tim2;
+
+static sim_config cfg;
+static uint64_t cycles;      // The virtual clock
+static uint64_t idle_cycles; // Spent in WFI
+static int finished;
+static double host_start;
+static double host_mark;     // Host CPU time control last went back to the firmware
+static volatile uint32_t uw_tick;
+
+static double host_time(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** CPU time, which unlike host_time() leaves out being descheduled. */
+static double host_cpu_time(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// NVIC //////////////////////////////////////////////////////////////////////
+
+struct sim_usart_model;
+
+typedef struct {
+  IRQn_Type irqn;
+  void (*handler)(void);
+  uint8_t priority;               // As the NVIC holds it: encoded, in the top 4 bits
+  uint8_t enabled;
+  uint8_t pending;                // Latched; PendSV & SysTick only
+  struct sim_usart_model *usart;  // Level-sensitive on its flags, if set
+} sim_irq;
+
+// In exception number order, which breaks ties of priority
+static sim_irq irqs[] = {
+    { PendSV_IRQn,       PendSV_Handler,          0, 1, 0, NULL },
+    { SysTick_IRQn,      SysTick_Handler,         0, 1, 0, NULL },
+    { FLASH_IRQn,        FLASH_IRQHandler,        0, 0, 0, NULL },
+    { DMA1_Stream5_IRQn, DMA1_Stream5_IRQHandler, 0, 0, 0, NULL },
+    { DMA1_Stream6_IRQn, DMA1_Stream6_IRQHandler, 0, 0, 0, NULL },
+    { I2C1_EV_IRQn,      I2C1_EV_IRQHandler,      0, 0, 0, NULL },
+    { I2C1_ER_IRQn,      I2C1_ER_IRQHandler,      0, 0, 0, NULL },
+    { USART2_IRQn,       USART2_IRQHandler,       0, 0, 0, NULL },
+    { USART3_IRQn,       USART3_IRQHandler,       0, 0, 0, NULL },
+    { UART4_IRQn,        UART4_IRQHandler,        0, 0, 0, NULL },
+    { UART5_IRQn,        UART5_IRQHandler,        0, 0, 0, NULL },
+    { ETH_IRQn,          ETH_IRQHandler,          0, 0, 0, NULL },
+    { OTG_FS_IRQn,       OTG_FS_IRQHandler,       0, 0, 0, NULL },
+    { USART6_IRQn,       USART6_IRQHandler,       0, 0, 0, NULL },
+    { UART7_IRQn,        UART7_IRQHandler,        0, 0, 0, NULL },
+};
+#define NUM_IRQS (sizeof(irqs) / sizeof(irqs[0]))
+#define IRQ_PENDSV  (&irqs[0])
+#define IRQ_SYSTICK (&irqs[1])
+
+static uint32_t prigroup;           // The PRIGROUP field, as HAL_NVIC_SetPriorityGrouping() sets it
+static uint32_t primask;
+static uint32_t basepri;
+static uint32_t exec_group = 0x100; // Group priority of what is running; above all in thread mode
+
+static sim_irq *find_irq(IRQn_Type irqn) {
+  for (size_t i = 0; i < NUM_IRQS; i++) {
+    if (irqs[i].irqn == irqn) {
+      return &irqs[i];
+    }
+  }
+  fprintf(stderr, "sim: IRQ %d is not simulated\n", irqn);
+  abort();
+}
+
+/** The part of a priority that decides preemption. */
+static uint32_t group_of(uint32_t priority) {
+  return priority & (0xFFUL << (prigroup + 1)) & 0xFF;
+}
+
+static int usart_line(struct sim_usart_model *m);
+static uint32_t dma_flags;
+static int i2c_done;
+static int flash_done;
+
+static int irq_asserted(sim_irq *q) {
+  if (q->usart != NULL) {
+    return usart_line(q->usart);
+  }
+  if (q->irqn == DMA1_Stream5_IRQn) {
+    return dma_flags != 0;
+  }
+  if (q->irqn == I2C1_EV_IRQn) {
+    return i2c_done;
+  }
+  if (q->irqn == FLASH_IRQn) {
+    return flash_done;
+  }
+  return q->pending;
+}
+
+/** The interrupt to take now, if any. WFI wakes regardless of PRIMASK. */
+static sim_irq *select_irq(int ignore_primask) {
+  sim_irq *best = NULL;
+
+  if (scb.ICSR & SCB_ICSR_PENDSVSET_Msk) {
+    scb.ICSR &= ~SCB_ICSR_PENDSVSET_Msk;
+    IRQ_PENDSV->pending = 1;
+  }
+  if (primask && !ignore_primask) {
+    return NULL;
+  }
+  for (size_t i = 0; i < NUM_IRQS; i++) {
+    sim_irq *q = &irqs[i];
+    uint32_t group = group_of(q->priority);
+    if (!q->enabled || !irq_asserted(q) || group >= exec_group) {
+      continue;
+    }
+    if (basepri != 0 && group >= group_of(basepri)) {
+      continue;
+    }
+    if (best == NULL || q->priority < best->priority) {
+      best = q;
+    }
+  }
+  return best;
+}
+
+// Peripheral events /////////////////////////////////////////////////////////
+
+typedef struct sim_usart_model {
+  USART_TypeDef *regs;
+  sim_irq *irq;
+  uint64_t byte_cycles;   // Start, 8 data & stop bits
+  sim_rx_source source;
+  void *source_ctx;
+  int rx_coming;          // rx_byte is on the line, in by rx_done
+  uint8_t rx_byte;
+  uint64_t rx_done;
+  uint64_t rdr_since;     // When RDR was filled
+  int shifting;           // shift is being sent, done at tx_done
+  uint8_t shift;
+  uint64_t tx_done;
+  int tdr_full;
+  uint8_t tdr;
+  FILE *sink;
+  sim_usart_stats stats;
+} sim_usart_model;
+
+static sim_usart_model usarts[9];
+
+static sim_usart_model *usart_model(USART_TypeDef *usart) {
+  return &usarts[usart - sim_usart];
+}
+
+static int usart_line(sim_usart_model *m) {
+  uint32_t isr = m->regs->ISR;
+  uint32_t cr1 = m->regs->CR1;
+  uint32_t cr3 = m->regs->CR3;
+
+  return ((isr & USART_ISR_RXNE) && (cr1 & USART_CR1_RXNEIE)) ||
+         ((isr & USART_ISR_ORE) && ((cr1 & USART_CR1_RXNEIE) || (cr3 & USART_CR3_EIE))) ||
+         ((isr & USART_ISR_TXE) && (cr1 & USART_CR1_TXEIE));
+}
+
+/** Puts the source's next byte on the line, after the last. */
+static void usart_next_rx(sim_usart_model *m, uint64_t now) {
+  uint64_t start;
+
+  if (m->source == NULL || !m->source(m->source_ctx, now, &m->rx_byte, &start)) {
+    m->rx_coming = 0;
+    return;
+  }
+  if (start < now) {
+    start = now;
+  }
+  m->rx_coming = 1;
+  m->rx_done = start + m->byte_cycles;
+}
+
+static void usart_rx_done(sim_usart_model *m, uint64_t t) {
+  USART_TypeDef *u = m->regs;
+
+  if ((u->CR1 & (USART_CR1_UE | USART_CR1_RE)) == (USART_CR1_UE | USART_CR1_RE)) {
+    if (u->ISR & USART_ISR_RXNE) {
+      // RDR keeps the old byte; this one is lost
+      u->ISR |= USART_ISR_ORE;
+      m->stats.rx_overruns++;
+    } else {
+      u->RDR = m->rx_byte;
+      u->ISR |= USART_ISR_RXNE;
+      m->rdr_since = t;
+      m->stats.rx_bytes++;
+    }
+  }
+  usart_next_rx(m, t);
+}
+
+static void usart_tx_done(sim_usart_model *m, uint64_t t) {
+  m->stats.tx_bytes++;
+  if (m->sink != NULL) {
+    fputc(m->shift, m->sink);
+  }
+  if (m->tdr_full) {
+    m->shift = m->tdr;
+    m->tdr_full = 0;
+    m->regs->ISR |= USART_ISR_TXE;
+    m->tx_done = t + m->byte_cycles;
+  } else {
+    m->shifting = 0;
+    m->regs->ISR |= USART_ISR_TC;
+  }
+}
+
+static uint64_t systick_next;
+static I2S_HandleTypeDef *dma_i2s;
+static int dma_running;
+static int dma_half;           // Which event is next: 0 half, 1 complete
+static uint64_t dma_next;
+static uint64_t dma_half_cycles;
+static sim_audio_stats audio_stats;
+
+static void dma_event(uint64_t t) {
+  audio_stats.halves++;
+  // The last half should have been taken & refilled by now
+  if (dma_flags != 0 || (cfg.audio_pending != NULL && *cfg.audio_pending)) {
+    audio_stats.misses++;
+  }
+  dma_flags |= dma_half ? 2 : 1;
+  dma_half ^= 1;
+  dma_next = t + dma_half_cycles;
+}
+
+static int i2c_busy;
+static uint64_t i2c_end;
+static void i2c_event(void);
+static int flash_busy;
+static uint64_t flash_end;
+static void flash_event(void);
+
+/** Runs the peripherals up to the current time, in time order. */
+static void update(void) {
+  while (1) {
+    uint64_t t = UINT64_MAX;
+    sim_usart_model *rx = NULL;
+    sim_usart_model *tx = NULL;
+    int what = 0; // 1 rx, 2 tx, 3 SysTick, 4 DMA, 5 I2C, 6 flash
+
+    for (size_t i = 0; i < sizeof(usarts) / sizeof(usarts[0]); i++) {
+      sim_usart_model *m = &usarts[i];
+      if (m->rx_coming && m->rx_done < t) {
+        t = m->rx_done;
+        rx = m;
+        what = 1;
+      }
+      if (m->shifting && m->tx_done < t) {
+        t = m->tx_done;
+        tx = m;
+        what = 2;
+      }
+    }
+    if (systick_next < t) {
+      t = systick_next;
+      what = 3;
+    }
+    if (dma_running && dma_next < t) {
+      t = dma_next;
+      what = 4;
+    }
+    if (i2c_busy && i2c_end < t) {
+      t = i2c_end;
+      what = 5;
+    }
+    if (flash_busy && flash_end < t) {
+      t = flash_end;
+      what = 6;
+    }
+    if (t > cycles) {
+      break;
+    }
+
+    switch (what) {
+    case 1: usart_rx_done(rx, t); break;
+    case 2: usart_tx_done(tx, t); break;
+    case 3:
+      IRQ_SYSTICK->pending = 1;
+      systick_next = t + SystemCoreClock / 1000;
+      break;
+    case 4: dma_event(t); break;
+    case 5: i2c_event(); break;
+    case 6: flash_event(); break;
+    }
+  }
+
+  if (cycles >= cfg.end_cycles && !finished) {
+    finished = 1;
+    cfg.finish();
+  }
+}
+
+/** The time the next peripheral event happens. */
+static uint64_t next_event(void) {
+  uint64_t t = systick_next;
+
+  if (dma_running && dma_next < t) {
+    t = dma_next;
+  }
+  if (i2c_busy && i2c_end < t) {
+    t = i2c_end;
+  }
+  if (flash_busy && flash_end < t) {
+    t = flash_end;
+  }
+  for (size_t i = 0; i < sizeof(usarts) / sizeof(usarts[0]); i++) {
+    if (usarts[i].rx_coming && usarts[i].rx_done < t) {
+      t = usarts[i].rx_done;
+    }
+    if (usarts[i].shifting && usarts[i].tx_done < t) {
+      t = usarts[i].tx_done;
+    }
+  }
+  return t;
+}
+
+// Running the firmware //////////////////////////////////////////////////////
+
+/** Charges the CPU for what it did since control last went back to the firmware. */
+static void charge(void) {
+  cycles += cfg.poll_cycles;
+  if (cfg.cpu_scale > 0) {
+    double now = host_cpu_time();
+    cycles += (uint64_t)((now - host_mark) * cfg.cpu_scale * SystemCoreClock);
+    host_mark = now;
+  }
+}
+
+static void resume(void) {
+  if (cfg.cpu_scale > 0) {
+    host_mark = host_cpu_time();
+  }
+}
+
+/** Takes every interrupt that preempts what is running, nesting as the
+ * NVIC would, as each handler's own polls come here too.
+ */
+static void dispatch(void) {
+  sim_irq *q;
+
+  while ((q = select_irq(0)) != NULL) {
+    uint32_t interrupted = exec_group;
+
+    q->pending = 0;
+    exec_group = group_of(q->priority);
+    cycles += cfg.poll_cycles; // Stacking & unstacking
+    resume();
+    q->handler();
+    charge();
+    exec_group = interrupted;
+    update();
+  }
+}
+
+void sim_poll(void) {
+  charge();
+  update();
+  dispatch();
+  resume();
+}
+
+void sim_wfi(void) {
+  charge();
+  update();
+  dispatch();
+  while (select_irq(1) == NULL) {
+    uint64_t t = next_event();
+    if (t > cycles) {
+      idle_cycles += t - cycles;
+      cycles = t;
+    }
+    update();
+  }
+  dispatch();
+  resume();
+}
+
+static void flash_init(void);
+
+void sim_init(const sim_config *config) {
+  cfg = *config;
+  flash_init();
+  systick_next = SystemCoreClock / 1000;
+  host_start = host_time();
+  host_mark = host_cpu_time();
+}
+
+uint64_t sim_now(void) {
+  return cycles;
+}
+
+uint64_t sim_idle_cycles(void) {
+  return idle_cycles;
+}
+
+double sim_host_seconds(void) {
+  return host_time() - host_start;
+}
+
+// Core registers & intrinsics ///////////////////////////////////////////////
+
+DWT_Type *sim_dwt(void) {
+  sim_poll();
+  dwt.CYCCNT = (uint32_t)cycles;
+  return &dwt;
+}
+
+SCB_Type *sim_scb(void) {
+  sim_poll();
+  return &scb;
+}
+
+TIM_TypeDef *sim_tim2(void) {
+  sim_poll();
+  if (tim2.CR1 & TIM_CR1_CEN) {
+    uint32_t timer_clock = HAL_RCC_GetPCLK1Freq();
+    if ((sim_rcc.CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) {
+      timer_clock *= 2;
+    }
+    tim2.CNT = (uint32_t)(cycles / (SystemCoreClock / timer_clock) / (tim2.PSC + 1));
+  }
+  return &tim2;
+}
+
+uint32_t __get_PRIMASK(void) {
+  return primask;
+}
+
+void __set_PRIMASK(uint32_t value) {
+  primask = value & 1;
+  if (!primask) {
+    sim_poll();
+  }
+}
+
+void __disable_irq(void) {
+  primask = 1;
+}
+
+void __enable_irq(void) {
+  primask = 0;
+  sim_poll();
+}
+
+uint32_t __get_BASEPRI(void) {
+  return basepri;
+}
+
+void __set_BASEPRI(uint32_t value) {
+  basepri = value & 0xF0; // Only the top __NVIC_PRIO_BITS exist
+  sim_poll();
+}
+
+uint32_t NVIC_GetPriorityGrouping(void) {
+  return prigroup;
+}
+
+// HAL ///////////////////////////////////////////////////////////////////////
+
+void HAL_NVIC_SetPriorityGrouping(uint32_t PriorityGroup) {
+  prigroup = PriorityGroup & 7;
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) {
+  find_irq(IRQn)->priority =
+      (uint8_t)(NVIC_EncodePriority(prigroup, PreemptPriority, SubPriority) << (8 - __NVIC_PRIO_BITS));
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) {
+  find_irq(IRQn)->enabled = 1;
+  sim_poll();
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn) {
+  find_irq(IRQn)->enabled = 0;
+  sim_poll();
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void) {
+  uint32_t ppre1 = (sim_rcc.CFGR & RCC_CFGR_PPRE1) >> 10;
+  return ppre1 < 4 ? SystemCoreClock : SystemCoreClock >> (ppre1 - 3);
+}
+
+uint32_t HAL_GetTick(void) {
+  sim_poll();
+  return uw_tick;
+}
+
+void HAL_IncTick(void) {
+  uw_tick++;
+}
+
+void HAL_DBGMCU_EnableDBGSleepMode(void) {
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init) {
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+  sim_poll();
+  return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+  if (PinState != GPIO_PIN_RESET) {
+    GPIOx->ODR |= GPIO_Pin;
+  } else {
+    GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+  }
+  sim_poll();
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+  GPIOx->ODR ^= GPIO_Pin;
+  sim_poll();
+}
+
+// USART /////////////////////////////////////////////////////////////////////
+
+void sim_usart_attach(USART_TypeDef *usart, IRQn_Type irq, uint32_t baud,
+                      sim_rx_source source, void *source_ctx, FILE *sink) {
+  sim_usart_model *m = usart_model(usart);
+
+  m->regs = usart;
+  m->irq = find_irq(irq);
+  m->irq->usart = m;
+  m->source = source;
+  m->source_ctx = source_ctx;
+  m->sink = sink;
+  sim_usart_set_baud(usart, baud);
+  // As HAL_UART_Init() leaves it
+  usart->CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE;
+  usart->ISR = USART_ISR_TXE | USART_ISR_TC;
+  usart_next_rx(m, cycles);
+}
+
+const sim_usart_stats *sim_usart_get_stats(USART_TypeDef *usart) {
+  return &usart_model(usart)->stats;
+}
+
+void sim_usart_set_baud(USART_TypeDef *usart, uint32_t baud) {
+  usart_model(usart)->byte_cycles = (uint64_t)SystemCoreClock * 10 / baud;
+}
+
+uint8_t sim_usart_receive(USART_TypeDef *usart) {
+  sim_usart_model *m = usart_model(usart);
+
+  sim_poll();
+  if (usart->ISR & USART_ISR_RXNE) {
+    if (cycles - m->rdr_since > m->stats.max_rx_wait) {
+      m->stats.max_rx_wait = cycles - m->rdr_since;
+    }
+    usart->ISR &= ~USART_ISR_RXNE;
+  }
+  return (uint8_t)usart->RDR;
+}
+
+void sim_usart_transmit(USART_TypeDef *usart, uint8_t value) {
+  sim_usart_model *m = usart_model(usart);
+
+  sim_poll();
+  usart->TDR = value;
+  if ((usart->CR1 & (USART_CR1_UE | USART_CR1_TE)) != (USART_CR1_UE | USART_CR1_TE)) {
+    return;
+  }
+  if (!(usart->ISR & USART_ISR_TXE)) {
+    m->stats.tx_overwrites++;
+    m->tdr = value;
+  } else if (!m->shifting) {
+    // Straight into the shift register; TDR stays empty
+    m->shifting = 1;
+    m->shift = value;
+    m->tx_done = cycles + m->byte_cycles;
+    usart->ISR &= ~USART_ISR_TC;
+  } else {
+    m->tdr = value;
+    m->tdr_full = 1;
+    usart->ISR &= ~USART_ISR_TXE;
+  }
+}
+
+void sim_uart_enable_it(UART_HandleTypeDef *huart, uint32_t it) {
+  if (it & UART_IT_ERR) {
+    huart->Instance->CR3 |= USART_CR3_EIE;
+  }
+  sim_poll();
+}
+
+/** Only the overrun handling of the HAL's: with no HAL reception going
+ * on, it ends reception (RXNEIE & EIE off) and calls the error callback.
+ * As in the HAL, ErrorCode is left set.
+ */
+void HAL_UART_IRQHandler(UART_HandleTypeDef *huart) {
+  USART_TypeDef *u = huart->Instance;
+
+  sim_poll();
+  if ((u->ISR & USART_ISR_ORE) && ((u->CR1 & USART_CR1_RXNEIE) || (u->CR3 & USART_CR3_EIE))) {
+    u->ISR &= ~USART_ISR_ORE;
+    huart->ErrorCode |= HAL_UART_ERROR_ORE;
+    u->CR1 &= ~USART_CR1_RXNEIE;
+    u->CR3 &= ~USART_CR3_EIE;
+    HAL_UART_ErrorCallback(huart);
+  }
+}
+
+// I2S DMA ///////////////////////////////////////////////////////////////////
+
+HAL_StatusTypeDef HAL_I2S_Transmit_DMA(I2S_HandleTypeDef *hi2s, uint16_t *pData, uint16_t Size) {
+  // Size is in 16 bit samples, two to a stereo frame, in two halves
+  dma_i2s = hi2s;
+  dma_half_cycles = (uint64_t)SystemCoreClock * (Size / 4) / hi2s->Init.AudioFreq;
+  dma_half = 0;
+  dma_flags = 0;
+  dma_running = 1;
+  dma_next = cycles + dma_half_cycles;
+  find_irq(DMA1_Stream5_IRQn)->enabled = 1;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2S_DMAPause(I2S_HandleTypeDef *hi2s) {
+  dma_running = 0;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2S_DMAResume(I2S_HandleTypeDef *hi2s) {
+  dma_running = 1;
+  dma_next = cycles + dma_half_cycles;
+  return HAL_OK;
+}
+
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma) {
+  uint32_t flags;
+
+  sim_poll();
+  flags = dma_flags;
+  dma_flags = 0;
+  if (flags & 1) {
+    HAL_I2S_TxHalfCpltCallback(dma_i2s);
+  }
+  if (flags & 2) {
+    HAL_I2S_TxCpltCallback(dma_i2s);
+  }
+}
+
+const sim_audio_stats *sim_audio_get_stats(void) {
+  return &audio_stats;
+}
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma) {
+  return HAL_OK;
+}
+
+// I2C & the display /////////////////////////////////////////////////////////
+
+#define I2C_BIT_RATE   400000
+#define OLED_ADDRESS   0x3C
+#define OLED_PAGES     8
+#define OLED_COLUMNS   128
+
+static I2C_HandleTypeDef *i2c_handle;
+static const uint8_t *i2c_data; // Read as the transfer ends, as if by the DMA
+static uint16_t i2c_size;
+static int i2c_nack;
+static sim_display_stats display_stats;
+
+// The controller's display RAM & where it writes next
+static uint8_t oled_ram[OLED_PAGES][OLED_COLUMNS];
+static uint8_t oled_page;
+static uint8_t oled_column;
+static int oled_args;           // Of the last command, yet to come
+
+/** The number of argument bytes of an SSD1306 command. */
+static int oled_command_args(uint8_t command) {
+  switch (command) {
+  case 0x21: // Column address
+  case 0x22: // Page address
+    return 2;
+  case 0x20: // Addressing mode
+  case 0x81: // Contrast
+  case 0x8D: // Charge pump
+  case 0xA8: // Multiplex ratio
+  case 0xD3: // Display offset
+  case 0xD5: // Clock
+  case 0xD9: // Pre-charge
+  case 0xDA: // COM pins
+  case 0xDB: // VCOMH
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static void oled_receive_command(uint8_t b) {
+  if (oled_args > 0) {
+    oled_args--;
+    return;
+  }
+  if (b <= 0x0F) {
+    oled_column = (oled_column & 0xF0) | b;
+  } else if (b <= 0x1F) {
+    oled_column = (uint8_t)(((b & 0x0F) << 4) | (oled_column & 0x0F));
+  } else if (b >= 0xB0 && b <= 0xB7) {
+    oled_page = b & 0x07;
+  } else if (b == 0xAE || b == 0xAF) {
+    display_stats.on = b == 0xAF;
+  } else {
+    oled_args = oled_command_args(b);
+  }
+}
+
+/** A transfer to the SSD1306: control bytes, each followed by one
+ * command or data byte if Co is set, else by all the rest.
+ */
+static void oled_receive(const uint8_t *p, size_t len) {
+  const uint8_t *end = p + len;
+
+  while (p < end) {
+    uint8_t control = *p++;
+    const uint8_t *stop = (control & 0x80) ? p + 1 : end;
+    for (; p < stop && p < end; p++) {
+      if (control & 0x40) {
+        if (oled_column < OLED_COLUMNS) {
+          oled_ram[oled_page][oled_column++] = *p;
+        }
+      } else {
+        oled_receive_command(*p);
+      }
+    }
+  }
+}
+
+static void i2c_event(void) {
+  i2c_busy = 0;
+  i2c_done = 1;
+  if (!i2c_nack) {
+    display_stats.transfers++;
+    display_stats.bytes += i2c_size;
+    oled_receive(i2c_data, i2c_size);
+  }
+}
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2CEx_ConfigAnalogFilter(I2C_HandleTypeDef *hi2c, uint32_t AnalogFilter) {
+  return HAL_OK;
+}
+
+/** Nine bit times a byte, the address included, then the completion
+ * (I2C1_EV, as the stop condition goes); a NACK of the address ends
+ * it after the first.
+ */
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress,
+                                              uint8_t *pData, uint16_t Size) {
+  sim_poll();
+  if (i2c_busy || i2c_done) {
+    return HAL_BUSY;
+  }
+  i2c_handle = hi2c;
+  i2c_data = pData;
+  i2c_size = Size;
+  i2c_nack = (DevAddress >> 1) != OLED_ADDRESS;
+  i2c_busy = 1;
+  i2c_end = cycles + (uint64_t)SystemCoreClock * 9 * (i2c_nack ? 1 : 1 + Size) / I2C_BIT_RATE;
+  return HAL_OK;
+}
+
+void HAL_I2C_EV_IRQHandler(I2C_HandleTypeDef *hi2c) {
+  sim_poll();
+  if (!i2c_done) {
+    return;
+  }
+  i2c_done = 0;
+  if (i2c_nack) {
+    hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+    HAL_I2C_ErrorCallback(i2c_handle);
+  } else {
+    HAL_I2C_MasterTxCpltCallback(i2c_handle);
+  }
+}
+
+// Bus errors are not simulated
+void HAL_I2C_ER_IRQHandler(I2C_HandleTypeDef *hi2c) {
+}
+
+const sim_display_stats *sim_display_get_stats(void) {
+  return &display_stats;
+}
+
+/** The display's RAM, as the screen shows it, a character a pixel. */
+void sim_display_print(FILE *f) {
+  for (int y = 0; y < OLED_PAGES * 8; y++) {
+    for (int x = 0; x < OLED_COLUMNS; x++) {
+      fputc((oled_ram[y / 8][x] >> (y % 8)) & 1 ? '#' : '.', f);
+    }
+    fputc('\n', f);
+  }
+}
+
+// USB device ////////////////////////////////////////////////////////////////
+
+// Unplugged: the OTG_FS interrupt is never asserted.
+
+HAL_StatusTypeDef HAL_PCD_Start(PCD_HandleTypeDef *hpcd) {
+  sim_poll();
+  return HAL_OK;
+}
+
+void HAL_PCD_IRQHandler(PCD_HandleTypeDef *hpcd) {
+}
+
+HAL_StatusTypeDef HAL_PCD_SetAddress(PCD_HandleTypeDef *hpcd, uint8_t address) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_EP_Open(PCD_HandleTypeDef *hpcd, uint8_t ep_addr, uint16_t ep_mps, uint8_t ep_type) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_EP_Close(PCD_HandleTypeDef *hpcd, uint8_t ep_addr) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_EP_Receive(PCD_HandleTypeDef *hpcd, uint8_t ep_addr, uint8_t *pBuf, uint32_t len) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_EP_Transmit(PCD_HandleTypeDef *hpcd, uint8_t ep_addr, uint8_t *pBuf, uint32_t len) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_EP_SetStall(PCD_HandleTypeDef *hpcd, uint8_t ep_addr) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCD_EP_ClrStall(PCD_HandleTypeDef *hpcd, uint8_t ep_addr) {
+  return HAL_OK;
+}
+
+uint32_t HAL_PCD_EP_GetRxCount(PCD_HandleTypeDef const *hpcd, uint8_t ep_addr) {
+  return 0;
+}
+
+HAL_StatusTypeDef HAL_PCDEx_SetTxFiFo(PCD_HandleTypeDef *hpcd, uint8_t fifo, uint16_t size) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_PCDEx_SetRxFiFo(PCD_HandleTypeDef *hpcd, uint16_t size) {
+  return HAL_OK;
+}
+
+// Ethernet //////////////////////////////////////////////////////////////////
+
+// Unplugged: the PHY reports no link, so the MAC is never started.
+
+HAL_StatusTypeDef HAL_ETH_Start_IT(ETH_HandleTypeDef *heth) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ETH_Stop_IT(ETH_HandleTypeDef *heth) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ETH_ReadData(ETH_HandleTypeDef *heth, void **pAppBuff) {
+  return HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_ETH_Transmit_IT(ETH_HandleTypeDef *heth, ETH_TxPacketConfig *pTxConfig) {
+  return HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_ETH_ReleaseTxPacket(ETH_HandleTypeDef *heth) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ETH_ReadPHYRegister(ETH_HandleTypeDef *heth, uint32_t PHYAddr, uint32_t PHYReg,
+                                          uint32_t *pRegValue) {
+  *pRegValue = 0;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ETH_GetMACConfig(ETH_HandleTypeDef *heth, ETH_MACConfigTypeDef *macconf) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ETH_SetMACConfig(ETH_HandleTypeDef *heth, ETH_MACConfigTypeDef *macconf) {
+  return HAL_OK;
+}
+
+void HAL_ETH_IRQHandler(ETH_HandleTypeDef *heth) {
+}
+
+// Flash /////////////////////////////////////////////////////////////////////
+
+#define FLASH_ADDRESS    0x08000000UL
+#define FLASH_SIZE       (2048 * 1024)
+#define FLASH_PROGRAM_US 16   // A word, x32
+#define FLASH_ERASE_US   8000 // A KB of a sector, x32: 2 s for 256 KB
+
+static uint8_t *flash_mem;     // Mapped at FLASH_ADDRESS, where the firmware reads it
+static int flash_unlocked;
+static int flash_erasing;      // The operation is an erase, else a program
+static uint32_t flash_address; // Of the word being programmed
+static uint32_t flash_word;
+static uint32_t flash_sector;  // Being erased
+static uint32_t flash_offset;  // Of that sector, from FLASH_ADDRESS
+static uint32_t flash_size;    // Of that sector
+static uint32_t flash_sectors; // Left to erase, this one included
+static sim_flash_stats flash_stats;
+
+/** Maps the flash where the firmware expects it, erased, in the
+ * default single bank layout.
+ */
+static void flash_init(void) {
+  void *p = mmap((void *)FLASH_ADDRESS, FLASH_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+  if (p != (void *)FLASH_ADDRESS) {
+    fprintf(stderr, "sim: cannot map the flash at 0x%08lX\n", FLASH_ADDRESS);
+    exit(2);
+  }
+  flash_mem = p;
+  memset(flash_mem, 0xFF, FLASH_SIZE);
+  sim_flash_regs.OPTCR = FLASH_OPTCR_nDBANK;
+}
+
+/** Where a sector starts & its size: 4 of 32 KB, 1 of 128 KB & 7 of
+ * 256 KB in single bank; in dual bank, half that in each bank, the
+ * second's numbered from 12.
+ */
+static int flash_sector_span(uint32_t sector, uint32_t *offset, uint32_t *size) {
+  int dual = (sim_flash_regs.OPTCR & FLASH_OPTCR_nDBANK) == 0;
+  uint32_t unit = dual ? 16 * 1024 : 32 * 1024;
+  uint32_t bank = 0;
+
+  if (dual && sector >= 12) {
+    bank = FLASH_SIZE / 2;
+    sector -= 12;
+  }
+  if (sector >= 12) {
+    return 0;
+  }
+  if (sector < 4) {
+    *offset = sector * unit;
+    *size = unit;
+  } else if (sector == 4) {
+    *offset = 4 * unit;
+    *size = 4 * unit;
+  } else {
+    *offset = (sector - 4) * 8 * unit;
+    *size = 8 * unit;
+  }
+  *offset += bank;
+  return 1;
+}
+
+static void flash_start_sector(void) {
+  flash_sector_span(flash_sector, &flash_offset, &flash_size);
+  flash_busy = 1;
+  flash_end = cycles + (uint64_t)SystemCoreClock / 1000000 * FLASH_ERASE_US * (flash_size / 1024);
+}
+
+/** NOR: programming can only clear bits. */
+static void flash_event(void) {
+  flash_busy = 0;
+  flash_done = 1;
+  if (flash_erasing) {
+    memset(flash_mem + flash_offset, 0xFF, flash_size);
+    flash_stats.sectors_erased++;
+  } else {
+    uint32_t word;
+    memcpy(&word, flash_mem + (flash_address - FLASH_ADDRESS), 4);
+    word &= flash_word;
+    memcpy(flash_mem + (flash_address - FLASH_ADDRESS), &word, 4);
+    flash_stats.words_programmed++;
+  }
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) {
+  sim_poll();
+  flash_unlocked = 1;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void) {
+  sim_poll();
+  flash_unlocked = 0;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program_IT(uint32_t TypeProgram, uint32_t Address, uint64_t Data) {
+  sim_poll();
+  if (flash_busy || flash_done) {
+    return HAL_BUSY;
+  }
+  if (!flash_unlocked || TypeProgram != FLASH_TYPEPROGRAM_WORD || Address % 4 != 0 ||
+      Address < FLASH_ADDRESS || Address - FLASH_ADDRESS > FLASH_SIZE - 4) {
+    return HAL_ERROR;
+  }
+  flash_erasing = 0;
+  flash_address = Address;
+  flash_word = (uint32_t)Data;
+  flash_busy = 1;
+  flash_end = cycles + (uint64_t)SystemCoreClock / 1000000 * FLASH_PROGRAM_US;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase_IT(FLASH_EraseInitTypeDef *pEraseInit) {
+  uint32_t offset;
+  uint32_t size;
+
+  sim_poll();
+  if (flash_busy || flash_done) {
+    return HAL_BUSY;
+  }
+  if (!flash_unlocked || pEraseInit->TypeErase != FLASH_TYPEERASE_SECTORS ||
+      pEraseInit->NbSectors == 0 ||
+      !flash_sector_span(pEraseInit->Sector + pEraseInit->NbSectors - 1, &offset, &size)) {
+    return HAL_ERROR;
+  }
+  flash_erasing = 1;
+  flash_sector = pEraseInit->Sector;
+  flash_sectors = pEraseInit->NbSectors;
+  flash_start_sector();
+  return HAL_OK;
+}
+
+/** As the HAL does: the end of a program passes its address; an erase
+ * passes each sector as it is done, then 0xFFFFFFFF after the last.
+ */
+void HAL_FLASH_IRQHandler(void) {
+  sim_poll();
+  if (!flash_done) {
+    return;
+  }
+  flash_done = 0;
+  if (!flash_erasing) {
+    HAL_FLASH_EndOfOperationCallback(flash_address);
+    return;
+  }
+  HAL_FLASH_EndOfOperationCallback(flash_sector);
+  if (--flash_sectors > 0) {
+    flash_sector++;
+    flash_start_sector();
+  } else {
+    HAL_FLASH_EndOfOperationCallback(0xFFFFFFFFU);
+  }
+}
+
+void sim_flash_set_dual_bank(int dual) {
+  if (dual) {
+    sim_flash_regs.OPTCR &= ~FLASH_OPTCR_nDBANK;
+  } else {
+    sim_flash_regs.OPTCR |= FLASH_OPTCR_nDBANK;
+  }
+}
+
+uint8_t *sim_flash_memory(void) {
+  return flash_mem;
+}
+
+size_t sim_flash_size(void) {
+  return FLASH_SIZE;
+}
+
+const sim_flash_stats *sim_flash_get_stats(void) {
+  return &flash_stats;
+}
+
+// The unique ID of an imaginary chip
+uint32_t HAL_GetUIDw0(void) {
+  return 0x00200031;
+}
+
+uint32_t HAL_GetUIDw1(void) {
+  return 0x3436510D;
+}
+
+uint32_t HAL_GetUIDw2(void) {
+  return 0x20393750;
+}
@@ -0,0 +1,100 @@
+/*
+ * sim.h
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Register-level simulation of the parts of the STM32F767 the firmware
+ * uses, so that realmain() runs unchanged on Linux: the NVIC (priority
+ * grouping, BASEPRI, PRIMASK, preemption, PendSV, SysTick), USARTs with
+ * byte timing from their baud rates (RXNE, ORE, TXE, TC), the I2S DMA's
+ * half & complete interrupts, TIM2 and the DWT cycle counter, and an
+ * SSD1306 display on I2C1 (transfers timed at 400 kHz, completing by
+ * I2C1_EV, into a model of its display RAM), and the flash (2 MB of
+ * NOR mapped at its own address, words programmed & sectors erased in
+ * the datasheet's typical times, completing by FLASH_IRQn). USB is
+ * there but never plugged in. Reads of the flash while it is busy do
+ * not stall as they would on the chip.
+ *
+ * Everything runs on a virtual clock of CPU cycles at SystemCoreClock.
+ * The firmware's own code takes no virtual time; instead every access to
+ * a (simulated) register, HAL or LL function is a poll point that
+ * charges the CPU a cost, brings the peripherals up to that time, and
+ * takes any interrupt that would have preempted by then. WFI jumps to
+ * the next peripheral event. The cost is either a fixed number of cycles
+ * per poll, which makes runs repeatable, or the host time since the last
+ * poll scaled to the target.
+ *
+ * Interrupts are only taken at poll points, so a long stretch of code
+ * without one (e.g., rendering audio) is seen as a single step; with
+ * host time charged it still costs what it took.
+ */
+
+#ifndef SIM_SIM_H_
+#define SIM_SIM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "stm32f7xx.h"
+
+/** Feeds a USART's receiver: sets the next byte & the cycle it should
+ * start arriving (it is sent no sooner than the line allows), or
+ * returns 0 when there are no more.
+ */
+typedef int (*sim_rx_source)(void *ctx, uint64_t now, uint8_t *byte, uint64_t *start);
+
+typedef struct {
+  uint64_t rx_bytes;     // Received into RDR
+  uint64_t rx_overruns;  // Lost as RXNE was still set (ORE)
+  uint64_t tx_bytes;     // Sent from the shift register
+  uint64_t tx_overwrites; // Written to TDR while TXE was clear
+  uint64_t max_rx_wait;  // Longest a byte sat in RDR, in cycles
+} sim_usart_stats;
+
+typedef struct {
+  uint64_t halves;       // Half & complete DMA events
+  uint64_t misses;       // Previous half not refilled in time
+} sim_audio_stats;
+
+typedef struct {
+  uint64_t transfers;    // To the display, acknowledged
+  uint64_t bytes;
+  int on;                // Whether it was last switched on
+} sim_display_stats;
+
+typedef struct {
+  uint64_t words_programmed;
+  uint64_t sectors_erased;
+} sim_flash_stats;
+
+typedef struct {
+  uint64_t end_cycles;   // When to call finish
+  uint32_t poll_cycles;  // Cycles charged per poll & interrupt entry
+  double cpu_scale;      // If > 0, also charge host time × this
+  const volatile int *audio_pending; // Set while a half buffer awaits refilling
+  void (*finish)(void);  // Called at the end; must not return
+} sim_config;
+
+void sim_init(const sim_config *config);
+uint64_t sim_now(void);
+uint64_t sim_idle_cycles(void);
+double sim_host_seconds(void);
+
+void sim_usart_attach(USART_TypeDef *usart, IRQn_Type irq, uint32_t baud,
+                      sim_rx_source source, void *source_ctx, FILE *sink);
+const sim_usart_stats *sim_usart_get_stats(USART_TypeDef *usart);
+const sim_audio_stats *sim_audio_get_stats(void);
+const sim_display_stats *sim_display_get_stats(void);
+void sim_display_print(FILE *f);
+
+/** The flash starts erased, in single bank. Its contents may be loaded
+ * or changed before the firmware runs.
+ */
+void sim_flash_set_dual_bank(int dual);
+uint8_t *sim_flash_memory(void);
+size_t sim_flash_size(void);
+const sim_flash_stats *sim_flash_get_stats(void);
+
+#endif /* SIM_SIM_H_ */
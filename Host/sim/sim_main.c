@@ -0,0 +1,349 @@
+/*
+ * sim_main.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Runs realmain() on the simulated board (sim.h) for a while, feeding
+ * the MIDI inputs & the console, then reports what was received, lost
+ * to overruns, sent, how many audio half buffers were not refilled in
+ * time, what went to the display, what was written to the flash, and
+ * what the binary MIDI capture (console c) recorded & dropped.
+ *
+ * Usage: sim [options]
+ *   --seconds S      virtual time to run (10)
+ *   --ports N        MIDI inputs fed, from port 0 (5)
+ *   --load PCT       how busy each fed MIDI input is (100: back to back)
+ *   --midi KIND      what they play: notes (the default), or clock, timing
+ *                    clocks alone, the most messages a second
+ *   --keys TEXT      typed into the console, one key each 100 ms from 0.5 s
+ *   --console FILE   where console output goes ("-" for stdout; default none)
+ *   --display FILE   where the display's screen goes at the end, as text
+ *   --flash FILE     the flash's contents, read at the start if it exists
+ *                    & written at the end, so settings last between runs
+ *   --flash-banks N  1 (the default) or 2, as the nDBANK option bit sets
+ *   --poll-cycles N  CPU cycles charged per poll (40)
+ *   --cpu-scale X    also charge host time, the target being X times slower
+ *   --max-overruns N exit 1 if the MIDI inputs lose more bytes than this
+ *   --max-misses N   exit 1 if more audio half buffers than this are late
+ *   --max-capture-drops N exit 1 if the capture drops more records than this,
+ *                    or records none
+ *
+ * Without --cpu-scale a run is repeatable.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "main.h"
+#include "realmain.h"
+#include "midiport.h"
+#include "capture.h"
+#include "sim.h"
+
+// What CubeMX's main.c sets up
+UART_HandleTypeDef huart3;
+UART_HandleTypeDef huart6;
+I2S_HandleTypeDef hi2s3;
+DMA_HandleTypeDef hdma_spi3_tx;
+PCD_HandleTypeDef hpcd_USB_OTG_FS;
+static uint8_t mac_address[6] = { 0x00, 0x80, 0xE1, 0x20, 0x00, 0x31 };
+ETH_HandleTypeDef heth = { .Init = { .MACAddr = mac_address } };
+ETH_TxPacketConfig TxConfig;
+
+extern int i2s_write_available;
+extern capture_log midi_capture;
+
+#define CORE_CLOCK   54000000 // HSE 8 MHz / 4 * 216 / 8
+#define CONSOLE_BAUD 460800
+
+void Error_Handler(void) {
+  fprintf(stderr, "Error_Handler()\n");
+  exit(2);
+}
+
+static double run_seconds = 10;
+static int fed_ports = MIDI_NUM_PORTS;
+static int midi_load = 100;
+static int midi_clock_only = 0;
+static const char *keys = "";
+static uint64_t max_overruns = UINT64_MAX;
+static uint64_t max_misses = UINT64_MAX;
+static uint64_t max_capture_drops = UINT64_MAX;
+static FILE *console;
+static FILE *display;
+static const char *flash_file;
+
+static USART_TypeDef *const port_usarts[MIDI_NUM_PORTS] = {
+    USART6, USART2, UART4, UART5, UART7,
+};
+static const IRQn_Type port_irqs[MIDI_NUM_PORTS] = {
+    USART6_IRQn, USART2_IRQn, UART4_IRQn, UART5_IRQn, UART7_IRQn,
+};
+
+// Stimulus //////////////////////////////////////////////////////////////////
+
+/** Busy playing on one channel per port: notes on & off under running
+ * status, with the odd timing clock between.
+ */
+typedef struct {
+  uint32_t seed;
+  uint8_t channel;
+  uint64_t gap;       // Cycles from the start of one byte to the next
+  uint64_t next;      // When the next starts
+  uint8_t msg[3];
+  int len;
+  int sent;
+  int running;        // Running status is in use
+} midi_source;
+
+static midi_source midi_sources[MIDI_NUM_PORTS];
+
+static uint32_t lcg(uint32_t *seed) {
+  *seed = *seed * 1664525 + 1013904223;
+  return *seed >> 8;
+}
+
+static int midi_next(void *ctx, uint64_t now, uint8_t *byte, uint64_t *start) {
+  midi_source *ms = ctx;
+
+  if (ms->sent == ms->len) {
+    uint32_t r = lcg(&ms->seed);
+    ms->sent = 0;
+    if (midi_clock_only || r % 16 == 0) {
+      ms->msg[0] = 0xF8; // Doesn't cancel running status
+      ms->len = 1;
+    } else {
+      ms->len = 0;
+      if (!ms->running || r % 32 == 1) {
+        ms->msg[ms->len++] = 0x90 | ms->channel;
+        ms->running = 1;
+      }
+      ms->msg[ms->len++] = 36 + lcg(&ms->seed) % 48;
+      ms->msg[ms->len++] = (r & 0x100) ? 0 : 1 + lcg(&ms->seed) % 127; // Half are note off
+    }
+  }
+  *byte = ms->msg[ms->sent++];
+  *start = ms->next;
+  ms->next += ms->gap;
+  return 1;
+}
+
+static uint64_t key_start = CORE_CLOCK / 2;
+static uint64_t key_gap = CORE_CLOCK / 10;
+
+static int keys_next(void *ctx, uint64_t now, uint8_t *byte, uint64_t *start) {
+  const char **k = ctx;
+
+  if (**k == '\0') {
+    return 0;
+  }
+  *byte = (uint8_t)*(*k)++;
+  *start = key_start;
+  key_start += key_gap;
+  return 1;
+}
+
+// Report ////////////////////////////////////////////////////////////////////
+
+static void print_usart(const char *name, USART_TypeDef *usart, uint32_t baud) {
+  const sim_usart_stats *s = sim_usart_get_stats(usart);
+
+  printf("%-8s %6lu %10llu %9llu %10llu %11llu\n", name, (unsigned long)baud,
+         (unsigned long long)s->rx_bytes, (unsigned long long)s->rx_overruns,
+         (unsigned long long)s->tx_bytes,
+         (unsigned long long)(s->max_rx_wait / (CORE_CLOCK / 1000000)));
+}
+
+static void finish(void) {
+  double virtual = (double)sim_now() / CORE_CLOCK;
+  double host = sim_host_seconds();
+  const sim_audio_stats *audio = sim_audio_get_stats();
+  const sim_display_stats *oled = sim_display_get_stats();
+  uint64_t overruns = 0;
+  int failed = 0;
+
+  if (console != NULL) {
+    fflush(console);
+  }
+  printf("\nSimulated %.3f s in %.3f s (%.1fx real time), CPU idle %.1f%%\n",
+         virtual, host, virtual / host, 100.0 * sim_idle_cycles() / sim_now());
+  printf("%-8s %6s %10s %9s %10s %11s\n", "usart", "baud", "rx bytes", "overruns", "tx bytes",
+         "max wait us");
+  print_usart("console", USART3, CONSOLE_BAUD);
+  for (int p = 0; p < MIDI_NUM_PORTS; p++) {
+    print_usart(midi_ports[p].name, port_usarts[p], MIDI_BAUD_RATE);
+    overruns += sim_usart_get_stats(port_usarts[p])->rx_overruns;
+  }
+  printf("Audio: %llu half buffers, %llu late\n", (unsigned long long)audio->halves,
+         (unsigned long long)audio->misses);
+  printf("Display: %s, %llu transfers, %llu bytes\n", oled->on ? "on" : "off",
+         (unsigned long long)oled->transfers, (unsigned long long)oled->bytes);
+  if (display != NULL) {
+    sim_display_print(display);
+    fflush(display);
+  }
+  printf("Flash: %llu words programmed, %llu sectors erased\n",
+         (unsigned long long)sim_flash_get_stats()->words_programmed,
+         (unsigned long long)sim_flash_get_stats()->sectors_erased);
+  printf("Capture: %lu records (%lu repeats), %lu drops, max %lu of %u bytes used\n",
+         (unsigned long)midi_capture.records, (unsigned long)midi_capture.repeats,
+         (unsigned long)midi_capture.drops, (unsigned long)midi_capture.max_used, CAPTURE_SIZE);
+  if (flash_file != NULL) {
+    FILE *f = fopen(flash_file, "wb");
+    if (f == NULL || fwrite(sim_flash_memory(), 1, sim_flash_size(), f) != sim_flash_size() ||
+        fclose(f) != 0) {
+      perror(flash_file);
+      failed = 1;
+    }
+  }
+
+  if (overruns > max_overruns) {
+    printf("FAILED: %llu MIDI bytes lost, over %llu\n", (unsigned long long)overruns,
+           (unsigned long long)max_overruns);
+    failed = 1;
+  }
+  if (audio->misses > max_misses) {
+    printf("FAILED: %llu audio half buffers late, over %llu\n",
+           (unsigned long long)audio->misses, (unsigned long long)max_misses);
+    failed = 1;
+  }
+  if (max_capture_drops != UINT64_MAX && midi_capture.records == 0) {
+    printf("FAILED: nothing captured\n");
+    failed = 1;
+  }
+  if (midi_capture.drops > max_capture_drops) {
+    printf("FAILED: %lu capture records dropped, over %llu\n",
+           (unsigned long)midi_capture.drops, (unsigned long long)max_capture_drops);
+    failed = 1;
+  }
+  exit(failed);
+}
+
+// Setup /////////////////////////////////////////////////////////////////////
+
+static void usage(void) {
+  fprintf(stderr, "usage: sim [--seconds S] [--ports N] [--load PCT] [--midi notes|clock]\n"
+                  "           [--keys TEXT] [--console FILE|-] [--display FILE|-]\n"
+                  "           [--flash FILE] [--flash-banks N] [--poll-cycles N]\n"
+                  "           [--cpu-scale X] [--max-overruns N] [--max-misses N]\n"
+                  "           [--max-capture-drops N]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  sim_config config = { 0 };
+  int flash_banks = 1;
+
+  config.poll_cycles = 40;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (value == NULL) {
+      usage();
+    }
+    i++;
+    if (strcmp(arg, "--seconds") == 0) {
+      run_seconds = atof(value);
+    } else if (strcmp(arg, "--ports") == 0) {
+      fed_ports = atoi(value);
+    } else if (strcmp(arg, "--load") == 0) {
+      midi_load = atoi(value);
+    } else if (strcmp(arg, "--midi") == 0) {
+      if (strcmp(value, "notes") == 0) {
+        midi_clock_only = 0;
+      } else if (strcmp(value, "clock") == 0) {
+        midi_clock_only = 1;
+      } else {
+        usage();
+      }
+    } else if (strcmp(arg, "--keys") == 0) {
+      keys = value;
+    } else if (strcmp(arg, "--console") == 0) {
+      console = strcmp(value, "-") == 0 ? stdout : fopen(value, "w");
+      if (console == NULL) {
+        perror(value);
+        return 2;
+      }
+    } else if (strcmp(arg, "--display") == 0) {
+      display = strcmp(value, "-") == 0 ? stdout : fopen(value, "w");
+      if (display == NULL) {
+        perror(value);
+        return 2;
+      }
+    } else if (strcmp(arg, "--flash") == 0) {
+      flash_file = value;
+    } else if (strcmp(arg, "--flash-banks") == 0) {
+      flash_banks = atoi(value);
+    } else if (strcmp(arg, "--poll-cycles") == 0) {
+      config.poll_cycles = atoi(value);
+    } else if (strcmp(arg, "--cpu-scale") == 0) {
+      config.cpu_scale = atof(value);
+    } else if (strcmp(arg, "--max-overruns") == 0) {
+      max_overruns = strtoull(value, NULL, 10);
+    } else if (strcmp(arg, "--max-misses") == 0) {
+      max_misses = strtoull(value, NULL, 10);
+    } else if (strcmp(arg, "--max-capture-drops") == 0) {
+      max_capture_drops = strtoull(value, NULL, 10);
+    } else {
+      usage();
+    }
+  }
+  if (fed_ports < 0 || fed_ports > MIDI_NUM_PORTS || midi_load < 1 || midi_load > 100 ||
+      flash_banks < 1 || flash_banks > 2) {
+    usage();
+  }
+
+  SystemCoreClock = CORE_CLOCK;
+  config.end_cycles = (uint64_t)(run_seconds * CORE_CLOCK);
+  config.audio_pending = &i2s_write_available;
+  config.finish = finish;
+  sim_init(&config);
+  sim_flash_set_dual_bank(flash_banks == 2);
+  if (flash_file != NULL) {
+    FILE *f = fopen(flash_file, "rb");
+    if (f != NULL) {
+      size_t got = fread(sim_flash_memory(), 1, sim_flash_size(), f);
+      fclose(f);
+      if (got != sim_flash_size()) {
+        fprintf(stderr, "%s: not a %lu byte flash image\n", flash_file,
+                (unsigned long)sim_flash_size());
+        return 2;
+      }
+    }
+  }
+
+  // HAL_Init() & HAL_MspInit()
+  HAL_NVIC_SetPriorityGrouping(NVIC_PRIORITYGROUP_3);
+  HAL_NVIC_SetPriority(SysTick_IRQn, 0, 0); // TICK_INT_PRIORITY
+
+  // MX_DMA_Init(), MX_I2S3_Init(), MX_USART3_UART_Init() & MX_USART6_UART_Init()
+  HAL_NVIC_SetPriority(DMA1_Stream5_IRQn, 1, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream5_IRQn);
+  hi2s3.Init.AudioFreq = I2S_AUDIOFREQ_32K;
+  huart3.Instance = USART3;
+  huart3.Init.BaudRate = CONSOLE_BAUD;
+  sim_usart_attach(USART3, USART3_IRQn, CONSOLE_BAUD, keys_next, &keys, console);
+  HAL_NVIC_SetPriority(USART3_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(USART3_IRQn);
+  huart6.Instance = USART6;
+  huart6.Init.BaudRate = MIDI_BAUD_RATE;
+  HAL_NVIC_SetPriority(USART6_IRQn, 3, 0);
+  HAL_NVIC_EnableIRQ(USART6_IRQn);
+
+  // The MIDI ports' wiring
+  for (int p = 0; p < MIDI_NUM_PORTS; p++) {
+    midi_source *ms = &midi_sources[p];
+    ms->seed = 1 + p;
+    ms->channel = p;
+    ms->gap = (uint64_t)CORE_CLOCK * 10 / MIDI_BAUD_RATE * 100 / midi_load;
+    ms->next = CORE_CLOCK / 10 + p * 1000; // After startup, not all in step
+    sim_usart_attach(port_usarts[p], port_irqs[p], MIDI_BAUD_RATE,
+                     p < fed_ports ? midi_next : NULL, ms, NULL);
+  }
+
+  realmain();
+  return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * stm32f7xx.h (host simulation)
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Stands in for the CMSIS device header when the firmware is built
+ * on Linux against the simulator (sim.h). It has only what the
+ * firmware uses. The core & timer registers are reached through
+ * functions, so that every access brings the virtual clock & the
+ * peripherals up to date, and lets any pending interrupt preempt.
+ */
+
+#ifndef SIM_STM32F7XX_H_
+#define SIM_STM32F7XX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define __IO volatile
+#define __NVIC_PRIO_BITS 4
+
+typedef enum {
+  PendSV_IRQn       = -2,
+  SysTick_IRQn      = -1,
+  FLASH_IRQn        = 4,
+  DMA1_Stream5_IRQn = 16,
+  DMA1_Stream6_IRQn = 17,
+  I2C1_EV_IRQn      = 31,
+  I2C1_ER_IRQn      = 32,
+  USART2_IRQn       = 38,
+  USART3_IRQn       = 39,
+  UART4_IRQn        = 52,
+  UART5_IRQn        = 53,
+  ETH_IRQn          = 61,
+  OTG_FS_IRQn       = 67,
+  USART6_IRQn       = 71,
+  UART7_IRQn        = 82,
+} IRQn_Type;
+
+typedef struct {
+  __IO uint32_t CTRL;
+  __IO uint32_t CYCCNT;
+  __IO uint32_t LAR;
+} DWT_Type;
+
+typedef struct {
+  __IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct {
+  __IO uint32_t ICSR;
+} SCB_Type;
+
+typedef struct {
+  __IO uint32_t CR1;
+  __IO uint32_t EGR;
+  __IO uint32_t CNT;
+  __IO uint32_t PSC;
+  __IO uint32_t ARR;
+} TIM_TypeDef;
+
+typedef struct {
+  __IO uint32_t CFGR;
+  __IO uint32_t DCKCFGR2;
+} RCC_TypeDef;
+
+typedef struct {
+  __IO uint32_t IDR;
+  __IO uint32_t ODR;
+} GPIO_TypeDef;
+
+typedef struct {
+  __IO uint32_t CR1;
+  __IO uint32_t CR3;
+  __IO uint32_t BRR;
+  __IO uint32_t ISR;
+  __IO uint32_t RDR;
+  __IO uint32_t TDR;
+} USART_TypeDef;
+
+typedef struct {
+  __IO uint32_t CR;
+} I2C_TypeDef;
+
+typedef struct {
+  __IO uint32_t CR;
+} DMA_Stream_TypeDef;
+
+typedef struct {
+  __IO uint32_t OPTCR;
+} FLASH_TypeDef;
+
+#define DWT_CTRL_CYCCNTENA_Msk     (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define SCB_ICSR_PENDSVSET_Msk     (1UL << 28)
+#define TIM_CR1_CEN                (1UL << 0)
+#define TIM_EGR_UG                 (1UL << 0)
+#define RCC_CFGR_PPRE1             (7UL << 10)
+#define RCC_CFGR_PPRE1_DIV1        0UL
+#define FLASH_OPTCR_nDBANK         (1UL << 29)
+
+DWT_Type *sim_dwt(void);
+SCB_Type *sim_scb(void);
+TIM_TypeDef *sim_tim2(void);
+extern CoreDebug_Type sim_core_debug;
+extern RCC_TypeDef sim_rcc;
+extern GPIO_TypeDef sim_gpio[11];
+extern USART_TypeDef sim_usart[9];
+extern I2C_TypeDef sim_i2c1;
+extern DMA_Stream_TypeDef sim_dma1_stream6;
+extern FLASH_TypeDef sim_flash_regs;
+
+#define DWT       (sim_dwt())
+#define SCB       (sim_scb())
+#define TIM2      (sim_tim2())
+#define CoreDebug (&sim_core_debug)
+#define RCC       (&sim_rcc)
+#define FLASH     (&sim_flash_regs)
+
+#define GPIOA (&sim_gpio[0])
+#define GPIOB (&sim_gpio[1])
+#define GPIOC (&sim_gpio[2])
+#define GPIOD (&sim_gpio[3])
+#define GPIOE (&sim_gpio[4])
+#define GPIOF (&sim_gpio[5])
+#define GPIOG (&sim_gpio[6])
+#define GPIOH (&sim_gpio[7])
+
+#define USART2 (&sim_usart[2])
+#define USART3 (&sim_usart[3])
+#define UART4  (&sim_usart[4])
+#define UART5  (&sim_usart[5])
+#define USART6 (&sim_usart[6])
+#define UART7  (&sim_usart[7])
+
+#define I2C1         (&sim_i2c1)
+#define DMA1_Stream6 (&sim_dma1_stream6)
+
+extern uint32_t SystemCoreClock;
+
+// Cortex-M intrinsics. Unmasking & sleeping let interrupts in.
+void sim_wfi(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_BASEPRI(void);
+void __set_BASEPRI(uint32_t basepri);
+
+#define __WFI() sim_wfi()
+#define __DSB() __sync_synchronize()
+#define __DMB() __sync_synchronize()
+#define __ISB() __sync_synchronize()
+#define __CLZ(x) ((x) == 0 ? 32U : (uint32_t)__builtin_clz(x))
+
+uint32_t NVIC_GetPriorityGrouping(void);
+
+/** As CMSIS core_cm7.h. */
+static inline uint32_t NVIC_EncodePriority(uint32_t PriorityGroup, uint32_t PreemptPriority,
+                                           uint32_t SubPriority) {
+  uint32_t group = PriorityGroup & 0x07UL;
+  uint32_t preempt_bits = (7UL - group) > __NVIC_PRIO_BITS ? __NVIC_PRIO_BITS : 7UL - group;
+  uint32_t sub_bits = (group + __NVIC_PRIO_BITS) < 7UL ? 0UL : group - 7UL + __NVIC_PRIO_BITS;
+
+  return ((PreemptPriority & ((1UL << preempt_bits) - 1UL)) << sub_bits) |
+         (SubPriority & ((1UL << sub_bits) - 1UL));
+}
+
+#endif /* SIM_STM32F7XX_H_ */
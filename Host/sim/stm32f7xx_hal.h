@@ -0,0 +1,320 @@
+/*
+ * stm32f7xx_hal.h (host simulation)
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * Stands in for the STM32 HAL when the firmware is built on Linux
+ * against the simulator (sim.h). Only what the firmware uses.
+ */
+
+#ifndef SIM_STM32F7XX_HAL_H_
+#define SIM_STM32F7XX_HAL_H_
+
+#include "stm32f7xx.h"
+
+typedef enum {
+  HAL_OK = 0,
+  HAL_ERROR,
+  HAL_BUSY,
+  HAL_TIMEOUT
+} HAL_StatusTypeDef;
+
+#define UNUSED(x) ((void)(x))
+
+// GPIO //////////////////////////////////////////////////////////////////////
+
+typedef enum {
+  GPIO_PIN_RESET = 0,
+  GPIO_PIN_SET
+} GPIO_PinState;
+
+#define GPIO_PIN_0  ((uint16_t)0x0001)
+#define GPIO_PIN_1  ((uint16_t)0x0002)
+#define GPIO_PIN_2  ((uint16_t)0x0004)
+#define GPIO_PIN_3  ((uint16_t)0x0008)
+#define GPIO_PIN_4  ((uint16_t)0x0010)
+#define GPIO_PIN_5  ((uint16_t)0x0020)
+#define GPIO_PIN_6  ((uint16_t)0x0040)
+#define GPIO_PIN_7  ((uint16_t)0x0080)
+#define GPIO_PIN_8  ((uint16_t)0x0100)
+#define GPIO_PIN_9  ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+
+typedef struct {
+  uint32_t Pin;
+  uint32_t Mode;
+  uint32_t Pull;
+  uint32_t Speed;
+  uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_MODE_AF_PP     0x02U
+#define GPIO_MODE_AF_OD     0x12U
+#define GPIO_PULLUP         0x01U
+#define GPIO_SPEED_FREQ_LOW 0x00U
+#define GPIO_AF7_USART2     0x07U
+#define GPIO_AF8_UART4      0x08U
+#define GPIO_AF8_UART5      0x08U
+#define GPIO_AF8_UART7      0x08U
+#define GPIO_AF4_I2C1       0x04U
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+// RCC, Cortex & system //////////////////////////////////////////////////////
+
+#define __HAL_RCC_GPIOB_CLK_ENABLE()  do { } while (0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE()  do { } while (0)
+#define __HAL_RCC_GPIOD_CLK_ENABLE()  do { } while (0)
+#define __HAL_RCC_GPIOE_CLK_ENABLE()  do { } while (0)
+#define __HAL_RCC_USART2_CLK_ENABLE() do { } while (0)
+#define __HAL_RCC_UART4_CLK_ENABLE()  do { } while (0)
+#define __HAL_RCC_UART5_CLK_ENABLE()  do { } while (0)
+#define __HAL_RCC_UART7_CLK_ENABLE()  do { } while (0)
+#define __HAL_RCC_TIM2_CLK_ENABLE()   do { } while (0)
+#define __HAL_RCC_I2C1_CLK_ENABLE()   do { } while (0)
+#define __HAL_RCC_DMA1_CLK_ENABLE()   do { } while (0)
+
+#define NVIC_PRIORITYGROUP_3 0x00000004U
+
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+void HAL_NVIC_SetPriorityGrouping(uint32_t PriorityGroup);
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn);
+uint32_t HAL_GetTick(void);
+void HAL_IncTick(void);
+void HAL_DBGMCU_EnableDBGSleepMode(void);
+
+// UART //////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  uint32_t BaudRate;
+} UART_InitTypeDef;
+
+typedef struct {
+  USART_TypeDef *Instance;
+  UART_InitTypeDef Init;
+  volatile uint32_t ErrorCode;
+} UART_HandleTypeDef;
+
+#define HAL_UART_ERROR_NONE 0x00U
+#define HAL_UART_ERROR_ORE  0x08U
+#define UART_IT_ERR         0x01U
+
+void sim_uart_enable_it(UART_HandleTypeDef *huart, uint32_t it);
+#define __HAL_UART_ENABLE_IT(h, it) sim_uart_enable_it((h), (it))
+
+void HAL_UART_IRQHandler(UART_HandleTypeDef *huart);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
+
+// DMA & I2S /////////////////////////////////////////////////////////////////
+
+typedef struct {
+  uint32_t Channel;
+  uint32_t Direction;
+  uint32_t PeriphInc;
+  uint32_t MemInc;
+  uint32_t PeriphDataAlignment;
+  uint32_t MemDataAlignment;
+  uint32_t Mode;
+  uint32_t Priority;
+  uint32_t FIFOMode;
+} DMA_InitTypeDef;
+
+typedef struct {
+  DMA_Stream_TypeDef *Instance;
+  DMA_InitTypeDef Init;
+  void *Parent;
+} DMA_HandleTypeDef;
+
+#define DMA_CHANNEL_1        0x02000000U
+#define DMA_MEMORY_TO_PERIPH 0x00000040U
+#define DMA_PINC_DISABLE     0x00000000U
+#define DMA_MINC_ENABLE      0x00000400U
+#define DMA_PDATAALIGN_BYTE  0x00000000U
+#define DMA_MDATAALIGN_BYTE  0x00000000U
+#define DMA_NORMAL           0x00000000U
+#define DMA_PRIORITY_LOW     0x00000000U
+#define DMA_FIFOMODE_DISABLE 0x00000000U
+
+#define __HAL_LINKDMA(h, field, dma) \
+  do { (h)->field = &(dma); (dma).Parent = (h); } while (0)
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+
+typedef struct {
+  uint32_t AudioFreq;
+} I2S_InitTypeDef;
+
+typedef struct {
+  I2S_InitTypeDef Init;
+} I2S_HandleTypeDef;
+
+#define I2S_AUDIOFREQ_32K 32000U
+
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_I2S_Transmit_DMA(I2S_HandleTypeDef *hi2s, uint16_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2S_DMAPause(I2S_HandleTypeDef *hi2s);
+HAL_StatusTypeDef HAL_I2S_DMAResume(I2S_HandleTypeDef *hi2s);
+void HAL_I2S_TxHalfCpltCallback(I2S_HandleTypeDef *hi2s);
+void HAL_I2S_TxCpltCallback(I2S_HandleTypeDef *hi2s);
+
+// I2C ///////////////////////////////////////////////////////////////////////
+
+// I2C1 has an SSD1306 at 0x3C on it, which takes whatever is sent (see
+// sim.h). Only master transmission by DMA.
+
+typedef struct {
+  uint32_t Timing;
+  uint32_t OwnAddress1;
+  uint32_t AddressingMode;
+  uint32_t DualAddressMode;
+  uint32_t OwnAddress2;
+  uint32_t OwnAddress2Masks;
+  uint32_t GeneralCallMode;
+  uint32_t NoStretchMode;
+} I2C_InitTypeDef;
+
+typedef struct {
+  I2C_TypeDef *Instance;
+  I2C_InitTypeDef Init;
+  DMA_HandleTypeDef *hdmatx;
+  volatile uint32_t ErrorCode;
+} I2C_HandleTypeDef;
+
+#define I2C_ADDRESSINGMODE_7BIT 0x00000001U
+#define I2C_DUALADDRESS_DISABLE 0x00000000U
+#define I2C_OA2_NOMASK          0x00U
+#define I2C_GENERALCALL_DISABLE 0x00000000U
+#define I2C_NOSTRETCH_DISABLE   0x00000000U
+#define I2C_ANALOGFILTER_ENABLE 0x00000000U
+#define HAL_I2C_ERROR_AF        0x00000004U
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2CEx_ConfigAnalogFilter(I2C_HandleTypeDef *hi2c, uint32_t AnalogFilter);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress,
+                                              uint8_t *pData, uint16_t Size);
+void HAL_I2C_EV_IRQHandler(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ER_IRQHandler(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+
+// USB device (PCD) //////////////////////////////////////////////////////////
+
+// No host is ever attached: the device starts and is never reset,
+// addressed or configured, so none of the callbacks are called.
+
+typedef struct {
+  uint32_t Setup[12];
+} PCD_HandleTypeDef;
+
+#define EP_TYPE_CTRL 0U
+#define EP_TYPE_BULK 2U
+#define EP_TYPE_INTR 3U
+
+HAL_StatusTypeDef HAL_PCD_Start(PCD_HandleTypeDef *hpcd);
+void HAL_PCD_IRQHandler(PCD_HandleTypeDef *hpcd);
+HAL_StatusTypeDef HAL_PCD_SetAddress(PCD_HandleTypeDef *hpcd, uint8_t address);
+HAL_StatusTypeDef HAL_PCD_EP_Open(PCD_HandleTypeDef *hpcd, uint8_t ep_addr, uint16_t ep_mps, uint8_t ep_type);
+HAL_StatusTypeDef HAL_PCD_EP_Close(PCD_HandleTypeDef *hpcd, uint8_t ep_addr);
+HAL_StatusTypeDef HAL_PCD_EP_Receive(PCD_HandleTypeDef *hpcd, uint8_t ep_addr, uint8_t *pBuf, uint32_t len);
+HAL_StatusTypeDef HAL_PCD_EP_Transmit(PCD_HandleTypeDef *hpcd, uint8_t ep_addr, uint8_t *pBuf, uint32_t len);
+HAL_StatusTypeDef HAL_PCD_EP_SetStall(PCD_HandleTypeDef *hpcd, uint8_t ep_addr);
+HAL_StatusTypeDef HAL_PCD_EP_ClrStall(PCD_HandleTypeDef *hpcd, uint8_t ep_addr);
+uint32_t HAL_PCD_EP_GetRxCount(PCD_HandleTypeDef const *hpcd, uint8_t ep_addr);
+HAL_StatusTypeDef HAL_PCDEx_SetTxFiFo(PCD_HandleTypeDef *hpcd, uint8_t fifo, uint16_t size);
+HAL_StatusTypeDef HAL_PCDEx_SetRxFiFo(PCD_HandleTypeDef *hpcd, uint16_t size);
+
+// Ethernet //////////////////////////////////////////////////////////////////
+
+// No cable is ever plugged in: the PHY never reports a link, so the
+// MAC is never started and none of the callbacks are called.
+
+#define ETH_RX_DESC_CNT 4U
+#define ETH_TX_DESC_CNT 4U
+
+typedef struct {
+  uint8_t *MACAddr;
+} ETH_InitTypeDef;
+
+typedef struct {
+  ETH_InitTypeDef Init;
+  uint32_t DMAErrorCode;
+} ETH_HandleTypeDef;
+
+typedef struct __ETH_BufferTypeDef {
+  uint8_t *buffer;
+  uint32_t len;
+  struct __ETH_BufferTypeDef *next;
+} ETH_BufferTypeDef;
+
+typedef struct {
+  uint32_t Length;
+  ETH_BufferTypeDef *TxBuffer;
+  void *pData;
+} ETH_TxPacketConfig;
+
+typedef struct {
+  uint32_t Speed;
+  uint32_t DuplexMode;
+} ETH_MACConfigTypeDef;
+
+#define ETH_SPEED_10M        0x00000000U
+#define ETH_SPEED_100M       0x00004000U
+#define ETH_FULLDUPLEX_MODE  0x00000800U
+#define ETH_HALFDUPLEX_MODE  0x00000000U
+#define ETH_DMASR_RBUS       0x00000080U
+
+HAL_StatusTypeDef HAL_ETH_Start_IT(ETH_HandleTypeDef *heth);
+HAL_StatusTypeDef HAL_ETH_Stop_IT(ETH_HandleTypeDef *heth);
+HAL_StatusTypeDef HAL_ETH_ReadData(ETH_HandleTypeDef *heth, void **pAppBuff);
+HAL_StatusTypeDef HAL_ETH_Transmit_IT(ETH_HandleTypeDef *heth, ETH_TxPacketConfig *pTxConfig);
+HAL_StatusTypeDef HAL_ETH_ReleaseTxPacket(ETH_HandleTypeDef *heth);
+HAL_StatusTypeDef HAL_ETH_ReadPHYRegister(ETH_HandleTypeDef *heth, uint32_t PHYAddr, uint32_t PHYReg,
+                                          uint32_t *pRegValue);
+HAL_StatusTypeDef HAL_ETH_GetMACConfig(ETH_HandleTypeDef *heth, ETH_MACConfigTypeDef *macconf);
+HAL_StatusTypeDef HAL_ETH_SetMACConfig(ETH_HandleTypeDef *heth, ETH_MACConfigTypeDef *macconf);
+void HAL_ETH_IRQHandler(ETH_HandleTypeDef *heth);
+
+// Flash /////////////////////////////////////////////////////////////////////
+
+// Word programming & sector erases by interrupt only (see sim.h).
+
+typedef struct {
+  uint32_t TypeErase;
+  uint32_t Banks;
+  uint32_t Sector;
+  uint32_t NbSectors;
+  uint32_t VoltageRange;
+} FLASH_EraseInitTypeDef;
+
+#define FLASH_TYPEERASE_SECTORS 0x00000000U
+#define FLASH_TYPEPROGRAM_WORD  0x00000002U
+#define FLASH_VOLTAGE_RANGE_3   0x00000002U
+#define FLASH_SECTOR_10         10U
+#define FLASH_SECTOR_20         20U
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program_IT(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase_IT(FLASH_EraseInitTypeDef *pEraseInit);
+void HAL_FLASH_IRQHandler(void);
+void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue);
+void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue);
+
+uint32_t HAL_GetUIDw0(void);
+uint32_t HAL_GetUIDw1(void);
+uint32_t HAL_GetUIDw2(void);
+
+#endif /* SIM_STM32F7XX_HAL_H_ */
@@ -0,0 +1,113 @@
+/*
+ * stm32f7xx_ll_usart.h (host simulation)
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * The LL USART functions the firmware uses, on the simulated USART
+ * registers (sim.c). Each lets the simulation catch up first, as
+ * the hardware would have moved on since the last access.
+ */
+
+#ifndef SIM_STM32F7XX_LL_USART_H_
+#define SIM_STM32F7XX_LL_USART_H_
+
+#include "stm32f7xx.h"
+
+#define USART_CR1_UE     (1UL << 0)
+#define USART_CR1_RE     (1UL << 2)
+#define USART_CR1_TE     (1UL << 3)
+#define USART_CR1_RXNEIE (1UL << 5)
+#define USART_CR1_TXEIE  (1UL << 7)
+#define USART_CR3_EIE    (1UL << 0)
+#define USART_ISR_ORE    (1UL << 3)
+#define USART_ISR_RXNE   (1UL << 5)
+#define USART_ISR_TC     (1UL << 6)
+#define USART_ISR_TXE    (1UL << 7)
+
+#define LL_USART_DATAWIDTH_8B     0UL
+#define LL_USART_PARITY_NONE      0UL
+#define LL_USART_STOPBITS_1       0UL
+#define LL_USART_OVERSAMPLING_16  0UL
+#define LL_USART_DIRECTION_TX_RX  (USART_CR1_TE | USART_CR1_RE)
+
+void sim_poll(void);
+uint8_t sim_usart_receive(USART_TypeDef *USARTx);
+void sim_usart_transmit(USART_TypeDef *USARTx, uint8_t Value);
+void sim_usart_set_baud(USART_TypeDef *USARTx, uint32_t BaudRate);
+
+static inline void LL_USART_Enable(USART_TypeDef *USARTx) {
+  USARTx->CR1 |= USART_CR1_UE;
+  sim_poll();
+}
+
+static inline void LL_USART_Disable(USART_TypeDef *USARTx) {
+  USARTx->CR1 &= ~USART_CR1_UE;
+  sim_poll();
+}
+
+static inline void LL_USART_SetDataWidth(USART_TypeDef *USARTx, uint32_t DataWidth) { }
+static inline void LL_USART_SetParity(USART_TypeDef *USARTx, uint32_t Parity) { }
+static inline void LL_USART_SetStopBitsLength(USART_TypeDef *USARTx, uint32_t StopBits) { }
+static inline void LL_USART_SetOverSampling(USART_TypeDef *USARTx, uint32_t OverSampling) { }
+
+static inline void LL_USART_SetTransferDirection(USART_TypeDef *USARTx, uint32_t TransferDirection) {
+  USARTx->CR1 = (USARTx->CR1 & ~LL_USART_DIRECTION_TX_RX) | TransferDirection;
+}
+
+static inline void LL_USART_SetBaudRate(USART_TypeDef *USARTx, uint32_t PeriphClk,
+                                        uint32_t OverSampling, uint32_t BaudRate) {
+  USARTx->BRR = PeriphClk / BaudRate;
+  sim_usart_set_baud(USARTx, BaudRate);
+}
+
+static inline uint32_t LL_USART_IsActiveFlag_RXNE(USART_TypeDef *USARTx) {
+  sim_poll();
+  return (USARTx->ISR & USART_ISR_RXNE) != 0;
+}
+
+static inline uint32_t LL_USART_IsActiveFlag_TXE(USART_TypeDef *USARTx) {
+  sim_poll();
+  return (USARTx->ISR & USART_ISR_TXE) != 0;
+}
+
+static inline uint32_t LL_USART_IsActiveFlag_ORE(USART_TypeDef *USARTx) {
+  sim_poll();
+  return (USARTx->ISR & USART_ISR_ORE) != 0;
+}
+
+static inline void LL_USART_ClearFlag_ORE(USART_TypeDef *USARTx) {
+  USARTx->ISR &= ~USART_ISR_ORE;
+  sim_poll();
+}
+
+static inline uint32_t LL_USART_IsEnabledIT_TXE(USART_TypeDef *USARTx) {
+  return (USARTx->CR1 & USART_CR1_TXEIE) != 0;
+}
+
+static inline void LL_USART_EnableIT_RXNE(USART_TypeDef *USARTx) {
+  USARTx->CR1 |= USART_CR1_RXNEIE;
+  sim_poll();
+}
+
+static inline void LL_USART_EnableIT_TXE(USART_TypeDef *USARTx) {
+  USARTx->CR1 |= USART_CR1_TXEIE;
+  sim_poll();
+}
+
+static inline void LL_USART_DisableIT_TXE(USART_TypeDef *USARTx) {
+  USARTx->CR1 &= ~USART_CR1_TXEIE;
+  sim_poll();
+}
+
+static inline uint8_t LL_USART_ReceiveData8(USART_TypeDef *USARTx) {
+  return sim_usart_receive(USARTx);
+}
+
+static inline void LL_USART_TransmitData8(USART_TypeDef *USARTx, uint8_t Value) {
+  sim_usart_transmit(USARTx, Value);
+}
+
+#endif /* SIM_STM32F7XX_LL_USART_H_ */
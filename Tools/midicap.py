@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+#
+# midicap.py
+#
+#  Created on: 2026-10-19
+#      Author: Douglas P. Fields, Jr.
+#   Copyright: 2026, Douglas P. Fields, Jr.
+#     License: Apache 2.0
+#
+# Decodes the binary MIDI capture streamed by console option c
+# (see Core/Inc/capture.h) to text, or to a Standard MIDI File
+# with one track per port.
+#
+# Usage:
+#   midicap.py capture.bin                  # text to stdout
+#   midicap.py capture.bin -o capture.mid   # Standard MIDI File
+#   midicap.py /dev/ttyACM0 --serial        # live, needs pyserial
+#
+# With --serial, start the capture with c after this is running;
+# it stops at the end of the capture (c again) or on Ctrl-C.
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"MCAP"
+VERSION = 2
+META = 7
+META_DROPS = 0
+META_END = 1
+
+# Data bytes after each status; system messages by status, others by high nibble
+CHANNEL_DATA = {0x80: 2, 0x90: 2, 0xA0: 2, 0xB0: 2, 0xC0: 1, 0xD0: 1, 0xE0: 2}
+SYSTEM_DATA = {0xF1: 1, 0xF2: 2, 0xF3: 1, 0xF6: 0}
+
+NAMES = {0x80: "Note off", 0x90: "Note on", 0xA0: "Poly pressure",
+         0xB0: "Control", 0xC0: "Program", 0xD0: "Channel pressure",
+         0xE0: "Pitch bend", 0xF0: "SysEx", 0xF1: "Time code QF",
+         0xF2: "Song position", 0xF3: "Song select", 0xF6: "Tune request",
+         0xF8: "Clock", 0xFA: "Start", 0xFB: "Continue", 0xFC: "Stop",
+         0xFE: "Active sense", 0xFF: "Reset"}
+
+# Standard MIDI File timing: 500000 us per quarter note at
+# SMF_DIVISION ticks per quarter note gives 100 us ticks
+SMF_TEMPO = 500000
+SMF_DIVISION = 5000
+
+
+class PortParser:
+    """Reassembles one port's MIDI byte stream into messages."""
+
+    def __init__(self):
+        self.restart()
+
+    def restart(self):
+        self.status = None   # Running status
+        self.common = None   # System common message being received
+        self.data = []
+        self.sysex = None
+
+    def feed(self, b):
+        """Returns a complete message (bytes) or None."""
+        if b >= 0xF8:
+            return bytes([b])
+        if b == 0xF0:
+            self.sysex = [b]
+            self.status = None
+            return None
+        if b == 0xF7:
+            msg = self.sysex
+            self.sysex = None
+            return bytes(msg + [b]) if msg is not None else None
+        if b >= 0x80:
+            self.sysex = None
+            self.data = []
+            self.status = b
+            self.common = None
+            if b >= 0xF0:
+                # System common cancels running status
+                self.status = None
+                if SYSTEM_DATA.get(b, 0) == 0:
+                    return bytes([b])
+                self.common = b
+            return None
+        # Data byte
+        if self.sysex is not None:
+            self.sysex.append(b)
+            return None
+        status = self.common if self.common is not None else self.status
+        if status is None:
+            return None
+        self.data.append(b)
+        need = SYSTEM_DATA[status] if status >= 0xF0 else CHANNEL_DATA[status & 0xF0]
+        if len(self.data) < need:
+            return None
+        msg = bytes([status] + self.data)
+        self.data = []
+        if status >= 0xF0:
+            self.common = None
+        return msg
+
+
+def read_vlq(read):
+    v = 0
+    while True:
+        b = read(1)[0]
+        v = (v << 7) | (b & 0x7F)
+        if not b & 0x80:
+            return v
+
+
+def records(read):
+    """Yields (port, time_us, message) and ("drops", count) from the stream."""
+    # Skip anything before the start of the capture
+    window = b""
+    while window != MAGIC:
+        window = (window + read(1))[-4:]
+    version = read(1)[0]
+    if version != VERSION:
+        raise ValueError("unsupported capture version %d" % version)
+
+    times = {}
+    parsers = {}
+    last = {}  # Each port's previous record, (delta, bytes), to repeat
+    while True:
+        hdr = read(1)[0]
+        port, low = hdr >> 5, hdr & 0x1F
+        if port == META:
+            if low == META_END:
+                return
+            if low == META_DROPS:
+                count = read_vlq(read)
+                for p in parsers.values():
+                    p.restart()
+                last.clear()
+                yield ("drops", count)
+                continue
+            raise ValueError("unknown meta record %d" % low)
+        if low == 0:
+            if port not in last:
+                raise ValueError("repeat with nothing to repeat on port %d" % port)
+            delta, data = last[port]
+        else:
+            delta = read_vlq(read)
+            data = read(low)
+            last[port] = (delta, data)
+        times[port] = times.get(port, 0) + delta
+        parser = parsers.setdefault(port, PortParser())
+        for b in data:
+            msg = parser.feed(b)
+            if msg is not None:
+                yield (port, times[port], msg)
+
+
+def describe(msg):
+    status = msg[0]
+    kind = status if status >= 0xF0 else status & 0xF0
+    text = NAMES.get(kind, "?")
+    if status < 0xF0:
+        text += " ch %d" % ((status & 0x0F) + 1)
+    return "%-24s %s" % (text, msg.hex(" "))
+
+
+def write_text(stream, out):
+    for r in stream:
+        if r[0] == "drops":
+            out.write("*** %d dropped\n" % r[1])
+            continue
+        port, t, msg = r
+        out.write("%12.6f %d: %s\n" % (t / 1e6, port, describe(msg)))
+
+
+def vlq(v):
+    out = [v & 0x7F]
+    v >>= 7
+    while v:
+        out.insert(0, 0x80 | (v & 0x7F))
+        v >>= 7
+    return bytes(out)
+
+
+def write_smf(stream, out):
+    """Format 1: a tempo track, then one track per port. Real-time and
+    system common messages cannot be stored in a file, so are skipped."""
+    events = {}
+    skipped = 0
+    drops = 0
+    for r in stream:
+        if r[0] == "drops":
+            drops += r[1]
+            continue
+        port, t, msg = r
+        if msg[0] == 0xF0:
+            data = b"\xF0" + vlq(len(msg) - 1) + msg[1:]
+        elif msg[0] < 0xF0:
+            data = msg
+        else:
+            skipped += 1
+            continue
+        events.setdefault(port, []).append((t * SMF_DIVISION // SMF_TEMPO, data))
+
+    def chunk(kind, body):
+        return kind + struct.pack(">I", len(body)) + body
+
+    tracks = [b"\x00\xFF\x51\x03" + SMF_TEMPO.to_bytes(3, "big") + b"\x00\xFF\x2F\x00"]
+    for port in sorted(events):
+        name = ("din%d" % port).encode()
+        body = b"\x00\xFF\x03" + vlq(len(name)) + name
+        last = 0
+        for tick, data in events[port]:
+            body += vlq(tick - last) + data
+            last = tick
+        tracks.append(body + b"\x00\xFF\x2F\x00")
+
+    out.write(chunk(b"MThd", struct.pack(">HHH", 1, len(tracks), SMF_DIVISION)))
+    for t in tracks:
+        out.write(chunk(b"MTrk", t))
+    if skipped or drops:
+        sys.stderr.write("skipped %d system messages, %d dropped in capture\n" % (skipped, drops))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode a binary MIDI capture")
+    ap.add_argument("input", help="capture file, or serial port with --serial")
+    ap.add_argument("-o", "--output", help="write a Standard MIDI File here instead of text")
+    ap.add_argument("--serial", action="store_true", help="read live from a serial port")
+    ap.add_argument("--baud", type=int, default=460800)
+    args = ap.parse_args()
+
+    if args.serial:
+        import serial
+        src = serial.Serial(args.input, args.baud)
+    else:
+        src = open(args.input, "rb")
+
+    def read(n):
+        data = src.read(n)
+        if len(data) < n:
+            raise EOFError
+        return data
+
+    def stream():
+        try:
+            yield from records(read)
+        except (EOFError, KeyboardInterrupt):
+            return
+
+    if args.output:
+        with open(args.output, "wb") as out:
+            write_smf(stream(), out)
+    else:
+        write_text(stream(), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+#
+# osctrie.py
+#
+#  Created on: 2026-10-19
+#      Author: Douglas P. Fields, Jr.
+#   Copyright: 2026, Douglas P. Fields, Jr.
+#     License: Apache 2.0
+#
+# Makes the OSC address trie (see Core/Inc/osc.h) from the list of
+# addresses in Core/Inc/oscaddr.h, as C.
+#
+# Usage:
+#   osctrie.py Core/Inc/oscaddr.h > Core/Src/oscaddr.c
+#
+# Nodes are laid out breadth first, so each node's children are
+# contiguous, sorted by their character.
+
+import argparse
+import re
+import sys
+
+ENTRY = re.compile(r'X\(\s*(\w+)\s*,\s*"([^"]*)"\s*\)')
+
+HEADER = """\
+/*
+ * oscaddr.c
+ *
+ *  Created on: 2026-10-19
+ *      Author: Douglas P. Fields, Jr.
+ *   Copyright: 2026, Douglas P. Fields, Jr.
+ *     License: Apache 2.0
+ *
+ * The trie of the OSC addresses in oscaddr.h, made by
+ *   Tools/osctrie.py Core/Inc/oscaddr.h > Core/Src/oscaddr.c
+ * Do not edit.
+ */
+
+#include "oscaddr.h"
+"""
+
+
+def c_char(c):
+    if c == "\\" or c == "'":
+        return "'\\%s'" % c
+    return "'%s'" % c
+
+
+def make_trie(entries):
+    """Returns the nodes, breadth first, each [char, children, first,
+    method, prefix]."""
+    root = {}
+    methods = {}
+    for method, address in entries:
+        if not address.startswith("/"):
+            sys.exit("%s: %s does not start with /" % (method, address))
+        if address in methods:
+            sys.exit("%s: %s is also %s" % (method, address, methods[address]))
+        methods[address] = method
+        node = root
+        for c in address:
+            node = node.setdefault(c, {})
+
+    nodes = [["0", 0, 0, "-1", ""]]
+    queue = [(root, "")]
+    index = 0
+    while index < len(queue):
+        children, prefix = queue[index]
+        nodes[index][1] = len(children)
+        nodes[index][2] = len(nodes) if children else 0
+        for c in sorted(children):
+            nodes.append([c_char(c), 0, 0, methods.get(prefix + c, "-1"), prefix + c])
+            queue.append((children[c], prefix + c))
+        index += 1
+    return nodes
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Make the OSC address trie")
+    ap.add_argument("header", help="oscaddr.h")
+    args = ap.parse_args()
+
+    with open(args.header) as f:
+        entries = ENTRY.findall(f.read())
+    if not entries:
+        sys.exit("%s: no addresses" % args.header)
+    nodes = make_trie(entries)
+    if len(nodes) > 0xFFFF:
+        sys.exit("too many nodes")
+
+    out = sys.stdout
+    out.write(HEADER)
+    out.write("\nconst osc_trie_node osc_trie[%d] = {\n" % len(nodes))
+    for i, (c, children, first, method, prefix) in enumerate(nodes):
+        out.write("    { %s, %d, %d, %s }, // %d \"%s\"\n" % (c, children, first, method, i, prefix))
+    out.write("};\n")
+    out.write("\nconst char *const osc_addresses[OSC_NUM_METHODS] = {\n")
+    for method, address in entries:
+        out.write("    [%s] = \"%s\",\n" % (method, address))
+    out.write("};\n")
+
+
+if __name__ == "__main__":
+    main()
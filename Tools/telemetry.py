@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+#
+# telemetry.py
+#
+#  Created on: 2026-10-19
+#      Author: Douglas P. Fields, Jr.
+#   Copyright: 2026, Douglas P. Fields, Jr.
+#     License: Apache 2.0
+#
+# Receives the board's UDP telemetry (see Core/Inc/telemetry.h) and
+# shows it as text, writes it to a CSV file, or plots chosen fields
+# live.
+#
+# Usage:
+#   telemetry.py                                  # text, every packet
+#   telemetry.py --board 192.168.1.200            # ask for it, not broadcast
+#   telemetry.py --csv counters.csv               # one row per value
+#   telemetry.py --plot audio.audio.headroom_min_us system.system.idle_permille
+#                                                 # live, needs matplotlib
+#
+# The board broadcasts on its subnet until a host sends it a datagram
+# on the telemetry port; --board does so every few seconds, so the
+# board keeps sending here (and after it restarts). Fields are named
+# section.row.field, e.g. tasks.net.max_run_us; --list shows them.
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+PORT = 5005
+MAGIC = b"MT"
+VERSION = 1
+SUBSCRIBE_S = 5
+
+# Section ids, names & their fields; keep in step with telemetry.h
+SECTIONS = {
+    1: ("system", ["idle_permille", "loops_per_tick", "core_clock_hz", "console_overruns",
+                   "uart_errors", "usart3_interrupts", "midi_overruns", "monitor_drops",
+                   "log_drops"]),
+    2: ("audio", ["blocks", "headroom_last_us", "headroom_min_us", "late_blocks", "voices",
+                  "synth_late", "synth_dropped", "latency_last_us", "latency_max_us"]),
+    3: ("profile", ["count", "min", "max", "mean"] + ["bucket%d" % i for i in range(32)]),
+    4: ("deferred", ["runs", "latency_last", "latency_max", "max_run"]),
+    5: ("tasks", ["runs", "max_run_us", "max_response_us", "misses", "overruns"]),
+    6: ("events", ["count", "last_us", "mean_us", "max_us"]),
+    7: ("ports", ["rx_bytes", "rx_messages", "overruns", "rt_drops", "in_max", "out_max"]),
+    8: ("rings", ["max", "size"]),
+    9: ("usb", ["rx_messages", "rx_ignored", "rx_overruns", "tx_messages", "tx_transfers",
+                "tx_drops"]),
+    10: ("net", ["state", "link_up", "rx_packets", "rx_messages", "rx_lost", "rx_recovered",
+                 "tx_packets", "tx_messages", "tx_drops", "frames_rx", "frames_tx",
+                 "ip_errors", "pool_exhausted", "rx_starved", "tx_starved"]),
+    11: ("osc", ["rx_packets", "rx_messages", "rx_bundles", "rx_errors", "rx_unmatched",
+                 "rx_bad_args", "late", "too_far"]),
+}
+
+# Fields that are signed
+SIGNED = {("audio", "headroom_last_us"), ("audio", "headroom_min_us")}
+
+
+def decode(packet):
+    """Returns (seq, uptime_ms, [(section, row, {field: value})]), or
+    raises ValueError if the packet is not telemetry we understand."""
+    if len(packet) < 12 or packet[:2] != MAGIC or packet[2] != VERSION:
+        raise ValueError("not a telemetry packet")
+    seq, uptime = struct.unpack_from("<II", packet, 4)
+    pos = 12
+    rows = []
+    while pos < len(packet):
+        if pos + 3 > len(packet):
+            raise ValueError("truncated section")
+        sid, nfields, nrows = packet[pos], packet[pos + 1], packet[pos + 2]
+        pos += 3
+        section, names = SECTIONS.get(sid, ("section%d" % sid, []))
+        names = names[:nfields] + ["field%d" % i for i in range(len(names), nfields)]
+        for _ in range(nrows):
+            end = packet.find(b"\0", pos)
+            if end < 0 or end + 1 + 4 * nfields > len(packet):
+                raise ValueError("truncated row")
+            name = packet[pos:end].decode("ascii", "replace")
+            pos = end + 1
+            values = struct.unpack_from("<%dI" % nfields, packet, pos)
+            pos += 4 * nfields
+            fields = {}
+            for f, v in zip(names, values):
+                if (section, f) in SIGNED and v >= 1 << 31:
+                    v -= 1 << 32
+                fields[f] = v
+            rows.append((section, name, fields))
+    return seq, uptime, rows
+
+
+def write_text(seq, uptime, rows, out):
+    out.write("#%d at %.3f s\n" % (seq, uptime / 1000))
+    last = None
+    for section, name, fields in rows:
+        if section != last:
+            out.write("%s\n" % section)
+            last = section
+        if section == "profile":
+            # The histogram only where it has counts
+            shown = {f: v for f, v in fields.items() if not f.startswith("bucket") or v}
+        else:
+            shown = fields
+        out.write("  %-14s %s\n" % (name, " ".join("%s=%d" % fv for fv in shown.items())))
+    out.flush()
+
+
+class Plot:
+    """Plots the chosen fields against the board's uptime, live."""
+
+    def __init__(self, keys, window):
+        import matplotlib.pyplot as plt
+        self.plt = plt
+        self.keys = keys
+        self.window = window
+        self.times = {k: [] for k in keys}
+        self.values = {k: [] for k in keys}
+        plt.ion()
+        self.fig, self.axes = plt.subplots(len(keys), 1, sharex=True, squeeze=False)
+        self.lines = {}
+        for k, ax in zip(keys, self.axes[:, 0]):
+            self.lines[k], = ax.plot([], [])
+            ax.set_ylabel(k, fontsize="small")
+        self.axes[-1, 0].set_xlabel("uptime, s")
+
+    def add(self, uptime, rows):
+        for section, name, fields in rows:
+            for f, v in fields.items():
+                k = "%s.%s.%s" % (section, name, f)
+                if k in self.times:
+                    self.times[k].append(uptime / 1000)
+                    self.values[k].append(v)
+                    del self.times[k][:-self.window]
+                    del self.values[k][:-self.window]
+        for k, ax in zip(self.keys, self.axes[:, 0]):
+            self.lines[k].set_data(self.times[k], self.values[k])
+            ax.relim()
+            ax.autoscale_view()
+        self.plt.pause(0.01)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Receive the board's UDP telemetry")
+    ap.add_argument("--port", type=int, default=PORT, help="UDP port to listen on")
+    ap.add_argument("--board", help="the board's IP address, to ask it to send here")
+    ap.add_argument("--csv", help="append uptime_ms,seq,section,row,field,value lines here")
+    ap.add_argument("--plot", nargs="+", metavar="FIELD", help="plot section.row.field live")
+    ap.add_argument("--window", type=int, default=300, help="packets of history plotted")
+    ap.add_argument("--list", action="store_true", help="list the fields of the first two packets")
+    ap.add_argument("-n", "--count", type=int, default=0, help="stop after this many packets")
+    args = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", args.port))
+    sock.settimeout(1)
+
+    csv = open(args.csv, "a") if args.csv else None
+    plot = Plot(args.plot, args.window) if args.plot else None
+    subscribed = 0
+    received = 0
+
+    try:
+        while not args.count or received < args.count:
+            if args.board and time.monotonic() - subscribed >= SUBSCRIBE_S:
+                sock.sendto(b"telemetry", (args.board, PORT))
+                subscribed = time.monotonic()
+            try:
+                packet, _ = sock.recvfrom(2048)
+            except socket.timeout:
+                continue
+            try:
+                seq, uptime, rows = decode(packet)
+            except ValueError as e:
+                sys.stderr.write("%s\n" % e)
+                continue
+            received += 1
+            if args.list:
+                # The profile comes in a packet of its own
+                for section, name, fields in rows:
+                    for f in fields:
+                        print("%s.%s.%s" % (section, name, f))
+                if received == 2:
+                    return
+                continue
+            if csv:
+                for section, name, fields in rows:
+                    for f, v in fields.items():
+                        csv.write("%d,%d,%s,%s,%s,%d\n" % (uptime, seq, section, name, f, v))
+                csv.flush()
+            if plot:
+                plot.add(uptime, rows)
+            if not csv and not plot:
+                write_text(seq, uptime, rows, sys.stdout)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if csv:
+            csv.close()
+
+
+if __name__ == "__main__":
+    main()